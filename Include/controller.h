@@ -24,7 +24,6 @@
 //
 #define MODE_MULTI_TOUCH                0x02
 #define MAX_TOUCH_COORD                 0x0FFF
-#define FINGER_STATUS                   0x01 // finger down
 
 //
 // Structures
@@ -60,6 +59,8 @@ typedef struct _TOUCH_SCREEN_SETTINGS
 	UINT32 ReprogramFw02;
 	UINT32 ReprogramFw03;
 	UINT32 ForceFlash;
+	UINT32 ReportRateHz;
+	UINT32 ReportRateRegister;
 	UINT32 Vendor00ProductId0;
 	UINT32 Vendor00ProductId1;
 	UINT32 Vendor00ProductId2;
@@ -223,6 +224,13 @@ TchStartDevice(
 	IN SPB_CONTEXT* SpbContext
 );
 
+NTSTATUS
+TchUpdateFirmware(
+	IN VOID* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN PTOUCH_SCREEN_SETTINGS TouchSettings
+);
+
 NTSTATUS 
 TchStopDevice(
     IN VOID *ControllerContext,
@@ -236,12 +244,30 @@ TchStandbyDevice(
 	IN VOID* ReportContext
 	);
 
+VOID
+TchSetPanelBounds(
+    IN VOID *ControllerContext,
+    IN ULONG MaxX,
+    IN ULONG MaxY
+    );
+
+VOID
+TchApplyTouchSettings(
+    IN VOID *ControllerContext,
+    IN PTOUCH_SCREEN_SETTINGS TouchSettings
+    );
+
 NTSTATUS 
 TchWakeDevice(
     IN VOID *ControllerContext,
     IN SPB_CONTEXT *SpbContext
     );
 
+NTSTATUS
+TchProbeController(
+    IN PVOID SpbContext
+    );
+
 NTSTATUS
 RtlReadRegistryValue(
     PCWSTR registry_path, 
@@ -268,4 +294,9 @@ TchPowerSettingCallback(
     _In_ PVOID Value,
     _In_ ULONG ValueLength,
     _Inout_opt_ PVOID Context
+);
+
+VOID
+TchStartPowerSettings(
+    IN PVOID Context
 );
\ No newline at end of file
@@ -42,7 +42,11 @@ typedef struct _PTP_DEVICE_HQA_CERTIFICATION_REPORT {
 
 #pragma warning(push)
 #pragma warning(disable:4201)  // (nameless struct/union)
+#ifdef HIMAX_USER_MODE
+#pragma pack(push, 1)
+#else
 #include <pshpack1.h>
+#endif
 
 // REPORTID_FINGER
 #pragma pack(push)
@@ -107,7 +111,11 @@ typedef struct _HID_INPUT_REPORT
 #endif
 } HID_INPUT_REPORT, * PHID_INPUT_REPORT;
 
+#ifdef HIMAX_USER_MODE
+#pragma pack(pop)
+#else
 #include <poppack.h>
+#endif
 #pragma warning(pop)
 
 //
@@ -172,7 +180,7 @@ TchReadReport(
 //
 // HID collections
 // 
-#include "HidCommon.h"
+#include "hidCommon.h"
 
 #define X_MASK 0xFE, 0xFE
 #define Y_MASK 0xFD, 0xFD
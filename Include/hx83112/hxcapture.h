@@ -0,0 +1,83 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxcapture.h
+
+	Abstract:
+
+		Contains the types used to record raw controller frames into a
+		capture stream and to replay them on the device
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+#include <spb.h>
+#include <report.h>
+#include <hx83112/hxdecode.h>
+#include <hx83112/hxfilter.h>
+#include <hx83112/hxstream.h>
+#include <hx83112/hxreplay.h>
+
+//
+// Ring of the most recent event stack frames. Frames are written from
+// the interrupt thread only, readers use the slot guards to discard
+// frames that were being overwritten. Guards work as in the Spb trace
+// ring, counting up by 2 per frame and odd while it is written.
+//
+#define HIMAX_CAPTURE_FRAME_COUNT    64
+
+#define HIMAX_CAPTURE_GUARD_BUSY(sequence)   ((((ULONG)(sequence)) << 1) | 1)
+#define HIMAX_CAPTURE_GUARD_STABLE(sequence) ((((ULONG)(sequence)) + 1) << 1)
+
+typedef struct _HIMAX_CAPTURE_RING
+{
+	volatile LONG Enabled;
+	volatile LONG Head;
+	ULONG FrameSize;
+	HIMAX_CAPTURE_FRAME Frames[HIMAX_CAPTURE_FRAME_COUNT];
+	volatile ULONG Guards[HIMAX_CAPTURE_FRAME_COUNT];
+} HIMAX_CAPTURE_RING;
+
+VOID
+HimaxCaptureEnable(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN BOOLEAN Enable
+);
+
+VOID
+HimaxCaptureAppendFrame(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN UINT8* Frame,
+	IN LONGLONG Timestamp
+);
+
+NTSTATUS
+HimaxCaptureWriteStream(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN SPB_CONTEXT* SpbContext,
+	OUT PVOID Buffer,
+	IN ULONG Length,
+	OUT ULONG* BytesWritten
+);
+
+NTSTATUS
+HimaxCaptureReplay(
+	IN PREPORT_CONTEXT ReportContext,
+	IN const HIMAX_FILTER_PARAMS* Profiles,
+	IN HIMAX_FILTER_PROFILE Profile,
+	IN PVOID Stream,
+	IN ULONG Length,
+	OUT HIMAX_CAPTURE_REPLAY_STATS* Stats
+);
@@ -0,0 +1,183 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxdecode.h
+
+	Abstract:
+
+		Contains the event stack layouts of the HX83112 controller and
+		the decoders specialized for each of them
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <Cross Platform Shim/compat.h>
+#ifndef HIMAX_USER_MODE
+#include <wdm.h>
+#include <wdf.h>
+#endif
+#include <reportpack.h>
+
+//
+// An event stack frame for N touch points holds N big endian X/Y
+// coordinate pairs, one area byte per point padded to a multiple of
+// four, then four info bytes: the finger count in the low nibble of the
+// first one, followed by the two state info bytes.
+//
+#define HIMAX_LAYOUT_COORD_SIZE(n)   (4 * (n))
+#define HIMAX_LAYOUT_AREA_SIZE(n)    ((((n) + 3) / 4) * 4)
+#define HIMAX_LAYOUT_INFO_OFFSET(n)  (HIMAX_LAYOUT_COORD_SIZE(n) + HIMAX_LAYOUT_AREA_SIZE(n))
+#define HIMAX_LAYOUT_FRAME_SIZE(n)   (HIMAX_LAYOUT_INFO_OFFSET(n) + 4)
+
+#define HIMAX_EVENT_STACK_DEFAULT_POINTS  10
+#define HIMAX_EVENT_STACK_MAX_POINTS      20
+#define HIMAX_EVENT_STACK_MAX_SIZE        HIMAX_LAYOUT_FRAME_SIZE(HIMAX_EVENT_STACK_MAX_POINTS)
+
+C_ASSERT(HIMAX_EVENT_STACK_MAX_POINTS <= MAX_TOUCHES);
+
+//
+// Largest coordinate reported inside the panel, coordinates beyond it
+// mark an empty slot
+//
+typedef struct _HIMAX_DECODE_BOUNDS
+{
+	UINT16 MaxX;
+	UINT16 MaxY;
+} HIMAX_DECODE_BOUNDS;
+
+//
+// Decodes the coordinate slots of a frame into Data, which the caller
+// has zeroed, and returns the mask of slots holding a finger
+//
+typedef ULONG
+HIMAX_DECODE_SLOTS(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+);
+
+typedef struct _HIMAX_EVENT_LAYOUT
+{
+	ULONG MaxPoints;
+	ULONG FrameSize;
+	ULONG AreaOffset;
+	ULONG InfoOffset;
+	HIMAX_DECODE_SLOTS* DecodeSlots;
+} HIMAX_EVENT_LAYOUT;
+
+//
+// Reasons an event stack frame is discarded before it is decoded. The
+// bytes of a frame sum to zero modulo 256, the firmware fills the whole
+// frame with 0xED after an ESD event, and a frame read while the chip
+// is resetting comes back all zeroes. A finger count byte of 0xFF means
+// no fingers.
+//
+typedef enum _HIMAX_FRAME_DISCARD
+{
+	HimaxFrameValid = 0,
+	HimaxFrameDiscardChecksum,
+	HimaxFrameDiscardAllZero,
+	HimaxFrameDiscardEsd,
+	HimaxFrameDiscardFingerCount,
+	HimaxFrameDiscardReasons
+} HIMAX_FRAME_DISCARD;
+
+#define HIMAX_FRAME_ESD_PATTERN        0xED
+#define HIMAX_FRAME_NO_FINGERS         0xFF
+
+typedef struct _HIMAX_FRAME_STATS
+{
+	ULONG Accepted;
+	ULONG Discarded[HimaxFrameDiscardReasons];
+} HIMAX_FRAME_STATS;
+
+//
+// In smart wake mode the chip scans at low power and only raises an
+// interrupt for a gesture. The frame then starts with the gesture ID
+// repeated four times, followed by a two byte header.
+//
+#define HIMAX_GESTURE_ID_LENGTH     4
+#define HIMAX_GESTURE_HEADER_LENGTH 2
+#define HIMAX_GESTURE_HEADER_0      0xCC
+#define HIMAX_GESTURE_HEADER_1      0x44
+#define HIMAX_GESTURE_NONE          0x00
+#define HIMAX_GESTURE_DOUBLE_TAP    0x80
+
+//
+// Result of timing the specialized decoder of a layout against the
+// generic one over the same randomized frames, generated from Seed
+//
+typedef struct _HIMAX_DECODE_BENCHMARK
+{
+	ULONG MaxPoints;
+	ULONG Frames;
+	ULONG Seed;
+	ULONG GenericNsPerFrame;
+	ULONG SpecializedNsPerFrame;
+} HIMAX_DECODE_BENCHMARK;
+
+const HIMAX_EVENT_LAYOUT*
+HimaxDecodeGetLayout(
+	IN ULONG MaxPoints
+);
+
+const HIMAX_EVENT_LAYOUT*
+HimaxDecodeGetLayoutByFrameSize(
+	IN ULONG FrameSize
+);
+
+HIMAX_FRAME_DISCARD
+HimaxDecodeValidateFrame(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const UINT8* Frame
+);
+
+ULONG
+HimaxDecodeFingerCount(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const UINT8* Frame
+);
+
+UINT8
+HimaxDecodeGesture(
+	IN const UINT8* Frame,
+	IN ULONG Length
+);
+
+ULONG
+HimaxDecodeSlotsGeneric(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+);
+
+NTSTATUS
+HimaxDecodeFrame(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN ULONG Length,
+	IN OUT DETECTED_OBJECTS* Data,
+	OUT ULONG* Mask,
+	OUT ULONG* FingerCount
+);
+
+NTSTATUS
+HimaxDecodeBenchmark(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN ULONG Frames,
+	IN ULONG Seed,
+	OUT HIMAX_DECODE_BENCHMARK* Result
+);
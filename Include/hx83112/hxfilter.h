@@ -0,0 +1,100 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxfilter.h
+
+	Abstract:
+
+		Contains the software contact filter applied to decoded frames,
+		with one profile for battery power and one for the noisier panel
+		seen on a charger
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <Cross Platform Shim/compat.h>
+#ifndef HIMAX_USER_MODE
+#include <wdm.h>
+#include <wdf.h>
+#endif
+#include <reportpack.h>
+
+//
+// A reported contact only moves once it leaves a square of Deadband
+// controller units around its last reported position, then trails the
+// raw position by Deadband. A new contact is held back until it has been
+// seen for DebounceFrames frames, which drops the single frame phantom
+// touches charger noise produces. Zero values leave the frames as
+// decoded.
+//
+typedef enum _HIMAX_FILTER_PROFILE
+{
+	HimaxFilterNormal,
+	HimaxFilterCharger,
+	HimaxFilterProfiles
+} HIMAX_FILTER_PROFILE;
+
+typedef struct _HIMAX_FILTER_PARAMS
+{
+	ULONG Deadband;
+	ULONG DebounceFrames;
+} HIMAX_FILTER_PARAMS;
+
+typedef struct _HIMAX_FILTER_SLOT
+{
+	DETECTED_OBJECT_POSITION Last;
+	ULONG Frames;
+	BOOLEAN Reported;
+} HIMAX_FILTER_SLOT;
+
+typedef struct _HIMAX_FILTER
+{
+	HIMAX_FILTER_PARAMS Params;
+	HIMAX_FILTER_SLOT Slots[MAX_TOUCHES];
+} HIMAX_FILTER;
+
+//
+// Movement of the contacts present in two consecutive frames. On a
+// session held still, Displacement and Moves are the jitter, so the
+// same recording measured before and after filtering gives comparable
+// figures. Phantoms counts contacts lifted before they were reported.
+//
+typedef struct _HIMAX_JITTER_STATS
+{
+	ULONG Frames;
+	ULONG HeldContacts;
+	ULONG Moves;
+	ULONGLONG Displacement;
+	ULONG MaxStep;
+	ULONG Phantoms;
+} HIMAX_JITTER_STATS;
+
+VOID
+HimaxFilterReset(
+	OUT HIMAX_FILTER* Filter,
+	IN const HIMAX_FILTER_PARAMS* Params
+);
+
+VOID
+HimaxFilterObjects(
+	IN OUT HIMAX_FILTER* Filter,
+	IN OUT DETECTED_OBJECTS* Data,
+	IN OUT HIMAX_JITTER_STATS* Stats
+);
+
+VOID
+HimaxFilterMeasure(
+	IN const DETECTED_OBJECTS* Previous,
+	IN const DETECTED_OBJECTS* Current,
+	IN OUT HIMAX_JITTER_STATS* Stats
+);
@@ -0,0 +1,73 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxfirmware.h
+
+	Abstract:
+
+		Contains the firmware update defines and interfaces of the
+		HX83112 controller
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+#include <controller.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+
+#define HIMAX_FIRMWARE_PATH      L"\\SystemRoot\\System32\\Drivers\\HimaxTouchFirmware.bin"
+#define HIMAX_FIRMWARE_MAX_SIZE  0x20000
+
+//
+// Zero flash parts boot from SRAM. The image is streamed there in the
+// largest chunks a single bus write carries: the AHB address and the
+// chunk fill HIMAX_MAX_DATA_SIZE, and with the register byte a large
+// tier buffer of the SPB buffer pool. Each verify block is checked by
+// the CRC engine while the next block is being written.
+//
+#define HIMAX_ZERO_FLASH_SRAM_ADDRESS    0x08000000
+#define HIMAX_ZERO_FLASH_CHUNK_SIZE      ((HIMAX_MAX_DATA_SIZE - FOUR_BYTE_ADDR_SZ) & ~3)
+#define HIMAX_ZERO_FLASH_RETRIES         3
+#define HIMAX_ZERO_FLASH_RELOAD_ADDRESS  0x10007f00
+#define HIMAX_ZERO_FLASH_RELOAD_DISABLE  0x0000A55A
+
+C_ASSERT(HIMAX_FIRMWARE_MAX_SIZE <= HIMAX_ZERO_FLASH_BLOCK_SIZE * HIMAX_ZERO_FLASH_MAX_BLOCKS);
+C_ASSERT(FOUR_BYTE_ADDR_SZ + HIMAX_ZERO_FLASH_CHUNK_SIZE + 1 <= SPB_LARGE_BUFFER_SIZE);
+
+NTSTATUS
+HimaxFirmwareLoad(
+	OUT UINT8** Image,
+	OUT ULONG* Length
+);
+
+NTSTATUS
+HimaxFirmwareUpdate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN PTOUCH_SCREEN_SETTINGS TouchSettings,
+	OUT BOOLEAN* FlashModified
+);
+
+NTSTATUS
+HimaxZeroFlashUpload(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN BOOLEAN Resume
+);
+
+VOID
+HimaxZeroFlashRelease(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
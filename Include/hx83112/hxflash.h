@@ -0,0 +1,189 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxflash.h
+
+	Abstract:
+
+		Contains the SPI flash programming defines and interfaces of the
+		HX83112 controller
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+
+//
+// The flash sits behind the controller's SPI200 master, driven through
+// AHB register writes. Sectors are erased with a 64KB block erase and
+// programmed one 256 byte page at a time. The SPI200 data FIFO takes a
+// page as a 16 byte chunk followed by 48 byte chunks.
+//
+#define HIMAX_FLASH_PAGE_SIZE           256
+#define HIMAX_FLASH_SECTOR_SIZE         0x10000
+#define HIMAX_FLASH_FIFO_FIRST_CHUNK    16
+#define HIMAX_FLASH_FIFO_CHUNK          48
+#define HIMAX_FLASH_FIFO_CHUNKS         (1 + (HIMAX_FLASH_PAGE_SIZE - HIMAX_FLASH_FIFO_FIRST_CHUNK) / HIMAX_FLASH_FIFO_CHUNK)
+
+#define HIMAX_FLASH_SPI200_TRANS_FMT    0x80000010
+#define HIMAX_FLASH_SPI200_TRANS_CTRL   0x80000020
+#define HIMAX_FLASH_SPI200_CMD          0x80000024
+#define HIMAX_FLASH_SPI200_ADDR         0x80000028
+#define HIMAX_FLASH_SPI200_DATA         0x8000002c
+
+#define HIMAX_FLASH_TRANS_FMT           0x00020780
+#define HIMAX_FLASH_CTRL_READ_STATUS    0x42000003
+#define HIMAX_FLASH_CTRL_WRITE_ENABLE   0x47000000
+#define HIMAX_FLASH_CTRL_ERASE          0x67000000
+#define HIMAX_FLASH_CTRL_PAGE_PROGRAM   0x610ff000
+
+#define HIMAX_FLASH_CMD_READ_STATUS     0x05
+#define HIMAX_FLASH_CMD_WRITE_ENABLE    0x06
+#define HIMAX_FLASH_CMD_BLOCK_ERASE     0xD8
+#define HIMAX_FLASH_CMD_PAGE_PROGRAM    0x02
+
+#define HIMAX_FLASH_STATUS_WIP          0x01
+
+//
+// Hardware CRC engine, computing the same CRC as HimaxFlashCrc32c over
+// a flash range given in 32-bit words
+//
+#define HIMAX_FLASH_CRC_STATUS          0x80050000
+#define HIMAX_FLASH_CRC_RESULT          0x80050018
+#define HIMAX_FLASH_CRC_ADDRESS         0x80050020
+#define HIMAX_FLASH_CRC_COMMAND         0x80050028
+#define HIMAX_FLASH_CRC_START           0x00990000
+#define HIMAX_FLASH_CRC_BUSY            0x01
+#define HIMAX_FLASH_CRC_POLYNOMIAL      0x82F63B78
+#define HIMAX_FLASH_CRC_POLL_US         1000
+#define HIMAX_FLASH_CRC_POLL_LIMIT      100
+
+#define HIMAX_FLASH_ERASE_TIMEOUT_US    3000000
+#define HIMAX_FLASH_ERASE_POLL_US       2000
+#define HIMAX_FLASH_PROGRAM_TIMEOUT_US  20000
+#define HIMAX_FLASH_PROGRAM_POLL_US     100
+
+typedef struct _HIMAX_FLASH_STATS
+{
+	ULONG SectorsErased;
+	ULONG PagesProgrammed;
+	ULONG PagesSkipped;
+	ULONG Sequences;
+	ULONG StatusPolls;
+	ULONG ElapsedInUs;
+	ULONG KBytesPerSecond;
+} HIMAX_FLASH_STATS;
+
+//
+// The flash simulation programs Length bytes of pseudo-random data drawn
+// from Seed, every fourth page left at 0xFF, one sector into a simulated
+// flash whose other content is zeroes. It checks the flash reads back as
+// the data followed by erased bytes up to the end of the last sector,
+// that nothing outside those sectors changed, and that the controller's
+// CRC of the range matches. Every sector erase and page program costs a
+// fixed number of SPB sequences, transfers and bytes, so the counts seen
+// by the simulated bus are checked against them as well.
+//
+#define HIMAX_FLASH_SIMULATE_MAX_LENGTH (2 * HIMAX_FLASH_SECTOR_SIZE)
+
+typedef struct _HIMAX_FLASH_SIMULATION_RESULT
+{
+	NTSTATUS Status;
+	HIMAX_FLASH_STATS Stats;
+	BOOLEAN ContentsMatch;
+	ULONG FirstMismatch;
+	BOOLEAN CrcMatch;
+	UINT32 Crc;
+	UINT32 ExpectedCrc;
+	BOOLEAN CountsMatch;
+	ULONG ExpectedSectors;
+	ULONG ExpectedPages;
+	ULONG ExpectedSequences;
+	ULONG ExpectedTransfers;
+	ULONG ExpectedBytesWritten;
+	ULONG ExpectedBytesRead;
+	ULONG Submissions;
+	ULONG Transfers;
+	ULONG BytesWritten;
+	ULONG BytesRead;
+	ULONG Rejected;
+} HIMAX_FLASH_SIMULATION_RESULT;
+
+NTSTATUS
+HimaxFlashEraseSector(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN OUT HIMAX_FLASH_STATS* Stats
+);
+
+NTSTATUS
+HimaxFlashProgramPage(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN UINT8* Data,
+	IN ULONG Length,
+	IN OUT HIMAX_FLASH_STATS* Stats
+);
+
+NTSTATUS
+HimaxFlashProgram(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN UINT8* Data,
+	IN ULONG Length,
+	OUT HIMAX_FLASH_STATS* Stats
+);
+
+UINT32
+HimaxFlashCrc32c(
+	IN UINT8* Data,
+	IN ULONG Length
+);
+
+NTSTATUS
+HimaxFlashHwCrcStart(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN ULONG Length
+);
+
+NTSTATUS
+HimaxFlashHwCrcResult(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	OUT UINT32* Crc
+);
+
+NTSTATUS
+HimaxFlashHwCrc(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN ULONG Length,
+	OUT UINT32* Crc
+);
+
+NTSTATUS
+HimaxFlashSimulate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN ULONG Length,
+	IN ULONG Seed,
+	OUT HIMAX_FLASH_SIMULATION_RESULT* Result
+);
@@ -28,6 +28,10 @@
 #include <Cross Platform Shim/bitops.h>
 #include <Cross Platform Shim/hweight.h>
 #include <report.h>
+#include <hx83112/hxcapture.h>
+#include <hx83112/hxdecode.h>
+#include <hx83112/hxfilter.h>
+#include <hx83112/hxscan.h>
 
 // Ignore warning C4152: nonstandard extension, function/data pointer conversion in expression
 #pragma warning (disable : 4152)
@@ -41,16 +45,24 @@
 // Ignore warning C4324: 'xxx' : structure was padded due to __declspec(align())
 #pragma warning (disable : 4324)
 
+//
+// Raw event stack frame, of which the selected layout's FrameSize bytes
+// are read
+//
 typedef struct _HIMAX_EVENT_DATA
 {
-	BYTE data[53];
-	BYTE state_info[3];
+	BYTE data[HIMAX_EVENT_STACK_MAX_SIZE];
 } HIMAX_EVENT_DATA, * PHIMAX_EVENT_DATA;
 
 #define TOUCH_POOL_TAG_F12              (ULONG)'21oT'
 #define HIMAX_MAX_DATA_SIZE				8191
 #define HIMAX_I2C_RETRY_TIMES 10
 
+#define FOUR_BYTE_DATA_SZ     4
+#define FOUR_BYTE_ADDR_SZ     4
+#define FLASH_RW_MAX_LEN      256
+#define FLASH_WRITE_BURST_SZ  8
+
 #define HX83112_MILLISECONDS_TO_TENTH_MILLISECONDS(n) n/10
 #define HX83112_SECONDS_TO_HALF_SECONDS(n) 2*n
 
@@ -61,13 +73,298 @@ typedef struct _HIMAX_EVENT_DATA
 typedef struct _HX83112_CONFIGURATION
 {
 	UINT32 PepRemovesVoltageInD3;
+	UINT32 ZeroFlash;
+	UINT32 MaxPoints;
+	UINT32 PredictedReads;
+	UINT32 IdleTimeoutMs;
+	UINT32 DozeTimeoutMs;
+	UINT32 IdleReportRateHz;
+	UINT32 DozeReportRateHz;
+	UINT32 FilterDeadband;
+	UINT32 ChargerFilterDeadband;
+	UINT32 ChargerDebounceFrames;
 } HX83112_CONFIGURATION;
 
+//
+// Zero flash parts run their firmware from SRAM, which is lost whenever
+// the rail drops. The image is kept in pool together with the CRC of
+// each verify block, so a resume upload does not touch the file system
+// or recompute the CRCs. Each phase of the last upload is timed.
+//
+#define HIMAX_ZERO_FLASH_BLOCK_SIZE  0x4000
+#define HIMAX_ZERO_FLASH_MAX_BLOCKS  8
+
+typedef struct _HIMAX_ZERO_FLASH_TIMING
+{
+	ULONG LoadInUs;
+	ULONG SafeModeInUs;
+	ULONG UploadInUs;
+	ULONG VerifyWaitInUs;
+	ULONG StartInUs;
+	ULONG TotalInUs;
+	ULONG BlocksRetried;
+} HIMAX_ZERO_FLASH_TIMING;
+
+typedef struct _HIMAX_ZERO_FLASH
+{
+	UINT8* Image;
+	ULONG Length;
+	UINT32 BlockCrc[HIMAX_ZERO_FLASH_MAX_BLOCKS];
+	ULONG Uploads;
+	HIMAX_ZERO_FLASH_TIMING ColdBoot;
+	HIMAX_ZERO_FLASH_TIMING Resume;
+} HIMAX_ZERO_FLASH;
+
+//
+// Bus retry policies. Once the breaker trips after repeated exhausted
+// operations, fail-fast policies stop touching the bus until a reset.
+//
+#define HIMAX_HOT_PATH_ATTEMPTS         3
+#define HIMAX_HOT_PATH_INITIAL_DELAY_US 100
+#define HIMAX_HOT_PATH_MAX_DELAY_US     500
+#define HIMAX_BRING_UP_INITIAL_DELAY_US 1000
+#define HIMAX_BRING_UP_MAX_DELAY_US     8000
+#define HIMAX_BREAKER_THRESHOLD         3
+
+typedef struct _HIMAX_CIRCUIT_BREAKER
+{
+	volatile LONG ConsecutiveFailures;
+	volatile LONG Open;
+	volatile LONG Trips;
+	LONG Threshold;
+} HIMAX_CIRCUIT_BREAKER;
+
+//
+// Waits out a backoff. Policies sleep with HimaxDelay unless given
+// another, such as the virtual clock of the retry simulation.
+//
+typedef VOID
+HIMAX_RETRY_DELAY(
+	IN PVOID Context,
+	IN ULONG DelayInUs
+);
+
+typedef struct _HIMAX_RETRY_POLICY
+{
+	UINT8 MaxAttempts;
+	ULONG InitialDelayInUs;
+	ULONG MaxDelayInUs;
+	BOOLEAN FailFast;
+	HIMAX_CIRCUIT_BREAKER* Breaker;
+	HIMAX_RETRY_DELAY* Delay;
+	PVOID DelayContext;
+
+	volatile LONG Operations;
+	volatile LONG Retries;
+	volatile LONG Exhausted;
+	volatile LONG FastFails;
+} HIMAX_RETRY_POLICY;
+
+//
+// The retry simulation runs bus reads through a policy against a
+// simulated chip failing the given amount of attempts of each read, or
+// every attempt for HIMAX_RETRY_SIMULATE_NEVER, with backoffs on a
+// virtual clock. Breaker state carries over from one read to the next.
+//
+#define HIMAX_RETRY_SIMULATE_MAX_PROBES 16
+#define HIMAX_RETRY_SIMULATE_NEVER      MAXULONG
+
+typedef struct _HIMAX_RETRY_PROBE_RESULT
+{
+	NTSTATUS Status;
+	ULONG Attempts;
+	ULONG WaitInUs;
+	BOOLEAN BreakerOpen;
+} HIMAX_RETRY_PROBE_RESULT;
+
+typedef struct _HIMAX_RETRY_SIMULATION_RESULT
+{
+	ULONG Count;
+	HIMAX_RETRY_PROBE_RESULT Probes[HIMAX_RETRY_SIMULATE_MAX_PROBES];
+	LONG Operations;
+	LONG Retries;
+	LONG Exhausted;
+	LONG FastFails;
+	LONG Trips;
+	ULONG WaitInUs;
+} HIMAX_RETRY_SIMULATION_RESULT;
+
+//
+// Shadow copy of the chip's AHB interface registers, used to skip
+// writes that would not change the chip's burst or direction state.
+// Event stack reads leave burst off between frames, so the counters
+// also track how many transfers each frame took and how often burst
+// had to be turned back on for an MCU access.
+//
+// Register 0x00 is both the burst read flag, when written alone, and
+// the first byte of the AHB address; only the former is cached. An
+// address write leaves the flag unknown.
+//
+#define HIMAX_BUS_STATE_BURST_READ 0 // 0x00
+#define HIMAX_BUS_STATE_DIRECTION  1 // 0x0C
+#define HIMAX_BUS_STATE_INCR4      2 // 0x0D
+#define HIMAX_BUS_STATE_CONTI      3 // 0x13
+#define HIMAX_BUS_STATE_REGISTERS  4
+
+//
+// Predicted event stack reads only fetch the occupied slots, a full
+// frame is still read at least this often to validate the stream
+//
+#define HIMAX_PREDICTED_READ_FULL_INTERVAL 16
+
+typedef struct _HIMAX_BUS_STATE
+{
+	UINT8 ValidMask;
+	UINT8 Registers[HIMAX_BUS_STATE_REGISTERS];
+	ULONG WritesSkipped;
+	ULONG EventReads;
+	ULONG EventReadTransfers;
+	ULONG BurstRestores;
+	ULONG PredictedReads;
+	ULONG PredictedSinceFull;
+	ULONG Mispredictions;
+	ULONG BytesSaved;
+	ULONG BytesWasted;
+} HIMAX_BUS_STATE;
+
+//
+// Scan rates the firmware can be switched between. The register taking
+// the rate, in Hz, depends on the firmware and comes from the touch
+// settings; without one the firmware keeps its own rate. The rate the
+// panel actually reports at is measured from the event stack reads,
+// ignoring the gaps between touches.
+//
+#define HIMAX_REPORT_RATE_FIRMWARE_DEFAULT 0
+#define HIMAX_REPORT_RATE_MAX_GAP_MS       100
+
+typedef struct _HIMAX_REPORT_RATE
+{
+	UINT32 Register;
+	ULONG Hz;
+	ULONG Changes;
+	LONGLONG LastFrame;
+	LONGLONG IntervalTicks;
+	ULONG Intervals;
+} HIMAX_REPORT_RATE;
+
+//
+// The scan state machine and what applies it to the controller: the
+// one-shot timer for timeouts, and the rate to restore when a contact
+// brings the controller back to ACTIVE
+//
+typedef struct _HIMAX_SCAN_CONTROL
+{
+	HIMAX_SCAN_POLICY Policy;
+	HIMAX_SCAN_MACHINE Machine;
+	BOOLEAN Running;
+	ULONG ActiveHz;
+	ULONG Transitions;
+	WDFTIMER Timer;
+	HIMAX_SCAN_WAKE_STATS Wake;
+} HIMAX_SCAN_CONTROL;
+
+//
+// Smart wake mode, in which the chip keeps scanning at low power with
+// the display off and reports a double tap as a gesture. Double taps
+// arriving within DedupWindowMs of the last reported one are dropped.
+//
+#define HIMAX_SMWP_ENABLE_ADDRESS 0x10007F10
+#define HIMAX_SMWP_ENABLE         0xA55AA55A
+#define HIMAX_SMWP_DISABLE        0x00000000
+
+typedef struct _HIMAX_GESTURE
+{
+	BOOLEAN Enabled;
+	ULONG DedupWindowMs;
+	ULONGLONG LastWakeMs;
+	ULONG Detected;
+	ULONG Reported;
+	ULONG Suppressed;
+	ULONG Ignored;
+	ULONG LastWakeInUs;
+	ULONG MaxWakeInUs;
+} HIMAX_GESTURE;
+
+//
+// USB detect register of the firmware, which switches it to its charger
+// noise immunity mode. The driver's contact filter follows the same
+// state, and the jitter before and after filtering is kept per profile.
+//
+#define HIMAX_USB_DETECT_ADDRESS      0x10007F38
+#define HIMAX_USB_DETECT_CONNECTED    0xA55AA55A
+#define HIMAX_USB_DETECT_DISCONNECTED 0x77887788
+
+typedef struct _HIMAX_FILTER_CONTROL
+{
+	HIMAX_FILTER_PARAMS Profiles[HimaxFilterProfiles];
+	HIMAX_FILTER_PROFILE Profile;
+	BOOLEAN ChargerConnected;
+	ULONG Switches;
+	HIMAX_FILTER Filter;
+	DETECTED_OBJECTS RawPrevious;
+	DETECTED_OBJECTS Previous;
+	HIMAX_JITTER_STATS Raw[HimaxFilterProfiles];
+	HIMAX_JITTER_STATS Filtered[HimaxFilterProfiles];
+} HIMAX_FILTER_CONTROL;
+
+//
+// The configuration registers read back once the controller is set up.
+// Resuming a controller that kept its power replays them as a single
+// batch and verifies them, a full bring-up only runs when it lost power
+// or the verification fails. Each path is timed up to the controller
+// being ready and up to the first reported contact.
+//
+#define HIMAX_RESUME_MAX_REGISTERS 8
+
+//
+// How long a replayed controller gets for its firmware to run again
+// before resume falls back to a full bring-up
+//
+#define HIMAX_RESUME_RUN_POLLS 10
+#define HIMAX_RESUME_RUN_POLL_US 2000
+
+typedef enum _HIMAX_RESUME_PATH
+{
+	HimaxResumeSnapshot,
+	HimaxResumeFullInit,
+	HimaxResumePaths
+} HIMAX_RESUME_PATH;
+
+typedef struct _HIMAX_RESUME_REGISTER
+{
+	UINT32 Address;
+	UINT32 Value;
+} HIMAX_RESUME_REGISTER;
+
+typedef struct _HIMAX_RESUME_TIMING
+{
+	ULONG Resumes;
+	ULONG LastReadyInUs;
+	ULONG MaxReadyInUs;
+	ULONG FirstReports;
+	ULONG LastFirstReportInUs;
+	ULONG MaxFirstReportInUs;
+} HIMAX_RESUME_TIMING;
+
+typedef struct _HIMAX_RESUME
+{
+	HIMAX_RESUME_REGISTER Registers[HIMAX_RESUME_MAX_REGISTERS];
+	ULONG Count;
+	BOOLEAN PowerLost;
+	BOOLEAN AwaitingReport;
+	HIMAX_RESUME_PATH LastPath;
+	LONGLONG Start;
+	ULONG VerifyFailures;
+	HIMAX_RESUME_TIMING Paths[HimaxResumePaths];
+} HIMAX_RESUME;
+
 typedef struct _HX83112_CONTROLLER_CONTEXT
 {
 	WDFDEVICE FxDevice;
 	WDFWAITLOCK ControllerLock;
 
+	HX83112_CONFIGURATION Config;
+
 	//
 	// Power state
 	//
@@ -81,15 +378,302 @@ typedef struct _HX83112_CONTROLLER_CONTEXT
 
 	UINT8 FingerNum;
 	UINT8 FingerOn;
-	UINT8 CoordBuf[56];
+	const HIMAX_EVENT_LAYOUT* Layout;
+	HIMAX_DECODE_BOUNDS Bounds;
+	UINT8 CoordBuf[HIMAX_EVENT_STACK_MAX_SIZE];
 	UINT8 StateInfo[2];
 	UINT8 AAPress;
 
-	UINT16 PreFingerMask;
-	UINT16 OldFinger;
+	//
+	// Presence masks of the current and previous frame, one bit per slot
+	//
+	ULONG PreFingerMask;
+	ULONG OldFinger;
 	BOOLEAN ProcessReports;
+
+	HIMAX_BUS_STATE BusState;
+
+	//
+	// Completion time of the last event stack read, for latency accounting
+	//
+	LONGLONG BusReadTimestamp;
+
+	HIMAX_CIRCUIT_BREAKER Breaker;
+	HIMAX_RETRY_POLICY HotPathRetry;
+	HIMAX_RETRY_POLICY BringUpRetry;
+
+	HIMAX_CAPTURE_RING Capture;
+
+	HIMAX_FRAME_STATS FrameStats;
+
+	HIMAX_REPORT_RATE ReportRate;
+
+	HIMAX_SCAN_CONTROL Scan;
+
+	HIMAX_GESTURE Gesture;
+
+	HIMAX_FILTER_CONTROL Filter;
+
+	HIMAX_RESUME Resume;
+
+	HIMAX_ZERO_FLASH ZeroFlash;
 } HIMAX_CONTROLLER_CONTEXT;
 
+//
+// Command lists record a bring-up sequence of bus writes, AHB register
+// writes, burst mode changes and delays, and submit it as a batch
+//
+
+#define HIMAX_COMMAND_LIST_MAX_COMMANDS 16
+#define HIMAX_COMMAND_DATA_SIZE 8
+
+typedef enum _HIMAX_COMMAND_TYPE
+{
+	HimaxCommandBusWrite,
+	HimaxCommandRegisterWrite,
+	HimaxCommandBurstMode,
+	HimaxCommandDelay
+} HIMAX_COMMAND_TYPE;
+
+typedef struct _HIMAX_COMMAND
+{
+	HIMAX_COMMAND_TYPE Type;
+	UINT8 Command;
+	UINT8 Data[HIMAX_COMMAND_DATA_SIZE];
+	ULONG Length;
+	ULONG DelayInUs;
+} HIMAX_COMMAND;
+
+typedef struct _HIMAX_COMMAND_LIST
+{
+	HIMAX_COMMAND Commands[HIMAX_COMMAND_LIST_MAX_COMMANDS];
+	ULONG Count;
+	NTSTATUS Status;
+} HIMAX_COMMAND_LIST;
+
+VOID
+HimaxCommandListInit(
+	OUT HIMAX_COMMAND_LIST* List
+);
+
+VOID
+HimaxCommandListBusWrite(
+	IN HIMAX_COMMAND_LIST* List,
+	IN UINT8 Command,
+	IN UINT8* Data,
+	IN ULONG Length
+);
+
+VOID
+HimaxCommandListRegisterWrite(
+	IN HIMAX_COMMAND_LIST* List,
+	IN UINT32 Address,
+	IN UINT8* Data
+);
+
+VOID
+HimaxCommandListBurstEnable(
+	IN HIMAX_COMMAND_LIST* List,
+	IN UINT8 AutoAdd4Byte
+);
+
+VOID
+HimaxCommandListDelay(
+	IN HIMAX_COMMAND_LIST* List,
+	IN ULONG DelayInUs
+);
+
+NTSTATUS
+HimaxCommandListExecute(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN HIMAX_COMMAND_LIST* List
+);
+
+//
+// The command lists checked against the per-call sequences they
+// replaced. Each is run both ways against the simulated chip, the
+// operations reaching it must be identical; the transfer and submission
+// counts show what batching saved.
+//
+typedef enum _HIMAX_COMMAND_LIST_CHECK_ID
+{
+	HimaxCommandListCheckSystemReset,
+	HimaxCommandListCheckFirmwareRelease,
+	HimaxCommandListCheckPasswordClear,
+	HimaxCommandListCheckConfiguration,
+	HimaxCommandListChecks
+} HIMAX_COMMAND_LIST_CHECK_ID;
+
+typedef struct _HIMAX_COMMAND_LIST_CHECK
+{
+	NTSTATUS Status;
+	BOOLEAN Equivalent;
+	ULONG Operations;
+	ULONG FirstMismatch;
+	ULONG ReferenceSubmissions;
+	ULONG ReferenceTransfers;
+	ULONG ListSubmissions;
+	ULONG ListTransfers;
+} HIMAX_COMMAND_LIST_CHECK;
+
+NTSTATUS
+HimaxRetrySimulate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN BOOLEAN HotPath,
+	IN ULONG* FailedAttempts,
+	IN ULONG Count,
+	OUT HIMAX_RETRY_SIMULATION_RESULT* Result
+);
+
+NTSTATUS
+HimaxCommandListVerify(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	OUT HIMAX_COMMAND_LIST_CHECK* Checks
+);
+
+VOID
+HimaxInitializeRetryPolicies(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+VOID
+HimaxDelay(
+	IN ULONG DelayInUs
+);
+
+VOID
+HimaxResetCircuitBreaker(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+VOID
+HimaxInvalidateBusState(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+NTSTATUS
+HimaxBusProbe(
+	IN SPB_CONTEXT* SpbContext
+);
+
+NTSTATUS
+HimaxBusExecuteSequence(
+	IN SPB_CONTEXT* SpbContext,
+	IN SPB_TRANSFER* Transfers,
+	IN ULONG TransferCount,
+	IN HIMAX_RETRY_POLICY* Policy
+);
+
+VOID
+HimaxBusStateUpdate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN UINT8 Command,
+	IN UINT8 Value
+);
+
+VOID
+HimaxBusStateWritten(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN UINT8 Command,
+	IN UINT8* Data,
+	IN ULONG Length
+);
+
+NTSTATUS
+HimaxMCUBurstEnable(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT8 AutoAdd4Byte
+);
+
+NTSTATUS
+HimaxMCURegisterRead(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 ReadAddr,
+	OUT UINT8* ReadData,
+	IN ULONG ReadLength,
+	IN UINT8 ConfigFlag
+);
+
+NTSTATUS
+HimaxMCURegisterWriteVerified(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN UINT32 Value
+);
+
+NTSTATUS
+HimaxMCUFlashWriteBurstLength(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 RegByte,
+	OUT UINT8* WriteData,
+	IN ULONG Length
+);
+
+NTSTATUS
+HimaxMCURegisterWrite(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 WriteAddr,
+	OUT UINT8* WriteData,
+	IN ULONG WriteLength,
+	IN UINT8 ConfigFlag
+);
+
+NTSTATUS
+HimaxMCUInterfaceOn(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+NTSTATUS
+HimaxMCUSystemReset(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+NTSTATUS
+HimaxMCUSenseOn(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT8 FlashMode
+);
+
+NTSTATUS
+HimaxMCUStopFirmware(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+NTSTATUS
+HimaxMCUSenseOff(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+HimaxSelectEventLayout(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN ULONG MaxPoints
+);
+
+VOID
+HimaxFilterInitialize(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+NTSTATUS
+HimaxDecodeEventStack(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN HIMAX_EVENT_DATA* EventData,
+	IN ULONG Length,
+	OUT DETECTED_OBJECTS* Data
+);
+
 NTSTATUS
 HimaxBuildFunctionsTable(
 	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
@@ -109,6 +693,56 @@ HimaxConfigureFunctions(
 	IN SPB_CONTEXT* SpbContext
 );
 
+BOOLEAN
+HimaxReportRateSupported(
+	IN ULONG Hz
+);
+
+NTSTATUS
+HimaxSetReportRate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG Hz
+);
+
+ULONG
+HimaxGetMeasuredReportRate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+NTSTATUS
+HimaxScanInitialize(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+VOID
+HimaxScanRelease(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+VOID
+HimaxScanStart(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+HimaxScanStop(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+);
+
+BOOLEAN
+HimaxScanOnFrame(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+HimaxScanRecordWake(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN LONGLONG InterruptTimestamp
+);
+
 NTSTATUS
 HimaxServiceInterrupts(
 	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
@@ -151,6 +785,19 @@ HimaxChangeSleepState(
     IN UCHAR SleepState
 );
 
+NTSTATUS
+HimaxResumeTakeSnapshot(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+HimaxResumeUpdateSnapshot(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN UINT32 Address,
+    IN UINT32 Value
+);
+
 NTSTATUS
 HimaxGetFirmwareVersion(
     IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
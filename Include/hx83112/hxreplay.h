@@ -0,0 +1,69 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxreplay.h
+
+	Abstract:
+
+		Contains the replay of capture streams through decoding, contact
+		filtering and report packing, shared by the driver and the host
+		replay tool
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <Cross Platform Shim/compat.h>
+#include <reportpack.h>
+#include <hx83112/hxdecode.h>
+#include <hx83112/hxfilter.h>
+#include <hx83112/hxstream.h>
+
+typedef struct _HIMAX_CAPTURE_REPLAY_STATS
+{
+	ULONG FramesReplayed;
+	ULONG FramesReported;
+	ULONG FramesDiscarded;
+	ULONG Gestures;
+	ULONG HidReports;
+	ULONG RecordsSkipped;
+	ULONG ElapsedInUs;
+	HIMAX_JITTER_STATS RawJitter;
+	HIMAX_JITTER_STATS Jitter[HimaxFilterProfiles];
+} HIMAX_CAPTURE_REPLAY_STATS;
+
+//
+// Decoding and reporting state of a replay, kept apart from the live
+// controller and report contexts. Too large for the stack, the caller
+// allocates it zeroed.
+//
+typedef struct _HIMAX_REPLAY
+{
+	const HIMAX_EVENT_LAYOUT* Layout;
+	HIMAX_DECODE_BOUNDS Bounds;
+	HIMAX_FILTER Filters[HimaxFilterProfiles];
+	DETECTED_OBJECTS Filtered[HimaxFilterProfiles];
+	DETECTED_OBJECTS Previous[HimaxFilterProfiles];
+	DETECTED_OBJECTS RawPrevious;
+	OBJECT_CACHE Cache;
+} HIMAX_REPLAY;
+
+NTSTATUS
+HimaxReplayStream(
+	IN OUT HIMAX_REPLAY* Replay,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN const HIMAX_FILTER_PARAMS* Profiles,
+	IN HIMAX_FILTER_PROFILE Profile,
+	IN PVOID Stream,
+	IN ULONG Length,
+	OUT HIMAX_CAPTURE_REPLAY_STATS* Stats
+);
@@ -0,0 +1,114 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxscan.h
+
+	Abstract:
+
+		Contains the scan state machine, which lowers the controller's
+		scan rate while the screen is left untouched and restores it on
+		the first contact
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+
+//
+// The controller scans at its full rate while ACTIVE, drops to the idle
+// rate IdleAfterMs after the last contact and to the doze rate a further
+// DozeAfterMs later. A contact returns it to ACTIVE at once. An
+// IdleAfterMs of zero keeps the controller ACTIVE, a DozeAfterMs of zero
+// stops it at IDLE.
+//
+typedef enum _HIMAX_SCAN_STATE
+{
+	HimaxScanActive,
+	HimaxScanIdle,
+	HimaxScanDoze,
+	HimaxScanStates
+} HIMAX_SCAN_STATE;
+
+typedef struct _HIMAX_SCAN_POLICY
+{
+	ULONG IdleAfterMs;
+	ULONG DozeAfterMs;
+	ULONG IdleHz;
+	ULONG DozeHz;
+} HIMAX_SCAN_POLICY;
+
+typedef struct _HIMAX_SCAN_MACHINE
+{
+	HIMAX_SCAN_STATE State;
+	ULONGLONG LastTouchMs;
+} HIMAX_SCAN_MACHINE;
+
+//
+// Time spent from the interrupt of the frame that woke the controller
+// from IDLE or DOZE to the completion of its report, rate switch
+// included
+//
+typedef struct _HIMAX_SCAN_WAKE_STATS
+{
+	ULONG Wakes;
+	ULONG LastInUs;
+	ULONG MaxInUs;
+	ULONGLONG TotalInUs;
+} HIMAX_SCAN_WAKE_STATS;
+
+//
+// Steps of a scripted run of the state machine on a virtual clock
+//
+#define HIMAX_SCAN_SCRIPT_MAX_STEPS 32
+
+typedef struct _HIMAX_SCAN_STEP
+{
+	ULONG TimeMs;
+	BOOLEAN Touched;
+} HIMAX_SCAN_STEP;
+
+typedef struct _HIMAX_SCAN_STEP_RESULT
+{
+	HIMAX_SCAN_STATE State;
+	ULONG NextDeadlineMs;
+} HIMAX_SCAN_STEP_RESULT;
+
+VOID
+HimaxScanReset(
+	OUT HIMAX_SCAN_MACHINE* Machine,
+	IN ULONGLONG NowMs
+);
+
+HIMAX_SCAN_STATE
+HimaxScanNextState(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN OUT HIMAX_SCAN_MACHINE* Machine,
+	IN BOOLEAN Touched,
+	IN ULONGLONG NowMs
+);
+
+ULONG
+HimaxScanNextDeadline(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN const HIMAX_SCAN_MACHINE* Machine,
+	IN ULONGLONG NowMs
+);
+
+NTSTATUS
+HimaxScanRunScript(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN const HIMAX_SCAN_STEP* Steps,
+	IN ULONG Count,
+	OUT HIMAX_SCAN_STEP_RESULT* Results
+);
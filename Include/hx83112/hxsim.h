@@ -0,0 +1,167 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxsim.h
+
+	Abstract:
+
+		Contains the simulated HX83112 the self-tests run the driver's
+		register protocols against, without touching the controller
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+#include <wdf.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxflash.h>
+
+//
+// The simulated chip keeps the AHB interface registers and a small AHB
+// register file. Every write that reaches the AHB, or a bus register
+// other than the interface ones, is logged with the interface state it
+// was made in, so two ways of issuing the same sequence can be compared
+// byte for byte whatever redundant interface writes either one made.
+//
+#define HIMAX_SIM_MAX_REGISTERS  64
+#define HIMAX_SIM_MAX_OPERATIONS 64
+#define HIMAX_SIM_OPERATION_DATA 8
+
+typedef struct _HIMAX_SIM_OPERATION
+{
+	UINT8 Command;
+	UINT8 Conti;
+	UINT8 Incr4;
+	UINT8 BurstRead;
+	ULONG Length;
+	UINT8 Data[HIMAX_SIM_OPERATION_DATA];
+} HIMAX_SIM_OPERATION;
+
+typedef struct _HIMAX_SIM_REGISTER
+{
+	UINT32 Address;
+	UINT32 Value;
+} HIMAX_SIM_REGISTER;
+
+typedef struct _HIMAX_SIM_CHIP
+{
+	UINT8 Conti;
+	UINT8 Incr4;
+	UINT8 Direction;
+	UINT8 BurstRead;
+	UINT32 AhbAddress;
+	HIMAX_SIM_REGISTER Registers[HIMAX_SIM_MAX_REGISTERS];
+	ULONG RegisterCount;
+} HIMAX_SIM_CHIP;
+
+//
+// SPI flash behind the simulated SPI200 master, absent until attached.
+// It behaves as NOR flash: a block erase sets 64KB to 0xFF, a page
+// program can only clear bits, and both are dropped as Rejected unless
+// a write enable came first. Data register writes fill the FIFO, and a
+// page program commits it once it holds the count set in TRANS_CTRL.
+// The flash is never busy, so status reads report WIP clear. The CRC
+// engine computes its result over the flash as soon as it is started.
+//
+#define HIMAX_SIM_FLASH_SIZE             (4 * HIMAX_FLASH_SECTOR_SIZE)
+#define HIMAX_SIM_SPI200_WRITE_COUNT(c)  ((((c) >> 12) & 0x1ff) + 1)
+#define HIMAX_SIM_FLASH_STATUS_WEL       0x02
+
+typedef struct _HIMAX_SIM_FLASH
+{
+	UINT8* Memory;
+	ULONG Size;
+	UINT32 TransCtrl;
+	UINT32 Address;
+	BOOLEAN WriteEnabled;
+	BOOLEAN Programming;
+	UINT8 Fifo[HIMAX_FLASH_PAGE_SIZE];
+	ULONG FifoLength;
+	ULONG Erases;
+	ULONG Programs;
+	ULONG Rejected;
+} HIMAX_SIM_FLASH;
+
+typedef struct _HIMAX_SIM_COUNTERS
+{
+	ULONG Submissions;
+	ULONG Transfers;
+	ULONG BytesWritten;
+	ULONG BytesRead;
+	ULONG Failures;
+} HIMAX_SIM_COUNTERS;
+
+//
+// The driver code runs on a scratch copy of the live controller context
+// and on a Spb context routed to the chip model, so neither the live
+// cached bus state nor the retry counters are touched. The next
+// FailSubmissions submissions fail without reaching the chip, as a chip
+// not answering would.
+//
+typedef struct _HIMAX_SIMULATOR
+{
+	HIMAX_CONTROLLER_CONTEXT Controller;
+	SPB_CONTEXT Spb;
+	HIMAX_SIM_CHIP Chip;
+	HIMAX_SIM_FLASH Flash;
+	HIMAX_SIM_COUNTERS Counters;
+	ULONG FailSubmissions;
+	HIMAX_SIM_OPERATION Log[HIMAX_SIM_MAX_OPERATIONS];
+	ULONG LogCount;
+	BOOLEAN LogOverflow;
+} HIMAX_SIMULATOR;
+
+NTSTATUS
+HimaxSimCreate(
+	IN HIMAX_CONTROLLER_CONTEXT* Live,
+	OUT HIMAX_SIMULATOR** Simulator
+);
+
+VOID
+HimaxSimDelete(
+	IN HIMAX_SIMULATOR* Simulator
+);
+
+VOID
+HimaxSimReset(
+	IN HIMAX_SIMULATOR* Simulator
+);
+
+NTSTATUS
+HimaxSimAttachFlash(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN ULONG Size
+);
+
+VOID
+HimaxSimSetRegister(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Address,
+	IN UINT32 Value
+);
+
+UINT32
+HimaxSimGetRegister(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Address
+);
+
+BOOLEAN
+HimaxSimCompareLogs(
+	IN HIMAX_SIM_OPERATION* Reference,
+	IN ULONG ReferenceCount,
+	IN HIMAX_SIM_OPERATION* Log,
+	IN ULONG LogCount,
+	OUT ULONG* FirstMismatch
+);
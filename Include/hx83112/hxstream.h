@@ -0,0 +1,82 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxstream.h
+
+	Abstract:
+
+		Contains the event stack capture stream format, shared by the
+		driver that records and replays it and the host replay tool
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <Cross Platform Shim/compat.h>
+#include <hx83112/hxdecode.h>
+
+//
+// A capture stream is a HIMAX_CAPTURE_STREAM_HEADER followed by
+// RecordCount records in timestamp order. Each record starts with a
+// HIMAX_CAPTURE_RECORD_HEADER; readers skip record types they do not
+// know using its Length, so new types do not require a version bump.
+// All fields are little endian and the layout is packed. Frame records
+// have room for the largest event stack layout; the header's FrameSize
+// is the size of the layout the frames were read with.
+//
+#define HIMAX_CAPTURE_MAGIC          0x43525848 // 'HXRC'
+#define HIMAX_CAPTURE_VERSION        2
+#define HIMAX_CAPTURE_FRAME_SIZE     HIMAX_EVENT_STACK_MAX_SIZE
+
+typedef enum _HIMAX_CAPTURE_RECORD_TYPE
+{
+	HimaxCaptureRecordFrame = 1,        // HIMAX_CAPTURE_FRAME
+	HimaxCaptureRecordSpbTransfer = 2,  // SPB_TRACE_RECORD
+} HIMAX_CAPTURE_RECORD_TYPE;
+
+#ifdef HIMAX_USER_MODE
+#pragma pack(push, 1)
+#else
+#include <pshpack1.h>
+#endif
+
+typedef struct _HIMAX_CAPTURE_STREAM_HEADER
+{
+	ULONG Magic;
+	USHORT Version;
+	USHORT HeaderSize;
+	LONGLONG TimestampFrequency;
+	ULONG FrameSize;
+	ULONG RecordCount;
+} HIMAX_CAPTURE_STREAM_HEADER;
+
+typedef struct _HIMAX_CAPTURE_RECORD_HEADER
+{
+	USHORT Type;
+	USHORT Length;
+} HIMAX_CAPTURE_RECORD_HEADER;
+
+typedef struct _HIMAX_CAPTURE_FRAME
+{
+	LONGLONG Timestamp;
+	ULONG Sequence;
+	UINT8 Data[HIMAX_CAPTURE_FRAME_SIZE];
+} HIMAX_CAPTURE_FRAME;
+
+#ifdef HIMAX_USER_MODE
+#pragma pack(pop)
+#else
+#include <poppack.h>
+#endif
+
+C_ASSERT(sizeof(HIMAX_CAPTURE_STREAM_HEADER) == 24);
+C_ASSERT(sizeof(HIMAX_CAPTURE_RECORD_HEADER) == 4);
@@ -5,6 +5,7 @@
 
 #include "controller.h"
 #include <report.h>
+#include <bringup.h>
 
 #define DEFINE_GUID2(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
         EXTERN_C const GUID DECLSPEC_SELECTANY name \
@@ -38,6 +39,19 @@ DEFINE_GUID2(GUID_CONSOLE_DISPLAY_STATE, 0x6fe69556, 0x704a, 0x47a0, 0x8f, 0x24,
 #define TOUCH_DELAY_TO_COMMUNICATE 200000
 #define TOUCH_POWER_RAIL_STABLE_TIME 2000
 
+//
+// Once reset is released the chip is left alone for the floor, then
+// polled until it answers, for at most TOUCH_DELAY_TO_COMMUNICATE.
+// Answering only means the bus interface acknowledged a read, not that
+// the firmware is running: a zero flash part has none until it is
+// uploaded, and the firmware state is only reachable through the AHB
+// sequences of a controller context. Firmware readiness is checked by
+// the update, the upload and resume themselves.
+//
+#define TOUCH_RESET_READY_FLOOR_TIME 10000
+#define TOUCH_READY_POLL_INITIAL_DELAY 1000
+#define TOUCH_READY_POLL_MAX_DELAY 16000
+
 typedef struct _TOUCH_POWER_CONTEXT
 {
     WDFIOTARGET TouchPowerIOTarget;
@@ -92,6 +106,21 @@ typedef struct _DEVICE_EXTENSION
     //
     WDFQUEUE IdleQueue;
 
+    //
+    // Power setting notifications arriving before the controller is
+    // started are held here and delivered once it is
+    //
+    BOOLEAN PowerSettingsStarted;
+    BOOLEAN PowerSourcePending;
+    ULONG PowerSource;
+    BOOLEAN DisplayStatePending;
+    ULONG DisplayState;
+
+    //
+    // The display on or off state the controller was last brought to
+    //
+    ULONG DisplayStateApplied;
+
     //
     // Touch related members used for the lifetime of the device
     //
@@ -107,6 +136,16 @@ typedef struct _DEVICE_EXTENSION
     //
     REPORT_CONTEXT ReportContext;
 
+    //
+    // Interrupt to report latency, per stage
+    //
+    LATENCY_HISTOGRAMS Latency;
+
+    //
+    // Phases of the last bring-up at prepare hardware
+    //
+    BRINGUP_TIMELINE BringUp;
+
 	//
 	// PTP New
 	//
@@ -23,7 +23,115 @@
 #include <wdm.h>
 #include <wdf.h>
 
-#define DEFAULT_SPB_BUFFER_SIZE 64
+#define SPB_MAX_SEQUENCE_TRANSFERS 8
+
+//
+// Transfer buffer pool tiers. The medium tier fits a flash page plus its
+// AHB address, the large tier HIMAX_MAX_DATA_SIZE plus the address byte.
+//
+#define SPB_BUFFER_TIER_COUNT   3
+#define SPB_SMALL_BUFFER_SIZE   64
+#define SPB_SMALL_BUFFER_COUNT  4
+#define SPB_MEDIUM_BUFFER_SIZE  512
+#define SPB_MEDIUM_BUFFER_COUNT 4
+#define SPB_LARGE_BUFFER_SIZE   8192
+#define SPB_LARGE_BUFFER_COUNT  2
+
+//
+// Register transfer, chained with others into one SPB sequence
+//
+
+typedef struct _SPB_TRANSFER
+{
+    BOOLEAN Read;
+    UCHAR Address;
+    PVOID Data;
+    ULONG Length;
+    ULONG DelayInUs;
+} SPB_TRANSFER;
+
+//
+// Transaction trace ring. Records are fixed size and written without
+// taking a lock, each slot has a guard a reader checks to discard
+// records that were being overwritten. Guards count up by 2 per record
+// written to the slot, odd while it is being written, so no sequence
+// number is set aside to mark a busy slot.
+//
+#define SPB_TRACE_RECORD_COUNT   256
+#define SPB_TRACE_PAYLOAD_SIZE   8
+
+#define SPB_TRACE_GUARD_BUSY(sequence)   ((((ULONG)(sequence)) << 1) | 1)
+#define SPB_TRACE_GUARD_STABLE(sequence) ((((ULONG)(sequence)) + 1) << 1)
+
+#define SPB_TRACE_DIRECTION_WRITE 0
+#define SPB_TRACE_DIRECTION_READ  1
+
+typedef struct _SPB_TRACE_RECORD
+{
+    LONGLONG Timestamp;
+    ULONG Sequence;
+    ULONG Length;
+    NTSTATUS Status;
+    UCHAR Address;
+    UCHAR Direction;
+    UCHAR Attempt;
+    UCHAR PayloadLength;
+    UCHAR Payload[SPB_TRACE_PAYLOAD_SIZE];
+} SPB_TRACE_RECORD;
+
+typedef struct _SPB_TRACE_RING
+{
+    WDFMEMORY Memory;
+    SPB_TRACE_RECORD* Records;
+    volatile ULONG Guards[SPB_TRACE_RECORD_COUNT];
+    volatile LONG Enabled;
+    volatile LONG Head;
+
+    //
+    // Last submission, a repeat of a failed one is counted as a retry
+    //
+    UCHAR LastAddress;
+    BOOLEAN LastRead;
+    UCHAR LastAttempt;
+    ULONG LastLength;
+    ULONG LastCount;
+    NTSTATUS LastStatus;
+} SPB_TRACE_RING;
+
+typedef struct _SPB_BUFFER_TIER
+{
+    PUCHAR Buffers;
+    ULONG BufferSize;
+    ULONG BufferCount;
+    volatile LONG InUseMask;
+} SPB_BUFFER_TIER;
+
+typedef struct _SPB_BUFFER_POOL
+{
+    WDFMEMORY Memory;
+    PUCHAR Base;
+    size_t Length;
+    SPB_BUFFER_TIER Tiers[SPB_BUFFER_TIER_COUNT];
+
+    //
+    // Buffers handed out from the tiers, and pool allocations made
+    // when no tier could satisfy the request
+    //
+    volatile LONG Acquisitions;
+    volatile LONG Allocations;
+} SPB_BUFFER_POOL;
+
+//
+// Stands in for the Spb target, so the register protocols built on the
+// bus can be run by the self-tests against a simulated controller. It
+// is called with the SpbLock held, with the transfers of one submission.
+//
+typedef NTSTATUS
+SPB_SIMULATED_TARGET(
+    IN PVOID Context,
+    IN SPB_TRANSFER *Transfers,
+    IN ULONG TransferCount
+    );
 
 //
 // SPB (I2C) context
@@ -33,11 +141,57 @@ typedef struct _SPB_CONTEXT
 {
     WDFIOTARGET SpbIoTarget;
     LARGE_INTEGER I2cResHubId;
-    WDFMEMORY WriteMemory;
-    WDFMEMORY ReadMemory;
+    SPB_BUFFER_POOL BufferPool;
+    WDFMEMORY SequenceMemory;
+    WDFREQUEST SequenceRequest;
     WDFWAITLOCK SpbLock;
+    SPB_TRACE_RING Trace;
+
+    //
+    // Number of I/O requests sent to the Spb target
+    //
+    volatile LONG RequestCount;
+
+    //
+    // Set on a simulated context only, every submission then goes to
+    // the simulated target instead of the Spb target
+    //
+    SPB_SIMULATED_TARGET *SimulatedTarget;
+    PVOID SimulatedContext;
 } SPB_CONTEXT;
 
+PUCHAR
+SpbAcquireBuffer(
+    IN SPB_CONTEXT *SpbContext,
+    IN ULONG Length
+    );
+
+VOID
+SpbReleaseBuffer(
+    IN SPB_CONTEXT *SpbContext,
+    IN PUCHAR Buffer
+    );
+
+NTSTATUS
+SpbExecuteSequence(
+    IN SPB_CONTEXT *SpbContext,
+    IN SPB_TRANSFER *Transfers,
+    IN ULONG TransferCount
+    );
+
+VOID
+SpbTraceEnable(
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN Enable
+    );
+
+ULONG
+SpbTraceSnapshot(
+    IN SPB_CONTEXT *SpbContext,
+    OUT SPB_TRACE_RECORD *Records,
+    IN ULONG MaxRecords
+    );
+
 NTSTATUS 
 SpbReadDataSynchronously(
     _In_ SPB_CONTEXT *SpbContext,
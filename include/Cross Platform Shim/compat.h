@@ -3,5 +3,171 @@
 #ifndef __COMPAT_H__
 #define __COMPAT_H__
 
+//
+// The frame decoding, contact filtering, report packing and replay
+// modules do not touch the controller, and build outside the driver
+// with HIMAX_USER_MODE defined, so recorded sessions can be replayed
+// on a development host. This provides the kernel types and routines
+// they use there.
+//
+#ifdef HIMAX_USER_MODE
 
-#endif
\ No newline at end of file
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IN
+#define OUT
+#define OPTIONAL
+
+#define VOID void
+#define FORCEINLINE static inline
+
+typedef void* PVOID;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef uint8_t UCHAR, * PUCHAR;
+typedef uint16_t USHORT, * PUSHORT;
+typedef uint32_t ULONG, * PULONG;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uint64_t ULONG64, * PULONG64;
+typedef size_t SIZE_T;
+typedef uint8_t BOOLEAN;
+typedef int32_t NTSTATUS;
+typedef wchar_t* PWSTR;
+
+typedef union _LARGE_INTEGER
+{
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+//
+// Opaque framework handles, only named in prototypes
+//
+typedef PVOID WDFDEVICE;
+typedef PVOID WDFQUEUE;
+typedef PVOID WDFREQUEST;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MAXUINT16 ((UINT16)~((UINT16)0))
+#define MAXULONG  0xffffffffUL
+#define MAXUCHAR  0xff
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define C_ASSERT(e) _Static_assert(e, #e)
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+#define NT_ASSERT(e) ((void)0)
+
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS                ((NTSTATUS)0x00000000L)
+#define STATUS_NO_DATA_DETECTED       ((NTSTATUS)0x80000022L)
+#define STATUS_INVALID_PARAMETER      ((NTSTATUS)0xC000000DL)
+#define STATUS_DATA_ERROR             ((NTSTATUS)0xC000003EL)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlFillMemory(Destination, Length, Fill) memset((Destination), (Fill), (Length))
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+FORCEINLINE
+SIZE_T
+RtlCompareMemory(
+	const void* Source1,
+	const void* Source2,
+	SIZE_T Length
+)
+{
+	SIZE_T i;
+
+	for (i = 0; i < Length && ((const UCHAR*)Source1)[i] == ((const UCHAR*)Source2)[i]; i++);
+
+	return i;
+}
+
+//
+// Same multiplier as the kernel's generator, the sequences are not
+// guaranteed to match it
+//
+FORCEINLINE
+ULONG
+RtlRandomEx(
+	PULONG Seed
+)
+{
+	*Seed = (ULONG)(((ULONGLONG)*Seed * 0x7fffffed + 0x7fffffc3) % 0x7fffffff);
+	return *Seed;
+}
+
+#define POOL_FLAG_NON_PAGED     0x0000000000000040ULL
+#define POOL_FLAG_UNINITIALIZED 0x0000000000000002ULL
+
+FORCEINLINE
+PVOID
+ExAllocatePool2(
+	ULONG64 Flags,
+	SIZE_T NumberOfBytes,
+	ULONG Tag
+)
+{
+	UNREFERENCED_PARAMETER(Tag);
+
+	return (Flags & POOL_FLAG_UNINITIALIZED) ? malloc(NumberOfBytes) : calloc(1, NumberOfBytes);
+}
+
+#define ExFreePoolWithTag(P, Tag) free(P)
+
+FORCEINLINE
+LARGE_INTEGER
+KeQueryPerformanceCounter(
+	LARGE_INTEGER* PerformanceFrequency
+)
+{
+	LARGE_INTEGER counter;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	counter.QuadPart = (LONGLONG)now.tv_sec * 1000000000 + now.tv_nsec;
+
+	if (PerformanceFrequency != NULL)
+	{
+		PerformanceFrequency->QuadPart = 1000000000;
+	}
+
+	return counter;
+}
+
+FORCEINLINE
+ULONG64
+KeQueryInterruptTimePrecise(
+	PULONG64 QpcTimeStamp
+)
+{
+	*QpcTimeStamp = (ULONG64)KeQueryPerformanceCounter(NULL).QuadPart;
+	return *QpcTimeStamp / 100;
+}
+
+//
+// WPP is not available, trace messages are dropped
+//
+#define Trace(Level, Flag, ...) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		bringup.h
+
+	Abstract:
+
+		Contains the controller bring-up timeline and the readiness
+		polling that replaces fixed waits after reset
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+
+//
+// Phases of bringing the controller up at prepare hardware, in the order
+// they start. Configuration only needs the host, so it runs while the
+// chip settles after reset and the two phases overlap.
+//
+typedef enum _BRINGUP_PHASE
+{
+	BringUpPhaseResetAssert,    // Reset held low while the rail settles
+	BringUpPhaseResetSettle,    // Reset released until the chip answered
+	BringUpPhaseConfiguration,  // Settings, context and timers
+	BringUpPhaseFirmware,       // Firmware update or zero flash upload
+	BringUpPhaseStart,          // Controller configured and sensing
+	BRINGUP_PHASE_COUNT
+} BRINGUP_PHASE;
+
+//
+// Start and duration of each phase, relative to the start of bring-up
+//
+typedef struct _BRINGUP_TIMELINE
+{
+	LONGLONG Frequency;
+	LONGLONG Origin;
+	LONGLONG PhaseStart[BRINGUP_PHASE_COUNT];
+	ULONG StartInUs[BRINGUP_PHASE_COUNT];
+	ULONG DurationInUs[BRINGUP_PHASE_COUNT];
+	ULONG ReadyPolls;
+	BOOLEAN ReadyTimedOut;
+	ULONG TotalInUs;
+} BRINGUP_TIMELINE;
+
+//
+// The chip is not probed before FloorInUs, the datasheet minimum after
+// reset, then with delays doubling from InitialDelayInUs up to
+// MaxDelayInUs until it answers or TimeoutInUs have passed. Both are
+// counted from the release of reset, so time spent on other work in the
+// meantime comes off the wait.
+//
+typedef struct _BRINGUP_READY_POLICY
+{
+	ULONG FloorInUs;
+	ULONG InitialDelayInUs;
+	ULONG MaxDelayInUs;
+	ULONG TimeoutInUs;
+} BRINGUP_READY_POLICY;
+
+//
+// Probes the chip once, without retrying
+//
+typedef NTSTATUS
+BRINGUP_READY_PROBE(
+	IN PVOID Context
+);
+
+//
+// The time source of the readiness wait. Elapsed returns the time since
+// Since, in the clock's own units, and Delay waits for the given time.
+// The wait runs on the system clock unless given another, such as the
+// virtual clock of the simulation.
+//
+typedef ULONG
+BRINGUP_CLOCK_ELAPSED(
+	IN PVOID Context,
+	IN LONGLONG Since
+);
+
+typedef VOID
+BRINGUP_CLOCK_DELAY(
+	IN PVOID Context,
+	IN ULONG DelayInUs
+);
+
+typedef struct _BRINGUP_CLOCK
+{
+	BRINGUP_CLOCK_ELAPSED* Elapsed;
+	BRINGUP_CLOCK_DELAY* Delay;
+	PVOID Context;
+} BRINGUP_CLOCK;
+
+VOID
+BringUpBegin(
+	OUT BRINGUP_TIMELINE* Timeline
+);
+
+VOID
+BringUpPhaseBegin(
+	IN BRINGUP_TIMELINE* Timeline,
+	IN BRINGUP_PHASE Phase
+);
+
+VOID
+BringUpPhaseEnd(
+	IN BRINGUP_TIMELINE* Timeline,
+	IN BRINGUP_PHASE Phase
+);
+
+VOID
+BringUpEnd(
+	IN BRINGUP_TIMELINE* Timeline
+);
+
+VOID
+BringUpDefaultReadyPolicy(
+	OUT BRINGUP_READY_POLICY* Policy
+);
+
+ULONG
+BringUpNextDelay(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN ULONG DelayInUs
+);
+
+NTSTATUS
+BringUpWaitForReady(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN OPTIONAL const BRINGUP_CLOCK* Clock,
+	IN LONGLONG Since,
+	IN BRINGUP_READY_PROBE* Probe,
+	IN PVOID Context,
+	OUT ULONG* Polls
+);
+
+VOID
+BringUpSimulateReady(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN ULONG ReadyAfterInUs,
+	IN ULONG BusyInUs,
+	OUT ULONG* ElapsedInUs,
+	OUT ULONG* Polls
+);
@@ -0,0 +1,118 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) Bingxing Wang. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		latency.h
+
+	Abstract:
+
+		Contains per-stage touch latency histogram defines and types
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <wdm.h>
+
+//
+// Log-linear histogram layout, values are in microseconds. Values below
+// LATENCY_LINEAR_BUCKETS get a bucket each, every power of two above is
+// split in LATENCY_SUB_BUCKETS buckets, for a worst case error of 1/16.
+//
+#define LATENCY_LINEAR_BUCKETS   32
+#define LATENCY_LINEAR_BITS      5
+#define LATENCY_SUB_BUCKETS      16
+#define LATENCY_SUB_BUCKET_BITS  4
+#define LATENCY_MAX_MAGNITUDE    24
+#define LATENCY_MAX_VALUE_US     ((1UL << LATENCY_MAX_MAGNITUDE) - 1)
+#define LATENCY_BUCKET_COUNT     (LATENCY_LINEAR_BUCKETS + \
+	(LATENCY_MAX_MAGNITUDE - LATENCY_LINEAR_BITS) * LATENCY_SUB_BUCKETS)
+
+//
+// Points in time captured while servicing one touch interrupt
+//
+typedef enum _LATENCY_POINT
+{
+	LatencyPointInterrupt,
+	LatencyPointBusRead,
+	LatencyPointDecoded,
+	LatencyPointSubmit,
+	LatencyPointCompleted,
+	LATENCY_POINT_COUNT
+} LATENCY_POINT;
+
+//
+// Stages measured between the above points
+//
+typedef enum _LATENCY_STAGE
+{
+	LatencyStageBusRead,   // Interrupt to event stack read
+	LatencyStageDecode,    // Event stack read to decoded objects
+	LatencyStageReport,    // Decoded objects to first HID report
+	LatencyStageComplete,  // First HID report to last request completed
+	LatencyStageTotal,     // Interrupt to last request completed
+	LATENCY_STAGE_COUNT
+} LATENCY_STAGE;
+
+typedef struct _LATENCY_STAMPS
+{
+	LONGLONG Points[LATENCY_POINT_COUNT];
+} LATENCY_STAMPS;
+
+typedef struct _LATENCY_HISTOGRAM
+{
+	volatile LONG Buckets[LATENCY_BUCKET_COUNT];
+	volatile LONG Count;
+	volatile LONG MaxInUs;
+} LATENCY_HISTOGRAM;
+
+typedef struct _LATENCY_HISTOGRAMS
+{
+	LONGLONG Frequency;
+	LATENCY_HISTOGRAM Stages[LATENCY_STAGE_COUNT];
+} LATENCY_HISTOGRAMS;
+
+typedef struct _LATENCY_SUMMARY
+{
+	ULONG Count;
+	ULONG P50InUs;
+	ULONG P99InUs;
+	ULONG MaxInUs;
+} LATENCY_SUMMARY;
+
+VOID
+LatencyInitialize(
+	OUT LATENCY_HISTOGRAMS* Histograms
+);
+
+VOID
+LatencyStamp(
+	IN LATENCY_STAMPS* Stamps,
+	IN LATENCY_POINT Point
+);
+
+VOID
+LatencyRecordFrame(
+	IN LATENCY_HISTOGRAMS* Histograms,
+	IN LATENCY_STAMPS* Stamps
+);
+
+VOID
+LatencyQuery(
+	IN LATENCY_HISTOGRAMS* Histograms,
+	OUT LATENCY_SUMMARY* Summaries
+);
+
+VOID
+LatencyReset(
+	IN LATENCY_HISTOGRAMS* Histograms
+);
@@ -27,49 +27,11 @@
 #include <hid.h>
 #include <HidCommon.h>
 #include <spb.h>
+#include <latency.h>
+#include <reportpack.h>
 
-#define MAX_TOUCHES                32
 #define MAX_BUTTONS                3
 
-typedef struct _OBJECT_INFO
-{
-	int x;
-	int y;
-	UCHAR status;
-} OBJECT_INFO;
-
-typedef struct _OBJECT_CACHE
-{
-	OBJECT_INFO Slot[MAX_TOUCHES];
-	UINT32 SlotValid;
-	UINT32 SlotDirty;
-	int DownOrder[MAX_TOUCHES];
-	int DownCount;
-	ULONG64 ScanTime;
-} OBJECT_CACHE;
-
-typedef struct _DETECTED_OBJECT_POSITION
-{
-	int X;
-	int Y;
-} DETECTED_OBJECT_POSITION;
-
-typedef enum _OBJECT_STATE
-{
-	OBJECT_STATE_NOT_PRESENT = 0,
-	OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS = 1,
-	OBJECT_STATE_FINGER_PRESENT_WITH_INACCURATE_POS = 2,
-	OBJECT_STATE_PEN_PRESENT_WITH_TIP = 3,
-	OBJECT_STATE_PEN_PRESENT_WITH_ERASER = 4,
-	OBJECT_STATE_RESERVED = 5
-} OBJECT_STATE;
-
-typedef struct _DETECTED_OBJECTS
-{
-	OBJECT_STATE States[MAX_TOUCHES];
-	DETECTED_OBJECT_POSITION Positions[MAX_TOUCHES];
-} DETECTED_OBJECTS;
-
 typedef struct _BUTTON_CACHE
 {
 	BOOLEAN ButtonSlots[MAX_BUTTONS];
@@ -82,6 +44,13 @@ typedef struct _REPORT_CONTEXT
 	OBJECT_CACHE Cache;
 	TOUCH_SCREEN_PROPERTIES Props;
 	WDFQUEUE PingPongQueue;
+
+	//
+	// Points captured while servicing the current interrupt, and the
+	// histograms they are accounted in once the report completes
+	//
+	LATENCY_STAMPS Latency;
+	LATENCY_HISTOGRAMS* LatencyHistograms;
 } REPORT_CONTEXT, * PREPORT_CONTEXT;
 
 NTSTATUS
@@ -118,6 +87,11 @@ ReportObjects(
 	IN DETECTED_OBJECTS data
 );
 
+VOID
+ReportStopContinuousSimulation(
+	VOID
+);
+
 NTSTATUS
 ReportConfigureContinuousSimulationTimer(
 	IN WDFDEVICE DeviceHandle
@@ -0,0 +1,100 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) Bingxing Wang. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		reportpack.h
+
+	Abstract:
+
+		Contains the decoded touch objects, the cache tracking them
+		between frames and the packing of cached contacts into hid
+		touch reports. None of it touches the device, so it also builds
+		in user mode for the host replay tool.
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#pragma once
+
+#include <Cross Platform Shim/compat.h>
+#include <resolutions.h>
+#include <hid.h>
+
+#define MAX_TOUCHES                32
+#define FINGER_STATUS              0x01 // finger down
+
+typedef struct _OBJECT_INFO
+{
+	int x;
+	int y;
+	UCHAR status;
+} OBJECT_INFO;
+
+typedef struct _OBJECT_CACHE
+{
+	OBJECT_INFO Slot[MAX_TOUCHES];
+	UINT32 SlotValid;
+	UINT32 SlotDirty;
+	int DownOrder[MAX_TOUCHES];
+	int DownCount;
+	ULONG64 ScanTime;
+} OBJECT_CACHE;
+
+typedef struct _DETECTED_OBJECT_POSITION
+{
+	int X;
+	int Y;
+} DETECTED_OBJECT_POSITION;
+
+typedef enum _OBJECT_STATE
+{
+	OBJECT_STATE_NOT_PRESENT = 0,
+	OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS = 1,
+	OBJECT_STATE_FINGER_PRESENT_WITH_INACCURATE_POS = 2,
+	OBJECT_STATE_PEN_PRESENT_WITH_TIP = 3,
+	OBJECT_STATE_PEN_PRESENT_WITH_ERASER = 4,
+	OBJECT_STATE_RESERVED = 5
+} OBJECT_STATE;
+
+typedef struct _DETECTED_OBJECTS
+{
+	OBJECT_STATE States[MAX_TOUCHES];
+	DETECTED_OBJECT_POSITION Positions[MAX_TOUCHES];
+} DETECTED_OBJECTS;
+
+//
+// A finger report carries up to this many contacts, more fingers are
+// sent in hybrid mode over several reports
+//
+#define REPORT_CONTACTS_PER_REPORT 2
+
+VOID
+ReportUpdateLocalObjectCache(
+	IN DETECTED_OBJECTS* Data,
+	IN OBJECT_CACHE* Cache
+);
+
+VOID
+ReportPackContact(
+	IN OBJECT_CACHE* Cache,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN PHID_INPUT_REPORT HidReport,
+	IN int ContactIndex,
+	IN int Slot
+);
+
+int
+ReportPackFingers(
+	IN OBJECT_CACHE* Cache,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN int TouchesReported,
+	OUT PHID_INPUT_REPORT HidReport
+);
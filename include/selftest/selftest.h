@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxflash.h>
 
 //
 // This GUID is used to access the touch self-test virtual device from user-mode
@@ -37,6 +39,27 @@ DEFINE_GUID(GUID_TOUCH_SELFTEST_INTERFACE,
 #define IOCTL_TOUCH_SELFTEST_WRITE          TOUCH_TEST_BUFFER_CTL_CODE(101)
 #define IOCTL_TOUCH_SELFTEST_MODE           TOUCH_TEST_BUFFER_CTL_CODE(102)
 #define IOCTL_TOUCH_SELFTEST_CHANGE_PAGE    TOUCH_TEST_BUFFER_CTL_CODE(103)
+#define IOCTL_TOUCH_SELFTEST_RETRY_STATS    TOUCH_TEST_BUFFER_CTL_CODE(104)
+#define IOCTL_TOUCH_SELFTEST_TRACE_ENABLE   TOUCH_TEST_BUFFER_CTL_CODE(105)
+#define IOCTL_TOUCH_SELFTEST_TRACE_READ     TOUCH_TEST_BUFFER_CTL_CODE(106)
+#define IOCTL_TOUCH_SELFTEST_LATENCY        TOUCH_TEST_BUFFER_CTL_CODE(107)
+#define IOCTL_TOUCH_SELFTEST_CAPTURE_ENABLE TOUCH_TEST_BUFFER_CTL_CODE(108)
+#define IOCTL_TOUCH_SELFTEST_CAPTURE_READ   TOUCH_TEST_BUFFER_CTL_CODE(109)
+#define IOCTL_TOUCH_SELFTEST_REPLAY         TOUCH_TEST_BUFFER_CTL_CODE(110)
+#define IOCTL_TOUCH_SELFTEST_BUS_STATS      TOUCH_TEST_BUFFER_CTL_CODE(111)
+#define IOCTL_TOUCH_SELFTEST_DECODE_BENCH   TOUCH_TEST_BUFFER_CTL_CODE(112)
+#define IOCTL_TOUCH_SELFTEST_FRAME_STATS    TOUCH_TEST_BUFFER_CTL_CODE(113)
+#define IOCTL_TOUCH_SELFTEST_REPORT_RATE    TOUCH_TEST_BUFFER_CTL_CODE(114)
+#define IOCTL_TOUCH_SELFTEST_SCAN_STATS     TOUCH_TEST_BUFFER_CTL_CODE(115)
+#define IOCTL_TOUCH_SELFTEST_SCAN_SCRIPT    TOUCH_TEST_BUFFER_CTL_CODE(116)
+#define IOCTL_TOUCH_SELFTEST_GESTURE_STATS  TOUCH_TEST_BUFFER_CTL_CODE(117)
+#define IOCTL_TOUCH_SELFTEST_FILTER_STATS   TOUCH_TEST_BUFFER_CTL_CODE(118)
+#define IOCTL_TOUCH_SELFTEST_RESUME_STATS   TOUCH_TEST_BUFFER_CTL_CODE(119)
+#define IOCTL_TOUCH_SELFTEST_BRINGUP        TOUCH_TEST_BUFFER_CTL_CODE(120)
+#define IOCTL_TOUCH_SELFTEST_READY_SIMULATE TOUCH_TEST_BUFFER_CTL_CODE(121)
+#define IOCTL_TOUCH_SELFTEST_COMMAND_LISTS  TOUCH_TEST_BUFFER_CTL_CODE(122)
+#define IOCTL_TOUCH_SELFTEST_RETRY_SIMULATE TOUCH_TEST_BUFFER_CTL_CODE(123)
+#define IOCTL_TOUCH_SELFTEST_FLASH_SIMULATE TOUCH_TEST_BUFFER_CTL_CODE(124)
 
 typedef struct _TOUCH_TEST_I2C_HEADER
 {
@@ -45,6 +68,273 @@ typedef struct _TOUCH_TEST_I2C_HEADER
     ULONG RequestedTransferLength;
 } TOUCH_TEST_I2C_HEADER;
 
+typedef struct _TOUCH_TEST_RETRY_COUNTERS
+{
+    ULONG Operations;
+    ULONG Retries;
+    ULONG Exhausted;
+    ULONG FastFails;
+} TOUCH_TEST_RETRY_COUNTERS;
+
+typedef struct _TOUCH_TEST_RETRY_STATS
+{
+    TOUCH_TEST_RETRY_COUNTERS HotPath;
+    TOUCH_TEST_RETRY_COUNTERS BringUp;
+    ULONG BreakerOpen;
+    ULONG BreakerTrips;
+} TOUCH_TEST_RETRY_STATS;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_TRACE_READ, followed by as many Spb
+// trace records as fit in the output buffer, oldest first
+//
+typedef struct _TOUCH_TEST_SPB_TRACE_HEADER
+{
+    ULONG RecordCount;
+    ULONG RecordSize;
+    LONGLONG TimestampFrequency;
+    ULONG RequestCount;
+    ULONG PoolAcquisitions;
+    ULONG PoolAllocations;
+} TOUCH_TEST_SPB_TRACE_HEADER;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_LATENCY, indexed by LATENCY_STAGE. An
+// optional BOOLEAN input set to TRUE clears the histograms after reading.
+//
+typedef struct _TOUCH_TEST_LATENCY_STATS
+{
+    LATENCY_SUMMARY Stages[LATENCY_STAGE_COUNT];
+} TOUCH_TEST_LATENCY_STATS;
+
+//
+// IOCTL_TOUCH_SELFTEST_CAPTURE_ENABLE takes a BOOLEAN and toggles both
+// frame capture and Spb tracing. IOCTL_TOUCH_SELFTEST_CAPTURE_READ
+// returns a capture stream, as described in hxcapture.h, and
+// IOCTL_TOUCH_SELFTEST_REPLAY takes such a stream as input.
+//
+typedef struct _TOUCH_TEST_REPLAY_RESULT
+{
+    HIMAX_CAPTURE_REPLAY_STATS Stats;
+} TOUCH_TEST_REPLAY_RESULT;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_BUS_STATS. LegacyEventReadOperations is
+// what the event stack reads would have cost with burst toggled off and
+// back on around every frame, three bus operations each. BytesSaved is
+// what predicted reads left unread, BytesWasted what mispredicted reads
+// cost before the full frame was read again.
+//
+typedef struct _TOUCH_TEST_BUS_STATS
+{
+    ULONG EventReads;
+    ULONG EventReadTransfers;
+    ULONG LegacyEventReadOperations;
+    ULONG WritesSkipped;
+    ULONG BurstRestores;
+    ULONG PredictedReads;
+    ULONG Mispredictions;
+    ULONG BytesSaved;
+    ULONG BytesWasted;
+} TOUCH_TEST_BUS_STATS;
+
+//
+// IOCTL_TOUCH_SELFTEST_DECODE_BENCH optionally takes a ULONG frame
+// count, then a ULONG seed, and times the decoder of the selected event
+// stack layout against the generic decoder. Without a seed the frames
+// come from a fixed one, reported with the results either way.
+//
+typedef struct _TOUCH_TEST_DECODE_BENCH_RESULT
+{
+    HIMAX_DECODE_BENCHMARK Benchmark;
+} TOUCH_TEST_DECODE_BENCH_RESULT;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_FRAME_STATS, the event stack frames
+// accepted and those discarded, indexed by HIMAX_FRAME_DISCARD
+//
+typedef struct _TOUCH_TEST_FRAME_STATS
+{
+    HIMAX_FRAME_STATS Frames;
+} TOUCH_TEST_FRAME_STATS;
+
+//
+// IOCTL_TOUCH_SELFTEST_REPORT_RATE optionally takes a ULONG rate of 60,
+// 90, 120 or 240 Hz to switch the controller to, and returns the rate
+// in use, 0 for the firmware default, with the rate measured since it
+// was selected. Latency is broken down per rate by clearing the
+// latency histograms after switching.
+//
+typedef struct _TOUCH_TEST_REPORT_RATE
+{
+    ULONG Hz;
+    ULONG Supported;
+    ULONG Changes;
+    ULONG MeasuredMilliHz;
+    ULONG Intervals;
+} TOUCH_TEST_REPORT_RATE;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_SCAN_STATS, the current scan state and
+// the cost of waking from IDLE or DOZE
+//
+typedef struct _TOUCH_TEST_SCAN_STATS
+{
+    ULONG State;
+    ULONG Transitions;
+    HIMAX_SCAN_WAKE_STATS Wake;
+} TOUCH_TEST_SCAN_STATS;
+
+//
+// IOCTL_TOUCH_SELFTEST_SCAN_SCRIPT runs the scan state machine through
+// a script on a virtual clock, without touching the controller, and
+// returns the state and next deadline after each step
+//
+typedef struct _TOUCH_TEST_SCAN_SCRIPT
+{
+    HIMAX_SCAN_POLICY Policy;
+    ULONG Count;
+    HIMAX_SCAN_STEP Steps[HIMAX_SCAN_SCRIPT_MAX_STEPS];
+} TOUCH_TEST_SCAN_SCRIPT;
+
+typedef struct _TOUCH_TEST_SCAN_SCRIPT_RESULT
+{
+    ULONG Count;
+    HIMAX_SCAN_STEP_RESULT Results[HIMAX_SCAN_SCRIPT_MAX_STEPS];
+} TOUCH_TEST_SCAN_SCRIPT_RESULT;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_GESTURE_STATS, the gestures seen in
+// smart wake mode and the time taken to report a wake. Recorded gesture
+// frames are counted by IOCTL_TOUCH_SELFTEST_REPLAY.
+//
+typedef struct _TOUCH_TEST_GESTURE_STATS
+{
+    BOOLEAN Enabled;
+    ULONG DedupWindowMs;
+    ULONG Detected;
+    ULONG Reported;
+    ULONG Suppressed;
+    ULONG Ignored;
+    ULONG LastWakeInUs;
+    ULONG MaxWakeInUs;
+} TOUCH_TEST_GESTURE_STATS;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_FILTER_STATS, the contact filter
+// profile in use and the jitter of the live frames before and after
+// filtering, indexed by HIMAX_FILTER_PROFILE. IOCTL_TOUCH_SELFTEST_REPLAY
+// measures a recorded session against every profile.
+//
+typedef struct _TOUCH_TEST_FILTER_STATS
+{
+    ULONG Profile;
+    BOOLEAN ChargerConnected;
+    ULONG Switches;
+    HIMAX_FILTER_PARAMS Profiles[HimaxFilterProfiles];
+    HIMAX_JITTER_STATS Raw[HimaxFilterProfiles];
+    HIMAX_JITTER_STATS Filtered[HimaxFilterProfiles];
+} TOUCH_TEST_FILTER_STATS;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_RESUME_STATS, the resume timings
+// indexed by HIMAX_RESUME_PATH, how many snapshot replays failed to
+// verify, and the number of registers in the snapshot
+//
+typedef struct _TOUCH_TEST_RESUME_STATS
+{
+    ULONG LastPath;
+    ULONG SnapshotRegisters;
+    ULONG VerifyFailures;
+    HIMAX_RESUME_TIMING Paths[HimaxResumePaths];
+} TOUCH_TEST_RESUME_STATS;
+
+//
+// Output of IOCTL_TOUCH_SELFTEST_BRINGUP, the phases of the last
+// bring-up at prepare hardware
+//
+typedef struct _TOUCH_TEST_BRINGUP
+{
+    BRINGUP_TIMELINE Timeline;
+} TOUCH_TEST_BRINGUP;
+
+//
+// IOCTL_TOUCH_SELFTEST_READY_SIMULATE runs the readiness wait on a
+// virtual clock against simulated chips answering ReadyAfterInUs after
+// reset, with the given policy or the driver's own if it is all zero.
+// ConfigurationInUs of host work is either done after the wait, giving
+// SequentialInUs and SequentialPolls, or while the chip settles, giving
+// ElapsedInUs and Polls, next to the former fixed wait followed by the
+// same work
+//
+#define TOUCH_TEST_READY_SIMULATE_MAX_CHIPS 16
+
+typedef struct _TOUCH_TEST_READY_SIMULATION
+{
+    BRINGUP_READY_POLICY Policy;
+    ULONG ConfigurationInUs;
+    ULONG Count;
+    ULONG ReadyAfterInUs[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+} TOUCH_TEST_READY_SIMULATION;
+
+typedef struct _TOUCH_TEST_READY_SIMULATION_RESULT
+{
+    ULONG Count;
+    ULONG FixedInUs;
+    ULONG SequentialInUs[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+    ULONG SequentialPolls[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+    ULONG ElapsedInUs[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+    ULONG Polls[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+} TOUCH_TEST_READY_SIMULATION_RESULT;
+
+//
+// IOCTL_TOUCH_SELFTEST_COMMAND_LISTS runs every command list the driver
+// builds against a simulated chip next to the per-call sequence it
+// replaced, one entry per HIMAX_COMMAND_LIST_CHECK_ID. Equivalent is set
+// when both put the same bytes on the chip in the same interface state
+//
+typedef struct _TOUCH_TEST_COMMAND_LISTS
+{
+    HIMAX_COMMAND_LIST_CHECK Checks[HimaxCommandListChecks];
+} TOUCH_TEST_COMMAND_LISTS;
+
+//
+// IOCTL_TOUCH_SELFTEST_RETRY_SIMULATE runs Count bus reads through the
+// hot path or bring-up retry policy against a simulated chip failing
+// FailedAttempts of each, on a virtual clock. The result gives the
+// attempts and backoff time of each read, whether the breaker was open
+// after it, and the policy counters and breaker trips
+//
+typedef struct _TOUCH_TEST_RETRY_SIMULATION
+{
+    BOOLEAN HotPath;
+    ULONG Count;
+    ULONG FailedAttempts[HIMAX_RETRY_SIMULATE_MAX_PROBES];
+} TOUCH_TEST_RETRY_SIMULATION;
+
+typedef struct _TOUCH_TEST_RETRY_SIMULATION_RESULT
+{
+    HIMAX_RETRY_SIMULATION_RESULT Simulation;
+} TOUCH_TEST_RETRY_SIMULATION_RESULT;
+
+//
+// IOCTL_TOUCH_SELFTEST_FLASH_SIMULATE programs Length bytes of data drawn
+// from Seed into a simulated flash through the driver's flash code, and
+// returns whether the flash and its CRC read back as expected and the
+// bus sequences, transfers and bytes the programming took next to what
+// it should have
+//
+typedef struct _TOUCH_TEST_FLASH_SIMULATION
+{
+    ULONG Length;
+    ULONG Seed;
+} TOUCH_TEST_FLASH_SIMULATION;
+
+typedef struct _TOUCH_TEST_FLASH_SIMULATION_RESULT
+{
+    HIMAX_FLASH_SIMULATION_RESULT Simulation;
+} TOUCH_TEST_FLASH_SIMULATION_RESULT;
+
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL TchSelfTestOnDeviceControl;
 
 EVT_WDF_DEVICE_FILE_CREATE TchSelfTestOnCreate;
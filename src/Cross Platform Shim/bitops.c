@@ -1,8 +1,10 @@
 /* BitOps Linux Port */
+#ifndef HIMAX_USER_MODE
 #include <wdm.h>
 #include <wdf.h>
-#include <Cross Platform Shim\bitops.h>
-#include <Cross Platform Shim\hweight.h>
+#endif
+#include <Cross Platform Shim/bitops.h>
+#include <Cross Platform Shim/hweight.h>
 
 void bitmap_set(unsigned long *map, unsigned int start, int len)
 {
@@ -45,7 +47,7 @@ static inline unsigned long __ffs(unsigned long word)
 {
 	int num = 0;
 
-#if defined(ARM64) || defined(AMD64)
+#if defined(ARM64) || defined(AMD64) || defined(__LP64__)
 	if ((word & 0xffffffff) == 0) {
 		num += 32;
 		word >>= 32;
@@ -1,7 +1,10 @@
 /* HWeight Linux Port */
+#ifndef HIMAX_USER_MODE
 #include <wdm.h>
 #include <wdf.h>
-#include <Cross Platform Shim\hweight.h>
+#endif
+#include <Cross Platform Shim/compat.h>
+#include <Cross Platform Shim/hweight.h>
 
 
 unsigned int hweight32(unsigned int w)
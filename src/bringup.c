@@ -0,0 +1,418 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		bringup.c
+
+	Abstract:
+
+		Times the phases of bringing the controller up and waits for it
+		to come out of reset by polling it with a bounded backoff. The
+		wait takes its clock as a parameter, so the same wait also runs
+		against a simulated chip on a virtual clock.
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <internal.h>
+#include <bringup.h>
+#include <bringup.tmh>
+
+static
+ULONG
+BringUpElapsedInUs(
+	IN BRINGUP_TIMELINE* Timeline,
+	IN LONGLONG From,
+	IN LONGLONG To
+)
+{
+	return (ULONG)min(
+		(ULONGLONG)(To - From) * 1000000 / (ULONGLONG)Timeline->Frequency,
+		MAXULONG);
+}
+
+VOID
+BringUpBegin(
+	OUT BRINGUP_TIMELINE* Timeline
+)
+/*++
+
+Routine Description:
+
+	Clears the timeline and starts its clock.
+
+Arguments:
+
+	Timeline - The timeline to start
+
+Return Value:
+
+	None
+
+--*/
+{
+	LARGE_INTEGER frequency;
+
+	RtlZeroMemory(Timeline, sizeof(BRINGUP_TIMELINE));
+
+	Timeline->Origin = KeQueryPerformanceCounter(&frequency).QuadPart;
+	Timeline->Frequency = frequency.QuadPart;
+}
+
+VOID
+BringUpPhaseBegin(
+	IN BRINGUP_TIMELINE* Timeline,
+	IN BRINGUP_PHASE Phase
+)
+{
+	Timeline->PhaseStart[Phase] = KeQueryPerformanceCounter(NULL).QuadPart;
+	Timeline->StartInUs[Phase] = BringUpElapsedInUs(
+		Timeline,
+		Timeline->Origin,
+		Timeline->PhaseStart[Phase]);
+}
+
+VOID
+BringUpPhaseEnd(
+	IN BRINGUP_TIMELINE* Timeline,
+	IN BRINGUP_PHASE Phase
+)
+{
+	Timeline->DurationInUs[Phase] = BringUpElapsedInUs(
+		Timeline,
+		Timeline->PhaseStart[Phase],
+		KeQueryPerformanceCounter(NULL).QuadPart);
+}
+
+VOID
+BringUpEnd(
+	IN BRINGUP_TIMELINE* Timeline
+)
+/*++
+
+Routine Description:
+
+	Records the total bring-up time and traces the timeline.
+
+Arguments:
+
+	Timeline - The timeline to close
+
+Return Value:
+
+	None
+
+--*/
+{
+	Timeline->TotalInUs = BringUpElapsedInUs(
+		Timeline,
+		Timeline->Origin,
+		KeQueryPerformanceCounter(NULL).QuadPart);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Bring-up took %d us: reset at %d us for %d us, settle at %d us for %d us in %d polls, configuration at %d us for %d us, firmware at %d us for %d us, start at %d us for %d us",
+		Timeline->TotalInUs,
+		Timeline->StartInUs[BringUpPhaseResetAssert],
+		Timeline->DurationInUs[BringUpPhaseResetAssert],
+		Timeline->StartInUs[BringUpPhaseResetSettle],
+		Timeline->DurationInUs[BringUpPhaseResetSettle],
+		Timeline->ReadyPolls,
+		Timeline->StartInUs[BringUpPhaseConfiguration],
+		Timeline->DurationInUs[BringUpPhaseConfiguration],
+		Timeline->StartInUs[BringUpPhaseFirmware],
+		Timeline->DurationInUs[BringUpPhaseFirmware],
+		Timeline->StartInUs[BringUpPhaseStart],
+		Timeline->DurationInUs[BringUpPhaseStart]);
+}
+
+VOID
+BringUpDefaultReadyPolicy(
+	OUT BRINGUP_READY_POLICY* Policy
+)
+/*++
+
+Routine Description:
+
+	Fills in the readiness policy used after a reset. The former fixed
+	wait becomes the timeout.
+
+Arguments:
+
+	Policy - Receives the policy
+
+Return Value:
+
+	None
+
+--*/
+{
+	Policy->FloorInUs = TOUCH_RESET_READY_FLOOR_TIME;
+	Policy->InitialDelayInUs = TOUCH_READY_POLL_INITIAL_DELAY;
+	Policy->MaxDelayInUs = TOUCH_READY_POLL_MAX_DELAY;
+	Policy->TimeoutInUs = TOUCH_DELAY_TO_COMMUNICATE;
+}
+
+ULONG
+BringUpNextDelay(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN ULONG DelayInUs
+)
+/*++
+
+Routine Description:
+
+	Returns the delay before the probe following one made after
+	DelayInUs.
+
+Arguments:
+
+	Policy - The readiness policy
+	DelayInUs - The last delay, 0 before the first retry
+
+Return Value:
+
+	The next delay in microseconds
+
+--*/
+{
+	if (DelayInUs == 0)
+	{
+		return min(Policy->InitialDelayInUs, Policy->MaxDelayInUs);
+	}
+
+	if (DelayInUs >= Policy->MaxDelayInUs / 2)
+	{
+		return Policy->MaxDelayInUs;
+	}
+
+	return DelayInUs * 2;
+}
+
+static
+ULONG
+BringUpSystemElapsed(
+	IN PVOID Context,
+	IN LONGLONG Since
+)
+{
+	LARGE_INTEGER frequency;
+	LONGLONG now;
+
+	UNREFERENCED_PARAMETER(Context);
+
+	now = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	return (ULONG)min(
+		(ULONGLONG)(now - Since) * 1000000 / (ULONGLONG)frequency.QuadPart,
+		MAXULONG);
+}
+
+static
+VOID
+BringUpSystemDelay(
+	IN PVOID Context,
+	IN ULONG DelayInUs
+)
+{
+	LARGE_INTEGER delay;
+
+	UNREFERENCED_PARAMETER(Context);
+
+	delay.QuadPart = -10 * (LONGLONG)DelayInUs;
+	KeDelayExecutionThread(KernelMode, TRUE, &delay);
+}
+
+static const BRINGUP_CLOCK BringUpSystemClock =
+{
+	BringUpSystemElapsed,
+	BringUpSystemDelay,
+	NULL
+};
+
+NTSTATUS
+BringUpWaitForReady(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN OPTIONAL const BRINGUP_CLOCK* Clock,
+	IN LONGLONG Since,
+	IN BRINGUP_READY_PROBE* Probe,
+	IN PVOID Context,
+	OUT ULONG* Polls
+)
+/*++
+
+Routine Description:
+
+	Waits for the chip to answer after a reset, probing it once the
+	floor has passed and backing off between probes.
+
+Arguments:
+
+	Policy - The readiness policy
+	Clock - The time source, NULL for the system clock
+	Since - When reset was released, a performance counter on the
+	system clock
+	Probe - Probes the chip once
+	Context - Passed to the probe
+	Polls - Receives the number of probes made
+
+Return Value:
+
+	NTSTATUS, STATUS_IO_TIMEOUT if the chip did not answer in time
+
+--*/
+{
+	NTSTATUS status;
+	ULONG elapsedInUs;
+	ULONG delayInUs = 0;
+
+	if (Clock == NULL)
+	{
+		Clock = &BringUpSystemClock;
+	}
+
+	*Polls = 0;
+
+	elapsedInUs = Clock->Elapsed(Clock->Context, Since);
+
+	if (elapsedInUs < Policy->FloorInUs)
+	{
+		Clock->Delay(Clock->Context, Policy->FloorInUs - elapsedInUs);
+	}
+
+	for (;;)
+	{
+		status = Probe(Context);
+		(*Polls)++;
+
+		if (NT_SUCCESS(status))
+		{
+			break;
+		}
+
+		elapsedInUs = Clock->Elapsed(Clock->Context, Since);
+
+		if (elapsedInUs >= Policy->TimeoutInUs)
+		{
+			status = STATUS_IO_TIMEOUT;
+			break;
+		}
+
+		delayInUs = BringUpNextDelay(Policy, delayInUs);
+
+		Clock->Delay(Clock->Context, min(delayInUs, Policy->TimeoutInUs - elapsedInUs));
+	}
+
+	return status;
+}
+
+//
+// A chip that answers once ReadyAfterInUs have passed on a virtual clock
+// counting from the release of reset
+//
+typedef struct _BRINGUP_SIMULATION
+{
+	ULONG NowInUs;
+	ULONG ReadyAfterInUs;
+} BRINGUP_SIMULATION;
+
+static
+ULONG
+BringUpSimulationElapsed(
+	IN PVOID Context,
+	IN LONGLONG Since
+)
+{
+	BRINGUP_SIMULATION* simulation = (BRINGUP_SIMULATION*)Context;
+
+	return simulation->NowInUs - (ULONG)Since;
+}
+
+static
+VOID
+BringUpSimulationDelay(
+	IN PVOID Context,
+	IN ULONG DelayInUs
+)
+{
+	BRINGUP_SIMULATION* simulation = (BRINGUP_SIMULATION*)Context;
+
+	simulation->NowInUs += DelayInUs;
+}
+
+static
+NTSTATUS
+BringUpSimulationProbe(
+	IN PVOID Context
+)
+{
+	BRINGUP_SIMULATION* simulation = (BRINGUP_SIMULATION*)Context;
+
+	if (simulation->NowInUs < simulation->ReadyAfterInUs)
+	{
+		return STATUS_DEVICE_NOT_READY;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+VOID
+BringUpSimulateReady(
+	IN const BRINGUP_READY_POLICY* Policy,
+	IN ULONG ReadyAfterInUs,
+	IN ULONG BusyInUs,
+	OUT ULONG* ElapsedInUs,
+	OUT ULONG* Polls
+)
+/*++
+
+Routine Description:
+
+	Runs the readiness wait on a virtual clock against a chip that
+	answers ReadyAfterInUs after reset, ignoring the cost of a probe.
+	The wait is the one the driver runs, only its clock and probe are
+	simulated.
+
+Arguments:
+
+	Policy - The readiness policy
+	ReadyAfterInUs - When the simulated chip starts answering
+	BusyInUs - Other work done after reset before the wait starts
+	ElapsedInUs - Receives when the wait ends
+	Polls - Receives the number of probes made
+
+Return Value:
+
+	None
+
+--*/
+{
+	BRINGUP_SIMULATION simulation;
+	BRINGUP_CLOCK clock;
+
+	simulation.NowInUs = BusyInUs;
+	simulation.ReadyAfterInUs = ReadyAfterInUs;
+
+	clock.Elapsed = BringUpSimulationElapsed;
+	clock.Delay = BringUpSimulationDelay;
+	clock.Context = &simulation;
+
+	BringUpWaitForReady(
+		Policy,
+		&clock,
+		0,
+		BringUpSimulationProbe,
+		&simulation,
+		Polls);
+
+	*ElapsedInUs = simulation.NowInUs;
+}
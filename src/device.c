@@ -77,6 +77,8 @@ OnInterruptIsr(
     status = STATUS_SUCCESS;
     devContext = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
 
+    LatencyStamp(&devContext->ReportContext.Latency, LatencyPointInterrupt);
+
     //
     // For performance tracing, write an ETW event marker
     //
@@ -317,6 +319,7 @@ OnPrepareHardware(
     ULONG i;
     LARGE_INTEGER delay;
     unsigned char value;
+    BRINGUP_READY_POLICY readyPolicy;
 
     UNREFERENCED_PARAMETER(FxResourcesRaw);
 
@@ -380,6 +383,27 @@ OnPrepareHardware(
         goto exit;
     }
 
+    BringUpBegin(&devContext->BringUp);
+
+    Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Pre SpbTargetInitialize");
+
+    //
+    // Initialize Spb so the driver can issue reads/writes, and poll the
+    // controller as it comes out of reset
+    //
+    status = SpbTargetInitialize(FxDevice, &devContext->I2CContext);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error in Spb initialization - 0x%08lX", 
+            status);
+
+        goto exit;
+    }
+
     if (devContext->HasResetGpio)
     {
         status = OpenIOTarget(devContext, devContext->ResetGpioId, GENERIC_READ | GENERIC_WRITE, &devContext->ResetGpio);
@@ -394,6 +418,8 @@ OnPrepareHardware(
 
         Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Setting reset gpio pin to low");
 
+        BringUpPhaseBegin(&devContext->BringUp, BringUpPhaseResetAssert);
+
         value = 0;
         SetGPIO(devContext->ResetGpio, &value);
 
@@ -402,36 +428,21 @@ OnPrepareHardware(
         delay.QuadPart = -10 * TOUCH_POWER_RAIL_STABLE_TIME;
         KeDelayExecutionThread(KernelMode, TRUE, &delay);
 
+        BringUpPhaseEnd(&devContext->BringUp, BringUpPhaseResetAssert);
+
         Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Setting reset gpio pin to high");
 
+        BringUpPhaseBegin(&devContext->BringUp, BringUpPhaseResetSettle);
+
         value = 1;
         SetGPIO(devContext->ResetGpio, &value);
-
-        Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Waiting...");
-
-        delay.QuadPart = -10 * TOUCH_DELAY_TO_COMMUNICATE;
-        KeDelayExecutionThread(KernelMode, TRUE, &delay);
-
-        Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Done");
     }
 
-    Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Pre SpbTargetInitialize");
-
     //
-    // Initialize Spb so the driver can issue reads/writes
+    // Nothing below touches the controller until it answers, so the host
+    // side of the bring-up runs while it comes out of reset
     //
-    status = SpbTargetInitialize(FxDevice, &devContext->I2CContext);
-
-    if (!NT_SUCCESS(status))
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Error in Spb initialization - 0x%08lX", 
-            status);
-
-        goto exit;
-    }
+    BringUpPhaseBegin(&devContext->BringUp, BringUpPhaseConfiguration);
 
     //
     // Initialize Touch Power so the driver can issue power state changes
@@ -453,6 +464,10 @@ OnPrepareHardware(
     // Get screen properties and populate context
     //
     TchGetScreenProperties(&devContext->ReportContext.Props);
+    TchGetTouchSettings(&devContext->TouchSettings);
+
+    LatencyInitialize(&devContext->Latency);
+    devContext->ReportContext.LatencyHistograms = &devContext->Latency;
 
     //
     // Prepare the hardware for touch scanning
@@ -470,6 +485,13 @@ OnPrepareHardware(
         goto exit;
     }
 
+    TchSetPanelBounds(
+        devContext->TouchContext,
+        devContext->ReportContext.Props.TouchPhysicalWidth,
+        devContext->ReportContext.Props.TouchPhysicalHeight);
+
+    TchApplyTouchSettings(devContext->TouchContext, &devContext->TouchSettings);
+
     //
     // Configure the timer for continuous simulation on synaptics hardware that doesn't support it
     //
@@ -487,20 +509,13 @@ OnPrepareHardware(
     }
 
     //
-    // Start the controller
+    // Power settings are delivered on registration, they are held until
+    // the controller is started
     //
-    status = TchStartDevice(devContext->TouchContext, &devContext->I2CContext);
-
-    if (!NT_SUCCESS(status))
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Error starting touch device - 0x%08lX",
-            status);
-
-        goto exit;
-    }
+    devContext->PowerSettingsStarted = FALSE;
+    devContext->PowerSourcePending = FALSE;
+    devContext->DisplayStatePending = FALSE;
+    devContext->DisplayStateApplied = 1;
 
     status = PoRegisterPowerSettingCallback(
         NULL,
@@ -540,6 +555,97 @@ OnPrepareHardware(
         goto exit;
     }
 
+    BringUpPhaseEnd(&devContext->BringUp, BringUpPhaseConfiguration);
+
+    if (devContext->HasResetGpio)
+    {
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Polling for the controller...");
+
+        //
+        // The floor and the timeout count from the release of reset. A
+        // controller that never answers is still given the rest of the
+        // bring-up, as it was with the former fixed wait.
+        //
+        BringUpDefaultReadyPolicy(&readyPolicy);
+
+        status = BringUpWaitForReady(
+            &readyPolicy,
+            NULL,
+            devContext->BringUp.PhaseStart[BringUpPhaseResetSettle],
+            TchProbeController,
+            &devContext->I2CContext,
+            &devContext->BringUp.ReadyPolls);
+
+        if (!NT_SUCCESS(status))
+        {
+            devContext->BringUp.ReadyTimedOut = TRUE;
+
+            Trace(
+                TRACE_LEVEL_WARNING,
+                TRACE_INIT,
+                "Controller did not answer within %d us of reset - 0x%08lX",
+                readyPolicy.TimeoutInUs,
+                status);
+        }
+
+        BringUpPhaseEnd(&devContext->BringUp, BringUpPhaseResetSettle);
+
+        Trace(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Done");
+    }
+
+    //
+    // Reflash the controller if its firmware differs from the shipped
+    // image, or upload it to the SRAM of a zero flash part. An update
+    // failing before the flash was erased leaves the current firmware
+    // running, any other failure leaves nothing to start.
+    //
+    BringUpPhaseBegin(&devContext->BringUp, BringUpPhaseFirmware);
+
+    status = TchUpdateFirmware(
+        devContext->TouchContext,
+        &devContext->I2CContext,
+        &devContext->TouchSettings);
+
+    BringUpPhaseEnd(&devContext->BringUp, BringUpPhaseFirmware);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error updating touch firmware - 0x%08lX",
+            status);
+
+        goto exit;
+    }
+
+    //
+    // Start the controller
+    //
+    BringUpPhaseBegin(&devContext->BringUp, BringUpPhaseStart);
+
+    status = TchStartDevice(devContext->TouchContext, &devContext->I2CContext);
+
+    BringUpPhaseEnd(&devContext->BringUp, BringUpPhaseStart);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error starting touch device - 0x%08lX",
+            status);
+
+        goto exit;
+    }
+
+    //
+    // Deliver the power source and display state seen while starting
+    //
+    TchStartPowerSettings(devContext);
+
+    BringUpEnd(&devContext->BringUp);
+
 exit:
 
     return status;
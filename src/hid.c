@@ -396,8 +396,8 @@ TchGenerateHidReportDescriptor(
 	devContext = GetDeviceContext(Device);
 
 	touchContext = (HIMAX_CONTROLLER_CONTEXT*)devContext->TouchContext;
-	PUCHAR hidReportDescBuffer = (PUCHAR)ExAllocatePoolWithTag(
-		NonPagedPool,
+	PUCHAR hidReportDescBuffer = (PUCHAR)ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
 		gdwcbReportDescriptor,
 		TOUCH_POOL_TAG
 	);
@@ -0,0 +1,370 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxcapture.c
+
+	Abstract:
+
+		Records raw event stack frames together with the surrounding bus
+		transactions into a versioned stream, and replays such streams
+		on the device through the shared replay in hxreplay.c
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <spb.h>
+#include <report.h>
+#include <hidCommon.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxcapture.h>
+#include <hxcapture.tmh>
+
+VOID
+HimaxCaptureEnable(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN BOOLEAN Enable
+)
+/*++
+
+Routine Description:
+
+	Turns event stack frame capture on or off at runtime.
+
+Arguments:
+
+	Ring - The frame capture ring
+	Enable - Whether frames should be recorded
+
+Return Value:
+
+	None
+
+--*/
+{
+	InterlockedExchange(&Ring->Enabled, Enable ? 1 : 0);
+}
+
+VOID
+HimaxCaptureAppendFrame(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN UINT8* Frame,
+	IN LONGLONG Timestamp
+)
+/*++
+
+Routine Description:
+
+	Records one raw event stack frame, if capture is enabled.
+
+Arguments:
+
+	Ring - The frame capture ring
+	Frame - The Ring->FrameSize bytes read from the event stack
+	Timestamp - Performance counter value at which the frame was read
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_CAPTURE_FRAME* frame;
+	ULONG sequence;
+	ULONG slot;
+
+	if (!Ring->Enabled)
+	{
+		return;
+	}
+
+	sequence = (ULONG)InterlockedIncrement(&Ring->Head) - 1;
+	slot = sequence % HIMAX_CAPTURE_FRAME_COUNT;
+	frame = &Ring->Frames[slot];
+
+	Ring->Guards[slot] = HIMAX_CAPTURE_GUARD_BUSY(sequence);
+	KeMemoryBarrier();
+
+	frame->Sequence = sequence;
+	frame->Timestamp = Timestamp;
+	RtlCopyMemory(frame->Data, Frame, Ring->FrameSize);
+
+	KeMemoryBarrier();
+	Ring->Guards[slot] = HIMAX_CAPTURE_GUARD_STABLE(sequence);
+}
+
+static
+ULONG
+HimaxCaptureSnapshot(
+	IN HIMAX_CAPTURE_RING* Ring,
+	OUT HIMAX_CAPTURE_FRAME* Frames
+)
+/*++
+
+Routine Description:
+
+	Copies the frames held in the ring, oldest first. A slot the ISR
+	overwrites while it is being copied is left out.
+
+Arguments:
+
+	Ring - The capture ring
+	Frames - Receives up to HIMAX_CAPTURE_FRAME_COUNT frames
+
+Return Value:
+
+	The number of frames copied
+
+--*/
+{
+	HIMAX_CAPTURE_FRAME* frame;
+	ULONG head;
+	ULONG sequence;
+	ULONG slot;
+	ULONG count;
+
+	head = (ULONG)Ring->Head;
+	count = 0;
+
+	for (sequence = head - min(head, HIMAX_CAPTURE_FRAME_COUNT); sequence != head; sequence++)
+	{
+		slot = sequence % HIMAX_CAPTURE_FRAME_COUNT;
+		frame = &Ring->Frames[slot];
+
+		if (Ring->Guards[slot] != HIMAX_CAPTURE_GUARD_STABLE(sequence))
+		{
+			continue;
+		}
+
+		KeMemoryBarrier();
+		Frames[count] = *frame;
+		KeMemoryBarrier();
+
+		if (Ring->Guards[slot] == HIMAX_CAPTURE_GUARD_STABLE(sequence))
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+NTSTATUS
+HimaxCaptureWriteStream(
+	IN HIMAX_CAPTURE_RING* Ring,
+	IN SPB_CONTEXT* SpbContext,
+	OUT PVOID Buffer,
+	IN ULONG Length,
+	OUT ULONG* BytesWritten
+)
+/*++
+
+Routine Description:
+
+	Serializes the captured frames and the Spb trace records into a
+	capture stream, merged in timestamp order. When the buffer is too
+	small for everything, the oldest records are dropped.
+
+Arguments:
+
+	Ring - The frame capture ring
+	SpbContext - The Spb context holding the transaction trace
+	Buffer - The buffer to receive the stream
+	Length - The size of the above buffer
+	BytesWritten - The size of the written stream
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HIMAX_CAPTURE_STREAM_HEADER* header;
+	HIMAX_CAPTURE_RECORD_HEADER* record;
+	HIMAX_CAPTURE_FRAME* frames = NULL;
+	SPB_TRACE_RECORD* transfers = NULL;
+	LARGE_INTEGER frequency;
+	ULONG frameCount;
+	ULONG transferCount;
+	ULONG frameIndex;
+	ULONG transferIndex;
+	ULONG recordSize;
+	ULONG available;
+	PUCHAR cursor;
+	BOOLEAN takeFrame;
+
+	*BytesWritten = 0;
+
+	if (Length < sizeof(HIMAX_CAPTURE_STREAM_HEADER))
+	{
+		status = STATUS_BUFFER_TOO_SMALL;
+		goto exit;
+	}
+
+	frames = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
+		sizeof(HIMAX_CAPTURE_FRAME) * HIMAX_CAPTURE_FRAME_COUNT,
+		TOUCH_POOL_TAG_F12);
+
+	transfers = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
+		sizeof(SPB_TRACE_RECORD) * SPB_TRACE_RECORD_COUNT,
+		TOUCH_POOL_TAG_F12);
+
+	if (frames == NULL || transfers == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	frameCount = HimaxCaptureSnapshot(Ring, frames);
+	transferCount = SpbTraceSnapshot(SpbContext, transfers, SPB_TRACE_RECORD_COUNT);
+
+	//
+	// Drop the oldest records until the rest fits in the buffer
+	//
+	available = Length - sizeof(HIMAX_CAPTURE_STREAM_HEADER);
+	frameIndex = 0;
+	transferIndex = 0;
+
+	while ((frameCount - frameIndex) * (sizeof(HIMAX_CAPTURE_RECORD_HEADER) + sizeof(HIMAX_CAPTURE_FRAME)) +
+		(transferCount - transferIndex) * (sizeof(HIMAX_CAPTURE_RECORD_HEADER) + sizeof(SPB_TRACE_RECORD)) >
+		available)
+	{
+		if (transferIndex < transferCount &&
+			(frameIndex == frameCount || transfers[transferIndex].Timestamp <= frames[frameIndex].Timestamp))
+		{
+			transferIndex++;
+		}
+		else
+		{
+			frameIndex++;
+		}
+	}
+
+	KeQueryPerformanceCounter(&frequency);
+
+	header = (HIMAX_CAPTURE_STREAM_HEADER*)Buffer;
+	header->Magic = HIMAX_CAPTURE_MAGIC;
+	header->Version = HIMAX_CAPTURE_VERSION;
+	header->HeaderSize = sizeof(HIMAX_CAPTURE_STREAM_HEADER);
+	header->TimestampFrequency = frequency.QuadPart;
+	header->FrameSize = Ring->FrameSize;
+	header->RecordCount = 0;
+
+	cursor = (PUCHAR)(header + 1);
+
+	while (frameIndex < frameCount || transferIndex < transferCount)
+	{
+		takeFrame = (transferIndex == transferCount) ||
+			(frameIndex < frameCount && frames[frameIndex].Timestamp < transfers[transferIndex].Timestamp);
+
+		record = (HIMAX_CAPTURE_RECORD_HEADER*)cursor;
+
+		if (takeFrame)
+		{
+			recordSize = sizeof(HIMAX_CAPTURE_FRAME);
+			record->Type = HimaxCaptureRecordFrame;
+			RtlCopyMemory(record + 1, &frames[frameIndex++], recordSize);
+		}
+		else
+		{
+			recordSize = sizeof(SPB_TRACE_RECORD);
+			record->Type = HimaxCaptureRecordSpbTransfer;
+			RtlCopyMemory(record + 1, &transfers[transferIndex++], recordSize);
+		}
+
+		record->Length = (USHORT)recordSize;
+		cursor += sizeof(HIMAX_CAPTURE_RECORD_HEADER) + recordSize;
+		header->RecordCount++;
+	}
+
+	*BytesWritten = (ULONG)(cursor - (PUCHAR)Buffer);
+
+exit:
+	if (frames != NULL)
+	{
+		ExFreePoolWithTag(frames, TOUCH_POOL_TAG_F12);
+	}
+
+	if (transfers != NULL)
+	{
+		ExFreePoolWithTag(transfers, TOUCH_POOL_TAG_F12);
+	}
+
+	return status;
+}
+
+NTSTATUS
+HimaxCaptureReplay(
+	IN PREPORT_CONTEXT ReportContext,
+	IN const HIMAX_FILTER_PARAMS* Profiles,
+	IN HIMAX_FILTER_PROFILE Profile,
+	IN PVOID Stream,
+	IN ULONG Length,
+	OUT HIMAX_CAPTURE_REPLAY_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Replays a capture stream on the device with HimaxReplayStream. The
+	replay runs on private scratch state, so the live controller and
+	report contexts are left untouched and no report reaches the hid
+	class driver.
+
+Arguments:
+
+	ReportContext - The live report context, only its screen properties
+		are used for coordinate translation
+	Profiles - The parameters of each filter profile
+	Profile - The profile whose output is reported
+	Stream - The capture stream to replay
+	Length - The size of the above stream
+	Stats - Receives replay counters
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HIMAX_REPLAY* replay;
+
+	RtlZeroMemory(Stats, sizeof(HIMAX_CAPTURE_REPLAY_STATS));
+
+	replay = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
+		sizeof(HIMAX_REPLAY),
+		TOUCH_POOL_TAG_F12);
+
+	if (replay == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	status = HimaxReplayStream(
+		replay,
+		&ReportContext->Props,
+		Profiles,
+		Profile,
+		Stream,
+		Length,
+		Stats);
+
+	ExFreePoolWithTag(replay, TOUCH_POOL_TAG_F12);
+
+exit:
+	return status;
+}
@@ -0,0 +1,789 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxdecode.c
+
+	Abstract:
+
+		Decodes the coordinate slots of event stack frames. Each layout
+		the controller can be configured for gets its own decoder, sized
+		at compile time, which unpacks the coordinates with SIMD where
+		available into a presence mask and then stores only the slots
+		set in it; the layout is selected once at bring-up.
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim/compat.h>
+#include <Cross Platform Shim/bitops.h>
+#ifndef HIMAX_USER_MODE
+#include <controller.h>
+#else
+#define TOUCH_POOL_TAG_F12 0 // Pool tags are not kept in user mode
+#endif
+#include <reportpack.h>
+#include <hx83112/hxdecode.h>
+#ifndef HIMAX_USER_MODE
+#include <hxdecode.tmh>
+#endif
+
+#define HIMAX_DECODE_BENCHMARK_DEFAULT_FRAMES  1024
+#define HIMAX_DECODE_BENCHMARK_MAX_FRAMES      8192
+#define HIMAX_DECODE_BENCHMARK_DEFAULT_SEED    0x48583833
+
+//
+// Coordinates are unpacked four points, one 16 byte load, at a time:
+// the big endian words are byte swapped, range checked against the
+// bounds and reduced to a four bit presence mask. x64 and ARM64 use
+// SSE2 and NEON, other targets the scalar path, which all produce
+// identical results. Each layout's frame is large enough for the loads
+// of its last group.
+//
+#define HIMAX_DECODE_GROUP_POINTS  4
+#define HIMAX_DECODE_GROUPS(n)     (((n) + HIMAX_DECODE_GROUP_POINTS - 1) / HIMAX_DECODE_GROUP_POINTS)
+#define HIMAX_DECODE_POINT_MASK(n) ((1UL << (n)) - 1)
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+
+FORCEINLINE
+ULONG
+HimaxDecodeUnpack(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN ULONG Groups,
+	OUT UINT16* Coords
+)
+{
+	__m128i bounds;
+	__m128i words;
+	__m128i inside;
+	ULONG mask = 0;
+	ULONG g;
+
+	bounds = _mm_set1_epi32((int)((ULONG)Bounds->MaxX | ((ULONG)Bounds->MaxY << 16)));
+
+	for (g = 0; g < Groups; g++)
+	{
+		words = _mm_loadu_si128((const __m128i*)&Frame[16 * g]);
+		words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+		_mm_storeu_si128((__m128i*)&Coords[8 * g], words);
+
+		//
+		// No unsigned 16-bit compare in SSE2, a saturated subtraction
+		// is zero exactly when the word is within its bound
+		//
+		inside = _mm_cmpeq_epi16(_mm_subs_epu16(words, bounds), _mm_setzero_si128());
+		inside = _mm_cmpeq_epi32(inside, _mm_set1_epi32(-1));
+
+		mask |= (ULONG)_mm_movemask_ps(_mm_castsi128_ps(inside)) << (HIMAX_DECODE_GROUP_POINTS * g);
+	}
+
+	return mask;
+}
+
+#elif defined(_M_ARM64)
+#include <arm64_neon.h>
+
+FORCEINLINE
+ULONG
+HimaxDecodeUnpack(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN ULONG Groups,
+	OUT UINT16* Coords
+)
+{
+	static const UINT32 weights[HIMAX_DECODE_GROUP_POINTS] = { 1, 2, 4, 8 };
+	uint16x8_t bounds;
+	uint16x8_t words;
+	uint32x4_t inside;
+	ULONG mask = 0;
+	ULONG g;
+
+	bounds = vreinterpretq_u16_u32(vdupq_n_u32((ULONG)Bounds->MaxX | ((ULONG)Bounds->MaxY << 16)));
+
+	for (g = 0; g < Groups; g++)
+	{
+		words = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(&Frame[16 * g])));
+		vst1q_u16(&Coords[8 * g], words);
+
+		inside = vreinterpretq_u32_u16(vcleq_u16(words, bounds));
+		inside = vceqq_u32(inside, vdupq_n_u32(0xFFFFFFFF));
+
+		mask |= vaddvq_u32(vandq_u32(inside, vld1q_u32(weights))) << (HIMAX_DECODE_GROUP_POINTS * g);
+	}
+
+	return mask;
+}
+
+#else
+
+FORCEINLINE
+ULONG
+HimaxDecodeUnpack(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN ULONG Groups,
+	OUT UINT16* Coords
+)
+{
+	ULONG mask = 0;
+	ULONG i;
+	ULONG x;
+	ULONG y;
+
+	for (i = 0; i < Groups * HIMAX_DECODE_GROUP_POINTS; i++)
+	{
+		x = ((ULONG)Frame[4 * i] << 8) | Frame[4 * i + 1];
+		y = ((ULONG)Frame[4 * i + 2] << 8) | Frame[4 * i + 3];
+
+		Coords[2 * i] = (UINT16)x;
+		Coords[2 * i + 1] = (UINT16)y;
+
+		mask |= ((ULONG)(x <= Bounds->MaxX) & (ULONG)(y <= Bounds->MaxY)) << i;
+	}
+
+	return mask;
+}
+
+#endif
+
+FORCEINLINE
+VOID
+HimaxDecodeStore(
+	IN const UINT16* Coords,
+	IN ULONG Points,
+	IN ULONG Mask,
+	IN OUT DETECTED_OBJECTS* Data
+)
+{
+	unsigned long present = Mask;
+	unsigned long slot;
+
+	//
+	// Only the slots set in the presence mask are visited, a frame
+	// with a single finger costs one store whatever the layout. The
+	// caller zeroed Data, so the empty slots already read as lifted.
+	//
+	for (slot = find_first_bit(&present, Points);
+		slot < Points;
+		slot = find_next_bit(&present, Points, slot + 1))
+	{
+		Data->States[slot] = OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS;
+		Data->Positions[slot].X = Coords[2 * slot];
+		Data->Positions[slot].Y = Coords[2 * slot + 1];
+	}
+}
+
+static
+ULONG
+HimaxDecodeSlots5(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+)
+{
+	UINT16 coords[2 * HIMAX_DECODE_GROUP_POINTS * HIMAX_DECODE_GROUPS(5)];
+	ULONG mask;
+
+	mask = HimaxDecodeUnpack(Bounds, Frame, HIMAX_DECODE_GROUPS(5), coords) & HIMAX_DECODE_POINT_MASK(5);
+
+	HimaxDecodeStore(coords, 5, mask, Data);
+
+	return mask;
+}
+
+static
+ULONG
+HimaxDecodeSlots10(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+)
+{
+	UINT16 coords[2 * HIMAX_DECODE_GROUP_POINTS * HIMAX_DECODE_GROUPS(10)];
+	ULONG mask;
+
+	mask = HimaxDecodeUnpack(Bounds, Frame, HIMAX_DECODE_GROUPS(10), coords) & HIMAX_DECODE_POINT_MASK(10);
+
+	HimaxDecodeStore(coords, 10, mask, Data);
+
+	return mask;
+}
+
+static
+ULONG
+HimaxDecodeSlots20(
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+)
+{
+	UINT16 coords[2 * HIMAX_DECODE_GROUP_POINTS * HIMAX_DECODE_GROUPS(20)];
+	ULONG mask;
+
+	mask = HimaxDecodeUnpack(Bounds, Frame, HIMAX_DECODE_GROUPS(20), coords) & HIMAX_DECODE_POINT_MASK(20);
+
+	HimaxDecodeStore(coords, 20, mask, Data);
+
+	return mask;
+}
+
+C_ASSERT(HIMAX_LAYOUT_FRAME_SIZE(5) >= 16 * HIMAX_DECODE_GROUPS(5));
+C_ASSERT(HIMAX_LAYOUT_FRAME_SIZE(10) >= 16 * HIMAX_DECODE_GROUPS(10));
+C_ASSERT(HIMAX_LAYOUT_FRAME_SIZE(20) >= 16 * HIMAX_DECODE_GROUPS(20));
+
+#define HIMAX_EVENT_LAYOUT_ENTRY(n, Decoder) \
+	{ (n), HIMAX_LAYOUT_FRAME_SIZE(n), HIMAX_LAYOUT_COORD_SIZE(n), HIMAX_LAYOUT_INFO_OFFSET(n), (Decoder) }
+
+static const HIMAX_EVENT_LAYOUT gHimaxEventLayouts[] =
+{
+	HIMAX_EVENT_LAYOUT_ENTRY(5, HimaxDecodeSlots5),
+	HIMAX_EVENT_LAYOUT_ENTRY(10, HimaxDecodeSlots10),
+	HIMAX_EVENT_LAYOUT_ENTRY(20, HimaxDecodeSlots20),
+};
+
+C_ASSERT(HIMAX_LAYOUT_FRAME_SIZE(HIMAX_EVENT_STACK_DEFAULT_POINTS) == 56);
+
+const HIMAX_EVENT_LAYOUT*
+HimaxDecodeGetLayout(
+	IN ULONG MaxPoints
+)
+/*++
+
+Routine Description:
+
+	Looks up the event stack layout for a touch point count.
+
+Arguments:
+
+	MaxPoints - The number of touch points the firmware reports
+
+Return Value:
+
+	The layout, or NULL if the point count is not supported
+
+--*/
+{
+	ULONG i;
+
+	for (i = 0; i < ARRAYSIZE(gHimaxEventLayouts); i++)
+	{
+		if (gHimaxEventLayouts[i].MaxPoints == MaxPoints)
+		{
+			return &gHimaxEventLayouts[i];
+		}
+	}
+
+	return NULL;
+}
+
+const HIMAX_EVENT_LAYOUT*
+HimaxDecodeGetLayoutByFrameSize(
+	IN ULONG FrameSize
+)
+/*++
+
+Routine Description:
+
+	Looks up the event stack layout whose frames are FrameSize bytes,
+	used to decode captured frames.
+
+Arguments:
+
+	FrameSize - The size of an event stack frame
+
+Return Value:
+
+	The layout, or NULL if no layout has frames of that size
+
+--*/
+{
+	ULONG i;
+
+	for (i = 0; i < ARRAYSIZE(gHimaxEventLayouts); i++)
+	{
+		if (gHimaxEventLayouts[i].FrameSize == FrameSize)
+		{
+			return &gHimaxEventLayouts[i];
+		}
+	}
+
+	return NULL;
+}
+
+HIMAX_FRAME_DISCARD
+HimaxDecodeValidateFrame(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const UINT8* Frame
+)
+/*++
+
+Routine Description:
+
+	Checks the integrity of a raw event stack frame before anything in
+	it is trusted: the checksum, the ESD and reset fill patterns and the
+	range of the finger count.
+
+Arguments:
+
+	Layout - The event stack layout
+	Frame - The raw event stack frame
+
+Return Value:
+
+	HimaxFrameValid, or the reason the frame must be discarded
+
+--*/
+{
+	ULONG sum = 0;
+	ULONG zeroes = 0;
+	ULONG esd = 0;
+	ULONG i;
+
+	for (i = 0; i < Layout->FrameSize; i++)
+	{
+		sum += Frame[i];
+		zeroes += (Frame[i] == 0);
+		esd += (Frame[i] == HIMAX_FRAME_ESD_PATTERN);
+	}
+
+	if (zeroes == Layout->FrameSize)
+	{
+		return HimaxFrameDiscardAllZero;
+	}
+
+	if (esd == Layout->FrameSize)
+	{
+		return HimaxFrameDiscardEsd;
+	}
+
+	if ((sum & 0xFF) != 0)
+	{
+		return HimaxFrameDiscardChecksum;
+	}
+
+	if (HimaxDecodeFingerCount(Layout, Frame) > Layout->MaxPoints)
+	{
+		return HimaxFrameDiscardFingerCount;
+	}
+
+	return HimaxFrameValid;
+}
+
+ULONG
+HimaxDecodeFingerCount(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const UINT8* Frame
+)
+/*++
+
+Routine Description:
+
+	Returns the number of fingers a frame reports.
+
+Arguments:
+
+	Layout - The event stack layout
+	Frame - The raw event stack frame
+
+Return Value:
+
+	The finger count
+
+--*/
+{
+	if (Frame[Layout->InfoOffset] == HIMAX_FRAME_NO_FINGERS)
+	{
+		return 0;
+	}
+
+	return Frame[Layout->InfoOffset] & 0x0f;
+}
+
+UINT8
+HimaxDecodeGesture(
+	IN const UINT8* Frame,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Decodes the gesture a frame read in smart wake mode reports.
+
+Arguments:
+
+	Frame - The raw event stack frame
+	Length - The size of the frame
+
+Return Value:
+
+	The gesture ID, or HIMAX_GESTURE_NONE if the frame is not a gesture
+
+--*/
+{
+	ULONG i;
+
+	if (Length < HIMAX_GESTURE_ID_LENGTH + HIMAX_GESTURE_HEADER_LENGTH ||
+		Frame[0] == HIMAX_GESTURE_NONE ||
+		Frame[0] == 0xFF)
+	{
+		return HIMAX_GESTURE_NONE;
+	}
+
+	for (i = 1; i < HIMAX_GESTURE_ID_LENGTH; i++)
+	{
+		if (Frame[i] != Frame[0])
+		{
+			return HIMAX_GESTURE_NONE;
+		}
+	}
+
+	if (Frame[HIMAX_GESTURE_ID_LENGTH] != HIMAX_GESTURE_HEADER_0 ||
+		Frame[HIMAX_GESTURE_ID_LENGTH + 1] != HIMAX_GESTURE_HEADER_1)
+	{
+		return HIMAX_GESTURE_NONE;
+	}
+
+	return Frame[0];
+}
+
+ULONG
+HimaxDecodeSlotsGeneric(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN OUT DETECTED_OBJECTS* Data
+)
+/*++
+
+Routine Description:
+
+	Decodes the coordinate slots of a frame of any layout, one slot at
+	a time. Serves as the reference the specialized decoders are
+	measured and checked against.
+
+Arguments:
+
+	Layout - The event stack layout
+	Bounds - The panel bounds
+	Frame - The raw event stack frame
+	Data - Receives the decoded slots, zeroed by the caller
+
+Return Value:
+
+	The mask of slots holding a finger
+
+--*/
+{
+	ULONG mask = 0;
+	ULONG i;
+	int x;
+	int y;
+
+	for (i = 0; i < Layout->MaxPoints; i++)
+	{
+		x = (int)Frame[4 * i] << 8 | (int)Frame[4 * i + 1];
+		y = (int)Frame[4 * i + 2] << 8 | (int)Frame[4 * i + 3];
+
+		if (x >= 0 && x <= Bounds->MaxX && y >= 0 && y <= Bounds->MaxY)
+		{
+			Data->States[i] = OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS;
+			Data->Positions[i].X = x;
+			Data->Positions[i].Y = y;
+			mask |= 1UL << i;
+		}
+	}
+
+	return mask;
+}
+
+NTSTATUS
+HimaxDecodeFrame(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN const UINT8* Frame,
+	IN ULONG Length,
+	IN OUT DETECTED_OBJECTS* Data,
+	OUT ULONG* Mask,
+	OUT ULONG* FingerCount
+)
+/*++
+
+Routine Description:
+
+	Decodes the touch slots of a validated frame and checks them against
+	the finger count it reports.
+
+Arguments:
+
+	Layout - The event stack layout
+	Bounds - The panel bounds
+	Frame - The raw event stack frame, FrameSize bytes long
+	Length - The number of bytes read, less than the frame size for a
+	         predicted read, with the remaining slots filled as empty
+	Data - Receives the decoded slots, zeroed by the caller
+	Mask - Receives the mask of slots holding a finger
+	FingerCount - Receives the number of fingers the frame reports
+
+Return Value:
+
+	STATUS_DATA_ERROR when more slots hold a finger than the frame
+	reports, STATUS_SUCCESS otherwise
+
+--*/
+{
+	unsigned long mask = 0;
+	ULONG fingerNum;
+
+	if (Length < Layout->FrameSize)
+	{
+		//
+		// A predicted read stops short of the info bytes, the presence
+		// mask is all there is to go on
+		//
+		mask = Layout->DecodeSlots(Bounds, Frame, Data);
+		fingerNum = (ULONG)bitmap_weight(&mask, Layout->MaxPoints);
+	}
+	else
+	{
+		fingerNum = HimaxDecodeFingerCount(Layout, Frame);
+
+		//
+		// A frame reporting no fingers is all lifts, Data was zeroed by
+		// the caller so there are no slots to visit
+		//
+		if (fingerNum != 0)
+		{
+			mask = Layout->DecodeSlots(Bounds, Frame, Data);
+		}
+	}
+
+	*Mask = (ULONG)mask;
+	*FingerCount = fingerNum;
+
+	//
+	// Slots holding more fingers than the frame reports are stale or
+	// corrupt coordinates that would turn into phantom contacts
+	//
+	if ((ULONG)bitmap_weight(&mask, Layout->MaxPoints) > fingerNum)
+	{
+		return STATUS_DATA_ERROR;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+static
+UINT16
+HimaxDecodeBenchmarkCoordinate(
+	IN OUT ULONG* Seed,
+	IN UINT16 Max
+)
+{
+	//
+	// Mostly coordinates on the panel, with the values either side of
+	// the bound and the empty slot marker mixed in
+	//
+	switch (RtlRandomEx(Seed) % 8)
+	{
+	case 0:
+		return Max;
+	case 1:
+		return (UINT16)(Max + 1);
+	case 2:
+		return 0xFFFF;
+	case 3:
+		return (UINT16)RtlRandomEx(Seed);
+	default:
+		return (UINT16)(RtlRandomEx(Seed) % ((ULONG)Max + 1));
+	}
+}
+
+static
+VOID
+HimaxDecodeBenchmarkFill(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	OUT UINT8* Frames,
+	IN ULONG Count,
+	IN ULONG Seed
+)
+{
+	UINT8* frame;
+	ULONG seed;
+	ULONG f;
+	ULONG i;
+	UINT16 x;
+	UINT16 y;
+
+	seed = Seed;
+
+	for (f = 0; f < Count; f++)
+	{
+		frame = &Frames[f * Layout->FrameSize];
+
+		RtlFillMemory(frame, Layout->FrameSize, 0xFF);
+
+		for (i = 0; i < Layout->MaxPoints; i++)
+		{
+			x = HimaxDecodeBenchmarkCoordinate(&seed, Bounds->MaxX);
+			y = HimaxDecodeBenchmarkCoordinate(&seed, Bounds->MaxY);
+
+			frame[4 * i] = (UINT8)(x >> 8);
+			frame[4 * i + 1] = (UINT8)x;
+			frame[4 * i + 2] = (UINT8)(y >> 8);
+			frame[4 * i + 3] = (UINT8)y;
+		}
+	}
+}
+
+NTSTATUS
+HimaxDecodeBenchmark(
+	IN const HIMAX_EVENT_LAYOUT* Layout,
+	IN const HIMAX_DECODE_BOUNDS* Bounds,
+	IN ULONG Frames,
+	IN ULONG Seed,
+	OUT HIMAX_DECODE_BENCHMARK* Result
+)
+/*++
+
+Routine Description:
+
+	Times the specialized decoder of a layout against the generic one
+	over randomized frames, after checking both decode every frame
+	identically. This is what keeps the SIMD unpacking bit-exact with
+	the scalar path. The frames only depend on the seed, so a mismatch
+	reproduces by running again with the seed reported.
+
+Arguments:
+
+	Layout - The event stack layout
+	Bounds - The panel bounds
+	Frames - The number of frames to decode, 0 selects a default
+	Seed - Seeds the frame generator, 0 selects a fixed default
+	Result - Receives the timings and the seed used
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	UINT8* frames = NULL;
+	DETECTED_OBJECTS generic;
+	DETECTED_OBJECTS specialized;
+	LARGE_INTEGER frequency;
+	LONGLONG start;
+	LONGLONG genericTicks;
+	LONGLONG specializedTicks;
+	ULONG genericMask;
+	ULONG specializedMask;
+	ULONG f;
+
+	RtlZeroMemory(Result, sizeof(HIMAX_DECODE_BENCHMARK));
+
+	if (Frames == 0)
+	{
+		Frames = HIMAX_DECODE_BENCHMARK_DEFAULT_FRAMES;
+	}
+
+	Frames = min(Frames, HIMAX_DECODE_BENCHMARK_MAX_FRAMES);
+
+	if (Seed == 0)
+	{
+		Seed = HIMAX_DECODE_BENCHMARK_DEFAULT_SEED;
+	}
+
+	Result->Seed = Seed;
+
+	frames = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED,
+		Frames * Layout->FrameSize,
+		TOUCH_POOL_TAG_F12);
+
+	if (frames == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	HimaxDecodeBenchmarkFill(Layout, Bounds, frames, Frames, Seed);
+
+	for (f = 0; f < Frames; f++)
+	{
+		RtlZeroMemory(&generic, sizeof(generic));
+		RtlZeroMemory(&specialized, sizeof(specialized));
+
+		genericMask = HimaxDecodeSlotsGeneric(Layout, Bounds, &frames[f * Layout->FrameSize], &generic);
+		specializedMask = Layout->DecodeSlots(Bounds, &frames[f * Layout->FrameSize], &specialized);
+
+		if (genericMask != specializedMask ||
+			RtlCompareMemory(&generic, &specialized, sizeof(generic)) != sizeof(generic))
+		{
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_SAMPLES,
+				"%d point decoder differs from the generic decoder on frame %d of seed %08X",
+				Layout->MaxPoints,
+				f,
+				Seed);
+
+			status = STATUS_DATA_ERROR;
+			goto exit;
+		}
+	}
+
+	start = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	for (f = 0; f < Frames; f++)
+	{
+		RtlZeroMemory(&generic, sizeof(generic));
+		HimaxDecodeSlotsGeneric(Layout, Bounds, &frames[f * Layout->FrameSize], &generic);
+	}
+
+	genericTicks = KeQueryPerformanceCounter(NULL).QuadPart - start;
+	start = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	for (f = 0; f < Frames; f++)
+	{
+		RtlZeroMemory(&specialized, sizeof(specialized));
+		Layout->DecodeSlots(Bounds, &frames[f * Layout->FrameSize], &specialized);
+	}
+
+	specializedTicks = KeQueryPerformanceCounter(NULL).QuadPart - start;
+
+	Result->MaxPoints = Layout->MaxPoints;
+	Result->Frames = Frames;
+	Result->GenericNsPerFrame = (ULONG)((ULONGLONG)genericTicks * 1000000000 / (ULONGLONG)frequency.QuadPart / Frames);
+	Result->SpecializedNsPerFrame = (ULONG)((ULONGLONG)specializedTicks * 1000000000 / (ULONGLONG)frequency.QuadPart / Frames);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_SAMPLES,
+		"%d point decode: generic %d ns, specialized %d ns per frame over %d frames of seed %08X",
+		Result->MaxPoints,
+		Result->GenericNsPerFrame,
+		Result->SpecializedNsPerFrame,
+		Result->Frames,
+		Result->Seed);
+
+exit:
+	if (frames != NULL)
+	{
+		ExFreePoolWithTag(frames, TOUCH_POOL_TAG_F12);
+	}
+
+	return status;
+}
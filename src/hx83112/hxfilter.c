@@ -0,0 +1,203 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxfilter.c
+
+	Abstract:
+
+		Filters the contacts of decoded frames with a deadband and a
+		touch down debounce, and measures the jitter left in a stream
+		of frames. Nothing here touches the controller, so recorded
+		sessions can be run through every profile.
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim/compat.h>
+#ifndef HIMAX_USER_MODE
+#include <internal.h>
+#endif
+#include <reportpack.h>
+#include <hx83112/hxfilter.h>
+#ifndef HIMAX_USER_MODE
+#include <hxfilter.tmh>
+#endif
+
+static
+int
+HimaxFilterAxis(
+	IN int Last,
+	IN int Raw,
+	IN int Deadband
+)
+{
+	if (Raw - Last > Deadband)
+	{
+		return Raw - Deadband;
+	}
+
+	if (Last - Raw > Deadband)
+	{
+		return Raw + Deadband;
+	}
+
+	return Last;
+}
+
+VOID
+HimaxFilterReset(
+	OUT HIMAX_FILTER* Filter,
+	IN const HIMAX_FILTER_PARAMS* Params
+)
+/*++
+
+Routine Description:
+
+	Forgets every contact and selects the filter parameters.
+
+Arguments:
+
+	Filter - The filter
+	Params - The parameters of the profile to apply
+
+Return Value:
+
+	None
+
+--*/
+{
+	RtlZeroMemory(Filter, sizeof(HIMAX_FILTER));
+	Filter->Params = *Params;
+}
+
+VOID
+HimaxFilterObjects(
+	IN OUT HIMAX_FILTER* Filter,
+	IN OUT DETECTED_OBJECTS* Data,
+	IN OUT HIMAX_JITTER_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Filters a decoded frame in place, holding back new contacts until
+	they are debounced and keeping reported contacts still within the
+	deadband.
+
+Arguments:
+
+	Filter - The filter
+	Data - The decoded frame
+	Stats - Counts the phantom contacts dropped
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_FILTER_SLOT* slot;
+	int deadband;
+	ULONG i;
+
+	deadband = (int)Filter->Params.Deadband;
+
+	for (i = 0; i < MAX_TOUCHES; i++)
+	{
+		slot = &Filter->Slots[i];
+
+		if (Data->States[i] == OBJECT_STATE_NOT_PRESENT)
+		{
+			if (slot->Frames != 0 && !slot->Reported)
+			{
+				Stats->Phantoms++;
+			}
+
+			slot->Frames = 0;
+			slot->Reported = FALSE;
+			continue;
+		}
+
+		if (slot->Frames != MAXULONG)
+		{
+			slot->Frames++;
+		}
+
+		if (!slot->Reported)
+		{
+			if (slot->Frames <= Filter->Params.DebounceFrames)
+			{
+				Data->States[i] = OBJECT_STATE_NOT_PRESENT;
+				continue;
+			}
+
+			slot->Reported = TRUE;
+			slot->Last = Data->Positions[i];
+			continue;
+		}
+
+		slot->Last.X = HimaxFilterAxis(slot->Last.X, Data->Positions[i].X, deadband);
+		slot->Last.Y = HimaxFilterAxis(slot->Last.Y, Data->Positions[i].Y, deadband);
+
+		Data->Positions[i] = slot->Last;
+	}
+}
+
+VOID
+HimaxFilterMeasure(
+	IN const DETECTED_OBJECTS* Previous,
+	IN const DETECTED_OBJECTS* Current,
+	IN OUT HIMAX_JITTER_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Accounts for the movement of the contacts present in both frames.
+
+Arguments:
+
+	Previous - The frame before
+	Current - The frame to measure
+	Stats - Receives the movement
+
+Return Value:
+
+	None
+
+--*/
+{
+	ULONG step;
+	ULONG i;
+
+	Stats->Frames++;
+
+	for (i = 0; i < MAX_TOUCHES; i++)
+	{
+		if (Previous->States[i] == OBJECT_STATE_NOT_PRESENT ||
+			Current->States[i] == OBJECT_STATE_NOT_PRESENT)
+		{
+			continue;
+		}
+
+		Stats->HeldContacts++;
+
+		step = (ULONG)abs(Current->Positions[i].X - Previous->Positions[i].X) +
+			(ULONG)abs(Current->Positions[i].Y - Previous->Positions[i].Y);
+
+		if (step != 0)
+		{
+			Stats->Moves++;
+			Stats->Displacement += step;
+			Stats->MaxStep = max(Stats->MaxStep, step);
+		}
+	}
+}
@@ -0,0 +1,756 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxfirmware.c
+
+	Abstract:
+
+		Keeps the controller firmware in sync with the image shipped with
+		the driver. The flash is only touched when the controller's CRC of
+		its content differs from the image, and then only in the sectors
+		that differ.
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxflash.h>
+#include <hx83112/hxfirmware.h>
+#include <hxfirmware.tmh>
+
+NTSTATUS
+HimaxFirmwareLoad(
+	OUT UINT8** Image,
+	OUT ULONG* Length
+)
+/*++
+
+Routine Description:
+
+	Reads the firmware image into a pool allocation the caller frees.
+
+Arguments:
+
+	Image - Receives the image
+	Length - Receives the size of the image
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	UNICODE_STRING path;
+	OBJECT_ATTRIBUTES attributes;
+	IO_STATUS_BLOCK ioStatus;
+	FILE_STANDARD_INFORMATION information;
+	HANDLE file = NULL;
+	UINT8* image = NULL;
+	ULONG length;
+
+	*Image = NULL;
+	*Length = 0;
+
+	RtlInitUnicodeString(&path, HIMAX_FIRMWARE_PATH);
+
+	InitializeObjectAttributes(
+		&attributes,
+		&path,
+		OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+		NULL,
+		NULL);
+
+	status = ZwOpenFile(
+		&file,
+		GENERIC_READ | SYNCHRONIZE,
+		&attributes,
+		&ioStatus,
+		FILE_SHARE_READ,
+		FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE);
+
+	if (!NT_SUCCESS(status))
+	{
+		file = NULL;
+		goto exit;
+	}
+
+	status = ZwQueryInformationFile(
+		file,
+		&ioStatus,
+		&information,
+		sizeof(information),
+		FileStandardInformation);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	if (information.EndOfFile.QuadPart == 0 ||
+		information.EndOfFile.QuadPart > HIMAX_FIRMWARE_MAX_SIZE ||
+		(information.EndOfFile.QuadPart & 3) != 0)
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Invalid firmware image size %I64d",
+			information.EndOfFile.QuadPart);
+
+		status = STATUS_INVALID_IMAGE_FORMAT;
+		goto exit;
+	}
+
+	length = (ULONG)information.EndOfFile.QuadPart;
+
+	image = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED,
+		length,
+		TOUCH_POOL_TAG_F12);
+
+	if (image == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	status = ZwReadFile(
+		file,
+		NULL,
+		NULL,
+		NULL,
+		&ioStatus,
+		image,
+		length,
+		NULL,
+		NULL);
+
+	if (!NT_SUCCESS(status) || ioStatus.Information != length)
+	{
+		status = NT_SUCCESS(status) ? STATUS_END_OF_FILE : status;
+		goto exit;
+	}
+
+	*Image = image;
+	*Length = length;
+	image = NULL;
+
+exit:
+	if (image != NULL)
+	{
+		ExFreePoolWithTag(image, TOUCH_POOL_TAG_F12);
+	}
+
+	if (file != NULL)
+	{
+		ZwClose(file);
+	}
+
+	return status;
+}
+
+NTSTATUS
+HimaxFirmwareUpdate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN PTOUCH_SCREEN_SETTINGS TouchSettings,
+	OUT BOOLEAN* FlashModified
+)
+/*++
+
+Routine Description:
+
+	Compares the firmware image against the flash content using the
+	controller's CRC engine and reprograms the sectors that differ.
+	An up to date controller costs a single CRC computation. Enabled by
+	any of the ReprogramFw00..03 settings, the panel vendor slot is not
+	detected. ForceFlash reprograms every sector regardless of the CRC.
+	Once an erase has started, a failure leaves the controller stopped
+	in safe mode rather than booting it from a partly written flash.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	TouchSettings - The registry touch settings
+	FlashModified - Receives TRUE if the flash was erased or programmed
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	NTSTATUS resetStatus;
+	HIMAX_FLASH_STATS stats;
+	HIMAX_FLASH_STATS sectorStats;
+	UINT8* image = NULL;
+	ULONG length;
+	ULONG offset;
+	ULONG sectorLength;
+	ULONG sectorsFlashed;
+	UINT32 imageCrc;
+	UINT32 flashCrc;
+	BOOLEAN safeMode = FALSE;
+	BOOLEAN force;
+
+	*FlashModified = FALSE;
+
+	force = TouchSettings->ForceFlash != 0;
+
+	if (!force &&
+		TouchSettings->ReprogramFw00 == 0 &&
+		TouchSettings->ReprogramFw01 == 0 &&
+		TouchSettings->ReprogramFw02 == 0 &&
+		TouchSettings->ReprogramFw03 == 0)
+	{
+		status = STATUS_SUCCESS;
+		goto exit;
+	}
+
+	status = HimaxFirmwareLoad(&image, &length);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Could not load firmware image - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+	imageCrc = HimaxFlashCrc32c(image, length);
+
+	status = HimaxMCUInterfaceOn(ControllerContext, SpbContext);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxMCUSenseOff(ControllerContext, SpbContext);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	safeMode = TRUE;
+
+	if (!force)
+	{
+		status = HimaxFlashHwCrc(ControllerContext, SpbContext, 0, length, &flashCrc);
+		if (!NT_SUCCESS(status)) goto exit;
+
+		if (flashCrc == imageCrc)
+		{
+			Trace(
+				TRACE_LEVEL_INFORMATION,
+				TRACE_INIT,
+				"Firmware up to date, CRC %08X",
+				flashCrc);
+
+			goto exit;
+		}
+
+		Trace(
+			TRACE_LEVEL_INFORMATION,
+			TRACE_INIT,
+			"Firmware CRC %08X differs from image CRC %08X",
+			flashCrc,
+			imageCrc);
+	}
+
+	RtlZeroMemory(&stats, sizeof(stats));
+	sectorsFlashed = 0;
+
+	for (offset = 0; offset < length; offset += HIMAX_FLASH_SECTOR_SIZE)
+	{
+		sectorLength = min(length - offset, HIMAX_FLASH_SECTOR_SIZE);
+
+		if (!force)
+		{
+			status = HimaxFlashHwCrc(ControllerContext, SpbContext, offset, sectorLength, &flashCrc);
+			if (!NT_SUCCESS(status)) goto exit;
+
+			if (flashCrc == HimaxFlashCrc32c(&image[offset], sectorLength))
+			{
+				continue;
+			}
+		}
+
+		*FlashModified = TRUE;
+
+		status = HimaxFlashProgram(
+			ControllerContext,
+			SpbContext,
+			offset,
+			&image[offset],
+			sectorLength,
+			&sectorStats);
+
+		if (!NT_SUCCESS(status)) goto exit;
+
+		stats.SectorsErased += sectorStats.SectorsErased;
+		stats.PagesProgrammed += sectorStats.PagesProgrammed;
+		stats.PagesSkipped += sectorStats.PagesSkipped;
+		stats.ElapsedInUs += sectorStats.ElapsedInUs;
+		sectorsFlashed++;
+	}
+
+	status = HimaxFlashHwCrc(ControllerContext, SpbContext, 0, length, &flashCrc);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	if (flashCrc != imageCrc)
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Firmware CRC %08X after update, expected %08X",
+			flashCrc,
+			imageCrc);
+
+		status = STATUS_DEVICE_DATA_ERROR;
+		goto exit;
+	}
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Firmware updated, %d sectors reflashed, %d pages in %d us",
+		sectorsFlashed,
+		stats.PagesProgrammed,
+		stats.ElapsedInUs);
+
+exit:
+	//
+	// The reset leaves safe mode and boots the firmware from flash, which
+	// is not done when the flash was left half written
+	//
+	if (safeMode && !NT_SUCCESS(status) && *FlashModified)
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Firmware update failed after erasing, controller left stopped - 0x%08lX",
+			status);
+	}
+	else if (safeMode)
+	{
+		resetStatus = HimaxMCUSystemReset(ControllerContext, SpbContext);
+
+		if (NT_SUCCESS(status))
+		{
+			status = resetStatus;
+		}
+	}
+
+	if (image != NULL)
+	{
+		ExFreePoolWithTag(image, TOUCH_POOL_TAG_F12);
+	}
+
+	return status;
+}
+
+static
+ULONG
+HimaxZeroFlashElapsedUs(
+	IN LONGLONG Start,
+	IN LONGLONG Frequency
+)
+{
+	return (ULONG)min(
+		(ULONGLONG)(KeQueryPerformanceCounter(NULL).QuadPart - Start) * 1000000 /
+			(ULONGLONG)Frequency,
+		MAXULONG);
+}
+
+static
+NTSTATUS
+HimaxZeroFlashLoadImage(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+	Reads the firmware image into the controller context and computes
+	the CRC of each verify block.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_ZERO_FLASH* zeroFlash;
+	ULONG offset;
+	ULONG block;
+
+	zeroFlash = &ControllerContext->ZeroFlash;
+
+	status = HimaxFirmwareLoad(&zeroFlash->Image, &zeroFlash->Length);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Could not load zero flash firmware image - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+	for (offset = 0, block = 0; offset < zeroFlash->Length; offset += HIMAX_ZERO_FLASH_BLOCK_SIZE, block++)
+	{
+		zeroFlash->BlockCrc[block] = HimaxFlashCrc32c(
+			&zeroFlash->Image[offset],
+			min(zeroFlash->Length - offset, HIMAX_ZERO_FLASH_BLOCK_SIZE));
+	}
+
+exit:
+	return status;
+}
+
+static
+NTSTATUS
+HimaxZeroFlashWriteBlock(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG Block
+)
+/*++
+
+Routine Description:
+
+	Streams one verify block of the image to SRAM. The AHB address
+	auto-increments across each write, so every chunk is a single bus
+	transfer.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Block - The index of the verify block
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_ZERO_FLASH* zeroFlash;
+	ULONG offset;
+	ULONG end;
+	ULONG chunk;
+
+	zeroFlash = &ControllerContext->ZeroFlash;
+	offset = Block * HIMAX_ZERO_FLASH_BLOCK_SIZE;
+	end = min(zeroFlash->Length, offset + HIMAX_ZERO_FLASH_BLOCK_SIZE);
+
+	status = HimaxMCUBurstEnable(ControllerContext, SpbContext, 1);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	for (; offset < end; offset += chunk)
+	{
+		chunk = min(end - offset, HIMAX_ZERO_FLASH_CHUNK_SIZE);
+
+		status = HimaxMCUFlashWriteBurstLength(
+			ControllerContext,
+			SpbContext,
+			HIMAX_ZERO_FLASH_SRAM_ADDRESS + offset,
+			&zeroFlash->Image[offset],
+			chunk);
+
+		if (!NT_SUCCESS(status)) goto exit;
+	}
+
+exit:
+	return status;
+}
+
+static
+NTSTATUS
+HimaxZeroFlashVerifyBlock(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG Block,
+	IN OUT HIMAX_ZERO_FLASH_TIMING* Timing
+)
+/*++
+
+Routine Description:
+
+	Collects the CRC the engine computed over a block written earlier
+	and rewrites the block if it does not match the image. Time spent
+	waiting for the engine and on rewrites counts as verify time.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Block - The index of the verify block whose CRC is running
+	Timing - The timing of the current upload
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_ZERO_FLASH* zeroFlash;
+	LARGE_INTEGER frequency;
+	LONGLONG start;
+	ULONG offset;
+	ULONG retries;
+	UINT32 sramCrc;
+
+	zeroFlash = &ControllerContext->ZeroFlash;
+	offset = Block * HIMAX_ZERO_FLASH_BLOCK_SIZE;
+	start = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	status = HimaxFlashHwCrcResult(ControllerContext, SpbContext, &sramCrc);
+
+	for (retries = 0; NT_SUCCESS(status) && sramCrc != zeroFlash->BlockCrc[Block]; retries++)
+	{
+		if (retries >= HIMAX_ZERO_FLASH_RETRIES)
+		{
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_INIT,
+				"SRAM block %d CRC %08X, expected %08X",
+				Block,
+				sramCrc,
+				zeroFlash->BlockCrc[Block]);
+
+			status = STATUS_DEVICE_DATA_ERROR;
+			break;
+		}
+
+		Timing->BlocksRetried++;
+
+		status = HimaxZeroFlashWriteBlock(ControllerContext, SpbContext, Block);
+		if (!NT_SUCCESS(status)) break;
+
+		status = HimaxFlashHwCrc(
+			ControllerContext,
+			SpbContext,
+			HIMAX_ZERO_FLASH_SRAM_ADDRESS + offset,
+			min(zeroFlash->Length - offset, HIMAX_ZERO_FLASH_BLOCK_SIZE),
+			&sramCrc);
+	}
+
+	Timing->VerifyWaitInUs += HimaxZeroFlashElapsedUs(start, frequency.QuadPart);
+
+	return status;
+}
+
+NTSTATUS
+HimaxZeroFlashUpload(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN BOOLEAN Resume
+)
+/*++
+
+Routine Description:
+
+	Downloads the firmware image to the SRAM of a zero flash part and
+	boots it. The image is read from disk once and kept for resume.
+	The CRC engine checks each block while the next one is written, so
+	verification mostly overlaps the upload; only a block that fails
+	its CRC is written again.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Resume - TRUE when the SRAM was lost across D3, selects which
+	timing record the upload updates
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_ZERO_FLASH* zeroFlash;
+	HIMAX_ZERO_FLASH_TIMING timing;
+	LARGE_INTEGER frequency;
+	LONGLONG begin;
+	LONGLONG start;
+	ULONG blocks;
+	ULONG block;
+	ULONG offset;
+	UINT8 tmp[FOUR_BYTE_DATA_SZ];
+	BOOLEAN safeMode = FALSE;
+
+	zeroFlash = &ControllerContext->ZeroFlash;
+	RtlZeroMemory(&timing, sizeof(timing));
+
+	begin = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	if (zeroFlash->Image == NULL)
+	{
+		status = HimaxZeroFlashLoadImage(ControllerContext);
+		if (!NT_SUCCESS(status)) goto exit;
+	}
+
+	timing.LoadInUs = HimaxZeroFlashElapsedUs(begin, frequency.QuadPart);
+
+	start = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	status = HimaxMCUInterfaceOn(ControllerContext, SpbContext);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxMCUSenseOff(ControllerContext, SpbContext);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	safeMode = TRUE;
+	timing.SafeModeInUs = HimaxZeroFlashElapsedUs(start, frequency.QuadPart);
+
+	blocks = (zeroFlash->Length + HIMAX_ZERO_FLASH_BLOCK_SIZE - 1) / HIMAX_ZERO_FLASH_BLOCK_SIZE;
+
+	for (block = 0; block < blocks; block++)
+	{
+		offset = block * HIMAX_ZERO_FLASH_BLOCK_SIZE;
+		start = KeQueryPerformanceCounter(NULL).QuadPart;
+
+		status = HimaxZeroFlashWriteBlock(ControllerContext, SpbContext, block);
+
+		timing.UploadInUs += HimaxZeroFlashElapsedUs(start, frequency.QuadPart);
+
+		if (!NT_SUCCESS(status)) goto exit;
+
+		//
+		// The previous block's CRC ran while this block was written
+		//
+		if (block > 0)
+		{
+			status = HimaxZeroFlashVerifyBlock(ControllerContext, SpbContext, block - 1, &timing);
+			if (!NT_SUCCESS(status)) goto exit;
+		}
+
+		status = HimaxFlashHwCrcStart(
+			ControllerContext,
+			SpbContext,
+			HIMAX_ZERO_FLASH_SRAM_ADDRESS + offset,
+			min(zeroFlash->Length - offset, HIMAX_ZERO_FLASH_BLOCK_SIZE));
+
+		if (!NT_SUCCESS(status)) goto exit;
+	}
+
+	status = HimaxZeroFlashVerifyBlock(ControllerContext, SpbContext, blocks - 1, &timing);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	//
+	// With the reload from flash disabled, the reset boots the image
+	// now held in SRAM
+	//
+	start = KeQueryPerformanceCounter(NULL).QuadPart;
+
+	tmp[0] = (UINT8)(HIMAX_ZERO_FLASH_RELOAD_DISABLE & 0xff);
+	tmp[1] = (UINT8)((HIMAX_ZERO_FLASH_RELOAD_DISABLE >> 8) & 0xff);
+	tmp[2] = (UINT8)((HIMAX_ZERO_FLASH_RELOAD_DISABLE >> 16) & 0xff);
+	tmp[3] = (UINT8)((HIMAX_ZERO_FLASH_RELOAD_DISABLE >> 24) & 0xff);
+
+	status = HimaxMCURegisterWrite(ControllerContext, SpbContext, HIMAX_ZERO_FLASH_RELOAD_ADDRESS, tmp, FOUR_BYTE_DATA_SZ, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	safeMode = FALSE;
+
+	status = HimaxMCUSenseOn(ControllerContext, SpbContext, 0x00);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	timing.StartInUs = HimaxZeroFlashElapsedUs(start, frequency.QuadPart);
+
+exit:
+	if (safeMode)
+	{
+		HimaxMCUSystemReset(ControllerContext, SpbContext);
+	}
+
+	timing.TotalInUs = HimaxZeroFlashElapsedUs(begin, frequency.QuadPart);
+
+	if (Resume)
+	{
+		zeroFlash->Resume = timing;
+	}
+	else
+	{
+		zeroFlash->ColdBoot = timing;
+	}
+
+	if (NT_SUCCESS(status))
+	{
+		zeroFlash->Uploads++;
+
+		Trace(
+			TRACE_LEVEL_INFORMATION,
+			TRACE_INIT,
+			"Zero flash %s upload of %d bytes in %d us: load %d, safe mode %d, write %d, verify %d, start %d, %d blocks retried",
+			Resume ? "resume" : "cold boot",
+			zeroFlash->Length,
+			timing.TotalInUs,
+			timing.LoadInUs,
+			timing.SafeModeInUs,
+			timing.UploadInUs,
+			timing.VerifyWaitInUs,
+			timing.StartInUs,
+			timing.BlocksRetried);
+	}
+	else
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Zero flash upload failed after %d us - 0x%08lX",
+			timing.TotalInUs,
+			status);
+	}
+
+	return status;
+}
+
+VOID
+HimaxZeroFlashRelease(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+	Frees the cached zero flash image.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+
+Return Value:
+
+	None
+
+--*/
+{
+	if (ControllerContext->ZeroFlash.Image != NULL)
+	{
+		ExFreePoolWithTag(ControllerContext->ZeroFlash.Image, TOUCH_POOL_TAG_F12);
+		ControllerContext->ZeroFlash.Image = NULL;
+		ControllerContext->ZeroFlash.Length = 0;
+	}
+}
@@ -0,0 +1,1085 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxflash.c
+
+	Abstract:
+
+		Programs the controller's SPI flash through the SPI200 master.
+		Every erase, page program and status poll is chained into as few
+		SPB sequences as possible.
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxflash.h>
+#include <hx83112/hxsim.h>
+#include <hxflash.tmh>
+
+#define HIMAX_FLASH_REGISTER_WRITE_SIZE 8
+
+//
+// An AHB register write is the 4 byte register address followed by the
+// 4 byte value, written to the AHB address register in a single transfer
+//
+typedef struct _HIMAX_FLASH_SEQUENCE
+{
+	SPB_TRANSFER Transfers[SPB_MAX_SEQUENCE_TRANSFERS];
+	UINT8 Registers[SPB_MAX_SEQUENCE_TRANSFERS][HIMAX_FLASH_REGISTER_WRITE_SIZE];
+	ULONG Count;
+} HIMAX_FLASH_SEQUENCE;
+
+static
+VOID
+HimaxFlashPutAddress(
+	OUT UINT8* Buffer,
+	IN UINT32 Value
+)
+/*++
+
+Routine Description:
+
+	Stores a 32-bit AHB address or value, least significant byte first.
+
+Arguments:
+
+	Buffer - Receives the 4 bytes
+	Value - The address or value to store
+
+Return Value:
+
+	None
+
+--*/
+{
+	Buffer[0] = (UINT8)(Value & 0xff);
+	Buffer[1] = (UINT8)((Value >> 8) & 0xff);
+	Buffer[2] = (UINT8)((Value >> 16) & 0xff);
+	Buffer[3] = (UINT8)((Value >> 24) & 0xff);
+}
+
+static
+VOID
+HimaxFlashSequenceAppend(
+	IN HIMAX_FLASH_SEQUENCE* Sequence,
+	IN BOOLEAN Read,
+	IN UINT8 Command,
+	IN UINT8* Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Appends a bus transfer to the sequence. The caller makes sure the
+	sequence has room for it.
+
+Arguments:
+
+	Sequence - The sequence being built
+	Read - TRUE to read from the bus register, FALSE to write to it
+	Command - The bus register
+	Data - The buffer to transfer, valid until the sequence is submitted
+	Length - The size of the above buffer
+
+Return Value:
+
+	None
+
+--*/
+{
+	SPB_TRANSFER* transfer = &Sequence->Transfers[Sequence->Count++];
+
+	transfer->Read = Read;
+	transfer->Address = Command;
+	transfer->Data = Data;
+	transfer->Length = Length;
+	transfer->DelayInUs = 0;
+}
+
+static
+VOID
+HimaxFlashSequenceRegister(
+	IN HIMAX_FLASH_SEQUENCE* Sequence,
+	IN UINT32 Register,
+	IN UINT32 Value
+)
+/*++
+
+Routine Description:
+
+	Appends an AHB register write to the sequence, staging the address
+	and value in the sequence's own buffers.
+
+Arguments:
+
+	Sequence - The sequence being built
+	Register - The AHB register to write
+	Value - The value to write
+
+Return Value:
+
+	None
+
+--*/
+{
+	UINT8* buffer = Sequence->Registers[Sequence->Count];
+
+	HimaxFlashPutAddress(&buffer[0], Register);
+	HimaxFlashPutAddress(&buffer[4], Value);
+
+	// ic_adr_ahb_addr_byte_0
+	HimaxFlashSequenceAppend(Sequence, FALSE, 0x00, buffer, HIMAX_FLASH_REGISTER_WRITE_SIZE);
+}
+
+static
+NTSTATUS
+HimaxFlashSequenceSubmit(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN HIMAX_FLASH_SEQUENCE* Sequence,
+	IN OUT HIMAX_FLASH_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Runs the sequence as one SPB sequence, then empties it. The cached
+	bus register state is updated with what was written, or dropped if
+	the sequence failed.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Sequence - The sequence to run
+	Stats - Flash statistics to update
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	SPB_TRANSFER* transfer;
+	ULONG i;
+
+	status = HimaxBusExecuteSequence(
+		SpbContext,
+		Sequence->Transfers,
+		Sequence->Count,
+		&ControllerContext->BringUpRetry);
+
+	if (!NT_SUCCESS(status))
+	{
+		HimaxInvalidateBusState(ControllerContext);
+		goto exit;
+	}
+
+	for (i = 0; i < Sequence->Count; i++)
+	{
+		transfer = &Sequence->Transfers[i];
+
+		if (!transfer->Read)
+		{
+			HimaxBusStateWritten(ControllerContext, transfer->Address, (UINT8*)transfer->Data, transfer->Length);
+		}
+	}
+
+	Stats->Sequences++;
+
+exit:
+	Sequence->Count = 0;
+	return status;
+}
+
+static
+VOID
+HimaxFlashSequenceWriteEnable(
+	IN HIMAX_FLASH_SEQUENCE* Sequence
+)
+/*++
+
+Routine Description:
+
+	Appends the register writes issuing a flash write enable command,
+	needed before every erase and page program.
+
+Arguments:
+
+	Sequence - The sequence being built
+
+Return Value:
+
+	None
+
+--*/
+{
+	HimaxFlashSequenceRegister(Sequence, HIMAX_FLASH_SPI200_TRANS_FMT, HIMAX_FLASH_TRANS_FMT);
+	HimaxFlashSequenceRegister(Sequence, HIMAX_FLASH_SPI200_TRANS_CTRL, HIMAX_FLASH_CTRL_WRITE_ENABLE);
+	HimaxFlashSequenceRegister(Sequence, HIMAX_FLASH_SPI200_CMD, HIMAX_FLASH_CMD_WRITE_ENABLE);
+}
+
+static
+NTSTATUS
+HimaxFlashWaitReady(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG TimeoutInUs,
+	IN ULONG PollInUs,
+	IN OUT HIMAX_FLASH_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Polls the flash status register until the write in progress bit
+	clears. Each poll issues the read status command and reads back the
+	SPI200 data register in one SPB sequence.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	TimeoutInUs - How long the flash may stay busy
+	PollInUs - The wait between two polls
+	Stats - Flash statistics to update
+
+Return Value:
+
+	NTSTATUS, STATUS_IO_TIMEOUT if the flash stayed busy
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_FLASH_SEQUENCE sequence;
+	LARGE_INTEGER frequency;
+	LONGLONG start;
+	LONGLONG deadline;
+	UINT8 address[FOUR_BYTE_ADDR_SZ];
+	UINT8 direction = 0x00; // ic_cmd_ahb_access_direction_read
+	UINT8 flashStatus[FOUR_BYTE_DATA_SZ];
+
+	start = KeQueryPerformanceCounter(&frequency).QuadPart;
+	deadline = start + (LONGLONG)TimeoutInUs * frequency.QuadPart / 1000000;
+
+	HimaxFlashPutAddress(address, HIMAX_FLASH_SPI200_DATA);
+	sequence.Count = 0;
+
+	for (;;)
+	{
+		HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_TRANS_CTRL, HIMAX_FLASH_CTRL_READ_STATUS);
+		HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_CMD, HIMAX_FLASH_CMD_READ_STATUS);
+
+		// ic_adr_ahb_addr_byte_0, ic_cmd_ahb_access_direction, ic_adr_ahb_rdata_byte_0
+		HimaxFlashSequenceAppend(&sequence, FALSE, 0x00, address, sizeof(address));
+		HimaxFlashSequenceAppend(&sequence, FALSE, 0x0c, &direction, sizeof(direction));
+		HimaxFlashSequenceAppend(&sequence, TRUE, 0x08, flashStatus, sizeof(flashStatus));
+
+		status = HimaxFlashSequenceSubmit(ControllerContext, SpbContext, &sequence, Stats);
+		if (!NT_SUCCESS(status)) goto exit;
+
+		Stats->StatusPolls++;
+
+		if ((flashStatus[0] & HIMAX_FLASH_STATUS_WIP) == 0)
+		{
+			break;
+		}
+
+		if (KeQueryPerformanceCounter(NULL).QuadPart >= deadline)
+		{
+			Trace(
+				TRACE_LEVEL_ERROR,
+				TRACE_INIT,
+				"Flash still busy after %d us",
+				TimeoutInUs);
+
+			status = STATUS_IO_TIMEOUT;
+			goto exit;
+		}
+
+		HimaxDelay(PollInUs);
+	}
+
+exit:
+	return status;
+}
+
+NTSTATUS
+HimaxFlashEraseSector(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN OUT HIMAX_FLASH_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Erases the flash sector holding the given address.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Address - A flash address within the sector to erase
+	Stats - Flash statistics to update
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_FLASH_SEQUENCE sequence;
+
+	status = HimaxMCUBurstEnable(ControllerContext, SpbContext, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	sequence.Count = 0;
+
+	HimaxFlashSequenceWriteEnable(&sequence);
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_TRANS_CTRL, HIMAX_FLASH_CTRL_ERASE);
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_ADDR, Address & ~(HIMAX_FLASH_SECTOR_SIZE - 1));
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_CMD, HIMAX_FLASH_CMD_BLOCK_ERASE);
+
+	status = HimaxFlashSequenceSubmit(ControllerContext, SpbContext, &sequence, Stats);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxFlashWaitReady(
+		ControllerContext,
+		SpbContext,
+		HIMAX_FLASH_ERASE_TIMEOUT_US,
+		HIMAX_FLASH_ERASE_POLL_US,
+		Stats);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	Stats->SectorsErased++;
+
+exit:
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Error erasing flash sector 0x%08X - 0x%08lX",
+			Address,
+			status);
+	}
+
+	return status;
+}
+
+NTSTATUS
+HimaxFlashProgramPage(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN UINT8* Data,
+	IN ULONG Length,
+	IN OUT HIMAX_FLASH_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Programs one flash page. Pages shorter than HIMAX_FLASH_PAGE_SIZE
+	are padded with 0xFF, which leaves the erased bytes untouched. The
+	page takes two SPB sequences plus the status polls.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Address - The page aligned flash address to program
+	Data - The data to program
+	Length - The amount of bytes to program, at most a page
+	Stats - Flash statistics to update
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_FLASH_SEQUENCE sequence;
+	UINT8 chunks[HIMAX_FLASH_FIFO_CHUNKS][FOUR_BYTE_ADDR_SZ + HIMAX_FLASH_FIFO_CHUNK];
+	ULONG offset;
+	ULONG chunk;
+	ULONG i;
+
+	if ((Address & (HIMAX_FLASH_PAGE_SIZE - 1)) != 0 ||
+		Length == 0 ||
+		Length > HIMAX_FLASH_PAGE_SIZE)
+	{
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	status = HimaxMCUBurstEnable(ControllerContext, SpbContext, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	sequence.Count = 0;
+
+	HimaxFlashSequenceWriteEnable(&sequence);
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_TRANS_CTRL, HIMAX_FLASH_CTRL_PAGE_PROGRAM);
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_ADDR, Address);
+
+	//
+	// Stage the FIFO chunks, each prefixed with the data register address.
+	// The FIFO is primed with the first chunk before the program command
+	// is issued, the other chunks follow it.
+	//
+	for (i = 0, offset = 0; i < HIMAX_FLASH_FIFO_CHUNKS; i++, offset += chunk)
+	{
+		chunk = (i == 0) ? HIMAX_FLASH_FIFO_FIRST_CHUNK : HIMAX_FLASH_FIFO_CHUNK;
+
+		HimaxFlashPutAddress(chunks[i], HIMAX_FLASH_SPI200_DATA);
+
+		if (offset + chunk <= Length)
+		{
+			RtlCopyMemory(&chunks[i][FOUR_BYTE_ADDR_SZ], &Data[offset], chunk);
+		}
+		else
+		{
+			RtlFillMemory(&chunks[i][FOUR_BYTE_ADDR_SZ], chunk, 0xFF);
+
+			if (offset < Length)
+			{
+				RtlCopyMemory(&chunks[i][FOUR_BYTE_ADDR_SZ], &Data[offset], Length - offset);
+			}
+		}
+
+		if (sequence.Count == SPB_MAX_SEQUENCE_TRANSFERS)
+		{
+			status = HimaxFlashSequenceSubmit(ControllerContext, SpbContext, &sequence, Stats);
+			if (!NT_SUCCESS(status)) goto exit;
+		}
+
+		// ic_adr_ahb_addr_byte_0
+		HimaxFlashSequenceAppend(&sequence, FALSE, 0x00, chunks[i], FOUR_BYTE_ADDR_SZ + chunk);
+
+		if (i == 0)
+		{
+			HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_SPI200_CMD, HIMAX_FLASH_CMD_PAGE_PROGRAM);
+		}
+	}
+
+	status = HimaxFlashSequenceSubmit(ControllerContext, SpbContext, &sequence, Stats);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxFlashWaitReady(
+		ControllerContext,
+		SpbContext,
+		HIMAX_FLASH_PROGRAM_TIMEOUT_US,
+		HIMAX_FLASH_PROGRAM_POLL_US,
+		Stats);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	Stats->PagesProgrammed++;
+
+exit:
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Error programming flash page 0x%08X - 0x%08lX",
+			Address,
+			status);
+	}
+
+	return status;
+}
+
+static
+BOOLEAN
+HimaxFlashPageIsErased(
+	IN UINT8* Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Tells whether a page holds only 0xFF, the content of erased flash.
+
+Arguments:
+
+	Data - The page data
+	Length - The size of the page data
+
+Return Value:
+
+	TRUE if programming the page can be skipped
+
+--*/
+{
+	ULONG i;
+
+	for (i = 0; i < Length; i++)
+	{
+		if (Data[i] != 0xFF)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+NTSTATUS
+HimaxFlashProgram(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN UINT8* Data,
+	IN ULONG Length,
+	OUT HIMAX_FLASH_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Erases every sector the range touches, then programs it page by
+	page. Pages that are all 0xFF are left erased. The controller must
+	be held in safe mode by the caller.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Address - The sector aligned flash address to program
+	Data - The data to program
+	Length - The amount of bytes to program
+	Stats - Receives flash statistics, including throughput
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	LARGE_INTEGER frequency;
+	LONGLONG start;
+	ULONG offset;
+	ULONG chunk;
+
+	RtlZeroMemory(Stats, sizeof(HIMAX_FLASH_STATS));
+
+	if ((Address & (HIMAX_FLASH_SECTOR_SIZE - 1)) != 0)
+	{
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	start = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	for (offset = 0; offset < Length; offset += HIMAX_FLASH_SECTOR_SIZE)
+	{
+		status = HimaxFlashEraseSector(ControllerContext, SpbContext, Address + offset, Stats);
+		if (!NT_SUCCESS(status)) goto exit;
+	}
+
+	for (offset = 0; offset < Length; offset += chunk)
+	{
+		chunk = min(Length - offset, HIMAX_FLASH_PAGE_SIZE);
+
+		if (HimaxFlashPageIsErased(&Data[offset], chunk))
+		{
+			Stats->PagesSkipped++;
+			continue;
+		}
+
+		status = HimaxFlashProgramPage(ControllerContext, SpbContext, Address + offset, &Data[offset], chunk, Stats);
+		if (!NT_SUCCESS(status)) goto exit;
+	}
+
+	Stats->ElapsedInUs = (ULONG)min(
+		(ULONGLONG)(KeQueryPerformanceCounter(NULL).QuadPart - start) * 1000000 /
+			(ULONGLONG)frequency.QuadPart,
+		MAXULONG);
+
+	if (Stats->ElapsedInUs != 0)
+	{
+		Stats->KBytesPerSecond = (ULONG)((ULONGLONG)Length * 1000000 / 1024 / Stats->ElapsedInUs);
+	}
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Flashed %d bytes in %d us (%d KB/s), %d sectors, %d pages, %d skipped, %d sequences, %d polls",
+		Length,
+		Stats->ElapsedInUs,
+		Stats->KBytesPerSecond,
+		Stats->SectorsErased,
+		Stats->PagesProgrammed,
+		Stats->PagesSkipped,
+		Stats->Sequences,
+		Stats->StatusPolls);
+
+exit:
+	return status;
+}
+
+UINT32
+HimaxFlashCrc32c(
+	IN UINT8* Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Computes the CRC of a buffer the way the controller's CRC engine
+	does: reflected CRC-32C, seeded with all ones and without a final
+	inversion.
+
+Arguments:
+
+	Data - The buffer to checksum
+	Length - The size of the above buffer, a multiple of 4
+
+Return Value:
+
+	The CRC
+
+--*/
+{
+	UINT32 crc = 0xFFFFFFFF;
+	ULONG i;
+	ULONG bit;
+
+	for (i = 0; i < Length; i++)
+	{
+		crc ^= Data[i];
+
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ HIMAX_FLASH_CRC_POLYNOMIAL : (crc >> 1);
+		}
+	}
+
+	return crc;
+}
+
+NTSTATUS
+HimaxFlashHwCrcStart(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Starts the controller's CRC engine over a range without waiting for
+	the result, so the caller can keep the bus busy in the meantime.
+	The controller must be held in safe mode by the caller.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Address - The address the range starts at
+	Length - The size of the range, a multiple of 4
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_FLASH_SEQUENCE sequence;
+	HIMAX_FLASH_STATS stats;
+
+	if ((Length & 3) != 0 || (Length >> 2) > 0xFFFF)
+	{
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	RtlZeroMemory(&stats, sizeof(stats));
+
+	status = HimaxMCUBurstEnable(ControllerContext, SpbContext, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	sequence.Count = 0;
+
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_CRC_ADDRESS, Address);
+	HimaxFlashSequenceRegister(&sequence, HIMAX_FLASH_CRC_COMMAND, HIMAX_FLASH_CRC_START | (Length >> 2));
+
+	status = HimaxFlashSequenceSubmit(ControllerContext, SpbContext, &sequence, &stats);
+
+exit:
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Error starting CRC at 0x%08X - 0x%08lX",
+			Address,
+			status);
+	}
+
+	return status;
+}
+
+NTSTATUS
+HimaxFlashHwCrcResult(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	OUT UINT32* Crc
+)
+/*++
+
+Routine Description:
+
+	Waits for the CRC started by HimaxFlashHwCrcStart and reads it.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Crc - Receives the CRC
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	UINT8 tmp[FOUR_BYTE_DATA_SZ];
+	ULONG polls;
+
+	status = HimaxMCUBurstEnable(ControllerContext, SpbContext, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	for (polls = 0; ; polls++)
+	{
+		status = HimaxMCURegisterRead(ControllerContext, SpbContext, HIMAX_FLASH_CRC_STATUS, tmp, FOUR_BYTE_DATA_SZ, 0);
+		if (!NT_SUCCESS(status)) goto exit;
+
+		if ((tmp[0] & HIMAX_FLASH_CRC_BUSY) == 0)
+		{
+			break;
+		}
+
+		if (polls >= HIMAX_FLASH_CRC_POLL_LIMIT)
+		{
+			status = STATUS_IO_TIMEOUT;
+			goto exit;
+		}
+
+		HimaxDelay(HIMAX_FLASH_CRC_POLL_US);
+	}
+
+	status = HimaxMCURegisterRead(ControllerContext, SpbContext, HIMAX_FLASH_CRC_RESULT, tmp, FOUR_BYTE_DATA_SZ, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	*Crc = (UINT32)tmp[0] | ((UINT32)tmp[1] << 8) | ((UINT32)tmp[2] << 16) | ((UINT32)tmp[3] << 24);
+
+exit:
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Error reading CRC - 0x%08lX",
+			status);
+	}
+
+	return status;
+}
+
+NTSTATUS
+HimaxFlashHwCrc(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN UINT32 Address,
+	IN ULONG Length,
+	OUT UINT32* Crc
+)
+/*++
+
+Routine Description:
+
+	Has the controller compute the CRC of a flash range, so its content
+	can be compared against an image without reading it back over the
+	bus. The controller must be held in safe mode by the caller.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Address - The flash address the range starts at
+	Length - The size of the range, a multiple of 4
+	Crc - Receives the CRC
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+
+	status = HimaxFlashHwCrcStart(ControllerContext, SpbContext, Address, Length);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxFlashHwCrcResult(ControllerContext, SpbContext, Crc);
+
+exit:
+	return status;
+}
+
+//
+// Bus cost of the operations built above. A status poll is the control
+// and command register writes, then the data register address, the
+// direction and the read. An erase is the write enable and the control,
+// address and command writes, a page program the same writes plus the
+// FIFO chunks, split into sequences of SPB_MAX_SEQUENCE_TRANSFERS.
+//
+#define HIMAX_FLASH_POLL_TRANSFERS       5
+#define HIMAX_FLASH_POLL_BYTES_WRITTEN   (2 * HIMAX_FLASH_REGISTER_WRITE_SIZE + FOUR_BYTE_ADDR_SZ + 1)
+#define HIMAX_FLASH_ERASE_TRANSFERS      6
+#define HIMAX_FLASH_ERASE_BYTES_WRITTEN  (6 * HIMAX_FLASH_REGISTER_WRITE_SIZE)
+#define HIMAX_FLASH_PAGE_TRANSFERS       (6 + HIMAX_FLASH_FIFO_CHUNKS)
+#define HIMAX_FLASH_PAGE_SEQUENCES       \
+	((HIMAX_FLASH_PAGE_TRANSFERS + SPB_MAX_SEQUENCE_TRANSFERS - 1) / SPB_MAX_SEQUENCE_TRANSFERS)
+#define HIMAX_FLASH_PAGE_BYTES_WRITTEN   \
+	(6 * HIMAX_FLASH_REGISTER_WRITE_SIZE + HIMAX_FLASH_FIFO_CHUNKS * FOUR_BYTE_ADDR_SZ + HIMAX_FLASH_PAGE_SIZE)
+
+NTSTATUS
+HimaxFlashSimulate(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN ULONG Length,
+	IN ULONG Seed,
+	OUT HIMAX_FLASH_SIMULATION_RESULT* Result
+)
+/*++
+
+Routine Description:
+
+	Programs pseudo-random data into a simulated flash through
+	HimaxFlashProgram, then checks the flash content, the controller's
+	CRC of it and what the programming cost on the bus. The live
+	controller is left untouched.
+
+Arguments:
+
+	ControllerContext - Touch controller context the simulation copies
+	Length - The amount of bytes to program, at most
+	HIMAX_FLASH_SIMULATE_MAX_LENGTH
+	Seed - Seed of the data
+	Result - Receives the programming status and statistics, the checks
+	and the expected and measured bus counts
+
+Return Value:
+
+	NTSTATUS indicating whether the simulation could be run
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_SIMULATOR* simulator = NULL;
+	HIMAX_SIM_COUNTERS* counters;
+	UINT8* data = NULL;
+	UINT8* memory;
+	UINT32 base = HIMAX_FLASH_SECTOR_SIZE;
+	ULONG crcLength;
+	ULONG chunk;
+	ULONG expected;
+	ULONG offset;
+	ULONG i;
+
+	RtlZeroMemory(Result, sizeof(HIMAX_FLASH_SIMULATION_RESULT));
+	Result->FirstMismatch = MAXULONG;
+
+	if (Length == 0 || Length > HIMAX_FLASH_SIMULATE_MAX_LENGTH)
+	{
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	//
+	// The CRC engine works on words, the padding past the data reads
+	// back erased
+	//
+	crcLength = (Length + 3) & ~3UL;
+
+	data = (UINT8*)ExAllocatePool2(
+		POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED,
+		crcLength,
+		TOUCH_POOL_TAG_F12);
+
+	if (data == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	RtlFillMemory(data, crcLength, 0xFF);
+
+	for (offset = 0; offset < Length; offset += chunk)
+	{
+		chunk = min(Length - offset, HIMAX_FLASH_PAGE_SIZE);
+
+		if ((offset / HIMAX_FLASH_PAGE_SIZE) % 4 == 3)
+		{
+			continue;
+		}
+
+		for (i = 0; i < chunk; i++)
+		{
+			data[offset + i] = (UINT8)RtlRandomEx(&Seed);
+		}
+
+		if (!HimaxFlashPageIsErased(&data[offset], chunk))
+		{
+			Result->ExpectedPages++;
+		}
+	}
+
+	status = HimaxSimCreate(ControllerContext, &simulator);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	status = HimaxSimAttachFlash(simulator, HIMAX_SIM_FLASH_SIZE);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	memory = simulator->Flash.Memory;
+	RtlZeroMemory(memory, simulator->Flash.Size);
+
+	//
+	// Settle the interface registers first, so the counters only see
+	// the flash operations
+	//
+	status = HimaxMCUBurstEnable(&simulator->Controller, &simulator->Spb, 0);
+	if (!NT_SUCCESS(status)) goto exit;
+
+	counters = &simulator->Counters;
+	RtlZeroMemory(counters, sizeof(HIMAX_SIM_COUNTERS));
+
+	Result->Status = HimaxFlashProgram(
+		&simulator->Controller,
+		&simulator->Spb,
+		base,
+		data,
+		Length,
+		&Result->Stats);
+
+	Result->Submissions = counters->Submissions;
+	Result->Transfers = counters->Transfers;
+	Result->BytesWritten = counters->BytesWritten;
+	Result->BytesRead = counters->BytesRead;
+	Result->Rejected = simulator->Flash.Rejected;
+
+	//
+	// The flash never reports busy, so each erase and page program is
+	// followed by a single status poll
+	//
+	Result->ExpectedSectors = (Length + HIMAX_FLASH_SECTOR_SIZE - 1) / HIMAX_FLASH_SECTOR_SIZE;
+	Result->ExpectedSequences =
+		Result->ExpectedSectors * (1 + 1) +
+		Result->ExpectedPages * (HIMAX_FLASH_PAGE_SEQUENCES + 1);
+	Result->ExpectedTransfers =
+		Result->ExpectedSectors * (HIMAX_FLASH_ERASE_TRANSFERS + HIMAX_FLASH_POLL_TRANSFERS) +
+		Result->ExpectedPages * (HIMAX_FLASH_PAGE_TRANSFERS + HIMAX_FLASH_POLL_TRANSFERS);
+	Result->ExpectedBytesWritten =
+		Result->ExpectedSectors * (HIMAX_FLASH_ERASE_BYTES_WRITTEN + HIMAX_FLASH_POLL_BYTES_WRITTEN) +
+		Result->ExpectedPages * (HIMAX_FLASH_PAGE_BYTES_WRITTEN + HIMAX_FLASH_POLL_BYTES_WRITTEN);
+	Result->ExpectedBytesRead = (Result->ExpectedSectors + Result->ExpectedPages) * FOUR_BYTE_DATA_SZ;
+
+	Result->CountsMatch =
+		Result->Stats.SectorsErased == Result->ExpectedSectors &&
+		Result->Stats.PagesProgrammed == Result->ExpectedPages &&
+		Result->Stats.Sequences == Result->ExpectedSequences &&
+		Result->Submissions == Result->ExpectedSequences &&
+		Result->Transfers == Result->ExpectedTransfers &&
+		Result->BytesWritten == Result->ExpectedBytesWritten &&
+		Result->BytesRead == Result->ExpectedBytesRead &&
+		Result->Rejected == 0;
+
+	//
+	// The programmed sectors hold the data then erased bytes, the others
+	// keep their zeroes
+	//
+	for (offset = 0; offset < simulator->Flash.Size; offset++)
+	{
+		if (offset >= base && offset < base + Length)
+		{
+			expected = data[offset - base];
+		}
+		else if (offset >= base && offset < base + Result->ExpectedSectors * HIMAX_FLASH_SECTOR_SIZE)
+		{
+			expected = 0xFF;
+		}
+		else
+		{
+			expected = 0x00;
+		}
+
+		if (memory[offset] != expected)
+		{
+			Result->FirstMismatch = offset;
+			break;
+		}
+	}
+
+	Result->ContentsMatch = Result->FirstMismatch == MAXULONG;
+
+	if (NT_SUCCESS(Result->Status))
+	{
+		Result->ExpectedCrc = HimaxFlashCrc32c(data, crcLength);
+
+		status = HimaxFlashHwCrc(&simulator->Controller, &simulator->Spb, base, crcLength, &Result->Crc);
+		if (!NT_SUCCESS(status)) goto exit;
+
+		Result->CrcMatch = Result->Crc == Result->ExpectedCrc;
+	}
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_INIT,
+		"Flash simulation of %d bytes - 0x%08lX, contents %d, crc %d, counts %d (%d/%d sequences, %d/%d transfers)",
+		Length,
+		Result->Status,
+		Result->ContentsMatch,
+		Result->CrcMatch,
+		Result->CountsMatch,
+		Result->Submissions,
+		Result->ExpectedSequences,
+		Result->Transfers,
+		Result->ExpectedTransfers);
+
+exit:
+	if (simulator != NULL)
+	{
+		HimaxSimDelete(simulator);
+	}
+
+	if (data != NULL)
+	{
+		ExFreePoolWithTag(data, TOUCH_POOL_TAG_F12);
+	}
+
+	return status;
+}
@@ -22,12 +22,184 @@
 #include <spb.h>
 #include <report.h>
 #include <hx83112/hxinternal.h>
+#include <hx83112/hxfirmware.h>
+#include <hx83112/hxsim.h>
 #include <ftinternal.tmh>
 
-#define FOUR_BYTE_DATA_SZ     4
-#define FOUR_BYTE_ADDR_SZ     4
-#define FLASH_RW_MAX_LEN      256
-#define FLASH_WRITE_BURST_SZ  8
+VOID
+HimaxInitializeRetryPolicies(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+    Sets up the retry profiles used for bus access. The hot path profile
+    is used while servicing touch interrupts and gives up quickly, the
+    bring-up profile is used for everything else and is more patient.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None
+
+--*/
+{
+    ControllerContext->Breaker.Threshold = HIMAX_BREAKER_THRESHOLD;
+
+    ControllerContext->HotPathRetry.MaxAttempts = HIMAX_HOT_PATH_ATTEMPTS;
+    ControllerContext->HotPathRetry.InitialDelayInUs = HIMAX_HOT_PATH_INITIAL_DELAY_US;
+    ControllerContext->HotPathRetry.MaxDelayInUs = HIMAX_HOT_PATH_MAX_DELAY_US;
+    ControllerContext->HotPathRetry.FailFast = TRUE;
+    ControllerContext->HotPathRetry.Breaker = &ControllerContext->Breaker;
+
+    ControllerContext->BringUpRetry.MaxAttempts = HIMAX_I2C_RETRY_TIMES;
+    ControllerContext->BringUpRetry.InitialDelayInUs = HIMAX_BRING_UP_INITIAL_DELAY_US;
+    ControllerContext->BringUpRetry.MaxDelayInUs = HIMAX_BRING_UP_MAX_DELAY_US;
+    ControllerContext->BringUpRetry.FailFast = FALSE;
+    ControllerContext->BringUpRetry.Breaker = &ControllerContext->Breaker;
+}
+
+VOID
+HimaxResetCircuitBreakerState(
+    IN HIMAX_CIRCUIT_BREAKER* Breaker
+)
+{
+    InterlockedExchange(&Breaker->ConsecutiveFailures, 0);
+    InterlockedExchange(&Breaker->Open, 0);
+}
+
+VOID
+HimaxResetCircuitBreaker(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+{
+    HimaxResetCircuitBreakerState(&ControllerContext->Breaker);
+}
+
+VOID
+HimaxDelay(
+    IN ULONG DelayInUs
+)
+/*++
+
+Routine Description:
+
+    Waits for the given time without holding the processor. The ISR is
+    passive-level and so is every caller, often with the interrupt lock
+    held, so even short waits sleep rather than stall. A sleep is
+    rounded up to the system timer resolution.
+
+Arguments:
+
+    DelayInUs - The time to wait, in microseconds
+
+Return Value:
+
+    None
+
+--*/
+{
+    LARGE_INTEGER delay;
+
+    delay.QuadPart = -10 * (LONGLONG)DelayInUs;
+    KeDelayExecutionThread(KernelMode, TRUE, &delay);
+}
+
+NTSTATUS
+HimaxRetryBegin(
+    IN HIMAX_RETRY_POLICY* Policy
+)
+{
+    InterlockedIncrement(&Policy->Operations);
+
+    if (Policy->FailFast && Policy->Breaker->Open)
+    {
+        InterlockedIncrement(&Policy->FastFails);
+        return STATUS_DEVICE_NOT_CONNECTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+HimaxRetryBackoff(
+    IN HIMAX_RETRY_POLICY* Policy,
+    IN UCHAR Attempt
+)
+/*++
+
+Routine Description:
+
+    Waits before the given retry attempt. The first retry is immediate,
+    later ones back off exponentially up to the policy maximum.
+
+Arguments:
+
+    Policy - The retry policy in use
+    Attempt - The attempt about to be made, 1 being the first retry
+
+Return Value:
+
+    None
+
+--*/
+{
+    ULONG delayInUs;
+
+    InterlockedIncrement(&Policy->Retries);
+
+    if (Attempt < 2)
+    {
+        return;
+    }
+
+    delayInUs = Policy->InitialDelayInUs << min(Attempt - 2, 16);
+    delayInUs = min(delayInUs, Policy->MaxDelayInUs);
+
+    if (Policy->Delay != NULL)
+    {
+        Policy->Delay(Policy->DelayContext, delayInUs);
+        return;
+    }
+
+    HimaxDelay(delayInUs);
+}
+
+VOID
+HimaxRetryComplete(
+    IN HIMAX_RETRY_POLICY* Policy,
+    IN NTSTATUS Status
+)
+{
+    HIMAX_CIRCUIT_BREAKER* breaker = Policy->Breaker;
+
+    if (NT_SUCCESS(Status))
+    {
+        if (breaker->ConsecutiveFailures != 0)
+        {
+            HimaxResetCircuitBreakerState(breaker);
+        }
+
+        return;
+    }
+
+    InterlockedIncrement(&Policy->Exhausted);
+
+    if (InterlockedIncrement(&breaker->ConsecutiveFailures) >= breaker->Threshold &&
+        InterlockedExchange(&breaker->Open, 1) == 0)
+    {
+        InterlockedIncrement(&breaker->Trips);
+
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Controller not responding, failing hot path bus access until reset");
+    }
+}
 
 NTSTATUS
 HimaxBusWrite(
@@ -35,25 +207,31 @@ HimaxBusWrite(
     IN UINT8 Command,
     IN UINT8* Data,
     IN ULONG Length,
-    IN UINT8 RetryCount
+    IN HIMAX_RETRY_POLICY* Policy
 )
 {
     NTSTATUS status = STATUS_SUCCESS;
-    LARGE_INTEGER delay;
 
-    for (UCHAR i = 0; i < RetryCount; i++) 
+    status = HimaxRetryBegin(Policy);
+    if (!NT_SUCCESS(status)) goto exit;
+
+    for (UCHAR i = 0; i < Policy->MaxAttempts; i++) 
     {
+        if (i > 0)
+        {
+            HimaxRetryBackoff(Policy, i);
+        }
+
         status = SpbWriteDataSynchronously(SpbContext, Command, Data, Length);
 
         if (NT_SUCCESS(status))
         {
             break;
         }
-
-        delay.QuadPart = -20000;
-        KeDelayExecutionThread(KernelMode, TRUE, &delay);
     }
 
+    HimaxRetryComplete(Policy, status);
+
     if (!NT_SUCCESS(status))
     {
         Trace(
@@ -71,10 +249,10 @@ NTSTATUS
 HimaxBusWriteCommand(
     IN SPB_CONTEXT* SpbContext,
     IN UINT8 Command,
-    IN UINT8 RetryCount
+    IN HIMAX_RETRY_POLICY* Policy
 )
 {
-    return HimaxBusWrite(SpbContext, Command, NULL, 0, RetryCount);
+    return HimaxBusWrite(SpbContext, Command, NULL, 0, Policy);
 }
 
 NTSTATUS
@@ -83,25 +261,31 @@ HimaxBusRead(
     IN UINT8 Command,
     OUT UINT8* Data,
     IN ULONG Length,
-    IN UINT8 RetryCount
+    IN HIMAX_RETRY_POLICY* Policy
 )
 {
     NTSTATUS status = STATUS_SUCCESS;
-    LARGE_INTEGER delay;
 
-    for (UCHAR i = 0; i < RetryCount; i++)
+    status = HimaxRetryBegin(Policy);
+    if (!NT_SUCCESS(status)) goto exit;
+
+    for (UCHAR i = 0; i < Policy->MaxAttempts; i++)
     {
+        if (i > 0)
+        {
+            HimaxRetryBackoff(Policy, i);
+        }
+
         status = SpbReadDataSynchronously(SpbContext, Command, Data, Length);
 
         if (NT_SUCCESS(status))
         {
             break;
         } 
-
-        delay.QuadPart = -20000;
-        KeDelayExecutionThread(KernelMode, TRUE, &delay);
     }
 
+    HimaxRetryComplete(Policy, status);
+
     if (!NT_SUCCESS(status))
     {
         Trace(
@@ -115,611 +299,3260 @@ exit:
     return status;
 }
 
-
 NTSTATUS
-HimaxBusReadEventStack(
-    IN SPB_CONTEXT* SpbContext,
-    OUT UINT8* Data,
-    IN ULONG Length)
-{
-    NTSTATUS status = STATUS_SUCCESS;
-    UINT8 cmd;
-    
-    cmd = 0; // AHB_I2C Burst Read Off
-    status = HimaxBusWrite(SpbContext, 0, &cmd, 1, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
+HimaxBusProbe(
+    IN SPB_CONTEXT* SpbContext
+)
+/*++
 
-    cmd = 0x30; // Event Stack
-    status = HimaxBusRead(SpbContext, cmd, Data, Length, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
+Routine Description:
 
-    cmd = 1; // AHB_I2C Burst Read On
-    status = HimaxBusWrite(SpbContext, 0, &cmd, 1, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
+    Reads the AHB data register once, the cheapest access the chip
+    answers as soon as its bus interface is out of reset. No retry
+    policy is involved, so a chip still in reset costs a single
+    transfer and no breaker state.
 
-    return status;
-}
+Arguments:
 
-NTSTATUS
-HimaxMCUBurstEnable(
-    IN SPB_CONTEXT* SpbContext,
-    IN UINT8 AutoAdd4Byte
-)
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    NTSTATUS indicating whether the chip answered
+
+--*/
 {
-    NTSTATUS status = STATUS_SUCCESS;
     UINT8 tmp[FOUR_BYTE_DATA_SZ];
 
-    tmp[0] = 0x31; // ic_cmd_conti
-    status = HimaxBusWrite(SpbContext, 0x13, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
+    // ic_adr_ahb_rdata_byte_0
+    return SpbReadDataSynchronously(SpbContext, 0x08, tmp, sizeof(tmp));
+}
 
-    tmp[0] = 0x10 | AutoAdd4Byte; // ic_cmd_incr4
-    status = HimaxBusWrite(SpbContext, 0x0d, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
-    
-    return status;
+static
+VOID
+HimaxRetryVirtualDelay(
+    IN PVOID Context,
+    IN ULONG DelayInUs
+)
+{
+    *(ULONG*)Context += DelayInUs;
 }
 
 NTSTATUS
-HimaxMCURegisterRead(
-    IN SPB_CONTEXT* SpbContext,
-    IN UINT32 ReadAddr,
-    OUT UINT8* ReadData,
-    IN ULONG ReadLength,
-    IN UINT8 ConfigFlag
+HimaxRetrySimulate(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN BOOLEAN HotPath,
+    IN ULONG* FailedAttempts,
+    IN ULONG Count,
+    OUT HIMAX_RETRY_SIMULATION_RESULT* Result
 )
-{
-    NTSTATUS status = STATUS_SUCCESS;
-    UINT8 tmp[FOUR_BYTE_DATA_SZ];
-    int i = 0;
-    int address = 0;
+/*++
 
-    if (ConfigFlag == 0) 
-    {
-        if (ReadLength > FLASH_RW_MAX_LEN)
-        {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_INTERRUPT,
-                "MCU Register Read failed - flash chunk size is cannot be over %d",
-                FLASH_RW_MAX_LEN);
-            return STATUS_BUFFER_OVERFLOW;
-        }
+Routine Description:
 
-        HimaxMCUBurstEnable(SpbContext, (ReadLength > FOUR_BYTE_DATA_SZ) ? 1 : 0);
+    Runs bus reads through the hot path or bring-up retry policy against
+    a simulated chip failing a scripted amount of attempts of each read.
+    The backoffs advance a virtual clock instead of sleeping, and the
+    live policies and breaker are left untouched.
 
-        tmp[0] = (UINT8)(ReadAddr & 0xff);
-        tmp[1] = (UINT8)((ReadAddr >> 8) & 0xff);
-        tmp[2] = (UINT8)((ReadAddr >> 16) & 0xff);
-        tmp[3] = (UINT8)((ReadAddr >> 24) & 0xff);
+Arguments:
 
-        // ic_adr_ahb_addr_byte_0
-        status = HimaxBusWrite(SpbContext, 0x00, tmp, FOUR_BYTE_DATA_SZ, HIMAX_I2C_RETRY_TIMES);
-        if (!NT_SUCCESS(status)) return status;
+    ControllerContext - Touch controller context the policies are
+    copied from
+    HotPath - Whether to use the hot path policy rather than bring-up
+    FailedAttempts - Per read, the attempts failing before the chip
+    answers, HIMAX_RETRY_SIMULATE_NEVER if it never does
+    Count - The amount of reads, at most HIMAX_RETRY_SIMULATE_MAX_PROBES
+    Result - Receives the attempts, waits and breaker state of each read
+    and the policy counters
 
-        tmp[0] = 0; // ic_cmd_ahb_access_direction_read
+Return Value:
 
-        // ic_cmd_ahb_access_direction
-        status = HimaxBusWrite(SpbContext, 0x0c, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-        if (!NT_SUCCESS(status)) return status;
+    NTSTATUS indicating whether the simulation could be run
 
-        // ic_adr_ahb_rdata_byte_0
-        status = HimaxBusRead(SpbContext, 0x08, ReadData, ReadLength, HIMAX_I2C_RETRY_TIMES);
-        if (!NT_SUCCESS(status)) return status;
+--*/
+{
+    NTSTATUS status;
+    HIMAX_SIMULATOR* simulator = NULL;
+    HIMAX_RETRY_POLICY* policy;
+    HIMAX_RETRY_PROBE_RESULT* probe;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    ULONG clockInUs = 0;
+    ULONG submissions;
+    ULONG i;
 
-        if (ReadLength > FOUR_BYTE_DATA_SZ) 
-        {
-            HimaxMCUBurstEnable(SpbContext, 0);
-        }
-    }
-    else if (ConfigFlag == 1) {
-        status = HimaxBusRead(SpbContext, (UINT8)ReadAddr, ReadData, ReadLength, HIMAX_I2C_RETRY_TIMES);
+    RtlZeroMemory(Result, sizeof(HIMAX_RETRY_SIMULATION_RESULT));
+
+    if (Count > HIMAX_RETRY_SIMULATE_MAX_PROBES)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        goto exit;
     }
 
-    return status;
-}
+    status = HimaxSimCreate(ControllerContext, &simulator);
+    if (!NT_SUCCESS(status)) goto exit;
 
-NTSTATUS
-HimaxMCUFlashWriteBurst(
-    IN SPB_CONTEXT* SpbContext,
-    IN UINT32 RegByte,
-    OUT UINT8* WriteData)
-{
-    NTSTATUS status;
-    UINT8 buffer[FLASH_WRITE_BURST_SZ];
+    policy = HotPath ? &simulator->Controller.HotPathRetry : &simulator->Controller.BringUpRetry;
+    policy->Delay = HimaxRetryVirtualDelay;
+    policy->DelayContext = &clockInUs;
 
-    buffer[0] = (UINT8)(RegByte & 0xff);
-    buffer[1] = (UINT8)((RegByte >> 8) & 0xff);
-    buffer[2] = (UINT8)((RegByte >> 16) & 0xff);
-    buffer[3] = (UINT8)((RegByte >> 24) & 0xff);
-    buffer[4] = WriteData[0];
-    buffer[5] = WriteData[1];
-    buffer[6] = WriteData[2];
-    buffer[7] = WriteData[3];
+    for (i = 0; i < Count; i++)
+    {
+        probe = &Result->Probes[i];
 
-    // ic_adr_ahb_addr_byte_0
-    status = HimaxBusWrite(SpbContext, 0, buffer, FLASH_WRITE_BURST_SZ, HIMAX_I2C_RETRY_TIMES);
+        simulator->FailSubmissions = FailedAttempts[i];
+        submissions = simulator->Counters.Submissions;
+        probe->WaitInUs = clockInUs;
 
-    return status;
-}
+        // ic_adr_ahb_rdata_byte_0
+        probe->Status = HimaxBusRead(&simulator->Spb, 0x08, tmp, sizeof(tmp), policy);
 
-NTSTATUS
-HimaxMCUFlashWriteBurstLength(
-    IN SPB_CONTEXT* SpbContext,
-    IN UINT32 RegByte,
-    OUT UINT8* WriteData,
-    IN ULONG Length)
-{
-    NTSTATUS status;
-    UINT8* buffer;
-    ULONG bufferLen = Length + 4;
+        probe->Attempts = simulator->Counters.Submissions - submissions;
+        probe->WaitInUs = clockInUs - probe->WaitInUs;
+        probe->BreakerOpen = simulator->Controller.Breaker.Open != 0;
+    }
 
-    buffer = ExAllocatePoolWithTag(
-        NonPagedPoolNx,
-        bufferLen,
-        TOUCH_POOL_TAG_F12);
+    Result->Count = Count;
+    Result->Operations = policy->Operations;
+    Result->Retries = policy->Retries;
+    Result->Exhausted = policy->Exhausted;
+    Result->FastFails = policy->FastFails;
+    Result->Trips = simulator->Controller.Breaker.Trips;
+    Result->WaitInUs = clockInUs;
 
-    if (buffer == NULL)
+exit:
+    if (simulator != NULL)
     {
-        return STATUS_INSUFFICIENT_RESOURCES;
+        HimaxSimDelete(simulator);
     }
 
-    buffer[0] = (UINT8)(RegByte & 0xff);
-    buffer[1] = (UINT8)((RegByte >> 8) & 0xff);
-    buffer[2] = (UINT8)((RegByte >> 16) & 0xff);
-    buffer[3] = (UINT8)((RegByte >> 24) & 0xff);
-
-    RtlCopyMemory(&buffer[4], WriteData, Length);
-
-    // ic_adr_ahb_addr_byte_0
-    status = HimaxBusWrite(SpbContext, 0, buffer, bufferLen, HIMAX_I2C_RETRY_TIMES);
-    
-    ExFreePoolWithTag(
-        buffer,
-        TOUCH_POOL_TAG_F12
-    );
-
     return status;
 }
 
+
 NTSTATUS
-HimaxMCURegisterWrite(
+HimaxBusExecuteSequence(
     IN SPB_CONTEXT* SpbContext,
-    IN UINT32 WriteAddr,
-    OUT UINT8* WriteData,
-    IN ULONG WriteLength,
-    IN UINT8 ConfigFlag
+    IN SPB_TRANSFER* Transfers,
+    IN ULONG TransferCount,
+    IN HIMAX_RETRY_POLICY* Policy
 )
 {
     NTSTATUS status = STATUS_SUCCESS;
-    UINT8 tmp[FOUR_BYTE_DATA_SZ];
-    int i = 0;
-    int address = 0;
 
-    if (ConfigFlag == 0)
+    status = HimaxRetryBegin(Policy);
+    if (!NT_SUCCESS(status)) return status;
+
+    for (UCHAR i = 0; i < Policy->MaxAttempts; i++)
     {
-        UINT32 EndAddr = WriteAddr + (UINT32)WriteLength;
-        for (UINT32 i = WriteAddr; i < EndAddr; i++)
+        if (i > 0)
         {
-            HimaxMCUBurstEnable(SpbContext, (WriteLength > FOUR_BYTE_DATA_SZ) ? 1 : 0);
-            HimaxMCUFlashWriteBurstLength(SpbContext, WriteAddr, WriteData, WriteLength);
+            HimaxRetryBackoff(Policy, i);
         }
-    }
-    else if (ConfigFlag == 1) {
-        status = HimaxBusWrite(SpbContext, (UINT8)WriteAddr, WriteData, WriteLength, HIMAX_I2C_RETRY_TIMES);
-    }
+
+        status = SpbExecuteSequence(SpbContext, Transfers, TransferCount);
+
+        if (NT_SUCCESS(status))
+        {
+            break;
+        }
+    }
+
+    HimaxRetryComplete(Policy, status);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Bus sequence error - 0x%08lX",
+            status);
+    }
 
     return status;
 }
 
-NTSTATUS HimaxMCUInterfaceOn(
-    IN SPB_CONTEXT* SpbContext
+int
+HimaxBusStateIndex(
+    IN UINT8 Command
 )
 {
-    NTSTATUS status = STATUS_SUCCESS;
-    LARGE_INTEGER delay;
-    UINT8 tmp[FOUR_BYTE_DATA_SZ];
-    int cnt = 0;
+    switch (Command)
+    {
+    case 0x00: // ic_adr_ahb_addr_byte_0
+        return HIMAX_BUS_STATE_BURST_READ;
+    case 0x0c: // ic_cmd_ahb_access_direction
+        return HIMAX_BUS_STATE_DIRECTION;
+    case 0x0d: // ic_cmd_incr4
+        return HIMAX_BUS_STATE_INCR4;
+    case 0x13: // ic_cmd_conti
+        return HIMAX_BUS_STATE_CONTI;
+    default:
+        return -1;
+    }
+}
 
-    // Read a dummy register to wake up I2C.
-    
-    // ic_adr_ahb_rdata_byte_0
-    status = HimaxBusRead(SpbContext, 0x08, tmp, FOUR_BYTE_DATA_SZ, HIMAX_I2C_RETRY_TIMES);
-    if (!NT_SUCCESS(status)) return status;
+VOID
+HimaxInvalidateBusState(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
 
-    do {
-        // ============================================
-        // Enable continuous burst mode : 0x13 ==> 0x31
-        // ============================================
-        tmp[0] = 0x31; // ic_cmd_conti
-        status = HimaxBusWrite(SpbContext, 0x13, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-        if (!NT_SUCCESS(status)) return status;
+Routine Description:
 
-        // ============================================
-        //   AHB address auto + 4		: 0x0D ==> 0x11
-        //  Do not AHB address auto + 4 : 0x0D ==> 0x10
-        // ============================================
+    Forgets the cached interface register state. Must be called whenever
+    the chip may have been reset or powered down, or a bus write failed.
 
-        tmp[0] = 0x10; // ic_cmd_incr4
-        status = HimaxBusWrite(SpbContext, 0x0d, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-        if (!NT_SUCCESS(status)) return status;
+Arguments:
 
-        UINT8 cmd_conti;
-        UINT8 cmd_incr4;
+    ControllerContext - Touch controller context
+
+Return Value:
 
-        HimaxBusRead(SpbContext, 0x13, &cmd_conti, sizeof(cmd_conti), HIMAX_I2C_RETRY_TIMES);
-        HimaxBusRead(SpbContext, 0x0d, &cmd_incr4, sizeof(cmd_incr4), HIMAX_I2C_RETRY_TIMES);
+    None
 
-        if (cmd_conti == 0x31 && cmd_incr4 == 0x10)
-        {
-            break;
-        }
+--*/
+{
+    ControllerContext->BusState.ValidMask = 0;
+}
 
-        delay.QuadPart = -1000;
-        KeDelayExecutionThread(KernelMode, TRUE, &delay);
-    } while (++cnt < 10);
+BOOLEAN
+HimaxBusStateMatches(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN UINT8 Command,
+    IN UINT8 Value
+)
+{
+    int index = HimaxBusStateIndex(Command);
 
-    if (cnt > 0)
+    if (index < 0)
     {
-        Trace(
-            TRACE_LEVEL_INFORMATION,
-            TRACE_INTERRUPT,
-            "Polling burst mode: %d times",
-            cnt);
+        return FALSE;
     }
 
-    return status;
+    return (ControllerContext->BusState.ValidMask & (1 << index)) != 0 &&
+        ControllerContext->BusState.Registers[index] == Value;
 }
 
-NTSTATUS HimaxMCUSystemReset(
-    IN SPB_CONTEXT* SpbContext
+VOID
+HimaxBusStateUpdate(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN UINT8 Command,
+    IN UINT8 Value
 )
 {
-    UINT8 tmp[FOUR_BYTE_DATA_SZ];
-    RtlZeroMemory(tmp, sizeof(tmp));
+    int index = HimaxBusStateIndex(Command);
 
-    tmp[0] = 0x55; // fw_data_system_reset
+    if (index < 0)
+    {
+        return;
+    }
 
-    // addr_system_reset
-    HimaxMCURegisterWrite(SpbContext, 0x90000018, tmp, FOUR_BYTE_DATA_SZ, 0);
+    ControllerContext->BusState.Registers[index] = Value;
+    ControllerContext->BusState.ValidMask |= (1 << index);
 }
 
-NTSTATUS HimaxMCUSenseOn(
+VOID
+HimaxBusStateWritten(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN UINT8 Command,
+    IN UINT8* Data,
+    IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+    Updates the cached interface register state after a bus write of
+    any length. A multi-byte write to 0x00 sets the AHB address rather
+    than the burst read flag, whose state is unknown afterwards.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Command - The register written
+    Data - The bytes written
+    Length - The size of the above buffer
+
+Return Value:
+
+    None
+
+--*/
+{
+    int index = HimaxBusStateIndex(Command);
+
+    if (index < 0 || Length == 0)
+    {
+        return;
+    }
+
+    if (Length > 1)
+    {
+        ControllerContext->BusState.ValidMask &= ~(1 << index);
+        return;
+    }
+
+    HimaxBusStateUpdate(ControllerContext, Command, Data[0]);
+}
+
+NTSTATUS
+HimaxBusWriteCached(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
     IN SPB_CONTEXT* SpbContext,
-    IN UINT8 FlashMode)
+    IN UINT8 Command,
+    IN UINT8 Value
+)
+/*++
+
+Routine Description:
+
+    Writes a single byte interface register, skipping the bus
+    transaction if the register is known to already hold the value.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Command - The interface register to write
+    Value - The value to write
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
 {
-    NTSTATUS status = STATUS_SUCCESS;
-    UINT8 tmp[FOUR_BYTE_DATA_SZ];
-    int retry = 0;
-    LARGE_INTEGER delay;
+    NTSTATUS status;
 
-    memset(tmp, 0, sizeof(tmp));
+    if (HimaxBusStateMatches(ControllerContext, Command, Value))
+    {
+        ControllerContext->BusState.WritesSkipped++;
+        return STATUS_SUCCESS;
+    }
 
-    HimaxMCUInterfaceOn(SpbContext);
-    HimaxMCURegisterWrite(SpbContext, 0x9000005c, tmp, FOUR_BYTE_DATA_SZ, 0);
+    status = HimaxBusWrite(SpbContext, Command, &Value, 1, &ControllerContext->BringUpRetry);
 
-    delay.QuadPart = -20000;
-    KeDelayExecutionThread(KernelMode, TRUE, &delay);
+    if (NT_SUCCESS(status))
+    {
+        HimaxBusStateUpdate(ControllerContext, Command, Value);
+    }
+    else
+    {
+        HimaxInvalidateBusState(ControllerContext);
+    }
 
-    if (FlashMode == 0)
+    return status;
+}
+
+NTSTATUS
+HimaxBusReadEventStack(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    OUT UINT8* Data,
+    IN ULONG Length)
+/*++
+
+Routine Description:
+
+    Reads the event stack. The chip is left with AHB burst off after the
+    read, so in steady state a frame costs a single combined write-read
+    transfer. Burst is only restored by HimaxBusRestoreBurst before an
+    MCU access that relies on it.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Data - The buffer receiving the event stack
+    Length - The amount of bytes to read
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    SPB_TRANSFER transfers[2];
+    ULONG count = 0;
+    UINT8 burstOff = 0; // AHB_I2C Burst Read Off
+
+    if (HimaxBusStateMatches(ControllerContext, 0x00, burstOff))
+    {
+        ControllerContext->BusState.WritesSkipped++;
+    }
+    else
     {
-        HimaxMCUSystemReset(SpbContext);
+        transfers[count].Read = FALSE;
+        transfers[count].Address = 0x00;
+        transfers[count].Data = &burstOff;
+        transfers[count].Length = sizeof(burstOff);
+        transfers[count].DelayInUs = 0;
+        count++;
     }
-    else {
-        do {
-            // fw_data_safe_mode_release_pw_active
-            tmp[3] = 0x00; 
-            tmp[2] = 0x00; 
-            tmp[1] = 0x00; 
-            tmp[0] = 0x53;
 
-            // fw_addr_safe_mode_release_pw
-            HimaxMCURegisterWrite(SpbContext, 0x90000098, tmp, FOUR_BYTE_DATA_SZ, 0);
+    transfers[count].Read = TRUE;
+    transfers[count].Address = 0x30; // Event Stack
+    transfers[count].Data = Data;
+    transfers[count].Length = Length;
+    transfers[count].DelayInUs = 0;
+    count++;
 
-            // fw_addr_flag_reset_event
-            HimaxMCURegisterRead(SpbContext, 0x900000e4, tmp, FOUR_BYTE_DATA_SZ, 0);
-        } while ((tmp[1] != 0x01 || tmp[0] != 0x00) && retry++ < 5);
+    status = HimaxBusExecuteSequence(SpbContext, transfers, count, &ControllerContext->HotPathRetry);
 
-        if (retry >= 5)
-        {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_INTERRUPT,
-                "Safe mode release failed.");
-            HimaxMCUSystemReset(SpbContext);
-        }
-        else {
-            Trace(
-                TRACE_LEVEL_INFORMATION,
-                TRACE_INTERRUPT,
-                "OK and Read status from IC = %x,%x",
-                tmp[0], tmp[1]);
+    if (NT_SUCCESS(status))
+    {
+        HimaxBusStateUpdate(ControllerContext, 0x00, burstOff);
 
-            tmp[0] = 0x00;
+        ControllerContext->BusState.EventReads++;
+        ControllerContext->BusState.EventReadTransfers += count;
+    }
+    else
+    {
+        HimaxInvalidateBusState(ControllerContext);
+    }
 
-            // ic_adr_i2c_psw_lb
-            status = HimaxBusWrite(SpbContext, 0x31, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-            if (!NT_SUCCESS(status)) return status;
-            
-            // ic_adr_i2c_psw_ub
-            status = HimaxBusWrite(SpbContext, 0x32, tmp, 1, HIMAX_I2C_RETRY_TIMES);
-            if (!NT_SUCCESS(status)) return status;
+    return status;
+}
 
-            // fw_data_safe_mode_release_pw_reset
-            tmp[3] = 0x00;
-            tmp[2] = 0x00;
-            tmp[1] = 0x00;
-            tmp[0] = 0x00;
+NTSTATUS
+HimaxBusRestoreBurst(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+)
+/*++
 
-            // fw_addr_safe_mode_release_pw
-            HimaxMCURegisterWrite(SpbContext, 0x90000098, tmp, FOUR_BYTE_DATA_SZ, 0);
-        }
+Routine Description:
+
+    Turns AHB burst back on unless it is known to be on. The last event
+    stack read leaves it off, and an AHB address write since leaves its
+    state unknown.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    UINT8 burstOn = 1; // AHB_I2C Burst Read On
+
+    if (HimaxBusStateMatches(ControllerContext, 0x00, burstOn))
+    {
+        return STATUS_SUCCESS;
     }
+
+    ControllerContext->BusState.BurstRestores++;
+
+    return HimaxBusWriteCached(ControllerContext, SpbContext, 0x00, burstOn);
 }
 
-NTSTATUS HimaxMCUAssignSortingMode(
+NTSTATUS
+HimaxMCUBurstEnable(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
     IN SPB_CONTEXT* SpbContext,
-    UINT8* Data
+    IN UINT8 AutoAdd4Byte
 )
 {
-    Trace(
-        TRACE_LEVEL_INFORMATION,
-        TRACE_INTERRUPT,
-        "Now tmp_data[3]=0x%02x,tmp_data[2]=0x%02x,tmp_data[1]=0x%02x,tmp_data[0]=0x%02x",
-        Data[3], Data[2], Data[1], Data[0]);
+    NTSTATUS status = STATUS_SUCCESS;
+
+    // ic_cmd_conti
+    status = HimaxBusWriteCached(ControllerContext, SpbContext, 0x13, 0x31);
+    if (!NT_SUCCESS(status)) return status;
 
-    return HimaxMCUFlashWriteBurst(SpbContext, 0x10007f04, Data);
+    // ic_cmd_incr4
+    status = HimaxBusWriteCached(ControllerContext, SpbContext, 0x0d, 0x10 | AutoAdd4Byte);
+    if (!NT_SUCCESS(status)) return status;
+    
+    return status;
 }
 
-// todo read
-#define HX_MAX_PT 10
-const int raw_cnt_max = HX_MAX_PT / 4;
-const int raw_cnt_rmd = HX_MAX_PT % 4;
-const int g_hx_rawdata_size = 67;
-const int touch_info_size = 56;
-const int coord_data_size = 4 * HX_MAX_PT;
-const int area_data_size = ((HX_MAX_PT / 4) + (HX_MAX_PT % 4 ? 1 : 0)) * 4;
-const int coord_info_size = (4 * HX_MAX_PT) + (((HX_MAX_PT / 4) + (HX_MAX_PT % 4 ? 1 : 0)) * 4) + 4;
-//const int coord_info_size = coord_data_size + area_data_size + 4;
+NTSTATUS
+HimaxMCURegisterRead(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 ReadAddr,
+    OUT UINT8* ReadData,
+    IN ULONG ReadLength,
+    IN UINT8 ConfigFlag
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    int i = 0;
+    int address = 0;
+
+    if (ConfigFlag == 0) 
+    {
+        if (ReadLength > FLASH_RW_MAX_LEN)
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INTERRUPT,
+                "MCU Register Read failed - flash chunk size is cannot be over %d",
+                FLASH_RW_MAX_LEN);
+            return STATUS_BUFFER_OVERFLOW;
+        }
+
+        HimaxMCUBurstEnable(ControllerContext, SpbContext, (ReadLength > FOUR_BYTE_DATA_SZ) ? 1 : 0);
+
+        tmp[0] = (UINT8)(ReadAddr & 0xff);
+        tmp[1] = (UINT8)((ReadAddr >> 8) & 0xff);
+        tmp[2] = (UINT8)((ReadAddr >> 16) & 0xff);
+        tmp[3] = (UINT8)((ReadAddr >> 24) & 0xff);
+
+        // ic_adr_ahb_addr_byte_0
+        status = HimaxBusWrite(SpbContext, 0x00, tmp, FOUR_BYTE_DATA_SZ, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status))
+        {
+            HimaxInvalidateBusState(ControllerContext);
+            return status;
+        }
+
+        HimaxBusStateWritten(ControllerContext, 0x00, tmp, FOUR_BYTE_DATA_SZ);
+
+        // ic_cmd_ahb_access_direction, ic_cmd_ahb_access_direction_read
+        status = HimaxBusWriteCached(ControllerContext, SpbContext, 0x0c, 0x00);
+        if (!NT_SUCCESS(status)) return status;
+
+        // ic_adr_ahb_rdata_byte_0
+        status = HimaxBusRead(SpbContext, 0x08, ReadData, ReadLength, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status)) return status;
+
+        if (ReadLength > FOUR_BYTE_DATA_SZ) 
+        {
+            HimaxMCUBurstEnable(ControllerContext, SpbContext, 0);
+        }
+    }
+    else if (ConfigFlag == 1) {
+        status = HimaxBusRestoreBurst(ControllerContext, SpbContext);
+        if (!NT_SUCCESS(status)) return status;
+
+        status = HimaxBusRead(SpbContext, (UINT8)ReadAddr, ReadData, ReadLength, &ControllerContext->BringUpRetry);
+    }
+
+    return status;
+}
+
+NTSTATUS
+HimaxMCUFlashWriteBurst(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 RegByte,
+    OUT UINT8* WriteData)
+{
+    NTSTATUS status;
+    UINT8 buffer[FLASH_WRITE_BURST_SZ];
+
+    buffer[0] = (UINT8)(RegByte & 0xff);
+    buffer[1] = (UINT8)((RegByte >> 8) & 0xff);
+    buffer[2] = (UINT8)((RegByte >> 16) & 0xff);
+    buffer[3] = (UINT8)((RegByte >> 24) & 0xff);
+    buffer[4] = WriteData[0];
+    buffer[5] = WriteData[1];
+    buffer[6] = WriteData[2];
+    buffer[7] = WriteData[3];
+
+    // ic_adr_ahb_addr_byte_0
+    status = HimaxBusWrite(SpbContext, 0, buffer, FLASH_WRITE_BURST_SZ, &ControllerContext->BringUpRetry);
+
+    if (NT_SUCCESS(status))
+    {
+        HimaxBusStateWritten(ControllerContext, 0x00, buffer, FLASH_WRITE_BURST_SZ);
+    }
+    else
+    {
+        HimaxInvalidateBusState(ControllerContext);
+    }
+
+    return status;
+}
+
+NTSTATUS
+HimaxMCUFlashWriteBurstLength(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 RegByte,
+    OUT UINT8* WriteData,
+    IN ULONG Length)
+{
+    NTSTATUS status;
+    UINT8* buffer;
+    ULONG bufferLen = Length + 4;
+
+    buffer = SpbAcquireBuffer(SpbContext, bufferLen);
+
+    if (buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    buffer[0] = (UINT8)(RegByte & 0xff);
+    buffer[1] = (UINT8)((RegByte >> 8) & 0xff);
+    buffer[2] = (UINT8)((RegByte >> 16) & 0xff);
+    buffer[3] = (UINT8)((RegByte >> 24) & 0xff);
+
+    RtlCopyMemory(&buffer[4], WriteData, Length);
+
+    // ic_adr_ahb_addr_byte_0
+    status = HimaxBusWrite(SpbContext, 0, buffer, bufferLen, &ControllerContext->BringUpRetry);
+
+    if (NT_SUCCESS(status))
+    {
+        HimaxBusStateWritten(ControllerContext, 0x00, buffer, bufferLen);
+    }
+    else
+    {
+        HimaxInvalidateBusState(ControllerContext);
+    }
+    
+    SpbReleaseBuffer(SpbContext, buffer);
+
+    return status;
+}
+
+NTSTATUS
+HimaxMCURegisterWrite(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 WriteAddr,
+    OUT UINT8* WriteData,
+    IN ULONG WriteLength,
+    IN UINT8 ConfigFlag
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG offset;
+    ULONG chunk;
+
+    if (ConfigFlag == 0)
+    {
+        status = HimaxMCUBurstEnable(ControllerContext, SpbContext, (WriteLength > FOUR_BYTE_DATA_SZ) ? 1 : 0);
+        if (!NT_SUCCESS(status)) return status;
+
+        //
+        // The AHB address auto-increments within a burst, larger writes
+        // are split in FLASH_RW_MAX_LEN chunks at increasing addresses
+        //
+        for (offset = 0; offset < WriteLength; offset += chunk)
+        {
+            chunk = min(WriteLength - offset, FLASH_RW_MAX_LEN);
+
+            status = HimaxMCUFlashWriteBurstLength(
+                ControllerContext,
+                SpbContext,
+                WriteAddr + offset,
+                WriteData + offset,
+                chunk);
+
+            if (!NT_SUCCESS(status)) return status;
+        }
+    }
+    else if (ConfigFlag == 1) {
+        status = HimaxBusRestoreBurst(ControllerContext, SpbContext);
+        if (!NT_SUCCESS(status)) return status;
+
+        status = HimaxBusWrite(SpbContext, (UINT8)WriteAddr, WriteData, WriteLength, &ControllerContext->BringUpRetry);
+    }
+
+    return status;
+}
+
+NTSTATUS
+HimaxMCURegisterWriteVerified(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT32 Address,
+    IN UINT32 Value
+)
+/*++
+
+Routine Description:
+
+    Writes a firmware register and reads it back, for mode switches the
+    firmware may not have taken.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Address - The register address
+    Value - The value to write
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+    UINT8 data[FOUR_BYTE_DATA_SZ];
+    UINT8 readBack[FOUR_BYTE_DATA_SZ];
+
+    data[0] = (UINT8)(Value & 0xff);
+    data[1] = (UINT8)((Value >> 8) & 0xff);
+    data[2] = (UINT8)((Value >> 16) & 0xff);
+    data[3] = (UINT8)((Value >> 24) & 0xff);
+
+    status = HimaxMCURegisterWrite(ControllerContext, SpbContext, Address, data, sizeof(data), 0);
+    if (!NT_SUCCESS(status)) goto exit;
+
+    status = HimaxMCURegisterRead(ControllerContext, SpbContext, Address, readBack, sizeof(readBack), 0);
+    if (!NT_SUCCESS(status)) goto exit;
+
+    if (RtlCompareMemory(data, readBack, sizeof(data)) != sizeof(data))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Register 0x%08lX reads back 0x%02X%02X%02X%02X after writing 0x%08lX",
+            Address,
+            readBack[3],
+            readBack[2],
+            readBack[1],
+            readBack[0],
+            Value);
+
+        status = STATUS_DEVICE_DATA_ERROR;
+    }
+
+exit:
+    return status;
+}
+
+VOID
+HimaxCommandListInit(
+    OUT HIMAX_COMMAND_LIST* List
+)
+{
+    RtlZeroMemory(List, sizeof(HIMAX_COMMAND_LIST));
+    List->Status = STATUS_SUCCESS;
+}
+
+HIMAX_COMMAND*
+HimaxCommandListAppend(
+    IN HIMAX_COMMAND_LIST* List,
+    IN HIMAX_COMMAND_TYPE Type
+)
+{
+    HIMAX_COMMAND* command;
+
+    if (List->Count >= HIMAX_COMMAND_LIST_MAX_COMMANDS)
+    {
+        List->Status = STATUS_BUFFER_OVERFLOW;
+        return NULL;
+    }
+
+    command = &List->Commands[List->Count++];
+    RtlZeroMemory(command, sizeof(HIMAX_COMMAND));
+    command->Type = Type;
+
+    return command;
+}
+
+VOID
+HimaxCommandListBusWrite(
+    IN HIMAX_COMMAND_LIST* List,
+    IN UINT8 Command,
+    IN UINT8* Data,
+    IN ULONG Length
+)
+{
+    HIMAX_COMMAND* command;
+
+    if (Length > HIMAX_COMMAND_DATA_SIZE)
+    {
+        List->Status = STATUS_BUFFER_OVERFLOW;
+        return;
+    }
+
+    command = HimaxCommandListAppend(List, HimaxCommandBusWrite);
+    if (command == NULL) return;
+
+    command->Command = Command;
+    command->Length = Length;
+    RtlCopyMemory(command->Data, Data, Length);
+}
+
+VOID
+HimaxCommandListRegisterWrite(
+    IN HIMAX_COMMAND_LIST* List,
+    IN UINT32 Address,
+    IN UINT8* Data
+)
+{
+    HIMAX_COMMAND* command;
+
+    command = HimaxCommandListAppend(List, HimaxCommandRegisterWrite);
+    if (command == NULL) return;
+
+    // ic_adr_ahb_addr_byte_0, followed by the data word
+    command->Command = 0x00;
+    command->Length = FLASH_WRITE_BURST_SZ;
+    command->Data[0] = (UINT8)(Address & 0xff);
+    command->Data[1] = (UINT8)((Address >> 8) & 0xff);
+    command->Data[2] = (UINT8)((Address >> 16) & 0xff);
+    command->Data[3] = (UINT8)((Address >> 24) & 0xff);
+    RtlCopyMemory(&command->Data[4], Data, FOUR_BYTE_DATA_SZ);
+}
+
+VOID
+HimaxCommandListBurstEnable(
+    IN HIMAX_COMMAND_LIST* List,
+    IN UINT8 AutoAdd4Byte
+)
+{
+    HIMAX_COMMAND* command;
+
+    command = HimaxCommandListAppend(List, HimaxCommandBurstMode);
+    if (command == NULL) return;
+
+    command->Data[0] = 0x31; // ic_cmd_conti
+    command->Data[1] = 0x10 | AutoAdd4Byte; // ic_cmd_incr4
+}
+
+VOID
+HimaxCommandListDelay(
+    IN HIMAX_COMMAND_LIST* List,
+    IN ULONG DelayInUs
+)
+{
+    HIMAX_COMMAND* command;
+
+    command = HimaxCommandListAppend(List, HimaxCommandDelay);
+    if (command == NULL) return;
+
+    command->DelayInUs = DelayInUs;
+}
+
+NTSTATUS
+HimaxCommandListFlush(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN SPB_TRANSFER* Transfers,
+    IN OUT ULONG* TransferCount
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    if (*TransferCount != 0)
+    {
+        status = HimaxBusExecuteSequence(SpbContext, Transfers, *TransferCount, &ControllerContext->BringUpRetry);
+        *TransferCount = 0;
+    }
+
+    return status;
+}
+
+NTSTATUS
+HimaxCommandListExecute(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN HIMAX_COMMAND_LIST* List
+)
+/*++
+
+Routine Description:
+
+    Submits a recorded command list. Consecutive bus and register writes
+    are chained into as few SPB sequences as possible, split only where
+    a delay was recorded or a sequence is full. Burst mode changes that
+    the cached interface state shows as already applied are dropped.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    List - The recorded command list
+
+Return Value:
+
+    NTSTATUS, the first failure stops execution of the list
+
+--*/
+{
+    NTSTATUS status;
+    SPB_TRANSFER transfers[SPB_MAX_SEQUENCE_TRANSFERS];
+    ULONG transferCount = 0;
+    HIMAX_COMMAND* command;
+
+    status = List->Status;
+    if (!NT_SUCCESS(status)) return status;
+
+    status = HimaxBusRestoreBurst(ControllerContext, SpbContext);
+    if (!NT_SUCCESS(status)) return status;
+
+    for (ULONG i = 0; i < List->Count; i++)
+    {
+        command = &List->Commands[i];
+
+        if (command->Type == HimaxCommandDelay)
+        {
+            status = HimaxCommandListFlush(ControllerContext, SpbContext, transfers, &transferCount);
+            if (!NT_SUCCESS(status)) goto exit;
+
+            HimaxDelay(command->DelayInUs);
+            continue;
+        }
+
+        if (transferCount + 2 > SPB_MAX_SEQUENCE_TRANSFERS)
+        {
+            status = HimaxCommandListFlush(ControllerContext, SpbContext, transfers, &transferCount);
+            if (!NT_SUCCESS(status)) goto exit;
+        }
+
+        //
+        // The cached state is updated as transfers are queued, and
+        // dropped entirely if the sequence carrying them fails
+        //
+        if (command->Type == HimaxCommandBurstMode)
+        {
+            if (HimaxBusStateMatches(ControllerContext, 0x13, command->Data[0]))
+            {
+                ControllerContext->BusState.WritesSkipped++;
+            }
+            else
+            {
+                transfers[transferCount].Read = FALSE;
+                transfers[transferCount].Address = 0x13;
+                transfers[transferCount].Data = &command->Data[0];
+                transfers[transferCount].Length = 1;
+                transfers[transferCount].DelayInUs = 0;
+                transferCount++;
+
+                HimaxBusStateUpdate(ControllerContext, 0x13, command->Data[0]);
+            }
+
+            if (HimaxBusStateMatches(ControllerContext, 0x0d, command->Data[1]))
+            {
+                ControllerContext->BusState.WritesSkipped++;
+            }
+            else
+            {
+                transfers[transferCount].Read = FALSE;
+                transfers[transferCount].Address = 0x0d;
+                transfers[transferCount].Data = &command->Data[1];
+                transfers[transferCount].Length = 1;
+                transfers[transferCount].DelayInUs = 0;
+                transferCount++;
+
+                HimaxBusStateUpdate(ControllerContext, 0x0d, command->Data[1]);
+            }
+        }
+        else
+        {
+            transfers[transferCount].Read = FALSE;
+            transfers[transferCount].Address = command->Command;
+            transfers[transferCount].Data = command->Data;
+            transfers[transferCount].Length = command->Length;
+            transfers[transferCount].DelayInUs = 0;
+            transferCount++;
+
+            HimaxBusStateWritten(ControllerContext, command->Command, command->Data, command->Length);
+        }
+    }
+
+    status = HimaxCommandListFlush(ControllerContext, SpbContext, transfers, &transferCount);
+
+exit:
+    if (!NT_SUCCESS(status))
+    {
+        HimaxInvalidateBusState(ControllerContext);
+    }
+
+    return status;
+}
+
+NTSTATUS HimaxMCUInterfaceOn(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    LARGE_INTEGER delay;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    int cnt = 0;
+
+    //
+    // The interface registers are rewritten and read back below,
+    // the cached state is only trusted again once that succeeds
+    //
+    HimaxInvalidateBusState(ControllerContext);
+
+    // Read a dummy register to wake up I2C.
+    
+    // ic_adr_ahb_rdata_byte_0
+    status = HimaxBusRead(SpbContext, 0x08, tmp, FOUR_BYTE_DATA_SZ, &ControllerContext->BringUpRetry);
+    if (!NT_SUCCESS(status)) return status;
+
+    do {
+        // ============================================
+        // Enable continuous burst mode : 0x13 ==> 0x31
+        // ============================================
+        tmp[0] = 0x31; // ic_cmd_conti
+        status = HimaxBusWrite(SpbContext, 0x13, tmp, 1, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status)) return status;
+
+        // ============================================
+        //   AHB address auto + 4		: 0x0D ==> 0x11
+        //  Do not AHB address auto + 4 : 0x0D ==> 0x10
+        // ============================================
+
+        tmp[0] = 0x10; // ic_cmd_incr4
+        status = HimaxBusWrite(SpbContext, 0x0d, tmp, 1, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status)) return status;
+
+        UINT8 cmd_conti;
+        UINT8 cmd_incr4;
+
+        HimaxBusRead(SpbContext, 0x13, &cmd_conti, sizeof(cmd_conti), &ControllerContext->BringUpRetry);
+        HimaxBusRead(SpbContext, 0x0d, &cmd_incr4, sizeof(cmd_incr4), &ControllerContext->BringUpRetry);
+
+        if (cmd_conti == 0x31 && cmd_incr4 == 0x10)
+        {
+            HimaxBusStateUpdate(ControllerContext, 0x13, cmd_conti);
+            HimaxBusStateUpdate(ControllerContext, 0x0d, cmd_incr4);
+            break;
+        }
+
+        delay.QuadPart = -1000;
+        KeDelayExecutionThread(KernelMode, TRUE, &delay);
+    } while (++cnt < 10);
+
+    if (cnt > 0)
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_INTERRUPT,
+            "Polling burst mode: %d times",
+            cnt);
+    }
+
+    return status;
+}
+
+static
+VOID
+HimaxBuildSystemReset(
+    OUT HIMAX_COMMAND_LIST* List
+)
+/*++
+
+Routine Description:
+
+    Records the system reset request.
+
+Arguments:
+
+    List - Receives the command list
+
+Return Value:
+
+    None
+
+--*/
+{
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    RtlZeroMemory(tmp, sizeof(tmp));
+
+    tmp[0] = 0x55; // fw_data_system_reset
+
+    HimaxCommandListInit(List);
+    HimaxCommandListBurstEnable(List, 0);
+
+    // addr_system_reset
+    HimaxCommandListRegisterWrite(List, 0x90000018, tmp);
+}
+
+static
+VOID
+HimaxBuildFirmwareRelease(
+    OUT HIMAX_COMMAND_LIST* List
+)
+/*++
+
+Routine Description:
+
+    Records clearing the firmware stop request, then the wait for the
+    firmware to pick it up.
+
+Arguments:
+
+    List - Receives the command list
+
+Return Value:
+
+    None
+
+--*/
+{
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    RtlZeroMemory(tmp, sizeof(tmp));
+
+    HimaxCommandListInit(List);
+    HimaxCommandListBurstEnable(List, 0);
+
+    // fw_addr_ctrl_fw
+    HimaxCommandListRegisterWrite(List, 0x9000005c, tmp);
+    HimaxCommandListDelay(List, 2000);
+}
+
+static
+VOID
+HimaxBuildPasswordClear(
+    OUT HIMAX_COMMAND_LIST* List
+)
+/*++
+
+Routine Description:
+
+    Records clearing the bus password and the safe mode release
+    password once safe mode was released.
+
+Arguments:
+
+    List - Receives the command list
+
+Return Value:
+
+    None
+
+--*/
+{
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    RtlZeroMemory(tmp, sizeof(tmp));
+
+    HimaxCommandListInit(List);
+
+    // ic_adr_i2c_psw_lb
+    HimaxCommandListBusWrite(List, 0x31, tmp, 1);
+
+    // ic_adr_i2c_psw_ub
+    HimaxCommandListBusWrite(List, 0x32, tmp, 1);
+
+    // fw_addr_safe_mode_release_pw, fw_data_safe_mode_release_pw_reset
+    HimaxCommandListBurstEnable(List, 0);
+    HimaxCommandListRegisterWrite(List, 0x90000098, tmp);
+}
+
+NTSTATUS HimaxMCUSystemReset(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+)
+{
+    NTSTATUS status;
+    HIMAX_COMMAND_LIST list;
+
+    HimaxBuildSystemReset(&list);
+
+    status = HimaxCommandListExecute(ControllerContext, SpbContext, &list);
+
+    //
+    // The reset returns the interface registers to their defaults
+    //
+    HimaxInvalidateBusState(ControllerContext);
+
+    if (NT_SUCCESS(status))
+    {
+        HimaxResetCircuitBreaker(ControllerContext);
+    }
+
+    return status;
+}
+
+NTSTATUS HimaxMCUSenseOn(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UINT8 FlashMode)
+/*++
+
+Routine Description:
+
+    Releases the stopped firmware. Without flash mode the controller is
+    reset to start it, otherwise safe mode is released and the release
+    acknowledged by the firmware.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    FlashMode - Whether to release safe mode rather than reset
+
+Return Value:
+
+    NTSTATUS, STATUS_IO_TIMEOUT if the firmware did not acknowledge the
+    safe mode release
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    HIMAX_COMMAND_LIST list;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    int retry = 0;
+
+    memset(tmp, 0, sizeof(tmp));
+
+    status = HimaxMCUInterfaceOn(ControllerContext, SpbContext);
+    if (!NT_SUCCESS(status)) return status;
+
+    HimaxBuildFirmwareRelease(&list);
+
+    status = HimaxCommandListExecute(ControllerContext, SpbContext, &list);
+    if (!NT_SUCCESS(status)) return status;
+
+    if (FlashMode == 0)
+    {
+        return HimaxMCUSystemReset(ControllerContext, SpbContext);
+    }
+
+    do {
+        // fw_data_safe_mode_release_pw_active
+        tmp[3] = 0x00; 
+        tmp[2] = 0x00; 
+        tmp[1] = 0x00; 
+        tmp[0] = 0x53;
+
+        // fw_addr_safe_mode_release_pw
+        status = HimaxMCURegisterWrite(ControllerContext, SpbContext, 0x90000098, tmp, FOUR_BYTE_DATA_SZ, 0);
+        if (!NT_SUCCESS(status)) return status;
+
+        // fw_addr_flag_reset_event
+        status = HimaxMCURegisterRead(ControllerContext, SpbContext, 0x900000e4, tmp, FOUR_BYTE_DATA_SZ, 0);
+        if (!NT_SUCCESS(status)) return status;
+    } while ((tmp[1] != 0x01 || tmp[0] != 0x00) && retry++ < 5);
+
+    if (tmp[1] != 0x01 || tmp[0] != 0x00)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Safe mode release failed.");
+
+        //
+        // The reset still restarts the firmware, but the caller asked
+        // for safe mode to be released and it was not
+        //
+        HimaxMCUSystemReset(ControllerContext, SpbContext);
+        return STATUS_IO_TIMEOUT;
+    }
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_INTERRUPT,
+        "OK and Read status from IC = %x,%x",
+        tmp[0], tmp[1]);
+
+    HimaxBuildPasswordClear(&list);
+
+    return HimaxCommandListExecute(ControllerContext, SpbContext, &list);
+}
+
+NTSTATUS HimaxMCUStopFirmware(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext)
+/*++
+
+Routine Description:
+
+    Asks the firmware to stop and waits for it to acknowledge. The
+    firmware keeps its configuration and runs again once the request
+    register is cleared.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    NTSTATUS, STATUS_IO_TIMEOUT if the firmware did not acknowledge
+
+--*/
+{
+    NTSTATUS status;
+    LARGE_INTEGER delay;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    int retry = 0;
+
+    do {
+        if (retry == 0 || (tmp[0] != 0xA5 && tmp[0] != 0x00 && tmp[0] != 0x87))
+        {
+            // fw_data_fw_stop
+            tmp[3] = 0x00;
+            tmp[2] = 0x00;
+            tmp[1] = 0x00;
+            tmp[0] = 0xA5;
+
+            // fw_addr_ctrl_fw
+            status = HimaxMCURegisterWrite(ControllerContext, SpbContext, 0x9000005c, tmp, FOUR_BYTE_DATA_SZ, 0);
+            if (!NT_SUCCESS(status)) return status;
+        }
+
+        delay.QuadPart = -10 * 20000;
+        KeDelayExecutionThread(KernelMode, TRUE, &delay);
+
+        // fw_addr_ctrl_fw
+        status = HimaxMCURegisterRead(ControllerContext, SpbContext, 0x9000005c, tmp, FOUR_BYTE_DATA_SZ, 0);
+        if (!NT_SUCCESS(status)) return status;
+    } while (tmp[0] != 0x87 && ++retry < 35);
+
+    if (tmp[0] != 0x87)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Firmware did not acknowledge the stop request, state %x",
+            tmp[0]);
+
+        return STATUS_IO_TIMEOUT;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS HimaxMCUSenseOff(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext)
+/*++
+
+Routine Description:
+
+    Stops the firmware and enters safe mode, which is required before
+    accessing the flash or its CRC engine. Leave it with a system reset.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    NTSTATUS, STATUS_IO_TIMEOUT if the controller did not enter safe mode
+
+--*/
+{
+    NTSTATUS status;
+    LARGE_INTEGER delay;
+    UINT8 tmp[FOUR_BYTE_DATA_SZ];
+    int retry = 0;
+
+    //
+    // A firmware that never acknowledged the stop is still running, and
+    // must not have its flash touched
+    //
+    status = HimaxMCUStopFirmware(ControllerContext, SpbContext);
+    if (!NT_SUCCESS(status)) return status;
+
+    do {
+        // ic_adr_i2c_psw_lb, ic_adr_i2c_psw_ub
+        tmp[0] = 0x27;
+        status = HimaxBusWrite(SpbContext, 0x31, tmp, 1, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status)) return status;
+
+        tmp[0] = 0x95;
+        status = HimaxBusWrite(SpbContext, 0x32, tmp, 1, &ControllerContext->BringUpRetry);
+        if (!NT_SUCCESS(status)) return status;
+
+        // fw_addr_cs_central_state, 0x0C is safe mode
+        status = HimaxMCURegisterRead(ControllerContext, SpbContext, 0x900000a8, tmp, FOUR_BYTE_DATA_SZ, 0);
+        if (!NT_SUCCESS(status)) return status;
+
+        if (tmp[0] == 0x0C)
+        {
+            return STATUS_SUCCESS;
+        }
+
+        delay.QuadPart = -10 * 10000;
+        KeDelayExecutionThread(KernelMode, TRUE, &delay);
+    } while (++retry < 15);
+
+    Trace(
+        TRACE_LEVEL_ERROR,
+        TRACE_INIT,
+        "Controller did not enter safe mode, state %x",
+        tmp[0]);
+
+    return STATUS_IO_TIMEOUT;
+}
+
+NTSTATUS HimaxMCUAssignSortingMode(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    UINT8* Data
+)
+{
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_INTERRUPT,
+        "Now tmp_data[3]=0x%02x,tmp_data[2]=0x%02x,tmp_data[1]=0x%02x,tmp_data[0]=0x%02x",
+        Data[3], Data[2], Data[1], Data[0]);
+
+    return HimaxMCUFlashWriteBurst(ControllerContext, SpbContext, 0x10007f04, Data);
+}
+
+VOID
+HimaxSelectEventLayout(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN ULONG MaxPoints
+)
+/*++
+
+Routine Description:
+
+      Selects the event stack layout, and with it the decoder, for the
+      number of touch points the firmware reports. Unsupported counts
+      fall back to the default layout.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      MaxPoints - The number of touch points, 0 for the default
+
+Return Value:
+
+      None
+
+--*/
+{
+      const HIMAX_EVENT_LAYOUT* layout;
+
+      layout = HimaxDecodeGetLayout(MaxPoints);
+
+      if (layout == NULL)
+      {
+            if (MaxPoints != 0)
+            {
+                  Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_INIT,
+                        "No event stack layout for %d points, using %d",
+                        MaxPoints,
+                        HIMAX_EVENT_STACK_DEFAULT_POINTS);
+            }
+
+            layout = HimaxDecodeGetLayout(HIMAX_EVENT_STACK_DEFAULT_POINTS);
+      }
+
+      ControllerContext->Layout = layout;
+      ControllerContext->Capture.FrameSize = layout->FrameSize;
+}
+
+static
+VOID
+HimaxFilterSelectProfile(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN HIMAX_FILTER_PROFILE Profile
+)
+{
+      HIMAX_FILTER_CONTROL* filter = &ControllerContext->Filter;
+
+      if (Profile == filter->Profile)
+      {
+            return;
+      }
+
+      filter->Switches++;
+      filter->Profile = Profile;
+
+      //
+      // Only the parameters change, the slots are kept so contacts down
+      // across the switch stay reported and keep their deadband anchor
+      //
+      filter->Filter.Params = filter->Profiles[Profile];
+}
+
+VOID
+HimaxFilterInitialize(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+      Sets up the contact filter profiles from the controller settings
+      and starts with the battery profile.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+
+Return Value:
+
+      None
+
+--*/
+{
+      HIMAX_FILTER_CONTROL* filter = &ControllerContext->Filter;
+
+      filter->Profiles[HimaxFilterNormal].Deadband = ControllerContext->Config.FilterDeadband;
+      filter->Profiles[HimaxFilterNormal].DebounceFrames = 0;
+      filter->Profiles[HimaxFilterCharger].Deadband = ControllerContext->Config.ChargerFilterDeadband;
+      filter->Profiles[HimaxFilterCharger].DebounceFrames = ControllerContext->Config.ChargerDebounceFrames;
+
+      filter->Profile = HimaxFilterNormal;
+      HimaxFilterReset(&filter->Filter, &filter->Profiles[HimaxFilterNormal]);
+}
+
+NTSTATUS
+HimaxBuildFunctionsTable(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext
+)
+{
+      UNREFERENCED_PARAMETER(SpbContext);
+      UNREFERENCED_PARAMETER(ControllerContext);
+
+      return STATUS_SUCCESS;
+}
+
+NTSTATUS
+HimaxChangePage(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN int DesiredPage
+)
+{
+      UNREFERENCED_PARAMETER(SpbContext);
+      UNREFERENCED_PARAMETER(ControllerContext);
+      UNREFERENCED_PARAMETER(DesiredPage);
+
+      return STATUS_SUCCESS;
+}
+
+static
+ULONG
+HimaxConfigurationRegisters(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      OUT HIMAX_RESUME_REGISTER* Registers
+)
+/*++
+
+Routine Description:
+
+      Lists the firmware registers the driver configures, with the values
+      the current settings call for.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      Registers - Receives up to HIMAX_RESUME_MAX_REGISTERS registers
+
+Return Value:
+
+      The number of registers listed
+
+--*/
+{
+      ULONG count = 0;
+
+      // fw_addr_raw_out_sel
+      Registers[count].Address = 0x800204b4;
+      Registers[count++].Value = 0;
+
+      // fw_addr_sorting_mode_en
+      Registers[count].Address = 0x10007f04;
+      Registers[count++].Value = 0;
+
+      //
+      // A zero flash part has no flash to reload from across a reset, it
+      // has to keep running the image uploaded to SRAM
+      //
+      if (ControllerContext->Config.ZeroFlash != 0)
+      {
+            Registers[count].Address = HIMAX_ZERO_FLASH_RELOAD_ADDRESS;
+            Registers[count++].Value = HIMAX_ZERO_FLASH_RELOAD_DISABLE;
+      }
+
+      //
+      // The firmware comes out of reset at its own rate
+      //
+      if (ControllerContext->ReportRate.Register != 0 &&
+          ControllerContext->ReportRate.Hz != HIMAX_REPORT_RATE_FIRMWARE_DEFAULT)
+      {
+            Registers[count].Address = ControllerContext->ReportRate.Register;
+            Registers[count++].Value = ControllerContext->ReportRate.Hz;
+      }
+
+      //
+      // Nor does it remember a charger seen before the reset
+      //
+      if (ControllerContext->Filter.ChargerConnected)
+      {
+            Registers[count].Address = HIMAX_USB_DETECT_ADDRESS;
+            Registers[count++].Value = HIMAX_USB_DETECT_CONNECTED;
+      }
+
+      return count;
+}
+
+static
+VOID
+HimaxBuildConfiguration(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      OUT HIMAX_COMMAND_LIST* List
+)
+/*++
+
+Routine Description:
+
+      Records writing the configuration registers.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      List - Receives the command list
+
+Return Value:
+
+      None
+
+--*/
+{
+      HIMAX_RESUME_REGISTER registers[HIMAX_RESUME_MAX_REGISTERS];
+      UINT8 tmp[FOUR_BYTE_DATA_SZ];
+      ULONG count;
+      ULONG i;
+
+      count = HimaxConfigurationRegisters(ControllerContext, registers);
+
+      HimaxCommandListInit(List);
+      HimaxCommandListBurstEnable(List, 0);
+
+      for (i = 0; i < count; i++)
+      {
+            tmp[0] = (UINT8)(registers[i].Value & 0xff);
+            tmp[1] = (UINT8)((registers[i].Value >> 8) & 0xff);
+            tmp[2] = (UINT8)((registers[i].Value >> 16) & 0xff);
+            tmp[3] = (UINT8)((registers[i].Value >> 24) & 0xff);
+
+            HimaxCommandListRegisterWrite(List, registers[i].Address, tmp);
+      }
+}
+
+NTSTATUS
+HimaxConfigureFunctions(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext
+)
+{
+      NTSTATUS status;
+      HIMAX_COMMAND_LIST list;
+
+      HimaxBuildConfiguration(ControllerContext, &list);
+
+      status = HimaxCommandListExecute(ControllerContext, SpbContext, &list);
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_INIT,
+                  "Error configuring raw out and sorting mode - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+      status = HimaxMCUSenseOn(ControllerContext, SpbContext, 0x00);
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_INIT,
+                  "Error turning sensing on - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+      HimaxSelectEventLayout(ControllerContext, ControllerContext->Config.MaxPoints);
+
+      ControllerContext->MaxFingers = (BYTE)ControllerContext->Layout->MaxPoints;
+
+exit:
+      return status;
+}
+
+static
+NTSTATUS
+HimaxCommandListReference(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN HIMAX_COMMAND_LIST_CHECK_ID Check
+)
+/*++
+
+Routine Description:
+
+      Issues a sequence the way it was issued before command lists, one
+      bus or register write per call.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+      Check - The sequence to issue
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
+{
+      NTSTATUS status = STATUS_SUCCESS;
+      HIMAX_RESUME_REGISTER registers[HIMAX_RESUME_MAX_REGISTERS];
+      UINT8 tmp[FOUR_BYTE_DATA_SZ];
+      ULONG count;
+      ULONG i;
+
+      RtlZeroMemory(tmp, sizeof(tmp));
+
+      switch (Check)
+      {
+      case HimaxCommandListCheckSystemReset:
+            tmp[0] = 0x55; // fw_data_system_reset
+
+            // addr_system_reset
+            status = HimaxMCURegisterWrite(ControllerContext, SpbContext, 0x90000018, tmp, FOUR_BYTE_DATA_SZ, 0);
+            break;
+      case HimaxCommandListCheckFirmwareRelease:
+            // fw_addr_ctrl_fw
+            status = HimaxMCURegisterWrite(ControllerContext, SpbContext, 0x9000005c, tmp, FOUR_BYTE_DATA_SZ, 0);
+            break;
+      case HimaxCommandListCheckPasswordClear:
+            // ic_adr_i2c_psw_lb
+            status = HimaxBusWrite(SpbContext, 0x31, tmp, 1, &ControllerContext->BringUpRetry);
+            if (!NT_SUCCESS(status)) break;
+
+            // ic_adr_i2c_psw_ub
+            status = HimaxBusWrite(SpbContext, 0x32, tmp, 1, &ControllerContext->BringUpRetry);
+            if (!NT_SUCCESS(status)) break;
+
+            // fw_addr_safe_mode_release_pw, fw_data_safe_mode_release_pw_reset
+            status = HimaxMCURegisterWrite(ControllerContext, SpbContext, 0x90000098, tmp, FOUR_BYTE_DATA_SZ, 0);
+            break;
+      case HimaxCommandListCheckConfiguration:
+            count = HimaxConfigurationRegisters(ControllerContext, registers);
+
+            for (i = 0; i < count; i++)
+            {
+                  tmp[0] = (UINT8)(registers[i].Value & 0xff);
+                  tmp[1] = (UINT8)((registers[i].Value >> 8) & 0xff);
+                  tmp[2] = (UINT8)((registers[i].Value >> 16) & 0xff);
+                  tmp[3] = (UINT8)((registers[i].Value >> 24) & 0xff);
+
+                  status = HimaxMCURegisterWrite(ControllerContext, SpbContext, registers[i].Address, tmp, FOUR_BYTE_DATA_SZ, 0);
+                  if (!NT_SUCCESS(status)) break;
+            }
+            break;
+      default:
+            status = STATUS_INVALID_PARAMETER;
+            break;
+      }
+
+      return status;
+}
+
+static
+VOID
+HimaxCommandListBuild(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN HIMAX_COMMAND_LIST_CHECK_ID Check,
+      OUT HIMAX_COMMAND_LIST* List
+)
+{
+      switch (Check)
+      {
+      case HimaxCommandListCheckSystemReset:
+            HimaxBuildSystemReset(List);
+            break;
+      case HimaxCommandListCheckFirmwareRelease:
+            HimaxBuildFirmwareRelease(List);
+            break;
+      case HimaxCommandListCheckPasswordClear:
+            HimaxBuildPasswordClear(List);
+            break;
+      default:
+            HimaxBuildConfiguration(ControllerContext, List);
+            break;
+      }
+}
+
+NTSTATUS
+HimaxCommandListVerify(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      OUT HIMAX_COMMAND_LIST_CHECK* Checks
+)
+/*++
+
+Routine Description:
+
+      Runs each command list the driver builds against the simulated
+      chip, next to the per-call sequence it replaced, and compares what
+      reached the chip byte for byte. The lists are pure data, so this
+      needs no hardware and does not touch the controller.
+
+Arguments:
+
+      ControllerContext - Touch controller context, whose configuration
+      the lists are built from
+      Checks - Receives one result per HIMAX_COMMAND_LIST_CHECK_ID
+
+Return Value:
+
+      NTSTATUS indicating whether the checks could be run, their
+      results are in Checks
+
+--*/
+{
+      NTSTATUS status;
+      HIMAX_SIMULATOR* simulator = NULL;
+      HIMAX_SIM_OPERATION* reference = NULL;
+      HIMAX_COMMAND_LIST list;
+      HIMAX_COMMAND_LIST_CHECK* result;
+      ULONG referenceCount;
+      BOOLEAN referenceOverflow;
+      ULONG check;
+
+      RtlZeroMemory(Checks, sizeof(HIMAX_COMMAND_LIST_CHECK) * HimaxCommandListChecks);
+
+      status = HimaxSimCreate(ControllerContext, &simulator);
+      if (!NT_SUCCESS(status)) goto exit;
+
+      reference = (HIMAX_SIM_OPERATION*)ExAllocatePool2(
+            POOL_FLAG_NON_PAGED,
+            sizeof(HIMAX_SIM_OPERATION) * HIMAX_SIM_MAX_OPERATIONS,
+            TOUCH_POOL_TAG_F12);
+
+      if (reference == NULL)
+      {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+      }
+
+      for (check = 0; check < HimaxCommandListChecks; check++)
+      {
+            result = &Checks[check];
+
+            HimaxSimReset(simulator);
+
+            result->Status = HimaxCommandListReference(
+                  &simulator->Controller,
+                  &simulator->Spb,
+                  (HIMAX_COMMAND_LIST_CHECK_ID)check);
+
+            if (!NT_SUCCESS(result->Status)) continue;
+
+            referenceCount = simulator->LogCount;
+            referenceOverflow = simulator->LogOverflow;
+            RtlCopyMemory(reference, simulator->Log, referenceCount * sizeof(HIMAX_SIM_OPERATION));
+
+            result->Operations = referenceCount;
+            result->ReferenceSubmissions = simulator->Counters.Submissions;
+            result->ReferenceTransfers = simulator->Counters.Transfers;
+
+            HimaxSimReset(simulator);
+
+            HimaxCommandListBuild(&simulator->Controller, (HIMAX_COMMAND_LIST_CHECK_ID)check, &list);
+
+            result->Status = HimaxCommandListExecute(&simulator->Controller, &simulator->Spb, &list);
+
+            if (!NT_SUCCESS(result->Status)) continue;
+
+            result->ListSubmissions = simulator->Counters.Submissions;
+            result->ListTransfers = simulator->Counters.Transfers;
+
+            result->Equivalent = HimaxSimCompareLogs(
+                  reference,
+                  referenceCount,
+                  simulator->Log,
+                  simulator->LogCount,
+                  &result->FirstMismatch);
+
+            if (referenceOverflow || simulator->LogOverflow)
+            {
+                  result->Equivalent = FALSE;
+            }
+
+            if (!result->Equivalent)
+            {
+                  Trace(
+                        TRACE_LEVEL_ERROR,
+                        TRACE_INIT,
+                        "Command list %d differs from its per-call sequence at operation %d",
+                        check,
+                        result->FirstMismatch);
+            }
+      }
+
+exit:
+      if (reference != NULL)
+      {
+            ExFreePoolWithTag(reference, TOUCH_POOL_TAG_F12);
+      }
+
+      if (simulator != NULL)
+      {
+            HimaxSimDelete(simulator);
+      }
+
+      return status;
+}
+
+BOOLEAN
+HimaxReportRateSupported(
+      IN ULONG Hz
+)
+/*++
+
+Routine Description:
+
+      Checks a report rate is one of the modes the driver offers. The
+      lowest is meant for idling.
+
+Arguments:
+
+      Hz - The report rate, 0 for the firmware default
+
+Return Value:
+
+      TRUE if the rate can be selected
+
+--*/
+{
+      switch (Hz)
+      {
+      case HIMAX_REPORT_RATE_FIRMWARE_DEFAULT:
+      case 30:
+      case 60:
+      case 90:
+      case 120:
+      case 240:
+            return TRUE;
+      default:
+            return FALSE;
+      }
+}
+
+NTSTATUS
+HimaxSetReportRate(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN ULONG Hz
+)
+/*++
+
+Routine Description:
+
+      Switches the scan rate of a running controller. The rate is kept
+      and reapplied whenever the controller is configured again. The
+      firmware default cannot be restored without a reset, so it is
+      not accepted here.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+      Hz - The report rate
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
+{
+      NTSTATUS status;
+      UINT8 rate[FOUR_BYTE_DATA_SZ];
+
+      if (Hz == HIMAX_REPORT_RATE_FIRMWARE_DEFAULT || !HimaxReportRateSupported(Hz))
+      {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+      }
+
+      if (ControllerContext->ReportRate.Register == 0)
+      {
+            status = STATUS_NOT_SUPPORTED;
+            goto exit;
+      }
+
+      rate[0] = (UINT8)(Hz & 0xff);
+      rate[1] = (UINT8)((Hz >> 8) & 0xff);
+      rate[2] = (UINT8)((Hz >> 16) & 0xff);
+      rate[3] = (UINT8)((Hz >> 24) & 0xff);
+
+      status = HimaxMCURegisterWrite(
+            ControllerContext,
+            SpbContext,
+            ControllerContext->ReportRate.Register,
+            rate,
+            sizeof(rate),
+            0);
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_INIT,
+                  "Error setting report rate to %d Hz - 0x%08lX",
+                  Hz,
+                  status);
+
+            goto exit;
+      }
+
+      ControllerContext->ReportRate.Hz = Hz;
+      ControllerContext->ReportRate.Changes++;
+
+      HimaxResumeUpdateSnapshot(ControllerContext, ControllerContext->ReportRate.Register, Hz);
+
+      //
+      // Start measuring the new rate afresh
+      //
+      ControllerContext->ReportRate.LastFrame = 0;
+      ControllerContext->ReportRate.IntervalTicks = 0;
+      ControllerContext->ReportRate.Intervals = 0;
+
+exit:
+      return status;
+}
+
+static
+VOID
+HimaxReportRateSample(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN LONGLONG Timestamp
+)
+/*++
+
+Routine Description:
+
+      Accounts the interval since the previous event stack read, unless
+      the screen was left untouched in between.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      Timestamp - Completion time of the read
+
+Return Value:
+
+      None
+
+--*/
+{
+      HIMAX_REPORT_RATE* rate = &ControllerContext->ReportRate;
+      LARGE_INTEGER frequency;
+      LONGLONG interval;
+
+      KeQueryPerformanceCounter(&frequency);
+
+      interval = Timestamp - rate->LastFrame;
+      rate->LastFrame = Timestamp;
+
+      if (interval > 0 &&
+          interval < frequency.QuadPart * HIMAX_REPORT_RATE_MAX_GAP_MS / 1000)
+      {
+            rate->IntervalTicks += interval;
+            rate->Intervals++;
+      }
+}
+
+ULONG
+HimaxGetMeasuredReportRate(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+      Returns the rate event stack frames arrived at while touched,
+      since the report rate last changed.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+
+Return Value:
+
+      The measured rate in millihertz, 0 if nothing was measured yet
+
+--*/
+{
+      HIMAX_REPORT_RATE* rate = &ControllerContext->ReportRate;
+      LARGE_INTEGER frequency;
+
+      if (rate->IntervalTicks == 0)
+      {
+            return 0;
+      }
+
+      KeQueryPerformanceCounter(&frequency);
+
+      return (ULONG)min(
+            (ULONGLONG)rate->Intervals * (ULONGLONG)frequency.QuadPart * 1000 /
+                  (ULONGLONG)rate->IntervalTicks,
+            MAXULONG);
+}
+
+static
+VOID
+HimaxDiscardFrame(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN HIMAX_FRAME_DISCARD Reason
+)
+/*++
+
+Routine Description:
+
+      Accounts for an event stack frame dropped before reporting.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      Reason - Why the frame was dropped
+
+Return Value:
+
+      None
+
+--*/
+{
+      ControllerContext->FrameStats.Discarded[Reason]++;
+
+      Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_SAMPLES,
+            "Discarding event stack frame, reason %d",
+            Reason);
+}
+
+NTSTATUS
+HimaxDecodeEventStack(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN HIMAX_EVENT_DATA* EventData,
+      IN ULONG Length,
+      OUT DETECTED_OBJECTS* Data
+)
+/*++
+
+Routine Description:
+
+      This routine decodes a raw event stack frame into touch objects.
+      It does not touch the bus, so captured frames can be fed through
+      it again.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      EventData - The raw event stack frame
+      Length - The number of bytes read, less than the frame size for a
+               predicted read, with the remaining slots filled as empty
+      Data - A pointer to the returned touch data
+
+Return Value:
+
+      NTSTATUS, where only success indicates data was returned
+
+--*/
+{
+      NTSTATUS status = STATUS_SUCCESS;
+      HIMAX_CONTROLLER_CONTEXT* controller = ControllerContext;
+      const HIMAX_EVENT_LAYOUT* layout = controller->Layout;
+      UINT8* stateInfo;
+      ULONG mask;
+      ULONG fingerNum;
+
+      RtlCopyMemory(controller->CoordBuf, EventData->data, layout->FrameSize);
+
+      //
+      // A predicted read stops short of the info bytes, the state info
+      // is then kept
+      //
+      if (Length >= layout->FrameSize)
+      {
+          stateInfo = &controller->CoordBuf[layout->InfoOffset + 1];
+
+          if (stateInfo[0] != 0xff && stateInfo[1] != 0xff)
+          {
+              RtlCopyMemory(controller->StateInfo, stateInfo, 2);
+          }
+          else {
+              RtlZeroMemory(controller->StateInfo, 2);
+          }
+      }
+
+      status = HimaxDecodeFrame(
+          layout,
+          &controller->Bounds,
+          controller->CoordBuf,
+          Length,
+          Data,
+          &mask,
+          &fingerNum);
+
+      if (!NT_SUCCESS(status))
+      {
+          HimaxDiscardFrame(controller, HimaxFrameDiscardFingerCount);
+          goto exit;
+      }
+
+      controller->OldFinger = controller->PreFingerMask;
+      controller->PreFingerMask = mask;
+      controller->FingerNum = (UINT8)fingerNum;
+      controller->FingerOn = 1;
+      controller->AAPress = 1;
+
+      if (controller->PreFingerMask != controller->OldFinger)
+      {
+          Trace(
+              TRACE_LEVEL_VERBOSE,
+              TRACE_SAMPLES,
+              "Fingers 0x%05lX -> 0x%05lX (%d reported)",
+              controller->OldFinger,
+              controller->PreFingerMask,
+              controller->FingerNum);
+      }
+
+exit:
+      return status;
+}
+
+static
+ULONG
+HimaxPredictEventStackLength(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+      Sizes the next event stack read. The firmware hands a new finger
+      the lowest free slot, so a read covering the slots occupied in the
+      last frame plus one spare slot holds every finger unless the spare
+      is taken. Such a read stops before the info bytes and cannot be
+      validated, so a full frame is read periodically, and always while
+      frames are being captured.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+
+Return Value:
+
+      The number of bytes to read
+
+--*/
+{
+      const HIMAX_EVENT_LAYOUT* layout = ControllerContext->Layout;
+      ULONG highest;
+      ULONG slots;
+
+      if (!ControllerContext->Config.PredictedReads ||
+          ControllerContext->Capture.Enabled ||
+          ControllerContext->BusState.PredictedSinceFull >= HIMAX_PREDICTED_READ_FULL_INTERVAL)
+      {
+          return layout->FrameSize;
+      }
+
+      slots = 1;
+
+      if (_BitScanReverse(&highest, ControllerContext->PreFingerMask))
+      {
+          slots = highest + 2;
+      }
+
+      if (slots >= layout->MaxPoints)
+      {
+          return layout->FrameSize;
+      }
+
+      return HIMAX_LAYOUT_COORD_SIZE(slots);
+}
+
+static
+BOOLEAN
+HimaxPredictionMissed(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN UINT8* Frame,
+      IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+      Checks the spare slot of a predicted read. A finger in it may have
+      company in the slots that were not read.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      Frame - The predicted read
+      Length - The number of bytes read
+
+Return Value:
+
+      TRUE if the full frame has to be read
+
+--*/
+{
+      UINT8* spare = &Frame[Length - HIMAX_LAYOUT_COORD_SIZE(1)];
+      ULONG x;
+      ULONG y;
+
+      x = ((ULONG)spare[0] << 8) | spare[1];
+      y = ((ULONG)spare[2] << 8) | spare[3];
+
+      return (x <= ControllerContext->Bounds.MaxX && y <= ControllerContext->Bounds.MaxY);
+}
+
+NTSTATUS
+HimaxGetObjectStatusFromControllerF12(
+      IN VOID* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN DETECTED_OBJECTS* Data
+)
+/*++
+
+Routine Description:
+
+      This routine reads raw touch messages from hardware. If there is
+      no touch data available (if a non-touch interrupt fired), the
+      function will not return success and no touch data was transferred.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+      Data - A pointer to any returned F11 touch data
+
+Return Value:
+
+      NTSTATUS, where only success indicates data was returned
+
+--*/
+{
+      NTSTATUS status;
+      HIMAX_CONTROLLER_CONTEXT* controller;
+
+      HIMAX_EVENT_DATA controllerData;
+      HIMAX_FRAME_DISCARD discard;
+      ULONG frameSize;
+      ULONG length;
+      controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
+
+      frameSize = controller->Layout->FrameSize;
+      length = HimaxPredictEventStackLength(controller);
+
+      if (length < frameSize)
+      {
+            //
+            // Slots past a predicted read decode as empty
+            //
+            RtlFillMemory(controllerData.data, frameSize, 0xFF);
+      }
+
+      status = HimaxBusReadEventStack(controller, SpbContext, controllerData.data, length);
+
+      controller->BusReadTimestamp = KeQueryPerformanceCounter(NULL).QuadPart;
+
+      if (NT_SUCCESS(status) && length < frameSize)
+      {
+            if (HimaxPredictionMissed(controller, controllerData.data, length))
+            {
+                  controller->BusState.Mispredictions++;
+                  controller->BusState.BytesWasted += length;
+
+                  length = frameSize;
+                  status = HimaxBusReadEventStack(controller, SpbContext, controllerData.data, length);
+
+                  controller->BusReadTimestamp = KeQueryPerformanceCounter(NULL).QuadPart;
+            }
+            else
+            {
+                  controller->BusState.PredictedReads++;
+                  controller->BusState.BytesSaved += frameSize - length;
+            }
+      }
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_INTERRUPT,
+                  "Error reading finger status data - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+      HimaxReportRateSample(controller, controller->BusReadTimestamp);
+
+      if (length < frameSize)
+      {
+            controller->BusState.PredictedSinceFull++;
+      }
+      else
+      {
+            controller->BusState.PredictedSinceFull = 0;
+
+            HimaxCaptureAppendFrame(
+                  &controller->Capture,
+                  (UINT8*)&controllerData,
+                  controller->BusReadTimestamp);
+
+            //
+            // A successful bus read does not make a frame trustworthy, drop
+            // corrupt ones before they reach the report cache
+            //
+            discard = HimaxDecodeValidateFrame(controller->Layout, controllerData.data);
+
+            if (discard != HimaxFrameValid)
+            {
+                  HimaxDiscardFrame(controller, discard);
+                  status = STATUS_DATA_ERROR;
+                  goto exit;
+            }
+      }
+
+      status = HimaxDecodeEventStack(controller, &controllerData, length, Data);
+
+      if (NT_SUCCESS(status))
+      {
+            controller->FrameStats.Accepted++;
+      }
+
+exit:
+      return status;
+}
+
+static
+VOID
+HimaxFilterApply(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN OUT DETECTED_OBJECTS* Data
+)
+{
+      HIMAX_FILTER_CONTROL* filter = &ControllerContext->Filter;
+      HIMAX_FILTER_PROFILE profile = filter->Profile;
+
+      HimaxFilterMeasure(&filter->RawPrevious, Data, &filter->Raw[profile]);
+      filter->RawPrevious = *Data;
+
+      HimaxFilterObjects(&filter->Filter, Data, &filter->Filtered[profile]);
+
+      HimaxFilterMeasure(&filter->Previous, Data, &filter->Filtered[profile]);
+      filter->Previous = *Data;
+}
+
+static
+VOID
+HimaxResumeRecordReport(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+{
+      HIMAX_RESUME* resume = &ControllerContext->Resume;
+      HIMAX_RESUME_TIMING* timing;
+      LARGE_INTEGER frequency;
+      ULONG elapsedInUs;
+
+      resume->AwaitingReport = FALSE;
+
+      elapsedInUs = (ULONG)min(
+            (ULONGLONG)(KeQueryPerformanceCounter(&frequency).QuadPart - resume->Start) * 1000000 /
+                  (ULONGLONG)frequency.QuadPart,
+            MAXULONG);
+
+      timing = &resume->Paths[resume->LastPath];
+      timing->FirstReports++;
+      timing->LastFirstReportInUs = elapsedInUs;
+      timing->MaxFirstReportInUs = max(timing->MaxFirstReportInUs, elapsedInUs);
+}
+
+NTSTATUS
+TchServiceObjectInterrupts(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN PREPORT_CONTEXT ReportContext
+)
+{
+      NTSTATUS status = STATUS_SUCCESS;
+      DETECTED_OBJECTS data;
+      BOOLEAN waking;
+      RtlZeroMemory(&data, sizeof(data));
+
+      //
+      // See if new touch data is available
+      //
+      status = HimaxGetObjectStatusFromControllerF12(
+            ControllerContext,
+            SpbContext,
+            &data
+      );
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_VERBOSE,
+                  TRACE_SAMPLES,
+                  "No object data to report - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+      ReportContext->Latency.Points[LatencyPointBusRead] = ControllerContext->BusReadTimestamp;
+
+      HimaxFilterApply(ControllerContext, &data);
+
+      LatencyStamp(&ReportContext->Latency, LatencyPointDecoded);
+
+      waking = HimaxScanOnFrame(ControllerContext, SpbContext);
+
+      if (ControllerContext->ProcessReports)
+      {
+          status = ReportObjects(
+              ReportContext,
+              data);
+      }
+
+      if (waking && NT_SUCCESS(status))
+      {
+          HimaxScanRecordWake(
+              ControllerContext,
+              ReportContext->Latency.Points[LatencyPointInterrupt]);
+      }
+
+      //
+      // The first contact after a resume closes its timing
+      //
+      if (ControllerContext->Resume.AwaitingReport &&
+          ControllerContext->PreFingerMask != 0 &&
+          NT_SUCCESS(status))
+      {
+          HimaxResumeRecordReport(ControllerContext);
+      }
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_VERBOSE,
+                  TRACE_SAMPLES,
+                  "Error while reporting objects - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+exit:
+      return status;
+}
+
+
+NTSTATUS
+TchServiceGestureInterrupts(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN PREPORT_CONTEXT ReportContext
+)
+/*++
+
+Routine Description:
+
+      Services an interrupt raised in smart wake mode, turning a double
+      tap into a wake report.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+      ReportContext - The report context
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
+{
+      NTSTATUS status;
+      HIMAX_GESTURE* gesture = &ControllerContext->Gesture;
+      HIMAX_EVENT_DATA controllerData;
+      LARGE_INTEGER frequency;
+      ULONGLONG nowMs;
+      LONGLONG interrupt;
+      ULONG elapsedInUs;
+      UINT8 id;
+
+      status = HimaxBusReadEventStack(
+            ControllerContext,
+            SpbContext,
+            controllerData.data,
+            ControllerContext->Layout->FrameSize);
+
+      ControllerContext->BusReadTimestamp = KeQueryPerformanceCounter(NULL).QuadPart;
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_INTERRUPT,
+                  "Error reading gesture data - 0x%08lX",
+                  status);
+
+            goto exit;
+      }
+
+      HimaxCaptureAppendFrame(
+            &ControllerContext->Capture,
+            controllerData.data,
+            ControllerContext->BusReadTimestamp);
+
+      id = HimaxDecodeGesture(controllerData.data, ControllerContext->Layout->FrameSize);
+
+      if (id != HIMAX_GESTURE_DOUBLE_TAP)
+      {
+            gesture->Ignored++;
+            goto exit;
+      }
+
+      gesture->Detected++;
+
+      //
+      // One tap sequence can raise more than one gesture event
+      //
+      nowMs = KeQueryInterruptTime() / 10000;
+
+      if (gesture->Reported != 0 && nowMs - gesture->LastWakeMs < gesture->DedupWindowMs)
+      {
+            gesture->Suppressed++;
+            goto exit;
+      }
+
+      status = ReportWakeup(ReportContext);
+
+      if (!NT_SUCCESS(status))
+      {
+            goto exit;
+      }
+
+      gesture->LastWakeMs = nowMs;
+      gesture->Reported++;
+
+      interrupt = ReportContext->Latency.Points[LatencyPointInterrupt];
+
+      if (interrupt != 0)
+      {
+            elapsedInUs = (ULONG)min(
+                  (ULONGLONG)(KeQueryPerformanceCounter(&frequency).QuadPart - interrupt) * 1000000 /
+                        (ULONGLONG)frequency.QuadPart,
+                  MAXULONG);
+
+            gesture->LastWakeInUs = elapsedInUs;
+            gesture->MaxWakeInUs = max(gesture->MaxWakeInUs, elapsedInUs);
+      }
+
+exit:
+      return status;
+}
+
+NTSTATUS
+HimaxServiceInterrupts(
+      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+      IN SPB_CONTEXT* SpbContext,
+      IN PREPORT_CONTEXT ReportContext
+)
+{
+      NTSTATUS status = STATUS_SUCCESS;
+
+      if (ControllerContext->Gesture.Enabled)
+      {
+            TchServiceGestureInterrupts(ControllerContext, SpbContext, ReportContext);
+      }
+      else
+      {
+            TchServiceObjectInterrupts(ControllerContext, SpbContext, ReportContext);
+      }
+
+      return status;
+}
+
+NTSTATUS
+HimaxSetReportingFlagsF12(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UCHAR NewMode,
+    OUT UCHAR* OldMode
+)
+{
+      NTSTATUS status = STATUS_SUCCESS;
+      BOOLEAN gestureMode;
+
+      if (OldMode != NULL)
+      {
+          *OldMode = ControllerContext->Gesture.Enabled ?
+              HX83112_F12_REPORTING_WAKEUP_GESTURE_MODE :
+              HX83112_F12_REPORTING_CONTINUOUS_MODE;
+      }
+
+      gestureMode = (NewMode == HX83112_F12_REPORTING_WAKEUP_GESTURE_MODE);
+
+      //
+      // Smart wake is a firmware mode, switch it whenever it changes
+      //
+      if (gestureMode != ControllerContext->Gesture.Enabled)
+      {
+          status = HimaxMCURegisterWriteVerified(
+              ControllerContext,
+              SpbContext,
+              HIMAX_SMWP_ENABLE_ADDRESS,
+              gestureMode ? HIMAX_SMWP_ENABLE : HIMAX_SMWP_DISABLE);
+
+          if (!NT_SUCCESS(status))
+          {
+              Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_POWER,
+                  "Error %s smart wake - 0x%08lX",
+                  gestureMode ? "enabling" : "disabling",
+                  status);
+
+              goto exit;
+          }
+
+          ControllerContext->Gesture.Enabled = gestureMode;
+      }
+
+      if (gestureMode)
+      {
+          ControllerContext->ProcessReports = FALSE;
+      }
+      else if (NewMode == HX83112_F12_REPORTING_CONTINUOUS_MODE)
+      {
+          ControllerContext->ProcessReports = TRUE;
+      }
+
+exit:
+      return status;
+}
+
+NTSTATUS
+HimaxChangeChargerConnectedState(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN UCHAR ChargerConnectedState
+)
+/*++
+
+Routine Description:
+
+      Switches the firmware in and out of its charger noise immunity
+      mode, and the contact filter to the matching profile.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+      ChargerConnectedState - Nonzero when on external power
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
+{
+      NTSTATUS status;
+      BOOLEAN connected;
+
+      connected = (ChargerConnectedState != 0);
+
+      //
+      // The filter follows the charger even if the chip cannot be told
+      // now, the firmware mode is restored with the configuration
+      //
+      ControllerContext->Filter.ChargerConnected = connected;
+
+      HimaxFilterSelectProfile(
+            ControllerContext,
+            connected ? HimaxFilterCharger : HimaxFilterNormal);
+
+      status = HimaxMCURegisterWriteVerified(
+            ControllerContext,
+            SpbContext,
+            HIMAX_USB_DETECT_ADDRESS,
+            connected ? HIMAX_USB_DETECT_CONNECTED : HIMAX_USB_DETECT_DISCONNECTED);
+
+      if (!NT_SUCCESS(status))
+      {
+            Trace(
+                  TRACE_LEVEL_ERROR,
+                  TRACE_POWER,
+                  "Error %s charger mode - 0x%08lX",
+                  connected ? "entering" : "leaving",
+                  status);
+
+            goto exit;
+      }
 
-NTSTATUS
-HimaxBuildFunctionsTable(
-      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-      IN SPB_CONTEXT* SpbContext
-)
-{
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
+      HimaxResumeUpdateSnapshot(
+            ControllerContext,
+            HIMAX_USB_DETECT_ADDRESS,
+            connected ? HIMAX_USB_DETECT_CONNECTED : HIMAX_USB_DETECT_DISCONNECTED);
 
-      return STATUS_SUCCESS;
+exit:
+      return status;
 }
 
 NTSTATUS
-HimaxChangePage(
-      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-      IN SPB_CONTEXT* SpbContext,
-      IN int DesiredPage
+HimaxResumeTakeSnapshot(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
 )
-{
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
-      UNREFERENCED_PARAMETER(DesiredPage);
+/*++
 
-      return STATUS_SUCCESS;
-}
+Routine Description:
 
-NTSTATUS
-HimaxConfigureFunctions(
-      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-      IN SPB_CONTEXT* SpbContext
-)
+      Reads back the configuration registers of a controller that was
+      just set up, for resume to replay.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+      NTSTATUS indicating success or failure. On failure the snapshot is
+      left empty and the next resume runs a full bring-up.
+
+--*/
 {
+      NTSTATUS status = STATUS_SUCCESS;
+      HIMAX_RESUME* resume = &ControllerContext->Resume;
       UINT8 tmp[FOUR_BYTE_DATA_SZ];
-      RtlZeroMemory(tmp, sizeof(tmp));
+      ULONG count;
+      ULONG i;
 
-      HimaxMCURegisterWrite(SpbContext, 0x800204b4, tmp, FOUR_BYTE_DATA_SZ, 0);
-      HimaxMCUAssignSortingMode(SpbContext, tmp);
-      HimaxMCUSenseOn(SpbContext, 0x00);
+      resume->Count = 0;
 
-      ControllerContext->MaxFingers = HX_MAX_PT;
+      count = HimaxConfigurationRegisters(ControllerContext, resume->Registers);
 
-      return STATUS_SUCCESS;
+      for (i = 0; i < count; i++)
+      {
+            status = HimaxMCURegisterRead(
+                  ControllerContext,
+                  SpbContext,
+                  resume->Registers[i].Address,
+                  tmp,
+                  sizeof(tmp),
+                  0);
+
+            if (!NT_SUCCESS(status))
+            {
+                  Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_POWER,
+                        "Error reading back register 0x%08lX, resume will run a full bring-up - 0x%08lX",
+                        resume->Registers[i].Address,
+                        status);
+
+                  goto exit;
+            }
+
+            resume->Registers[i].Value =
+                  (UINT32)tmp[0] |
+                  ((UINT32)tmp[1] << 8) |
+                  ((UINT32)tmp[2] << 16) |
+                  ((UINT32)tmp[3] << 24);
+      }
+
+      resume->Count = count;
+
+exit:
+      return status;
 }
 
-NTSTATUS
-HimaxGetObjectStatusFromControllerF12(
-      IN VOID* ControllerContext,
-      IN SPB_CONTEXT* SpbContext,
-      IN DETECTED_OBJECTS* Data
+VOID
+HimaxResumeUpdateSnapshot(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN UINT32 Address,
+    IN UINT32 Value
 )
 /*++
 
 Routine Description:
 
-      This routine reads raw touch messages from hardware. If there is
-      no touch data available (if a non-touch interrupt fired), the
-      function will not return success and no touch data was transferred.
+      Records a configuration register written after the snapshot was
+      taken, so resume replays its latest value.
 
 Arguments:
 
       ControllerContext - Touch controller context
-      SpbContext - A pointer to the current i2c context
-      Data - A pointer to any returned F11 touch data
+      Address - The register address
+      Value - The value written
 
 Return Value:
 
-      NTSTATUS, where only success indicates data was returned
+      None
 
 --*/
 {
-      NTSTATUS status;
-      HIMAX_CONTROLLER_CONTEXT* controller;
-
-      HIMAX_EVENT_DATA controllerData;
-      controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
-
-      status = HimaxBusReadEventStack(SpbContext, &controllerData, sizeof(controllerData));
+      HIMAX_RESUME* resume = &ControllerContext->Resume;
+      ULONG i;
 
-      if (!NT_SUCCESS(status))
+      //
+      // Without a snapshot resume runs a full bring-up, which applies
+      // the settings anyway
+      //
+      if (resume->Count == 0)
       {
-            Trace(
-                  TRACE_LEVEL_ERROR,
-                  TRACE_INTERRUPT,
-                  "Error reading finger status data - 0x%08lX",
-                  status);
-
-            goto exit;
+            return;
       }
 
-      RtlCopyMemory(controller->CoordBuf, &controllerData.data, touch_info_size);
+      for (i = 0; i < resume->Count; i++)
+      {
+            if (resume->Registers[i].Address == Address)
+            {
+                  resume->Registers[i].Value = Value;
+                  return;
+            }
+      }
 
-      if (controllerData.state_info[0] != 0xff && controllerData.state_info[1] != 0xff)
+      if (resume->Count < HIMAX_RESUME_MAX_REGISTERS)
       {
-          RtlCopyMemory(controller->StateInfo, &controllerData.state_info, 2);
+            resume->Registers[resume->Count].Address = Address;
+            resume->Registers[resume->Count].Value = Value;
+            resume->Count++;
       }
-      else {
-          RtlZeroMemory(controller->StateInfo, 2);
+      else
+      {
+            resume->Count = 0;
       }
+}
 
-      int x = 0;
-      int y = 0;
-      int w = 0;
-      int base = 0;
-      int loop_i = 0;
+static
+NTSTATUS
+HimaxResumeWaitFirmwareRunning(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+)
+/*++
 
-      controller->OldFinger = controller->PreFingerMask;
-      controller->PreFingerMask = 0;
-      controller->FingerNum = controller->CoordBuf[coord_info_size - 4] & 0x0f;
-      controller->FingerOn = 1;
-      controller->AAPress = 1;
+Routine Description:
 
-      for (loop_i = 0; loop_i < HX_MAX_PT; loop_i++)
-      {
-          base = loop_i * 4;
-          x = (int)controller->CoordBuf[base] << 8 | (int)controller->CoordBuf[base + 1];
-          y = (int)controller->CoordBuf[base + 2] << 8 | (int)controller->CoordBuf[base + 3];
-          w = (int)controller->CoordBuf[(HX_MAX_PT * 4) + loop_i];
+      Waits for the firmware released by resume to run again: the stop
+      request register no longer holds the request or its acknowledge,
+      and the central state is out of safe mode.
 
-          if (x >= 0 && x <= 1080 && y >= 0 && y <= 2160)
-          {
-              Data->States[loop_i] = OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS;
+Arguments:
 
-              Data->Positions[loop_i].X = x;
-              Data->Positions[loop_i].Y = y;
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
 
-              /*Trace(
-                  TRACE_LEVEL_INFORMATION,
-                  TRACE_INTERRUPT,
-                  "finger[%d]: x=%d, y=%d, w=%d",
-                  loop_i, x, y, w);*/
-          }
+Return Value:
+
+      NTSTATUS, STATUS_IO_TIMEOUT if the firmware did not restart
+
+--*/
+{
+      NTSTATUS status;
+      UINT8 control[FOUR_BYTE_DATA_SZ];
+      UINT8 state[FOUR_BYTE_DATA_SZ];
+      ULONG polls;
+
+      for (polls = 0; ; polls++)
+      {
+            // fw_addr_ctrl_fw
+            status = HimaxMCURegisterRead(ControllerContext, SpbContext, 0x9000005c, control, FOUR_BYTE_DATA_SZ, 0);
+            if (!NT_SUCCESS(status)) goto exit;
+
+            // fw_addr_cs_central_state, 0x0C is safe mode
+            status = HimaxMCURegisterRead(ControllerContext, SpbContext, 0x900000a8, state, FOUR_BYTE_DATA_SZ, 0);
+            if (!NT_SUCCESS(status)) goto exit;
+
+            if (control[0] != 0xA5 && control[0] != 0x87 && state[0] != 0x0C)
+            {
+                  break;
+            }
+
+            if (polls >= HIMAX_RESUME_RUN_POLLS)
+            {
+                  Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_POWER,
+                        "Firmware did not restart, control %x, state %x",
+                        control[0],
+                        state[0]);
+
+                  status = STATUS_IO_TIMEOUT;
+                  goto exit;
+            }
+
+            HimaxDelay(HIMAX_RESUME_RUN_POLL_US);
       }
 
 exit:
       return status;
 }
 
+static
 NTSTATUS
-TchServiceObjectInterrupts(
-      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-      IN SPB_CONTEXT* SpbContext,
-      IN PREPORT_CONTEXT ReportContext
+HimaxResumeReplay(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
 )
+/*++
+
+Routine Description:
+
+      Replays the register snapshot on a controller that kept its power,
+      releases its stopped firmware and checks that it runs again with
+      the configuration in place.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+      NTSTATUS indicating success or failure, the controller needs a full
+      bring-up on failure
+
+--*/
 {
-      NTSTATUS status = STATUS_SUCCESS;
-      DETECTED_OBJECTS data;
-      RtlZeroMemory(&data, sizeof(data));
+      NTSTATUS status;
+      HIMAX_RESUME* resume = &ControllerContext->Resume;
+      HIMAX_COMMAND_LIST list;
+      UINT8 tmp[FOUR_BYTE_DATA_SZ];
+      UINT32 value;
+      ULONG i;
 
-      //
-      // See if new touch data is available
-      //
-      status = HimaxGetObjectStatusFromControllerF12(
-            ControllerContext,
-            SpbContext,
-            &data
-      );
+      HimaxCommandListInit(&list);
+      HimaxCommandListBurstEnable(&list, 0);
 
-      if (!NT_SUCCESS(status))
+      for (i = 0; i < resume->Count; i++)
       {
-            Trace(
-                  TRACE_LEVEL_VERBOSE,
-                  TRACE_SAMPLES,
-                  "No object data to report - 0x%08lX",
-                  status);
+            tmp[0] = (UINT8)(resume->Registers[i].Value & 0xff);
+            tmp[1] = (UINT8)((resume->Registers[i].Value >> 8) & 0xff);
+            tmp[2] = (UINT8)((resume->Registers[i].Value >> 16) & 0xff);
+            tmp[3] = (UINT8)((resume->Registers[i].Value >> 24) & 0xff);
 
-            goto exit;
+            HimaxCommandListRegisterWrite(&list, resume->Registers[i].Address, tmp);
       }
 
-      if (ControllerContext->ProcessReports)
+      //
+      // fw_addr_ctrl_fw, lets the firmware stopped by sleep run again
+      //
+      RtlZeroMemory(tmp, sizeof(tmp));
+      HimaxCommandListRegisterWrite(&list, 0x9000005c, tmp);
+
+      status = HimaxCommandListExecute(ControllerContext, SpbContext, &list);
+      if (!NT_SUCCESS(status)) goto exit;
+
+      //
+      // Read-back alone passes on any chip that kept power, the firmware
+      // has to be seen running as well
+      //
+      status = HimaxResumeWaitFirmwareRunning(ControllerContext, SpbContext);
+      if (!NT_SUCCESS(status)) goto exit;
+
+      for (i = 0; i < resume->Count; i++)
       {
-          status = ReportObjects(
-              ReportContext,
-              data);
+            status = HimaxMCURegisterRead(
+                  ControllerContext,
+                  SpbContext,
+                  resume->Registers[i].Address,
+                  tmp,
+                  sizeof(tmp),
+                  0);
+
+            if (!NT_SUCCESS(status)) goto exit;
+
+            value =
+                  (UINT32)tmp[0] |
+                  ((UINT32)tmp[1] << 8) |
+                  ((UINT32)tmp[2] << 16) |
+                  ((UINT32)tmp[3] << 24);
+
+            if (value != resume->Registers[i].Value)
+            {
+                  Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_POWER,
+                        "Register 0x%08lX reads 0x%08lX after resume, expected 0x%08lX",
+                        resume->Registers[i].Address,
+                        value,
+                        resume->Registers[i].Value);
+
+                  status = STATUS_DEVICE_DATA_ERROR;
+                  goto exit;
+            }
       }
 
+exit:
       if (!NT_SUCCESS(status))
       {
-            Trace(
-                  TRACE_LEVEL_VERBOSE,
-                  TRACE_SAMPLES,
-                  "Error while reporting objects - 0x%08lX",
-                  status);
-
-            goto exit;
+            resume->PowerLost = TRUE;
       }
 
-exit:
       return status;
 }
 
-
+static
 NTSTATUS
-HimaxServiceInterrupts(
-      IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-      IN SPB_CONTEXT* SpbContext,
-      IN PREPORT_CONTEXT ReportContext
+HimaxResumeBringUp(
+    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
 )
+/*++
+
+Routine Description:
+
+      Configures the controller from scratch and takes a new snapshot.
+      A controller that could not be read back is still usable, the
+      next resume just runs a full bring-up again.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
 {
-      NTSTATUS status = STATUS_SUCCESS;
+      NTSTATUS status;
 
-      TchServiceObjectInterrupts(ControllerContext, SpbContext, ReportContext);
+      status = HimaxMCUInterfaceOn(ControllerContext, SpbContext);
+      if (!NT_SUCCESS(status)) goto exit;
 
+      status = HimaxConfigureFunctions(ControllerContext, SpbContext);
+      if (!NT_SUCCESS(status)) goto exit;
+
+      status = HimaxConfigureInterruptEnable(ControllerContext, SpbContext);
+      if (!NT_SUCCESS(status)) goto exit;
+
+      if (!NT_SUCCESS(HimaxResumeTakeSnapshot(ControllerContext, SpbContext)))
+      {
+            ControllerContext->Resume.PowerLost = TRUE;
+      }
+
+exit:
       return status;
 }
 
+static
 NTSTATUS
-HimaxSetReportingFlagsF12(
+HimaxResumeController(
     IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-    IN SPB_CONTEXT* SpbContext,
-    IN UCHAR NewMode,
-    OUT UCHAR* OldMode
+    IN SPB_CONTEXT* SpbContext
 )
+/*++
+
+Routine Description:
+
+      Brings a sleeping controller back to the configuration it had,
+      replaying the register snapshot if the controller kept its power
+      and falling back to a full bring-up otherwise.
+
+Arguments:
+
+      ControllerContext - Touch controller context
+      SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+      NTSTATUS indicating success or failure
+
+--*/
 {
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
-      UNREFERENCED_PARAMETER(NewMode);
-      UNREFERENCED_PARAMETER(OldMode);
+      NTSTATUS status = STATUS_UNSUCCESSFUL;
+      HIMAX_RESUME* resume = &ControllerContext->Resume;
+      HIMAX_RESUME_TIMING* timing;
+      HIMAX_RESUME_PATH path;
+      LARGE_INTEGER frequency;
+      LONGLONG start;
+      ULONG elapsedInUs;
+
+      start = KeQueryPerformanceCounter(&frequency).QuadPart;
 
-      if (NewMode == HX83112_F12_REPORTING_CONTINUOUS_MODE)
+      path = HimaxResumeFullInit;
+
+      if (resume->Count != 0 && !resume->PowerLost)
       {
-          ControllerContext->ProcessReports = TRUE;
+            status = HimaxResumeReplay(ControllerContext, SpbContext);
+
+            if (NT_SUCCESS(status))
+            {
+                  path = HimaxResumeSnapshot;
+            }
+            else
+            {
+                  resume->VerifyFailures++;
+
+                  Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_POWER,
+                        "Register snapshot did not verify, running a full bring-up - 0x%08lX",
+                        status);
+            }
       }
 
-      return STATUS_SUCCESS;
-}
+      if (path == HimaxResumeFullInit)
+      {
+            //
+            // Cleared first, a bring-up that could not take its snapshot
+            // sets it again
+            //
+            resume->PowerLost = FALSE;
+
+            status = HimaxResumeBringUp(ControllerContext, SpbContext);
+
+            if (!NT_SUCCESS(status))
+            {
+                  resume->PowerLost = TRUE;
+
+                  Trace(
+                        TRACE_LEVEL_ERROR,
+                        TRACE_POWER,
+                        "Error bringing up touch controller - 0x%08lX",
+                        status);
+
+                  goto exit;
+            }
+      }
 
-NTSTATUS
-HimaxChangeChargerConnectedState(
-    IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
-    IN SPB_CONTEXT* SpbContext,
-    IN UCHAR ChargerConnectedState
-)
-{
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
-      UNREFERENCED_PARAMETER(ChargerConnectedState);
+      resume->LastPath = path;
+      resume->Start = start;
+      resume->AwaitingReport = TRUE;
 
-      return STATUS_SUCCESS;
+      elapsedInUs = (ULONG)min(
+            (ULONGLONG)(KeQueryPerformanceCounter(NULL).QuadPart - start) * 1000000 /
+                  (ULONGLONG)frequency.QuadPart,
+            MAXULONG);
+
+      timing = &resume->Paths[path];
+      timing->Resumes++;
+      timing->LastReadyInUs = elapsedInUs;
+      timing->MaxReadyInUs = max(timing->MaxReadyInUs, elapsedInUs);
+
+      Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_POWER,
+            "Touch controller resumed by %s in %d us",
+            path == HimaxResumeSnapshot ? "snapshot replay" : "full bring-up",
+            elapsedInUs);
+
+exit:
+      return status;
 }
 
 NTSTATUS
@@ -729,11 +3562,58 @@ HimaxChangeSleepState(
     IN UCHAR SleepState
 )
 {
-      UNREFERENCED_PARAMETER(SpbContext);
-      UNREFERENCED_PARAMETER(ControllerContext);
-      UNREFERENCED_PARAMETER(SleepState);
+      NTSTATUS status = STATUS_SUCCESS;
 
-      return STATUS_SUCCESS;
+      //
+      // The chip may have lost its interface state while asleep
+      //
+      HimaxInvalidateBusState(ControllerContext);
+
+      if (SleepState == HX83112_F01_DEVICE_CONTROL_SLEEP_MODE_OPERATING)
+      {
+            HimaxResetCircuitBreaker(ControllerContext);
+
+            //
+            // In smart wake the chip never stopped scanning
+            //
+            if (!ControllerContext->Gesture.Enabled)
+            {
+                  status = HimaxResumeController(ControllerContext, SpbContext);
+                  if (!NT_SUCCESS(status)) goto exit;
+            }
+
+            HimaxScanStart(ControllerContext, SpbContext);
+      }
+      else
+      {
+            HimaxScanStop(ControllerContext);
+
+            if (ControllerContext->Gesture.Enabled)
+            {
+                  goto exit;
+            }
+
+            if (ControllerContext->Config.PepRemovesVoltageInD3 != 0)
+            {
+                  ControllerContext->Resume.PowerLost = TRUE;
+                  goto exit;
+            }
+
+            //
+            // Stops the firmware scanning but leaves its configuration in
+            // place for resume to pick up. A firmware that never
+            // acknowledged the stop cannot be assumed to be in that state.
+            //
+            status = HimaxMCUStopFirmware(ControllerContext, SpbContext);
+
+            if (!NT_SUCCESS(status))
+            {
+                  ControllerContext->Resume.PowerLost = TRUE;
+            }
+      }
+
+exit:
+      return status;
 }
 
 NTSTATUS
@@ -0,0 +1,252 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxreplay.c
+
+	Abstract:
+
+		Replays capture streams through event stack decoding, contact
+		filtering, the object cache and hid report packing. Nothing here
+		touches the controller, so the same code runs on the device and
+		in the host replay tool.
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim/compat.h>
+#ifndef HIMAX_USER_MODE
+#include <controller.h>
+#endif
+#include <reportpack.h>
+#include <hidCommon.h>
+#include <hx83112/hxreplay.h>
+#ifndef HIMAX_USER_MODE
+#include <hxreplay.tmh>
+#endif
+
+NTSTATUS
+HimaxReplayStream(
+	IN OUT HIMAX_REPLAY* Replay,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN const HIMAX_FILTER_PARAMS* Profiles,
+	IN HIMAX_FILTER_PROFILE Profile,
+	IN PVOID Stream,
+	IN ULONG Length,
+	OUT HIMAX_CAPTURE_REPLAY_STATS* Stats
+)
+/*++
+
+Routine Description:
+
+	Feeds the frames of a capture stream through event stack decoding,
+	contact filtering, the object cache and hid report packing, and
+	times the whole run. The decoded frames are run through every
+	filter profile to measure the jitter each leaves, and the output of
+	one of them is reported. No report leaves the replay.
+
+Arguments:
+
+	Replay - Zeroed scratch state for the replay
+	Props - The screen properties to translate the coordinates with, the
+		panel bounds are taken from its touch physical size
+	Profiles - The parameters of each filter profile
+	Profile - The profile whose output is reported
+	Stream - The capture stream to replay
+	Length - The size of the above stream
+	Stats - Receives replay counters
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HIMAX_CAPTURE_STREAM_HEADER* header;
+	HIMAX_CAPTURE_RECORD_HEADER* record;
+	HIMAX_CAPTURE_FRAME* frame;
+	DETECTED_OBJECTS data;
+	HID_INPUT_REPORT hidReport;
+	LARGE_INTEGER frequency;
+	LONGLONG start;
+	PUCHAR cursor;
+	PUCHAR end;
+	ULONG mask;
+	ULONG fingerNum;
+	ULONG i;
+	ULONG p;
+	int touchesReported;
+
+	RtlZeroMemory(Stats, sizeof(HIMAX_CAPTURE_REPLAY_STATS));
+
+	header = (HIMAX_CAPTURE_STREAM_HEADER*)Stream;
+
+	if (Length < sizeof(HIMAX_CAPTURE_STREAM_HEADER) ||
+		header->Magic != HIMAX_CAPTURE_MAGIC ||
+		header->Version != HIMAX_CAPTURE_VERSION ||
+		header->HeaderSize < sizeof(HIMAX_CAPTURE_STREAM_HEADER) ||
+		header->HeaderSize > Length ||
+		HimaxDecodeGetLayoutByFrameSize(header->FrameSize) == NULL)
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_SAMPLES,
+			"Invalid capture stream header");
+
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	Replay->Layout = HimaxDecodeGetLayoutByFrameSize(header->FrameSize);
+	Replay->Bounds.MaxX = (UINT16)min(Props->TouchPhysicalWidth, MAXUINT16);
+	Replay->Bounds.MaxY = (UINT16)min(Props->TouchPhysicalHeight, MAXUINT16);
+
+	for (p = 0; p < HimaxFilterProfiles; p++)
+	{
+		HimaxFilterReset(&Replay->Filters[p], &Profiles[p]);
+	}
+
+	cursor = (PUCHAR)Stream + header->HeaderSize;
+	end = (PUCHAR)Stream + Length;
+
+	start = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	for (i = 0; i < header->RecordCount; i++)
+	{
+		if ((ULONG)(end - cursor) < sizeof(HIMAX_CAPTURE_RECORD_HEADER))
+		{
+			status = STATUS_INVALID_PARAMETER;
+			goto exit;
+		}
+
+		record = (HIMAX_CAPTURE_RECORD_HEADER*)cursor;
+		cursor += sizeof(HIMAX_CAPTURE_RECORD_HEADER);
+
+		if ((ULONG)(end - cursor) < record->Length)
+		{
+			status = STATUS_INVALID_PARAMETER;
+			goto exit;
+		}
+
+		if (record->Type != HimaxCaptureRecordFrame ||
+			record->Length < sizeof(HIMAX_CAPTURE_FRAME))
+		{
+			Stats->RecordsSkipped++;
+			cursor += record->Length;
+			continue;
+		}
+
+		frame = (HIMAX_CAPTURE_FRAME*)cursor;
+		cursor += record->Length;
+
+		RtlZeroMemory(&data, sizeof(data));
+
+		Stats->FramesReplayed++;
+
+		//
+		// Frames captured in smart wake mode carry a gesture instead of
+		// touch points
+		//
+		if (HimaxDecodeGesture(frame->Data, Replay->Layout->FrameSize) == HIMAX_GESTURE_DOUBLE_TAP)
+		{
+			Stats->Gestures++;
+			continue;
+		}
+
+		//
+		// Frames are captured before validation, so corrupt frames are
+		// dropped here the same way the interrupt path drops them
+		//
+		if (HimaxDecodeValidateFrame(Replay->Layout, frame->Data) != HimaxFrameValid)
+		{
+			Stats->FramesDiscarded++;
+			continue;
+		}
+
+		if (!NT_SUCCESS(HimaxDecodeFrame(
+			Replay->Layout,
+			&Replay->Bounds,
+			frame->Data,
+			Replay->Layout->FrameSize,
+			&data,
+			&mask,
+			&fingerNum)))
+		{
+			Stats->FramesDiscarded++;
+			continue;
+		}
+
+		HimaxFilterMeasure(&Replay->RawPrevious, &data, &Stats->RawJitter);
+		Replay->RawPrevious = data;
+
+		for (p = 0; p < HimaxFilterProfiles; p++)
+		{
+			Replay->Filtered[p] = data;
+
+			HimaxFilterObjects(&Replay->Filters[p], &Replay->Filtered[p], &Stats->Jitter[p]);
+			HimaxFilterMeasure(&Replay->Previous[p], &Replay->Filtered[p], &Stats->Jitter[p]);
+
+			Replay->Previous[p] = Replay->Filtered[p];
+		}
+
+		data = Replay->Filtered[Profile];
+
+		ReportUpdateLocalObjectCache(&data, &Replay->Cache);
+
+		if (Replay->Cache.DownCount == 0)
+		{
+			continue;
+		}
+
+		Stats->FramesReported++;
+
+		for (touchesReported = 0; touchesReported < Replay->Cache.DownCount;)
+		{
+			touchesReported = ReportPackFingers(
+				&Replay->Cache,
+				Props,
+				touchesReported,
+				&hidReport);
+
+			Stats->HidReports++;
+		}
+	}
+
+	Stats->ElapsedInUs = (ULONG)min(
+		(ULONGLONG)(KeQueryPerformanceCounter(NULL).QuadPart - start) * 1000000 /
+			(ULONGLONG)frequency.QuadPart,
+		MAXULONG);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_SAMPLES,
+		"Replayed %d frames in %d us, %d discarded, %d gestures, %d reported in %d hid reports",
+		Stats->FramesReplayed,
+		Stats->ElapsedInUs,
+		Stats->FramesDiscarded,
+		Stats->Gestures,
+		Stats->FramesReported,
+		Stats->HidReports);
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_SAMPLES,
+		"Replay jitter: raw %I64u over %d moves, normal %I64u over %d moves, charger %I64u over %d moves",
+		Stats->RawJitter.Displacement,
+		Stats->RawJitter.Moves,
+		Stats->Jitter[HimaxFilterNormal].Displacement,
+		Stats->Jitter[HimaxFilterNormal].Moves,
+		Stats->Jitter[HimaxFilterCharger].Displacement,
+		Stats->Jitter[HimaxFilterCharger].Moves);
+
+exit:
+	return status;
+}
@@ -0,0 +1,710 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxscan.c
+
+	Abstract:
+
+		Runs the scan state machine. The transitions themselves are a
+		pure function of the policy, the machine and a clock value, so
+		they can be driven by a virtual clock; the rest applies them to
+		the controller from the interrupt path and a one-shot timer.
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <internal.h>
+#include <controller.h>
+#include <spb.h>
+#include <report.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxscan.h>
+#include <hxscan.tmh>
+
+typedef struct _HIMAX_SCAN_TIMER_CONTEXT
+{
+	HIMAX_CONTROLLER_CONTEXT* Controller;
+} HIMAX_SCAN_TIMER_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(HIMAX_SCAN_TIMER_CONTEXT, HimaxGetScanTimerContext)
+
+EVT_WDF_TIMER HimaxScanEvtTimerFunc;
+
+VOID
+HimaxScanReset(
+	OUT HIMAX_SCAN_MACHINE* Machine,
+	IN ULONGLONG NowMs
+)
+/*++
+
+Routine Description:
+
+	Puts the state machine in ACTIVE as if the screen was just touched.
+
+Arguments:
+
+	Machine - The state machine
+	NowMs - The current time
+
+Return Value:
+
+	None
+
+--*/
+{
+	Machine->State = HimaxScanActive;
+	Machine->LastTouchMs = NowMs;
+}
+
+HIMAX_SCAN_STATE
+HimaxScanNextState(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN OUT HIMAX_SCAN_MACHINE* Machine,
+	IN BOOLEAN Touched,
+	IN ULONGLONG NowMs
+)
+/*++
+
+Routine Description:
+
+	Advances the state machine to NowMs. Does nothing but update the
+	machine, so transitions can be replayed on a virtual clock.
+
+Arguments:
+
+	Policy - The idle and doze timeouts
+	Machine - The state machine
+	Touched - Whether a contact was seen at NowMs
+	NowMs - The current time, never earlier than the previous call
+
+Return Value:
+
+	The new state
+
+--*/
+{
+	ULONGLONG untouched;
+
+	if (Touched)
+	{
+		HimaxScanReset(Machine, NowMs);
+		goto exit;
+	}
+
+	if (Policy->IdleAfterMs == 0)
+	{
+		Machine->State = HimaxScanActive;
+		goto exit;
+	}
+
+	untouched = NowMs - Machine->LastTouchMs;
+
+	if (Policy->DozeAfterMs != 0 &&
+		untouched >= (ULONGLONG)Policy->IdleAfterMs + Policy->DozeAfterMs)
+	{
+		Machine->State = HimaxScanDoze;
+	}
+	else if (untouched >= Policy->IdleAfterMs)
+	{
+		Machine->State = HimaxScanIdle;
+	}
+	else
+	{
+		Machine->State = HimaxScanActive;
+	}
+
+exit:
+	return Machine->State;
+}
+
+ULONG
+HimaxScanNextDeadline(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN const HIMAX_SCAN_MACHINE* Machine,
+	IN ULONGLONG NowMs
+)
+/*++
+
+Routine Description:
+
+	Computes when the state machine next changes state on its own.
+
+Arguments:
+
+	Policy - The idle and doze timeouts
+	Machine - The state machine
+	NowMs - The current time
+
+Return Value:
+
+	Milliseconds from NowMs to the next transition, 0 if there is none
+	without a contact
+
+--*/
+{
+	ULONGLONG untouched;
+	ULONGLONG target;
+
+	switch (Machine->State)
+	{
+	case HimaxScanActive:
+		if (Policy->IdleAfterMs == 0)
+		{
+			return 0;
+		}
+
+		target = Policy->IdleAfterMs;
+		break;
+
+	case HimaxScanIdle:
+		if (Policy->DozeAfterMs == 0)
+		{
+			return 0;
+		}
+
+		target = (ULONGLONG)Policy->IdleAfterMs + Policy->DozeAfterMs;
+		break;
+
+	default:
+		return 0;
+	}
+
+	untouched = NowMs - Machine->LastTouchMs;
+
+	if (untouched >= target)
+	{
+		return 1;
+	}
+
+	return (ULONG)min(target - untouched, MAXULONG);
+}
+
+NTSTATUS
+HimaxScanRunScript(
+	IN const HIMAX_SCAN_POLICY* Policy,
+	IN const HIMAX_SCAN_STEP* Steps,
+	IN ULONG Count,
+	OUT HIMAX_SCAN_STEP_RESULT* Results
+)
+/*++
+
+Routine Description:
+
+	Drives a fresh state machine through a script of contacts and clock
+	ticks, starting ACTIVE at time zero. Untouched steps stand for the
+	timer firing.
+
+Arguments:
+
+	Policy - The idle and doze timeouts
+	Steps - The script, in increasing time order
+	Count - The number of steps
+	Results - Receives the state and next deadline after each step
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	HIMAX_SCAN_MACHINE machine;
+	ULONG i;
+
+	if (Count > HIMAX_SCAN_SCRIPT_MAX_STEPS)
+	{
+		status = STATUS_INVALID_PARAMETER;
+		goto exit;
+	}
+
+	HimaxScanReset(&machine, 0);
+
+	for (i = 0; i < Count; i++)
+	{
+		if (i > 0 && Steps[i].TimeMs < Steps[i - 1].TimeMs)
+		{
+			status = STATUS_INVALID_PARAMETER;
+			goto exit;
+		}
+
+		Results[i].State = HimaxScanNextState(Policy, &machine, Steps[i].Touched, Steps[i].TimeMs);
+		Results[i].NextDeadlineMs = HimaxScanNextDeadline(Policy, &machine, Steps[i].TimeMs);
+	}
+
+exit:
+	return status;
+}
+
+static
+ULONGLONG
+HimaxScanNowMs(
+	VOID
+)
+{
+	return KeQueryInterruptTime() / 10000;
+}
+
+static
+VOID
+HimaxScanApply(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN HIMAX_SCAN_STATE Previous
+)
+/*++
+
+Routine Description:
+
+	Switches the controller to the scan rate of the current state. The
+	rate in use when leaving ACTIVE is the one restored on return, so a
+	rate selected at runtime survives idling. A controller left at its
+	firmware default rate cannot be brought back to it, so its rate is
+	never lowered.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+	Previous - The state being left
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SCAN_CONTROL* scan = &ControllerContext->Scan;
+	NTSTATUS status;
+	ULONG hz;
+
+	scan->Transitions++;
+
+	Trace(
+		TRACE_LEVEL_INFORMATION,
+		TRACE_POWER,
+		"Scan state %d -> %d",
+		Previous,
+		scan->Machine.State);
+
+	if (scan->Machine.State != HimaxScanActive)
+	{
+		//
+		// Nothing is touching the screen, stop repeating the last
+		// report on hardware without continuous reporting
+		//
+		ReportStopContinuousSimulation();
+	}
+
+	if (ControllerContext->ReportRate.Register == 0)
+	{
+		return;
+	}
+
+	if (Previous == HimaxScanActive)
+	{
+		scan->ActiveHz = ControllerContext->ReportRate.Hz;
+	}
+
+	if (scan->ActiveHz == HIMAX_REPORT_RATE_FIRMWARE_DEFAULT)
+	{
+		return;
+	}
+
+	switch (scan->Machine.State)
+	{
+	case HimaxScanIdle:
+		hz = scan->Policy.IdleHz;
+		break;
+	case HimaxScanDoze:
+		hz = scan->Policy.DozeHz;
+		break;
+	default:
+		hz = scan->ActiveHz;
+		break;
+	}
+
+	if (hz == HIMAX_REPORT_RATE_FIRMWARE_DEFAULT || hz == ControllerContext->ReportRate.Hz)
+	{
+		return;
+	}
+
+	status = HimaxSetReportRate(ControllerContext, SpbContext, hz);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_POWER,
+			"Error switching scan state %d to %d Hz - 0x%08lX",
+			scan->Machine.State,
+			hz,
+			status);
+	}
+}
+
+static
+VOID
+HimaxScanArm(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN ULONGLONG NowMs
+)
+{
+	HIMAX_SCAN_CONTROL* scan = &ControllerContext->Scan;
+	ULONG deadline;
+
+	deadline = HimaxScanNextDeadline(&scan->Policy, &scan->Machine, NowMs);
+
+	if (deadline != 0)
+	{
+		WdfTimerStart(scan->Timer, WDF_REL_TIMEOUT_IN_MS(deadline));
+	}
+}
+
+VOID
+HimaxScanEvtTimerFunc(
+	IN WDFTIMER Timer
+)
+/*++
+
+Routine Description:
+
+	Fires at the next timeout of the state machine. Contacts seen since
+	it was armed push the timeout back, in which case the timer is just
+	armed again.
+
+Arguments:
+
+	Timer - The scan timer
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_CONTROLLER_CONTEXT* controller;
+	PDEVICE_EXTENSION devContext;
+	HIMAX_SCAN_STATE previous;
+	ULONGLONG now;
+
+	controller = HimaxGetScanTimerContext(Timer)->Controller;
+	devContext = GetDeviceContext(controller->FxDevice);
+
+	WdfInterruptAcquireLock(devContext->InterruptObject);
+
+	if (!controller->Scan.Running)
+	{
+		goto exit;
+	}
+
+	now = HimaxScanNowMs();
+	previous = controller->Scan.Machine.State;
+
+	if (HimaxScanNextState(&controller->Scan.Policy, &controller->Scan.Machine, FALSE, now) != previous)
+	{
+		HimaxScanApply(controller, &devContext->I2CContext, previous);
+	}
+
+	HimaxScanArm(controller, now);
+
+exit:
+	WdfInterruptReleaseLock(devContext->InterruptObject);
+}
+
+NTSTATUS
+HimaxScanInitialize(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+	Sets up the scan state machine from the controller settings and
+	creates its timer.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	HIMAX_SCAN_CONTROL* scan = &ControllerContext->Scan;
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES timerAttributes;
+	NTSTATUS status;
+
+	scan->Policy.IdleAfterMs = ControllerContext->Config.IdleTimeoutMs;
+	scan->Policy.DozeAfterMs = ControllerContext->Config.DozeTimeoutMs;
+	scan->Policy.IdleHz = ControllerContext->Config.IdleReportRateHz;
+	scan->Policy.DozeHz = ControllerContext->Config.DozeReportRateHz;
+
+	if (!HimaxReportRateSupported(scan->Policy.IdleHz) ||
+		!HimaxReportRateSupported(scan->Policy.DozeHz))
+	{
+		Trace(
+			TRACE_LEVEL_WARNING,
+			TRACE_INIT,
+			"Unsupported idle or doze report rate %d/%d Hz, keeping the active rate",
+			scan->Policy.IdleHz,
+			scan->Policy.DozeHz);
+
+		scan->Policy.IdleHz = HIMAX_REPORT_RATE_FIRMWARE_DEFAULT;
+		scan->Policy.DozeHz = HIMAX_REPORT_RATE_FIRMWARE_DEFAULT;
+	}
+
+	HimaxScanReset(&scan->Machine, HimaxScanNowMs());
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, HimaxScanEvtTimerFunc);
+
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&timerAttributes, HIMAX_SCAN_TIMER_CONTEXT);
+	timerAttributes.ParentObject = ControllerContext->FxDevice;
+	timerAttributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	status = WdfTimerCreate(
+		&timerConfig,
+		&timerAttributes,
+		&scan->Timer);
+
+	if (!NT_SUCCESS(status))
+	{
+		Trace(
+			TRACE_LEVEL_ERROR,
+			TRACE_INIT,
+			"Error creating the scan timer - 0x%08lX",
+			status);
+
+		goto exit;
+	}
+
+	HimaxGetScanTimerContext(scan->Timer)->Controller = ControllerContext;
+
+exit:
+	return status;
+}
+
+VOID
+HimaxScanRelease(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+	Deletes the scan timer before the controller context goes away.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+
+Return Value:
+
+	None
+
+--*/
+{
+	if (ControllerContext->Scan.Timer != NULL)
+	{
+		ControllerContext->Scan.Running = FALSE;
+
+		WdfTimerStop(ControllerContext->Scan.Timer, TRUE);
+		WdfObjectDelete(ControllerContext->Scan.Timer);
+		ControllerContext->Scan.Timer = NULL;
+	}
+}
+
+VOID
+HimaxScanStart(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+)
+/*++
+
+Routine Description:
+
+	Starts the state machine ACTIVE once the controller is operating,
+	restoring the active rate if it went to sleep idling.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SCAN_CONTROL* scan = &ControllerContext->Scan;
+	HIMAX_SCAN_STATE previous;
+	ULONGLONG now;
+
+	if (scan->Timer == NULL)
+	{
+		return;
+	}
+
+	now = HimaxScanNowMs();
+	previous = scan->Machine.State;
+
+	HimaxScanReset(&scan->Machine, now);
+
+	if (previous != HimaxScanActive)
+	{
+		HimaxScanApply(ControllerContext, SpbContext, previous);
+	}
+
+	scan->Running = TRUE;
+
+	HimaxScanArm(ControllerContext, now);
+}
+
+VOID
+HimaxScanStop(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext
+)
+/*++
+
+Routine Description:
+
+	Stops the state machine while the controller sleeps. The state is
+	kept so the rate can be restored when it starts again.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+
+Return Value:
+
+	None
+
+--*/
+{
+	if (ControllerContext->Scan.Timer == NULL)
+	{
+		return;
+	}
+
+	ControllerContext->Scan.Running = FALSE;
+
+	WdfTimerStop(ControllerContext->Scan.Timer, TRUE);
+}
+
+BOOLEAN
+HimaxScanOnFrame(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN SPB_CONTEXT* SpbContext
+)
+/*++
+
+Routine Description:
+
+	Feeds a decoded frame to the state machine, from the interrupt
+	path. A contact returns the controller to its full rate before the
+	frame is reported.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+	TRUE if the frame woke the controller from IDLE or DOZE
+
+--*/
+{
+	HIMAX_SCAN_CONTROL* scan = &ControllerContext->Scan;
+	HIMAX_SCAN_STATE previous;
+	ULONGLONG now;
+
+	if (!scan->Running)
+	{
+		return FALSE;
+	}
+
+	now = HimaxScanNowMs();
+	previous = scan->Machine.State;
+
+	HimaxScanNextState(
+		&scan->Policy,
+		&scan->Machine,
+		ControllerContext->PreFingerMask != 0,
+		now);
+
+	if (scan->Machine.State == previous)
+	{
+		return FALSE;
+	}
+
+	HimaxScanApply(ControllerContext, SpbContext, previous);
+
+	if (scan->Machine.State != HimaxScanActive)
+	{
+		return FALSE;
+	}
+
+	//
+	// The timer idles out of ACTIVE again
+	//
+	HimaxScanArm(ControllerContext, now);
+
+	return TRUE;
+}
+
+VOID
+HimaxScanRecordWake(
+	IN HIMAX_CONTROLLER_CONTEXT* ControllerContext,
+	IN LONGLONG InterruptTimestamp
+)
+/*++
+
+Routine Description:
+
+	Accounts the time from the interrupt of a waking frame to the
+	completion of its report.
+
+Arguments:
+
+	ControllerContext - Touch controller context
+	InterruptTimestamp - Performance counter value at the interrupt
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SCAN_WAKE_STATS* wake = &ControllerContext->Scan.Wake;
+	LARGE_INTEGER frequency;
+	LONGLONG now;
+	ULONG elapsedInUs;
+
+	now = KeQueryPerformanceCounter(&frequency).QuadPart;
+
+	if (InterruptTimestamp == 0 || now < InterruptTimestamp)
+	{
+		return;
+	}
+
+	elapsedInUs = (ULONG)min(
+		(ULONGLONG)(now - InterruptTimestamp) * 1000000 / (ULONGLONG)frequency.QuadPart,
+		MAXULONG);
+
+	wake->Wakes++;
+	wake->LastInUs = elapsedInUs;
+	wake->MaxInUs = max(wake->MaxInUs, elapsedInUs);
+	wake->TotalInUs += elapsedInUs;
+}
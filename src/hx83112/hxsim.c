@@ -0,0 +1,750 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		hxsim.c
+
+	Abstract:
+
+		Simulates the HX83112 behind a simulated Spb target, so the
+		self-tests can run the driver's register protocols and compare
+		what reaches the chip without touching the controller.
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <spb.h>
+#include <hx83112/hxinternal.h>
+#include <hx83112/hxflash.h>
+#include <hx83112/hxsim.h>
+#include <hxsim.tmh>
+
+static
+UINT32
+HimaxSimGetWord(
+	IN UINT8* Buffer
+)
+{
+	return (UINT32)Buffer[0] |
+		((UINT32)Buffer[1] << 8) |
+		((UINT32)Buffer[2] << 16) |
+		((UINT32)Buffer[3] << 24);
+}
+
+VOID
+HimaxSimSetRegister(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Address,
+	IN UINT32 Value
+)
+/*++
+
+Routine Description:
+
+	Stores a value in the simulated AHB register file. Writes beyond
+	its capacity are dropped.
+
+Arguments:
+
+	Simulator - The simulator
+	Address - The AHB address
+	Value - The value to store
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_CHIP* chip = &Simulator->Chip;
+	ULONG i;
+
+	for (i = 0; i < chip->RegisterCount; i++)
+	{
+		if (chip->Registers[i].Address == Address)
+		{
+			chip->Registers[i].Value = Value;
+			return;
+		}
+	}
+
+	if (chip->RegisterCount < HIMAX_SIM_MAX_REGISTERS)
+	{
+		chip->Registers[chip->RegisterCount].Address = Address;
+		chip->Registers[chip->RegisterCount].Value = Value;
+		chip->RegisterCount++;
+	}
+}
+
+UINT32
+HimaxSimGetRegister(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Address
+)
+/*++
+
+Routine Description:
+
+	Reads a value from the simulated AHB register file, registers never
+	written read as 0.
+
+Arguments:
+
+	Simulator - The simulator
+	Address - The AHB address
+
+Return Value:
+
+	The register value
+
+--*/
+{
+	HIMAX_SIM_CHIP* chip = &Simulator->Chip;
+	ULONG i;
+
+	for (i = 0; i < chip->RegisterCount; i++)
+	{
+		if (chip->Registers[i].Address == Address)
+		{
+			return chip->Registers[i].Value;
+		}
+	}
+
+	return 0;
+}
+
+static
+VOID
+HimaxSimFlashProgram(
+	IN HIMAX_SIMULATOR* Simulator
+)
+/*++
+
+Routine Description:
+
+	Commits the FIFO of a page program to the flash. The address wraps
+	within the page, and programming only clears bits.
+
+Arguments:
+
+	Simulator - The simulator
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_FLASH* flash = &Simulator->Flash;
+	UINT32 page = flash->Address & ~(UINT32)(HIMAX_FLASH_PAGE_SIZE - 1);
+	ULONG i;
+
+	if (page + HIMAX_FLASH_PAGE_SIZE <= flash->Size)
+	{
+		for (i = 0; i < flash->FifoLength; i++)
+		{
+			flash->Memory[page + ((flash->Address + i) & (HIMAX_FLASH_PAGE_SIZE - 1))] &= flash->Fifo[i];
+		}
+	}
+
+	flash->Programs++;
+	flash->Programming = FALSE;
+	flash->WriteEnabled = FALSE;
+	flash->FifoLength = 0;
+}
+
+static
+VOID
+HimaxSimFlashCommand(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Command
+)
+/*++
+
+Routine Description:
+
+	Runs a flash command written to the SPI200 command register.
+
+Arguments:
+
+	Simulator - The simulator
+	Command - The flash command
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_FLASH* flash = &Simulator->Flash;
+	UINT32 block;
+
+	switch (Command)
+	{
+	case HIMAX_FLASH_CMD_WRITE_ENABLE:
+		flash->WriteEnabled = TRUE;
+		break;
+	case HIMAX_FLASH_CMD_READ_STATUS:
+		HimaxSimSetRegister(
+			Simulator,
+			HIMAX_FLASH_SPI200_DATA,
+			flash->WriteEnabled ? HIMAX_SIM_FLASH_STATUS_WEL : 0);
+		break;
+	case HIMAX_FLASH_CMD_BLOCK_ERASE:
+		if (!flash->WriteEnabled)
+		{
+			flash->Rejected++;
+			break;
+		}
+
+		block = flash->Address & ~(UINT32)(HIMAX_FLASH_SECTOR_SIZE - 1);
+
+		if (block + HIMAX_FLASH_SECTOR_SIZE <= flash->Size)
+		{
+			RtlFillMemory(&flash->Memory[block], HIMAX_FLASH_SECTOR_SIZE, 0xFF);
+		}
+
+		flash->Erases++;
+		flash->WriteEnabled = FALSE;
+		flash->FifoLength = 0;
+		break;
+	case HIMAX_FLASH_CMD_PAGE_PROGRAM:
+		if (!flash->WriteEnabled)
+		{
+			flash->Rejected++;
+			flash->FifoLength = 0;
+			break;
+		}
+
+		flash->Programming = TRUE;
+
+		if (flash->FifoLength >= HIMAX_SIM_SPI200_WRITE_COUNT(flash->TransCtrl))
+		{
+			HimaxSimFlashProgram(Simulator);
+		}
+		break;
+	default:
+		flash->Rejected++;
+		break;
+	}
+}
+
+static
+VOID
+HimaxSimAhbWrite(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT32 Address,
+	IN UINT32 Value
+)
+/*++
+
+Routine Description:
+
+	Applies a word written to the AHB. The SPI200 registers drive the
+	flash when one is attached and starting the CRC engine computes its
+	result, every other address goes to the register file.
+
+Arguments:
+
+	Simulator - The simulator
+	Address - The AHB address
+	Value - The word written
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_FLASH* flash = &Simulator->Flash;
+	UINT32 start;
+	ULONG length;
+	ULONG i;
+
+	if (flash->Memory == NULL)
+	{
+		HimaxSimSetRegister(Simulator, Address, Value);
+		return;
+	}
+
+	switch (Address)
+	{
+	case HIMAX_FLASH_SPI200_TRANS_CTRL:
+		flash->TransCtrl = Value;
+		break;
+	case HIMAX_FLASH_SPI200_ADDR:
+		flash->Address = Value;
+		break;
+	case HIMAX_FLASH_SPI200_CMD:
+		HimaxSimFlashCommand(Simulator, Value);
+		break;
+	case HIMAX_FLASH_SPI200_DATA:
+		for (i = 0; i < FOUR_BYTE_DATA_SZ; i++)
+		{
+			if (flash->FifoLength == sizeof(flash->Fifo))
+			{
+				flash->Rejected++;
+				break;
+			}
+
+			flash->Fifo[flash->FifoLength++] = (UINT8)(Value >> (8 * i));
+		}
+
+		if (flash->Programming &&
+			flash->FifoLength >= HIMAX_SIM_SPI200_WRITE_COUNT(flash->TransCtrl))
+		{
+			HimaxSimFlashProgram(Simulator);
+		}
+		break;
+	case HIMAX_FLASH_CRC_COMMAND:
+		start = HimaxSimGetRegister(Simulator, HIMAX_FLASH_CRC_ADDRESS);
+		length = (Value & 0xFFFF) * FOUR_BYTE_DATA_SZ;
+
+		if (start <= flash->Size && length <= flash->Size - start)
+		{
+			HimaxSimSetRegister(Simulator, HIMAX_FLASH_CRC_RESULT, HimaxFlashCrc32c(&flash->Memory[start], length));
+		}
+
+		HimaxSimSetRegister(Simulator, HIMAX_FLASH_CRC_STATUS, 0);
+		HimaxSimSetRegister(Simulator, Address, Value);
+		break;
+	default:
+		HimaxSimSetRegister(Simulator, Address, Value);
+		break;
+	}
+}
+
+static
+VOID
+HimaxSimLog(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT8 Command,
+	IN UINT8* Data,
+	IN ULONG Length
+)
+{
+	HIMAX_SIM_OPERATION* operation;
+
+	if (Simulator->LogCount >= HIMAX_SIM_MAX_OPERATIONS)
+	{
+		Simulator->LogOverflow = TRUE;
+		return;
+	}
+
+	operation = &Simulator->Log[Simulator->LogCount++];
+
+	RtlZeroMemory(operation, sizeof(HIMAX_SIM_OPERATION));
+	operation->Command = Command;
+	operation->Conti = Simulator->Chip.Conti;
+	operation->Incr4 = Simulator->Chip.Incr4;
+	operation->BurstRead = Simulator->Chip.BurstRead;
+	operation->Length = Length;
+	RtlCopyMemory(operation->Data, Data, min(Length, HIMAX_SIM_OPERATION_DATA));
+}
+
+static
+VOID
+HimaxSimWrite(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT8 Command,
+	IN UINT8* Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Applies a bus register write to the chip. A write of the AHB address
+	register carrying data past the address writes it to the AHB, one
+	word at a time, at increasing addresses if auto increment is on.
+	With auto increment off, every word of a write to the SPI200 data
+	register goes to the FIFO.
+
+Arguments:
+
+	Simulator - The simulator
+	Command - The bus register
+	Data - The bytes written
+	Length - The size of the above buffer
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_CHIP* chip = &Simulator->Chip;
+	UINT32 address;
+	ULONG offset;
+
+	if (Length == 0)
+	{
+		return;
+	}
+
+	switch (Command)
+	{
+	case 0x00: // ic_adr_ahb_addr_byte_0
+		if (Length < FOUR_BYTE_ADDR_SZ)
+		{
+			chip->BurstRead = Data[0];
+			break;
+		}
+
+		chip->AhbAddress = HimaxSimGetWord(Data);
+
+		if (Length < FOUR_BYTE_ADDR_SZ + FOUR_BYTE_DATA_SZ)
+		{
+			break;
+		}
+
+		HimaxSimLog(Simulator, Command, Data, Length);
+
+		address = chip->AhbAddress;
+
+		for (offset = FOUR_BYTE_ADDR_SZ; offset + FOUR_BYTE_DATA_SZ <= Length; offset += FOUR_BYTE_DATA_SZ)
+		{
+			HimaxSimAhbWrite(Simulator, address, HimaxSimGetWord(&Data[offset]));
+
+			if (chip->Incr4 & 1)
+			{
+				address += FOUR_BYTE_DATA_SZ;
+			}
+		}
+		break;
+	case 0x0c: // ic_cmd_ahb_access_direction
+		chip->Direction = Data[0];
+		break;
+	case 0x0d: // ic_cmd_incr4
+		chip->Incr4 = Data[0];
+		break;
+	case 0x13: // ic_cmd_conti
+		chip->Conti = Data[0];
+		break;
+	default:
+		HimaxSimLog(Simulator, Command, Data, Length);
+		break;
+	}
+}
+
+static
+VOID
+HimaxSimRead(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN UINT8 Command,
+	OUT UINT8* Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+	Serves a bus register read. The AHB data register returns the words
+	at the AHB address when the direction is set to read, every other
+	register reads as zeroes.
+
+Arguments:
+
+	Simulator - The simulator
+	Command - The bus register
+	Data - Receives the bytes read
+	Length - The size of the above buffer
+
+Return Value:
+
+	None
+
+--*/
+{
+	HIMAX_SIM_CHIP* chip = &Simulator->Chip;
+	UINT32 address;
+	UINT32 value;
+	ULONG offset;
+	ULONG i;
+
+	RtlZeroMemory(Data, Length);
+
+	// ic_adr_ahb_rdata_byte_0, ic_cmd_ahb_access_direction_read
+	if (Command != 0x08 || chip->Direction != 0x00)
+	{
+		return;
+	}
+
+	address = chip->AhbAddress;
+
+	for (offset = 0; offset < Length; offset += FOUR_BYTE_DATA_SZ)
+	{
+		value = HimaxSimGetRegister(Simulator, address);
+
+		for (i = 0; i < FOUR_BYTE_DATA_SZ && offset + i < Length; i++)
+		{
+			Data[offset + i] = (UINT8)(value >> (8 * i));
+		}
+
+		if (chip->Incr4 & 1)
+		{
+			address += FOUR_BYTE_DATA_SZ;
+		}
+	}
+}
+
+static
+NTSTATUS
+HimaxSimTarget(
+	IN PVOID Context,
+	IN SPB_TRANSFER* Transfers,
+	IN ULONG TransferCount
+)
+{
+	HIMAX_SIMULATOR* simulator = (HIMAX_SIMULATOR*)Context;
+	ULONG i;
+
+	simulator->Counters.Submissions++;
+
+	if (simulator->FailSubmissions > 0)
+	{
+		simulator->FailSubmissions--;
+		simulator->Counters.Failures++;
+		return STATUS_IO_TIMEOUT;
+	}
+
+	for (i = 0; i < TransferCount; i++)
+	{
+		simulator->Counters.Transfers++;
+
+		if (Transfers[i].Read)
+		{
+			simulator->Counters.BytesRead += Transfers[i].Length;
+			HimaxSimRead(simulator, Transfers[i].Address, (UINT8*)Transfers[i].Data, Transfers[i].Length);
+		}
+		else
+		{
+			simulator->Counters.BytesWritten += Transfers[i].Length;
+			HimaxSimWrite(simulator, Transfers[i].Address, (UINT8*)Transfers[i].Data, Transfers[i].Length);
+		}
+	}
+
+	return STATUS_SUCCESS;
+}
+
+VOID
+HimaxSimReset(
+	IN HIMAX_SIMULATOR* Simulator
+)
+/*++
+
+Routine Description:
+
+	Brings the simulated chip back to its reset state, clears the log
+	and the counters, and has the scratch controller context forget
+	what it knew of the chip. The flash keeps its content.
+
+Arguments:
+
+	Simulator - The simulator
+
+Return Value:
+
+	None
+
+--*/
+{
+	UINT8* memory = Simulator->Flash.Memory;
+	ULONG size = Simulator->Flash.Size;
+
+	RtlZeroMemory(&Simulator->Chip, sizeof(HIMAX_SIM_CHIP));
+	RtlZeroMemory(&Simulator->Flash, sizeof(HIMAX_SIM_FLASH));
+	RtlZeroMemory(&Simulator->Counters, sizeof(HIMAX_SIM_COUNTERS));
+	Simulator->Flash.Memory = memory;
+	Simulator->Flash.Size = size;
+	Simulator->FailSubmissions = 0;
+	Simulator->LogCount = 0;
+	Simulator->LogOverflow = FALSE;
+
+	HimaxInvalidateBusState(&Simulator->Controller);
+	HimaxResetCircuitBreaker(&Simulator->Controller);
+}
+
+NTSTATUS
+HimaxSimCreate(
+	IN HIMAX_CONTROLLER_CONTEXT* Live,
+	OUT HIMAX_SIMULATOR** Simulator
+)
+/*++
+
+Routine Description:
+
+	Creates a simulator whose scratch controller context starts as a
+	copy of the live one, so sequences depending on the configuration
+	are built the same way.
+
+Arguments:
+
+	Live - The live touch controller context
+	Simulator - Receives the simulator
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+	HIMAX_SIMULATOR* simulator;
+
+	*Simulator = NULL;
+
+	simulator = (HIMAX_SIMULATOR*)ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
+		sizeof(HIMAX_SIMULATOR),
+		TOUCH_POOL_TAG_F12);
+
+	if (simulator == NULL)
+	{
+		status = STATUS_INSUFFICIENT_RESOURCES;
+		goto exit;
+	}
+
+	status = WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &simulator->Spb.SpbLock);
+
+	if (!NT_SUCCESS(status))
+	{
+		ExFreePoolWithTag(simulator, TOUCH_POOL_TAG_F12);
+		goto exit;
+	}
+
+	simulator->Spb.SimulatedTarget = HimaxSimTarget;
+	simulator->Spb.SimulatedContext = simulator;
+
+	RtlCopyMemory(&simulator->Controller, Live, sizeof(HIMAX_CONTROLLER_CONTEXT));
+	RtlZeroMemory(&simulator->Controller.BusState, sizeof(HIMAX_BUS_STATE));
+	RtlZeroMemory(&simulator->Controller.Breaker, sizeof(HIMAX_CIRCUIT_BREAKER));
+	RtlZeroMemory(&simulator->Controller.HotPathRetry, sizeof(HIMAX_RETRY_POLICY));
+	RtlZeroMemory(&simulator->Controller.BringUpRetry, sizeof(HIMAX_RETRY_POLICY));
+	HimaxInitializeRetryPolicies(&simulator->Controller);
+
+	HimaxSimReset(simulator);
+
+	*Simulator = simulator;
+
+exit:
+	return status;
+}
+
+NTSTATUS
+HimaxSimAttachFlash(
+	IN HIMAX_SIMULATOR* Simulator,
+	IN ULONG Size
+)
+/*++
+
+Routine Description:
+
+	Attaches an erased flash of the given size behind the SPI200 master.
+
+Arguments:
+
+	Simulator - The simulator
+	Size - The flash size, a multiple of HIMAX_FLASH_SECTOR_SIZE
+
+Return Value:
+
+	NTSTATUS indicating success or failure
+
+--*/
+{
+	if (Simulator->Flash.Memory != NULL ||
+		Size == 0 ||
+		(Size & (HIMAX_FLASH_SECTOR_SIZE - 1)) != 0)
+	{
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	Simulator->Flash.Memory = (UINT8*)ExAllocatePool2(
+		POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED,
+		Size,
+		TOUCH_POOL_TAG_F12);
+
+	if (Simulator->Flash.Memory == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlFillMemory(Simulator->Flash.Memory, Size, 0xFF);
+	Simulator->Flash.Size = Size;
+
+	return STATUS_SUCCESS;
+}
+
+VOID
+HimaxSimDelete(
+	IN HIMAX_SIMULATOR* Simulator
+)
+{
+	if (Simulator->Flash.Memory != NULL)
+	{
+		ExFreePoolWithTag(Simulator->Flash.Memory, TOUCH_POOL_TAG_F12);
+	}
+
+	WdfObjectDelete(Simulator->Spb.SpbLock);
+	ExFreePoolWithTag(Simulator, TOUCH_POOL_TAG_F12);
+}
+
+BOOLEAN
+HimaxSimCompareLogs(
+	IN HIMAX_SIM_OPERATION* Reference,
+	IN ULONG ReferenceCount,
+	IN HIMAX_SIM_OPERATION* Log,
+	IN ULONG LogCount,
+	OUT ULONG* FirstMismatch
+)
+/*++
+
+Routine Description:
+
+	Compares two operation logs byte for byte.
+
+Arguments:
+
+	Reference - The expected operations
+	ReferenceCount - The amount of expected operations
+	Log - The operations to check
+	LogCount - The amount of operations to check
+	FirstMismatch - Receives the index of the first operation that
+	differs, MAXULONG if the logs are equal
+
+Return Value:
+
+	TRUE if the logs are equal
+
+--*/
+{
+	ULONG i;
+
+	*FirstMismatch = MAXULONG;
+
+	for (i = 0; i < min(ReferenceCount, LogCount); i++)
+	{
+		if (RtlCompareMemory(&Reference[i], &Log[i], sizeof(HIMAX_SIM_OPERATION)) != sizeof(HIMAX_SIM_OPERATION))
+		{
+			*FirstMismatch = i;
+			return FALSE;
+		}
+	}
+
+	if (ReferenceCount != LogCount)
+	{
+		*FirstMismatch = i;
+		return FALSE;
+	}
+
+	return TRUE;
+}
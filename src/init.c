@@ -22,6 +22,7 @@
 #include <Cross Platform Shim\compat.h>
 #include <spb.h>
 #include <hx83112/hxinternal.h>
+#include <hx83112/hxfirmware.h>
 #include <init.tmh>
 
 NTSTATUS
@@ -106,6 +107,15 @@ TchStartDevice(
 		goto exit;
 	}
 
+	//
+	// Keep the configuration for resume to replay, without it resume
+	// runs a full bring-up
+	//
+	if (!NT_SUCCESS(HimaxResumeTakeSnapshot(controller, SpbContext)))
+	{
+		controller->Resume.PowerLost = TRUE;
+	}
+
 	//
 	// Read and store the firmware version
 	//
@@ -145,6 +155,96 @@ exit:
 	return status;
 }
 
+NTSTATUS
+TchProbeController(
+	IN PVOID SpbContext
+)
+/*++
+
+  Routine Description:
+
+	This routine checks once, without retrying, whether the controller
+	answers on the bus after a reset.
+
+  Arguments:
+
+	SpbContext - A pointer to the current i2c context
+
+  Return Value:
+
+	NTSTATUS indicating whether the controller answered
+
+--*/
+{
+	return HimaxBusProbe((SPB_CONTEXT*)SpbContext);
+}
+
+NTSTATUS
+TchUpdateFirmware(
+	IN VOID* ControllerContext,
+	IN SPB_CONTEXT* SpbContext,
+	IN PTOUCH_SCREEN_SETTINGS TouchSettings
+)
+/*++
+
+  Routine Description:
+
+	This routine is called before the controller is started to bring
+	its firmware in line with the image shipped with the driver, if the
+	touch settings ask for it. Zero flash parts have no firmware until
+	the image is uploaded to their SRAM.
+
+  Arguments:
+
+	ControllerContext - A pointer to the current touch controller
+	context
+
+	SpbContext - A pointer to the current i2c context
+
+	TouchSettings - The registry touch settings
+
+  Return Value:
+
+	NTSTATUS, failing only when the controller is left without a
+	firmware to run
+
+--*/
+{
+	HIMAX_CONTROLLER_CONTEXT* controller;
+	NTSTATUS status;
+	BOOLEAN flashModified;
+
+	controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
+
+	if (controller->Config.ZeroFlash != 0)
+	{
+		return HimaxZeroFlashUpload(controller, SpbContext, FALSE);
+	}
+
+	status = HimaxFirmwareUpdate(
+		controller,
+		SpbContext,
+		TouchSettings,
+		&flashModified);
+
+	//
+	// An update that failed before erasing leaves the current firmware
+	// running, and the controller can still be started
+	//
+	if (!NT_SUCCESS(status) && !flashModified)
+	{
+		Trace(
+			TRACE_LEVEL_WARNING,
+			TRACE_INIT,
+			"Firmware not updated, keeping the current firmware - 0x%08lX",
+			status);
+
+		status = STATUS_SUCCESS;
+	}
+
+	return status;
+}
+
 NTSTATUS
 TchStopDevice(
 	IN VOID* ControllerContext,
@@ -176,6 +276,87 @@ Return Value:
 	return STATUS_SUCCESS;
 }
 
+VOID
+TchSetPanelBounds(
+	IN VOID* ControllerContext,
+	IN ULONG MaxX,
+	IN ULONG MaxY
+)
+/*++
+
+Routine Description:
+
+	This routine sets the largest coordinates the controller reports
+	inside the panel. Slots beyond them are treated as empty.
+
+Argument:
+
+	ControllerContext - Touch controller context
+	MaxX - The largest X coordinate
+	MaxY - The largest Y coordinate
+
+Return Value:
+
+	None
+--*/
+{
+	HIMAX_CONTROLLER_CONTEXT* controller;
+
+	controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
+
+	controller->Bounds.MaxX = (UINT16)min(MaxX, MAXUINT16);
+	controller->Bounds.MaxY = (UINT16)min(MaxY, MAXUINT16);
+}
+
+VOID
+TchApplyTouchSettings(
+	IN VOID* ControllerContext,
+	IN PTOUCH_SCREEN_SETTINGS TouchSettings
+)
+/*++
+
+Routine Description:
+
+	This routine hands the touch settings that shape how the controller
+	is configured to the controller context, before it is started.
+
+Argument:
+
+	ControllerContext - Touch controller context
+	TouchSettings - The registry touch settings
+
+Return Value:
+
+	None
+--*/
+{
+	HIMAX_CONTROLLER_CONTEXT* controller;
+
+	controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
+
+	controller->ReportRate.Register = TouchSettings->ReportRateRegister;
+	controller->ReportRate.Hz = HIMAX_REPORT_RATE_FIRMWARE_DEFAULT;
+
+	if (!HimaxReportRateSupported(TouchSettings->ReportRateHz))
+	{
+		Trace(
+			TRACE_LEVEL_WARNING,
+			TRACE_INIT,
+			"Unsupported report rate %d Hz, keeping the firmware default",
+			TouchSettings->ReportRateHz);
+	}
+	else if (controller->ReportRate.Register != 0)
+	{
+		controller->ReportRate.Hz = TouchSettings->ReportRateHz;
+	}
+
+	//
+	// The chip recognizes the double tap itself, the tap time only
+	// spaces out the wake reports of taps repeated while waking
+	//
+	controller->Gesture.DedupWindowMs = TouchSettings->DoubleTapMaxTapTime10ms * 10;
+}
+
 NTSTATUS
 TchAllocateContext(
 	OUT VOID** ControllerContext,
@@ -200,8 +381,8 @@ Return Value:
 	HIMAX_CONTROLLER_CONTEXT* context;
 	NTSTATUS status;
 	
-	context = ExAllocatePoolWithTag(
-		NonPagedPoolNx,
+	context = ExAllocatePool2(
+		POOL_FLAG_NON_PAGED,
 		sizeof(HIMAX_CONTROLLER_CONTEXT),
 		TOUCH_POOL_TAG);
 
@@ -216,9 +397,18 @@ Return Value:
 		goto exit;
 	}
 
-	RtlZeroMemory(context, sizeof(HIMAX_CONTROLLER_CONTEXT));
 	context->FxDevice = FxDevice;
 
+	HimaxInitializeRetryPolicies(context);
+
+	TchRegistryGetControllerSettings(context, FxDevice);
+
+	HimaxSelectEventLayout(context, context->Config.MaxPoints);
+
+	TchSetPanelBounds(context, TOUCH_DEFAULT_RESOLUTION_X, TOUCH_DEFAULT_RESOLUTION_Y);
+
+	HimaxFilterInitialize(context);
+
 	//
 	// Allocate a WDFWAITLOCK for guarding access to the
 	// controller HW and driver controller context
@@ -240,6 +430,14 @@ Return Value:
 
 	}
 
+	status = HimaxScanInitialize(context);
+
+	if (!NT_SUCCESS(status))
+	{
+		TchFreeContext(context);
+		goto exit;
+	}
+
 	*ControllerContext = context;
 
 exit:
@@ -272,6 +470,8 @@ Return Value:
 
 	if (controller != NULL)
 	{
+		HimaxZeroFlashRelease(controller);
+		HimaxScanRelease(controller);
 
 		if (controller->ControllerLock != NULL)
 		{
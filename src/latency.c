@@ -0,0 +1,272 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) Bingxing Wang. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		latency.c
+
+	Abstract:
+
+		Contains per-stage touch latency histograms, from the touch
+		interrupt to the completion of the HID read request
+
+	Environment:
+
+		Kernel mode
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim\compat.h>
+#include <internal.h>
+#include <latency.h>
+#include <latency.tmh>
+
+static
+ULONG
+LatencyBucketIndex(
+	IN ULONG ValueInUs
+)
+{
+	ULONG magnitude;
+
+	if (ValueInUs < LATENCY_LINEAR_BUCKETS)
+	{
+		return ValueInUs;
+	}
+
+	ValueInUs = min(ValueInUs, LATENCY_MAX_VALUE_US);
+
+	_BitScanReverse(&magnitude, ValueInUs);
+
+	return LATENCY_LINEAR_BUCKETS +
+		(magnitude - LATENCY_LINEAR_BITS) * LATENCY_SUB_BUCKETS +
+		((ValueInUs >> (magnitude - LATENCY_SUB_BUCKET_BITS)) - LATENCY_SUB_BUCKETS);
+}
+
+static
+ULONG
+LatencyBucketUpperBound(
+	IN ULONG Index
+)
+{
+	ULONG magnitude;
+	ULONG subBucket;
+
+	if (Index < LATENCY_LINEAR_BUCKETS)
+	{
+		return Index;
+	}
+
+	magnitude = (Index - LATENCY_LINEAR_BUCKETS) / LATENCY_SUB_BUCKETS + LATENCY_LINEAR_BITS;
+	subBucket = (Index - LATENCY_LINEAR_BUCKETS) % LATENCY_SUB_BUCKETS;
+
+	return ((LATENCY_SUB_BUCKETS + subBucket + 1) << (magnitude - LATENCY_SUB_BUCKET_BITS)) - 1;
+}
+
+VOID
+LatencyInitialize(
+	OUT LATENCY_HISTOGRAMS* Histograms
+)
+/*++
+
+Routine Description:
+
+	Clears the histograms and caches the performance counter frequency.
+
+Arguments:
+
+	Histograms - The histograms to initialize
+
+Return Value:
+
+	None
+
+--*/
+{
+	LARGE_INTEGER frequency;
+
+	RtlZeroMemory(Histograms, sizeof(LATENCY_HISTOGRAMS));
+
+	KeQueryPerformanceCounter(&frequency);
+	Histograms->Frequency = frequency.QuadPart;
+}
+
+VOID
+LatencyStamp(
+	IN LATENCY_STAMPS* Stamps,
+	IN LATENCY_POINT Point
+)
+{
+	Stamps->Points[Point] = KeQueryPerformanceCounter(NULL).QuadPart;
+}
+
+static
+VOID
+LatencyRecord(
+	IN LATENCY_HISTOGRAMS* Histograms,
+	IN LATENCY_STAGE Stage,
+	IN LONGLONG Start,
+	IN LONGLONG End
+)
+{
+	LATENCY_HISTOGRAM* histogram;
+	ULONGLONG elapsed;
+	ULONG valueInUs;
+	LONG max;
+
+	histogram = &Histograms->Stages[Stage];
+
+	elapsed = (ULONGLONG)(End - Start) * 1000000 / (ULONGLONG)Histograms->Frequency;
+	valueInUs = (ULONG)min(elapsed, LATENCY_MAX_VALUE_US);
+
+	InterlockedIncrement(&histogram->Buckets[LatencyBucketIndex(valueInUs)]);
+	InterlockedIncrement(&histogram->Count);
+
+	do
+	{
+		max = histogram->MaxInUs;
+
+		if ((ULONG)max >= valueInUs)
+		{
+			break;
+		}
+	} while (InterlockedCompareExchange(&histogram->MaxInUs, (LONG)valueInUs, max) != max);
+}
+
+VOID
+LatencyRecordFrame(
+	IN LATENCY_HISTOGRAMS* Histograms,
+	IN LATENCY_STAMPS* Stamps
+)
+/*++
+
+Routine Description:
+
+	Accounts the stages of one serviced touch interrupt. Frames missing
+	a point, such as reports repeated by the continuous reporting timer,
+	are ignored. The stamps are consumed.
+
+Arguments:
+
+	Histograms - The histograms to update
+	Stamps - The points captured while servicing the interrupt
+
+Return Value:
+
+	None
+
+--*/
+{
+	LONGLONG* points = Stamps->Points;
+	ULONG i;
+
+	if (Histograms == NULL || Histograms->Frequency == 0)
+	{
+		goto exit;
+	}
+
+	for (i = 0; i < LATENCY_POINT_COUNT; i++)
+	{
+		if (points[i] == 0 || (i > 0 && points[i] < points[i - 1]))
+		{
+			goto exit;
+		}
+	}
+
+	LatencyRecord(Histograms, LatencyStageBusRead,
+		points[LatencyPointInterrupt], points[LatencyPointBusRead]);
+	LatencyRecord(Histograms, LatencyStageDecode,
+		points[LatencyPointBusRead], points[LatencyPointDecoded]);
+	LatencyRecord(Histograms, LatencyStageReport,
+		points[LatencyPointDecoded], points[LatencyPointSubmit]);
+	LatencyRecord(Histograms, LatencyStageComplete,
+		points[LatencyPointSubmit], points[LatencyPointCompleted]);
+	LatencyRecord(Histograms, LatencyStageTotal,
+		points[LatencyPointInterrupt], points[LatencyPointCompleted]);
+
+exit:
+	RtlZeroMemory(Stamps, sizeof(LATENCY_STAMPS));
+}
+
+VOID
+LatencyQuery(
+	IN LATENCY_HISTOGRAMS* Histograms,
+	OUT LATENCY_SUMMARY* Summaries
+)
+/*++
+
+Routine Description:
+
+	Computes p50, p99 and max for every stage. Percentiles are reported
+	as the upper bound of the bucket they fall in.
+
+Arguments:
+
+	Histograms - The histograms to summarize
+	Summaries - An array of LATENCY_STAGE_COUNT summaries to fill
+
+Return Value:
+
+	None
+
+--*/
+{
+	LATENCY_HISTOGRAM* histogram;
+	ULONGLONG seen;
+	ULONGLONG p50Rank;
+	ULONGLONG p99Rank;
+	BOOLEAN p50Found;
+	ULONG stage;
+	ULONG i;
+
+	for (stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+	{
+		histogram = &Histograms->Stages[stage];
+
+		RtlZeroMemory(&Summaries[stage], sizeof(LATENCY_SUMMARY));
+		Summaries[stage].Count = histogram->Count;
+		Summaries[stage].MaxInUs = histogram->MaxInUs;
+
+		if (Summaries[stage].Count == 0)
+		{
+			continue;
+		}
+
+		p50Rank = ((ULONGLONG)Summaries[stage].Count * 50 + 99) / 100;
+		p99Rank = ((ULONGLONG)Summaries[stage].Count * 99 + 99) / 100;
+		seen = 0;
+		p50Found = FALSE;
+
+		for (i = 0; i < LATENCY_BUCKET_COUNT; i++)
+		{
+			seen += histogram->Buckets[i];
+
+			if (!p50Found && seen >= p50Rank)
+			{
+				p50Found = TRUE;
+				Summaries[stage].P50InUs = min(LatencyBucketUpperBound(i), Summaries[stage].MaxInUs);
+			}
+
+			if (seen >= p99Rank)
+			{
+				Summaries[stage].P99InUs = min(LatencyBucketUpperBound(i), Summaries[stage].MaxInUs);
+				break;
+			}
+		}
+	}
+}
+
+VOID
+LatencyReset(
+	IN LATENCY_HISTOGRAMS* Histograms
+)
+{
+	LONGLONG frequency = Histograms->Frequency;
+
+	RtlZeroMemory(Histograms->Stages, sizeof(Histograms->Stages));
+	Histograms->Frequency = frequency;
+}
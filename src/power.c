@@ -23,12 +23,14 @@
 #include <controller.h>
 #include <spb.h>
 #include <hx83112/hxinternal.h>
+#include <hx83112/hxfirmware.h>
 #include <internal.h>
 #include <touch_power\touch_power.h>
 #include <power.tmh>
 
+static
 NTSTATUS
-TchPowerSettingCallback(
+TchApplyPowerSetting(
     _In_ LPCGUID SettingGuid,
     _In_ PVOID Value,
     _In_ ULONG ValueLength,
@@ -39,13 +41,16 @@ TchPowerSettingCallback(
     PDEVICE_EXTENSION devContext = NULL;
     HIMAX_CONTROLLER_CONTEXT* ControllerContext = NULL;
     SPB_CONTEXT* SpbContext = NULL;
+    BRINGUP_READY_POLICY readyPolicy;
+    LONGLONG powerOnTime;
+    ULONG readyPolls;
 
     if (Context == NULL)
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_POWER,
-            "TchPowerSettingCallback: Context is NULL"
+            "TchApplyPowerSetting: Context is NULL"
         );
 
         status = STATUS_INVALID_DEVICE_REQUEST;
@@ -81,19 +86,23 @@ TchPowerSettingCallback(
         DWORD PowerState = *(DWORD*)Value;
         switch (PowerState)
         {
-        // On Battery
+        // Plugged In
         case PoAc:
             Trace(
                 TRACE_LEVEL_INFORMATION,
                 TRACE_POWER,
-                "On Battery Power");
+                "On External Power");
+
+            WdfInterruptAcquireLock(devContext->InterruptObject);
 
             status = HimaxChangeChargerConnectedState(
                 ControllerContext,
                 SpbContext,
-                0
+                1
             );
 
+            WdfInterruptReleaseLock(devContext->InterruptObject);
+
             if (!NT_SUCCESS(status))
             {
                 Trace(
@@ -104,20 +113,24 @@ TchPowerSettingCallback(
                 goto exit;
             }
             break;
-        // Plugged In
+        // On Battery, or a short term source such as a UPS
         case PoDc:
         case PoHot:
             Trace(
                 TRACE_LEVEL_INFORMATION,
                 TRACE_POWER,
-                "On External Power");
+                "On Battery Power");
+
+            WdfInterruptAcquireLock(devContext->InterruptObject);
 
             status = HimaxChangeChargerConnectedState(
                 ControllerContext,
                 SpbContext,
-                1
+                0
             );
 
+            WdfInterruptReleaseLock(devContext->InterruptObject);
+
             if (!NT_SUCCESS(status))
             {
                 Trace(
@@ -158,6 +171,26 @@ TchPowerSettingCallback(
         DWORD DisplayState = *(DWORD*)Value;
         DWORD GestureEnabled = 0;
 
+        //
+        // The controller is started powered and scanning, as with the
+        // display on. Bringing it to the state it is already in would
+        // only repeat the power on and resume work. A state is only
+        // recorded once its transition succeeded, so a failed one is
+        // tried again on the next notification.
+        //
+        if (DisplayState == 0 || DisplayState == 1)
+        {
+            if (DisplayState == devContext->DisplayStateApplied)
+            {
+                Trace(
+                    TRACE_LEVEL_INFORMATION,
+                    TRACE_POWER,
+                    "Display state unchanged - 0x%02X",
+                    DisplayState);
+                goto exit;
+            }
+        }
+
         switch (DisplayState)
         {
         case 0:
@@ -166,18 +199,12 @@ TchPowerSettingCallback(
                 TRACE_POWER,
                 "The Display is Off");
 
-            status = PowerToggle(&devContext->TouchPowerContext, 0);
-
-            if (!NT_SUCCESS(status))
-            {
-                Trace(
-                    TRACE_LEVEL_ERROR,
-                    TRACE_POWER,
-                    "Error changing touch power state - 0x%08lX",
-                    status);
-                goto exit;
-            }
+            HimaxScanStop(ControllerContext);
 
+            //
+            // Smart wake needs the chip powered, only cut the rail when
+            // wakeup gestures are off or the chip did not take the mode
+            //
             if (NT_SUCCESS(RtlReadRegistryValue(
                 (PCWSTR)L"\\Registry\\Machine\\SOFTWARE\\OEM\\Nokia\\Touch\\WakeupGesture",
                 (PCWSTR)L"Enabled",
@@ -185,6 +212,8 @@ TchPowerSettingCallback(
                 &GestureEnabled,
                 sizeof(DWORD))) && GestureEnabled == 1)
             {
+                WdfInterruptAcquireLock(devContext->InterruptObject);
+
                 status = HimaxSetReportingFlagsF12(
                     ControllerContext,
                     SpbContext,
@@ -192,27 +221,41 @@ TchPowerSettingCallback(
                     NULL
                 );
 
-                if (!NT_SUCCESS(status))
+                WdfInterruptReleaseLock(devContext->InterruptObject);
+
+                if (NT_SUCCESS(status))
                 {
-                    Trace(
-                        TRACE_LEVEL_ERROR,
-                        TRACE_POWER,
-                        "Error Changing Reporting Mode for F12 - 0x%08lX",
-                        status);
-                    goto exit;
+                    devContext->DisplayStateApplied = DisplayState;
+                    break;
                 }
+
+                Trace(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_POWER,
+                    "Error Changing Reporting Mode for F12 - 0x%08lX",
+                    status);
             }
 
+            status = PowerToggle(&devContext->TouchPowerContext, 0);
+
+            //
+            // Toggling the rail resets the chip's interface registers,
+            // and its configuration has to be brought up again
+            //
+            HimaxInvalidateBusState(ControllerContext);
+            ControllerContext->Resume.PowerLost = TRUE;
+
             if (!NT_SUCCESS(status))
             {
                 Trace(
                     TRACE_LEVEL_ERROR,
                     TRACE_POWER,
-                    "Error Changing Reporting Mode for F12 - 0x%08lX",
+                    "Error changing touch power state - 0x%08lX",
                     status);
                 goto exit;
             }
 
+            devContext->DisplayStateApplied = DisplayState;
             break;
         case 1:
             Trace(
@@ -220,18 +263,85 @@ TchPowerSettingCallback(
                 TRACE_POWER,
                 "The Display is On");
 
-            status = PowerToggle(&devContext->TouchPowerContext, 1);
-
-            if (!NT_SUCCESS(status))
+            //
+            // In smart wake the chip kept its rail and firmware
+            //
+            if (!ControllerContext->Gesture.Enabled)
             {
-                Trace(
-                    TRACE_LEVEL_ERROR,
-                    TRACE_POWER,
-                    "Error changing touch power state - 0x%08lX",
-                    status);
-                //goto exit;
+                status = PowerToggle(&devContext->TouchPowerContext, 1);
+                powerOnTime = KeQueryPerformanceCounter(NULL).QuadPart;
+
+                //
+                // Toggling the rail resets the chip's interface registers
+                //
+                HimaxInvalidateBusState(ControllerContext);
+                HimaxResetCircuitBreaker(ControllerContext);
+
+                if (!NT_SUCCESS(status))
+                {
+                    Trace(
+                        TRACE_LEVEL_ERROR,
+                        TRACE_POWER,
+                        "Error changing touch power state - 0x%08lX",
+                        status);
+                    //goto exit;
+                }
+
+                //
+                // The chip comes out of power on like out of reset, and is
+                // left alone until it answers before anything is sent
+                //
+                BringUpDefaultReadyPolicy(&readyPolicy);
+
+                status = BringUpWaitForReady(
+                    &readyPolicy,
+                    NULL,
+                    powerOnTime,
+                    TchProbeController,
+                    SpbContext,
+                    &readyPolls);
+
+                if (!NT_SUCCESS(status))
+                {
+                    ControllerContext->Resume.PowerLost = TRUE;
+
+                    Trace(
+                        TRACE_LEVEL_WARNING,
+                        TRACE_POWER,
+                        "Controller did not answer within %d us of power on - 0x%08lX",
+                        readyPolicy.TimeoutInUs,
+                        status);
+                }
+
+                //
+                // A zero flash part lost its firmware with the rail
+                //
+                if (ControllerContext->Config.ZeroFlash != 0)
+                {
+                    //
+                    // The ISR must not read the event stack in the middle
+                    // of the upload's AHB register sequences
+                    //
+                    WdfInterruptAcquireLock(devContext->InterruptObject);
+
+                    status = HimaxZeroFlashUpload(ControllerContext, SpbContext, TRUE);
+
+                    WdfInterruptReleaseLock(devContext->InterruptObject);
+
+                    if (!NT_SUCCESS(status))
+                    {
+                        Trace(
+                            TRACE_LEVEL_ERROR,
+                            TRACE_POWER,
+                            "Error reloading zero flash firmware - 0x%08lX",
+                            status);
+                        goto exit;
+                    }
+                }
             }
 
+            WdfInterruptAcquireLock(devContext->InterruptObject);
+
             status = HimaxSetReportingFlagsF12(
                 ControllerContext,
                 SpbContext,
@@ -239,15 +349,30 @@ TchPowerSettingCallback(
                 NULL
             );
 
+            //
+            // Reconfigures a chip that lost its rail and starts scanning
+            //
+            if (NT_SUCCESS(status))
+            {
+                status = HimaxChangeSleepState(
+                    ControllerContext,
+                    SpbContext,
+                    HX83112_F01_DEVICE_CONTROL_SLEEP_MODE_OPERATING);
+            }
+
+            WdfInterruptReleaseLock(devContext->InterruptObject);
+
             if (!NT_SUCCESS(status))
             {
                 Trace(
                     TRACE_LEVEL_ERROR,
                     TRACE_POWER,
-                    "Error Changing Reporting Mode for F12 - 0x%08lX",
+                    "Error restoring touch controller - 0x%08lX",
                     status);
                 goto exit;
             }
+
+            devContext->DisplayStateApplied = DisplayState;
             break;
         case 2:
             Trace(
@@ -269,6 +394,137 @@ TchPowerSettingCallback(
     return status;
 }
 
+NTSTATUS
+TchPowerSettingCallback(
+    _In_ LPCGUID SettingGuid,
+    _In_ PVOID Value,
+    _In_ ULONG ValueLength,
+    _Inout_opt_ PVOID Context
+)
+/*++
+
+Routine Description:
+
+    Handles a power source or display state notification. Registering
+    for a setting delivers its current value right away, which happens
+    before the controller is started, so until it is the latest value
+    of each setting is held and delivered by TchStartPowerSettings.
+
+Arguments:
+
+    SettingGuid - The power setting that changed
+    Value - The new value of the setting
+    ValueLength - The size of the value
+    Context - The device extension
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PDEVICE_EXTENSION devContext = NULL;
+    HIMAX_CONTROLLER_CONTEXT* ControllerContext = NULL;
+
+    if (Context == NULL)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_POWER,
+            "TchPowerSettingCallback: Context is NULL"
+        );
+
+        status = STATUS_INVALID_DEVICE_REQUEST;
+        goto exit;
+    }
+
+    devContext = (PDEVICE_EXTENSION)Context;
+    ControllerContext = (HIMAX_CONTROLLER_CONTEXT*)devContext->TouchContext;
+
+    WdfWaitLockAcquire(ControllerContext->ControllerLock, NULL);
+
+    if (devContext->PowerSettingsStarted)
+    {
+        status = TchApplyPowerSetting(SettingGuid, Value, ValueLength, Context);
+    }
+    else if (ValueLength == sizeof(DWORD) &&
+        IsEqualGUID(&GUID_ACDC_POWER_SOURCE, SettingGuid))
+    {
+        devContext->PowerSource = *(DWORD*)Value;
+        devContext->PowerSourcePending = TRUE;
+    }
+    else if (ValueLength == sizeof(DWORD) &&
+        IsEqualGUID(&GUID_CONSOLE_DISPLAY_STATE, SettingGuid))
+    {
+        devContext->DisplayState = *(DWORD*)Value;
+        devContext->DisplayStatePending = TRUE;
+    }
+
+    WdfWaitLockRelease(ControllerContext->ControllerLock);
+
+exit:
+    return status;
+}
+
+VOID
+TchStartPowerSettings(
+    IN PVOID Context
+)
+/*++
+
+Routine Description:
+
+    Delivers the power settings held while the controller was starting,
+    and every later notification as it arrives. A held display on is
+    dropped by TchApplyPowerSetting, the controller was just started in
+    that state.
+
+Arguments:
+
+    Context - The device extension
+
+Return Value:
+
+    None
+
+--*/
+{
+    PDEVICE_EXTENSION devContext;
+    HIMAX_CONTROLLER_CONTEXT* ControllerContext;
+
+    devContext = (PDEVICE_EXTENSION)Context;
+    ControllerContext = (HIMAX_CONTROLLER_CONTEXT*)devContext->TouchContext;
+
+    WdfWaitLockAcquire(ControllerContext->ControllerLock, NULL);
+
+    devContext->PowerSettingsStarted = TRUE;
+
+    if (devContext->PowerSourcePending)
+    {
+        devContext->PowerSourcePending = FALSE;
+
+        TchApplyPowerSetting(
+            &GUID_ACDC_POWER_SOURCE,
+            &devContext->PowerSource,
+            sizeof(DWORD),
+            devContext);
+    }
+
+    if (devContext->DisplayStatePending)
+    {
+        devContext->DisplayStatePending = FALSE;
+
+        TchApplyPowerSetting(
+            &GUID_CONSOLE_DISPLAY_STATE,
+            &devContext->DisplayState,
+            sizeof(DWORD),
+            devContext);
+    }
+
+    WdfWaitLockRelease(ControllerContext->ControllerLock);
+}
+
 NTSTATUS 
 TchWakeDevice(
    IN VOID *ControllerContext,
@@ -293,9 +549,17 @@ Return Value:
 --*/
 {    
     HIMAX_CONTROLLER_CONTEXT* controller;
+    PDEVICE_EXTENSION devContext;
     NTSTATUS status;
 
     controller = (HIMAX_CONTROLLER_CONTEXT*) ControllerContext;
+    devContext = GetDeviceContext(controller->FxDevice);
+
+    //
+    // The zero flash upload and the resume work must not interleave
+    // with a display state change or a self test on the controller
+    //
+    WdfWaitLockAcquire(controller->ControllerLock, NULL);
 
     //
     // Check if we were already on
@@ -307,6 +571,29 @@ Return Value:
 
     controller->DevicePowerState = PowerDeviceD0;
 
+    //
+    // The SRAM of a zero flash part does not survive D3 when the
+    // platform removes its voltage
+    //
+    if (controller->Config.ZeroFlash != 0 &&
+        controller->Config.PepRemovesVoltageInD3 != 0)
+    {
+        WdfInterruptAcquireLock(devContext->InterruptObject);
+
+        status = HimaxZeroFlashUpload(controller, SpbContext, TRUE);
+
+        WdfInterruptReleaseLock(devContext->InterruptObject);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_POWER,
+                "Error reloading zero flash firmware - 0x%08lX",
+                status);
+        }
+    }
+
     //
     // Attempt to put the controller into operating mode 
     //
@@ -325,6 +612,7 @@ Return Value:
     }
 
 exit:
+    WdfWaitLockRelease(controller->ControllerLock);
 
     return STATUS_SUCCESS;
 }
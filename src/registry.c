@@ -68,8 +68,8 @@ RtlReadRegistryValue(
 
     len = sizeof(KEY_VALUE_PARTIAL_INFORMATION) + length;
 
-    pinfo = ExAllocatePoolWithTag(
-        NonPagedPool, 
+    pinfo = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED,
         len, 
         TOUCH_POOL_TAG
     );
@@ -120,12 +120,12 @@ TchRegistryGetControllerSettings(
   Routine Description:
 
     This routine retrieves controller wide settings
-    from the registry.
+    from the registry. Values that are not present read as zero.
 
   Arguments:
 
+    ControllerContext - A pointer to the controller context
     FxDevice - a handle to the framework device object
-    Settings - A pointer to the chip settings structure
 
   Return Value:
 
@@ -137,13 +137,188 @@ TchRegistryGetControllerSettings(
     NTSTATUS status;
 
     UNREFERENCED_PARAMETER(FxDevice);
-    UNREFERENCED_PARAMETER(ControllerContext);
+
+    controller = (HIMAX_CONTROLLER_CONTEXT*)ControllerContext;
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"PepRemovesVoltageInD3",
+        REG_DWORD,
+        &controller->Config.PepRemovesVoltageInD3,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"ZeroFlash",
+        REG_DWORD,
+        &controller->Config.ZeroFlash,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"MaxPoints",
+        REG_DWORD,
+        &controller->Config.MaxPoints,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"PredictedReads",
+        REG_DWORD,
+        &controller->Config.PredictedReads,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"IdleTimeoutMs",
+        REG_DWORD,
+        &controller->Config.IdleTimeoutMs,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"DozeTimeoutMs",
+        REG_DWORD,
+        &controller->Config.DozeTimeoutMs,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"IdleReportRateHz",
+        REG_DWORD,
+        &controller->Config.IdleReportRateHz,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"DozeReportRateHz",
+        REG_DWORD,
+        &controller->Config.DozeReportRateHz,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"FilterDeadband",
+        REG_DWORD,
+        &controller->Config.FilterDeadband,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"ChargerFilterDeadband",
+        REG_DWORD,
+        &controller->Config.ChargerFilterDeadband,
+        sizeof(UINT32));
+
+    RtlReadRegistryValue(
+        TOUCH_REG_KEY,
+        L"ChargerDebounceFrames",
+        REG_DWORD,
+        &controller->Config.ChargerDebounceFrames,
+        sizeof(UINT32));
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REGISTRY,
+        "Controller settings: zero flash %d, voltage removed in D3 %d, max points %d, predicted reads %d",
+        controller->Config.ZeroFlash,
+        controller->Config.PepRemovesVoltageInD3,
+        controller->Config.MaxPoints,
+        controller->Config.PredictedReads);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REGISTRY,
+        "Scan settings: idle after %d ms at %d Hz, doze after %d ms at %d Hz",
+        controller->Config.IdleTimeoutMs,
+        controller->Config.IdleReportRateHz,
+        controller->Config.DozeTimeoutMs,
+        controller->Config.DozeReportRateHz);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REGISTRY,
+        "Filter settings: deadband %d, on charger deadband %d and debounce %d frames",
+        controller->Config.FilterDeadband,
+        controller->Config.ChargerFilterDeadband,
+        controller->Config.ChargerDebounceFrames);
 
     status = STATUS_SUCCESS;
 
     return status;
 }
 
+typedef struct _TOUCH_SETTING_VALUE
+{
+    PCWSTR Name;
+    SIZE_T Offset;
+} TOUCH_SETTING_VALUE;
+
+static const TOUCH_SETTING_VALUE gTouchSettingValues[] =
+{
+    { L"ReprogramFw00", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReprogramFw00) },
+    { L"ReprogramFw01", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReprogramFw01) },
+    { L"ReprogramFw02", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReprogramFw02) },
+    { L"ReprogramFw03", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReprogramFw03) },
+    { L"ForceFlash", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ForceFlash) },
+    { L"ReportRateHz", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReportRateHz) },
+    { L"ReportRateRegister", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, ReportRateRegister) },
+    { L"DoubleTapMaxTapTime10ms", FIELD_OFFSET(TOUCH_SCREEN_SETTINGS, DoubleTapMaxTapTime10ms) },
+};
+
+VOID
+TchGetTouchSettings(
+    IN PTOUCH_SCREEN_SETTINGS TouchSettings
+)
+/*++
+
+  Routine Description:
+
+    This routine retrieves the touch settings the driver acts upon
+    from the registry. Values that are not present read as zero.
+
+  Arguments:
+
+    TouchSettings - receives the settings
+
+  Return Value:
+
+    None
+
+--*/
+{
+    ULONG i;
+
+    RtlZeroMemory(TouchSettings, sizeof(TOUCH_SCREEN_SETTINGS));
+
+    for (i = 0; i < ARRAYSIZE(gTouchSettingValues); i++)
+    {
+        RtlReadRegistryValue(
+            TOUCH_REG_KEY,
+            gTouchSettingValues[i].Name,
+            REG_DWORD,
+            (PUCHAR)TouchSettings + gTouchSettingValues[i].Offset,
+            sizeof(UINT32));
+    }
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REGISTRY,
+        "Firmware update settings: reprogram %d/%d/%d/%d, force %d",
+        TouchSettings->ReprogramFw00,
+        TouchSettings->ReprogramFw01,
+        TouchSettings->ReprogramFw02,
+        TouchSettings->ReprogramFw03,
+        TouchSettings->ForceFlash);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REGISTRY,
+        "Report rate settings: %d Hz through register 0x%08lX",
+        TouchSettings->ReportRateHz,
+        TouchSettings->ReportRateRegister);
+}
+
 /*
  * Appends src to string dst of size siz (unlike strncat, siz is the
  * full size of dst, not space left).  At most siz-1 characters
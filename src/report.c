@@ -188,134 +188,6 @@ exit:
 	return status;
 }
 
-VOID
-ReportUpdateLocalObjectCache(
-	IN DETECTED_OBJECTS* Data,
-	IN OBJECT_CACHE* Cache
-)
-/*++
-
-Routine Description:
-
-	This routine takes raw data reported by the FocalTech hardware and
-	parses it to update a local cache of finger states. This routine manages
-	removing lifted touches from the cache, and manages a map between the
-	order of reported touches in hardware, and the order the driver should
-	use in reporting.
-
-Arguments:
-
-	Data - A pointer to the new data returned from hardware
-	Cache - A data structure holding various current finger state info
-
-Return Value:
-
-	None.
-
---*/
-{
-	int i, j;
-
-	//
-	// When hardware was last read, if any slots reported as lifted, we
-	// must clean out the slot and old touch info. There may be new
-	// finger data using the slot.
-	//
-	for (i = 0; i < MAX_TOUCHES; i++)
-	{
-		//
-		// Sweep for a slot that needs to be cleaned
-		//
-		if (!(Cache->SlotDirty & (1 << i)))
-		{
-			continue;
-		}
-
-		NT_ASSERT(Cache->DownCount > 0);
-
-		//
-		// Find the slot in the reporting list 
-		//
-		for (j = 0; j < MAX_TOUCHES; j++)
-		{
-			if (Cache->DownOrder[j] == i)
-			{
-				break;
-			}
-		}
-
-		NT_ASSERT(j != MAX_TOUCHES);
-
-		//
-		// Remove the slot. If the finger lifted was the last in the list,
-		// we just decrement the list total by one. If it was not last, we
-		// shift the trailing list items up by one.
-		//
-		for (; (j < Cache->DownCount - 1) && (j < MAX_TOUCHES - 1); j++)
-		{
-			Cache->DownOrder[j] = Cache->DownOrder[j + 1];
-		}
-		Cache->DownCount--;
-
-		//
-		// Finished, clobber the dirty bit
-		//
-		Cache->SlotDirty &= ~(1 << i);
-	}
-
-	//
-	// Cache the new set of finger data reported by hardware
-	//
-	for (i = 0; i < MAX_TOUCHES; i++)
-	{
-		//
-		// Take actions when a new contact is first reported as down
-		//
-		if ((Data->States[i] != OBJECT_STATE_NOT_PRESENT) &&
-			((Cache->SlotValid & (1 << i)) == 0) &&
-			(Cache->DownCount < MAX_TOUCHES))
-		{
-			Cache->SlotValid |= (1 << i);
-			Cache->DownOrder[Cache->DownCount++] = i;
-		}
-
-		//
-		// Ignore slots with no new information
-		//
-		if (!(Cache->SlotValid & (1 << i)))
-		{
-			continue;
-		}
-
-		//
-		// When finger is down, update local cache with new information from
-		// the controller. When finger is up, we'll use last cached value
-		//
-		Cache->Slot[i].status = (UCHAR)Data->States[i];
-		if (Cache->Slot[i].status)
-		{
-			Cache->Slot[i].x = Data->Positions[i].X;
-			Cache->Slot[i].y = Data->Positions[i].Y;
-		}
-
-		//
-		// If a finger lifted, note the slot is now inactive so that any
-		// cached data is cleaned out before we read hardware again.
-		//
-		if (Cache->Slot[i].status == OBJECT_STATE_NOT_PRESENT)
-		{
-			Cache->SlotDirty |= (1 << i);
-			Cache->SlotValid &= ~(1 << i);
-		}
-	}
-
-	//
-	// Get current scan time (in 100us units)
-	//
-	ULONG64 QpcTimeStamp;
-	Cache->ScanTime = KeQueryInterruptTimePrecise(&QpcTimeStamp) / 1000;
-}
-
 NTSTATUS
 ReportObjectsInternal(
 	IN PREPORT_CONTEXT ReportContext,
@@ -350,7 +222,6 @@ Return Value:
 	int TouchesReported = 0;
 	int currentFingerIndex;
 	int fingersToReport = 0;
-	USHORT SctatchX = 0, ScratchY = 0;
 	BOOLEAN HasPen = FALSE;
 
 	//
@@ -369,6 +240,8 @@ Return Value:
 		goto exit;
 	}
 
+	LatencyStamp(&ReportContext->Latency, LatencyPointSubmit);
+
 	while (TouchesReported != ReportContext->Cache.DownCount)
 	{
 		//
@@ -378,7 +251,7 @@ Return Value:
 
 		currentFingerIndex = 0;
 
-		fingersToReport = min(ReportContext->Cache.DownCount - TouchesReported, 2);
+		fingersToReport = min(ReportContext->Cache.DownCount - TouchesReported, REPORT_CONTACTS_PER_REPORT);
 
 		HidReport.ReportID = REPORTID_FINGER;
 
@@ -443,26 +316,12 @@ Return Value:
 				}
 			}
 
-			HidReport.TouchReport.Contacts[currentFingerIndex].ContactID = (UCHAR)currentlyReporting;
-			SctatchX = (USHORT)info.x;
-			ScratchY = (USHORT)info.y;
-			HidReport.TouchReport.Contacts[currentFingerIndex].Confidence = 1;
-
-			//
-			// Perform per-platform x/y adjustments to controller coordinates
-			//
-
-			TchTranslateToDisplayCoordinates(
-				&SctatchX,
-				&ScratchY,
-				&ReportContext->Props);
-
-			if (info.status == OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS)
-			{
-				HidReport.TouchReport.Contacts[currentFingerIndex].X = SctatchX;
-				HidReport.TouchReport.Contacts[currentFingerIndex].Y = ScratchY;
-				HidReport.TouchReport.Contacts[currentFingerIndex].TipSwitch = FINGER_STATUS;
-			}
+			ReportPackContact(
+				&ReportContext->Cache,
+				&ReportContext->Props,
+				&HidReport,
+				currentFingerIndex,
+				currentlyReporting);
 
 			TouchesReported++;
 		}
@@ -510,6 +369,12 @@ Return Value:
 		}
 	}
 
+	LatencyStamp(&ReportContext->Latency, LatencyPointCompleted);
+
+	LatencyRecordFrame(
+		ReportContext->LatencyHistograms,
+		&ReportContext->Latency);
+
 exit:
 	return status;
 }
@@ -609,6 +474,33 @@ exit:
 	return status;
 }
 
+VOID
+ReportStopContinuousSimulation(
+	VOID
+)
+/*++
+
+Routine Description:
+
+	Stops repeating the last report, for when the screen is known to be
+	left untouched. The next report starts it again.
+
+Arguments:
+
+	None
+
+Return Value:
+
+	None
+
+--*/
+{
+	if (timerHandle != NULL)
+	{
+		WdfTimerStop(timerHandle, FALSE);
+	}
+}
+
 NTSTATUS
 ReportObjectsContinuous(
 	IN PREPORT_CONTEXT ReportContext,
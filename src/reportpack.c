@@ -0,0 +1,430 @@
+/*++
+	Copyright (c) Microsoft Corporation. All Rights Reserved.
+	Copyright (c) Bingxing Wang. All Rights Reserved.
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		reportpack.c
+
+	Abstract:
+
+		Tracks decoded touch objects between frames and packs the cached
+		contacts into hid touch reports
+
+	Environment:
+
+		Kernel mode, user mode with HIMAX_USER_MODE
+
+	Revision History:
+
+--*/
+
+#include <Cross Platform Shim/compat.h>
+#ifndef HIMAX_USER_MODE
+#include <wdm.h>
+#include <controller.h>
+#endif
+#include <resolutions.h>
+#include <hid.h>
+#include <reportpack.h>
+#ifndef HIMAX_USER_MODE
+#include <reportpack.tmh>
+#endif
+
+VOID
+ReportUpdateLocalObjectCache(
+	IN DETECTED_OBJECTS* Data,
+	IN OBJECT_CACHE* Cache
+)
+/*++
+
+Routine Description:
+
+	This routine takes raw data reported by the FocalTech hardware and
+	parses it to update a local cache of finger states. This routine manages
+	removing lifted touches from the cache, and manages a map between the
+	order of reported touches in hardware, and the order the driver should
+	use in reporting.
+
+Arguments:
+
+	Data - A pointer to the new data returned from hardware
+	Cache - A data structure holding various current finger state info
+
+Return Value:
+
+	None.
+
+--*/
+{
+	int i, j;
+
+	//
+	// When hardware was last read, if any slots reported as lifted, we
+	// must clean out the slot and old touch info. There may be new
+	// finger data using the slot.
+	//
+	for (i = 0; i < MAX_TOUCHES; i++)
+	{
+		//
+		// Sweep for a slot that needs to be cleaned
+		//
+		if (!(Cache->SlotDirty & (1 << i)))
+		{
+			continue;
+		}
+
+		NT_ASSERT(Cache->DownCount > 0);
+
+		//
+		// Find the slot in the reporting list 
+		//
+		for (j = 0; j < MAX_TOUCHES; j++)
+		{
+			if (Cache->DownOrder[j] == i)
+			{
+				break;
+			}
+		}
+
+		NT_ASSERT(j != MAX_TOUCHES);
+
+		//
+		// Remove the slot. If the finger lifted was the last in the list,
+		// we just decrement the list total by one. If it was not last, we
+		// shift the trailing list items up by one.
+		//
+		for (; (j < Cache->DownCount - 1) && (j < MAX_TOUCHES - 1); j++)
+		{
+			Cache->DownOrder[j] = Cache->DownOrder[j + 1];
+		}
+		Cache->DownCount--;
+
+		//
+		// Finished, clobber the dirty bit
+		//
+		Cache->SlotDirty &= ~(1 << i);
+	}
+
+	//
+	// Cache the new set of finger data reported by hardware
+	//
+	for (i = 0; i < MAX_TOUCHES; i++)
+	{
+		//
+		// Take actions when a new contact is first reported as down
+		//
+		if ((Data->States[i] != OBJECT_STATE_NOT_PRESENT) &&
+			((Cache->SlotValid & (1 << i)) == 0) &&
+			(Cache->DownCount < MAX_TOUCHES))
+		{
+			Cache->SlotValid |= (1 << i);
+			Cache->DownOrder[Cache->DownCount++] = i;
+		}
+
+		//
+		// Ignore slots with no new information
+		//
+		if (!(Cache->SlotValid & (1 << i)))
+		{
+			continue;
+		}
+
+		//
+		// When finger is down, update local cache with new information from
+		// the controller. When finger is up, we'll use last cached value
+		//
+		Cache->Slot[i].status = (UCHAR)Data->States[i];
+		if (Cache->Slot[i].status)
+		{
+			Cache->Slot[i].x = Data->Positions[i].X;
+			Cache->Slot[i].y = Data->Positions[i].Y;
+		}
+
+		//
+		// If a finger lifted, note the slot is now inactive so that any
+		// cached data is cleaned out before we read hardware again.
+		//
+		if (Cache->Slot[i].status == OBJECT_STATE_NOT_PRESENT)
+		{
+			Cache->SlotDirty |= (1 << i);
+			Cache->SlotValid &= ~(1 << i);
+		}
+	}
+
+	//
+	// Get current scan time (in 100us units)
+	//
+	ULONG64 QpcTimeStamp;
+	Cache->ScanTime = KeQueryInterruptTimePrecise(&QpcTimeStamp) / 1000;
+}
+
+VOID
+ReportPackContact(
+	IN OBJECT_CACHE* Cache,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN PHID_INPUT_REPORT HidReport,
+	IN int ContactIndex,
+	IN int Slot
+)
+/*++
+
+Routine Description:
+
+	Packs one cached finger into a contact of a hid touch report, applying
+	the per-platform coordinate translation.
+
+Arguments:
+
+	Cache - The object cache holding the finger
+	Props - The screen properties to translate the coordinates with
+	HidReport - The hid report to fill
+	ContactIndex - The contact of the report to fill
+	Slot - The object cache slot to report
+
+Return Value:
+
+	None.
+
+--*/
+{
+	OBJECT_INFO info = Cache->Slot[Slot];
+	USHORT ScratchX, ScratchY;
+
+	HidReport->TouchReport.Contacts[ContactIndex].ContactID = (UCHAR)Slot;
+	ScratchX = (USHORT)info.x;
+	ScratchY = (USHORT)info.y;
+	HidReport->TouchReport.Contacts[ContactIndex].Confidence = 1;
+
+	//
+	// Perform per-platform x/y adjustments to controller coordinates
+	//
+
+	TchTranslateToDisplayCoordinates(
+		&ScratchX,
+		&ScratchY,
+		Props);
+
+	if (info.status == OBJECT_STATE_FINGER_PRESENT_WITH_ACCURATE_POS)
+	{
+		HidReport->TouchReport.Contacts[ContactIndex].X = ScratchX;
+		HidReport->TouchReport.Contacts[ContactIndex].Y = ScratchY;
+		HidReport->TouchReport.Contacts[ContactIndex].TipSwitch = FINGER_STATUS;
+	}
+}
+
+int
+ReportPackFingers(
+	IN OBJECT_CACHE* Cache,
+	IN PTOUCH_SCREEN_PROPERTIES Props,
+	IN int TouchesReported,
+	OUT PHID_INPUT_REPORT HidReport
+)
+/*++
+
+Routine Description:
+
+	Packs the next cached fingers, in down order, into a hybrid mode hid
+	finger report. Only the first report of a frame carries the contact
+	count, the following ones report 0.
+
+Arguments:
+
+	Cache - The object cache holding the fingers
+	Props - The screen properties to translate the coordinates with
+	TouchesReported - The fingers of this frame already reported
+	HidReport - The hid report to fill
+
+Return Value:
+
+	The fingers of this frame reported once this report is sent.
+
+--*/
+{
+	int fingersToReport;
+	int contactIndex;
+
+	RtlZeroMemory(HidReport, sizeof(HID_INPUT_REPORT));
+
+	HidReport->ReportID = REPORTID_FINGER;
+	HidReport->TouchReport.ContactCount =
+		TouchesReported == 0 ? (UCHAR)Cache->DownCount : 0;
+
+	fingersToReport = min(Cache->DownCount - TouchesReported, REPORT_CONTACTS_PER_REPORT);
+
+	for (contactIndex = 0; contactIndex < fingersToReport; contactIndex++)
+	{
+		ReportPackContact(
+			Cache,
+			Props,
+			HidReport,
+			contactIndex,
+			Cache->DownOrder[TouchesReported]);
+
+		TouchesReported++;
+	}
+
+	return TouchesReported;
+}
+
+VOID
+TchTranslateToDisplayCoordinates(
+	IN PUSHORT PX,
+	IN PUSHORT PY,
+	IN PTOUCH_SCREEN_PROPERTIES Props
+)
+/*++
+ 
+  Routine Description:
+
+	This routine performs translations on touch coordinates
+	to ensure points reported to the OS match pixels on the
+	display.
+
+  Arguments:
+
+	X - pointer to the pre-processed X coordinate
+	Y - pointer the pre-processed Y coordinate
+	Props - pointer to screen information
+
+  Return Value:
+
+	None. The X/Y values will be modified by this function.
+
+--*/
+{
+	return;
+
+	ULONG X;
+	ULONG Y;
+
+	//
+	// Avoid overflow
+	//
+	X = (ULONG) *PX;
+	Y = (ULONG) *PY;
+
+	//
+	// Swap the axes reported by the touch controller if requested
+	//
+	if (Props->TouchSwapAxes)
+	{
+		ULONG temp = Y;
+		Y = X;
+		X = temp;
+	}
+
+	//
+	// Invert the coordinates as requested
+	//
+	if (Props->TouchInvertXAxis)
+	{
+		if (X >= Props->TouchPhysicalWidth)
+		{
+			X = Props->TouchPhysicalWidth - 1u;
+		}
+
+		X = Props->TouchPhysicalWidth - X - 1u;
+	}
+	if (Props->TouchInvertYAxis)
+	{
+		if (Y >= Props->TouchPhysicalHeight)
+		{
+			Y = Props->TouchPhysicalHeight - 1u;
+		}
+
+		Y = Props->TouchPhysicalHeight - Y - 1u;
+	}
+
+	//
+	// Handle touch clipping boundaries so touch matches
+	// the physical display
+	//
+	if (X <= Props->TouchPillarBoxWidthLeft)
+	{
+		X = 0;
+	}
+	else
+	{
+		X -= Props->TouchPillarBoxWidthLeft;
+	}
+
+	if (X >= Props->TouchPhysicalWidth - Props->TouchPillarBoxWidthRight)
+	{
+		X = Props->TouchPhysicalWidth;
+	}
+	else
+	{
+		X += Props->TouchPillarBoxWidthRight;
+	}
+
+	if (Y <= Props->TouchLetterBoxHeightTop)
+	{
+		Y = 0;
+	}
+	else
+	{
+		Y -= Props->TouchLetterBoxHeightTop;
+	}
+
+	if (Y >= Props->TouchPhysicalHeight - Props->TouchLetterBoxHeightBottom)
+	{
+		Y = Props->TouchPhysicalHeight;
+	}
+	else
+	{
+		Y += Props->TouchLetterBoxHeightBottom;
+	}
+
+	//
+	// Scale the raw touch pixel units into physical display pixels,
+	// leaving off the capacitive button region.
+	//
+	X = X * Props->DisplayPhysicalWidth / Props->TouchPhysicalWidth;
+	Y = Y * Props->DisplayPhysicalHeight / 
+		(Props->TouchPhysicalHeight - Props->TouchPhysicalButtonHeight);
+
+	//
+	// If the display is additionally being letterboxed or pillarboxed, make
+	// further adjustments to the touch coordinates.
+	//
+	if (X <= Props->DisplayPillarBoxWidthLeft)
+	{
+		X = 0;
+	}
+	else
+	{
+		X -= Props->DisplayPillarBoxWidthLeft;
+	}
+
+	if (X >= Props->DisplayPhysicalWidth - Props->DisplayPillarBoxWidthRight)
+	{
+		X = Props->DisplayPhysicalWidth;
+	}
+	else
+	{
+		X += Props->DisplayPillarBoxWidthRight;
+	}
+
+	if (Y <= Props->DisplayLetterBoxHeightTop)
+	{
+		Y = 0;
+	}
+	else
+	{
+		Y -= Props->DisplayLetterBoxHeightTop;
+	}
+
+	if (Y >= Props->DisplayPhysicalHeight - Props->DisplayLetterBoxHeightBottom)
+	{
+		Y = Props->DisplayPhysicalHeight;
+	}
+	else
+	{
+		Y += Props->DisplayLetterBoxHeightBottom;
+	}
+
+	*PX = (USHORT) X;
+	*PY = (USHORT) Y;
+}
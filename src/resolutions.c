@@ -10,8 +10,8 @@
     Abstract:
 
         This module retrieves platform-specific configuration
-        parameters from the registry, and translates touch
-        controller pixel units to display pixel units.
+        parameters from the registry. Touch controller pixel units
+        are translated to display pixel units in reportpack.c.
 
     Environment:
 
@@ -249,167 +249,6 @@ static const ULONG gcRegistryTable =
     sizeof(gResParamsRegTable) / sizeof(gResParamsRegTable[0]);
 
 
-VOID
-TchTranslateToDisplayCoordinates(
-    IN PUSHORT PX,
-    IN PUSHORT PY,
-    IN PTOUCH_SCREEN_PROPERTIES Props
-    )
-/*++
- 
-  Routine Description:
-
-    This routine performs translations on touch coordinates
-    to ensure points reported to the OS match pixels on the
-    display.
-
-  Arguments:
-
-    X - pointer to the pre-processed X coordinate
-    Y - pointer the pre-processed Y coordinate
-    Props - pointer to screen information
-
-  Return Value:
-
-    None. The X/Y values will be modified by this function.
-
---*/
-{
-    return;
-
-    ULONG X;
-    ULONG Y;
-
-    //
-    // Avoid overflow
-    //
-    X = (ULONG) *PX;
-    Y = (ULONG) *PY;
-
-    //
-    // Swap the axes reported by the touch controller if requested
-    //
-    if (Props->TouchSwapAxes)
-    {
-        ULONG temp = Y;
-        Y = X;
-        X = temp;
-    }
-
-    //
-    // Invert the coordinates as requested
-    //
-    if (Props->TouchInvertXAxis)
-    {
-        if (X >= Props->TouchPhysicalWidth)
-        {
-            X = Props->TouchPhysicalWidth - 1u;
-        }
-
-        X = Props->TouchPhysicalWidth - X - 1u;
-    }
-    if (Props->TouchInvertYAxis)
-    {
-        if (Y >= Props->TouchPhysicalHeight)
-        {
-            Y = Props->TouchPhysicalHeight - 1u;
-        }
-
-        Y = Props->TouchPhysicalHeight - Y - 1u;
-    }
-
-    //
-    // Handle touch clipping boundaries so touch matches
-    // the physical display
-    //
-    if (X <= Props->TouchPillarBoxWidthLeft)
-    {
-        X = 0;
-    }
-    else
-    {
-        X -= Props->TouchPillarBoxWidthLeft;
-    }
-
-    if (X >= Props->TouchPhysicalWidth - Props->TouchPillarBoxWidthRight)
-    {
-        X = Props->TouchPhysicalWidth;
-    }
-    else
-    {
-        X += Props->TouchPillarBoxWidthRight;
-    }
-
-    if (Y <= Props->TouchLetterBoxHeightTop)
-    {
-        Y = 0;
-    }
-    else
-    {
-        Y -= Props->TouchLetterBoxHeightTop;
-    }
-
-    if (Y >= Props->TouchPhysicalHeight - Props->TouchLetterBoxHeightBottom)
-    {
-        Y = Props->TouchPhysicalHeight;
-    }
-    else
-    {
-        Y += Props->TouchLetterBoxHeightBottom;
-    }
-
-    //
-    // Scale the raw touch pixel units into physical display pixels,
-    // leaving off the capacitive button region.
-    //
-    X = X * Props->DisplayPhysicalWidth / Props->TouchPhysicalWidth;
-    Y = Y * Props->DisplayPhysicalHeight / 
-        (Props->TouchPhysicalHeight - Props->TouchPhysicalButtonHeight);
-
-    //
-    // If the display is additionally being letterboxed or pillarboxed, make
-    // further adjustments to the touch coordinates.
-    //
-    if (X <= Props->DisplayPillarBoxWidthLeft)
-    {
-        X = 0;
-    }
-    else
-    {
-        X -= Props->DisplayPillarBoxWidthLeft;
-    }
-
-    if (X >= Props->DisplayPhysicalWidth - Props->DisplayPillarBoxWidthRight)
-    {
-        X = Props->DisplayPhysicalWidth;
-    }
-    else
-    {
-        X += Props->DisplayPillarBoxWidthRight;
-    }
-
-    if (Y <= Props->DisplayLetterBoxHeightTop)
-    {
-        Y = 0;
-    }
-    else
-    {
-        Y -= Props->DisplayLetterBoxHeightTop;
-    }
-
-    if (Y >= Props->DisplayPhysicalHeight - Props->DisplayLetterBoxHeightBottom)
-    {
-        Y = Props->DisplayPhysicalHeight;
-    }
-    else
-    {
-        Y += Props->DisplayLetterBoxHeightBottom;
-    }
-
-    *PX = (USHORT) X;
-    *PY = (USHORT) Y;
-}
-
 VOID
 TchGetScreenProperties(
     IN PTOUCH_SCREEN_PROPERTIES Props
@@ -439,10 +278,10 @@ TchGetScreenProperties(
 
     //
     // Table passed to RtlQueryRegistryValues must be allocated 
-    // from NonPagedPoolNx
+    // from non-paged pool
     //
-    regTable = ExAllocatePoolWithTag(
-        NonPagedPoolNx,
+    regTable = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED,
         gcbRegistryTable,
         TOUCH_POOL_TAG);
 
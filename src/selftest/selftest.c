@@ -68,6 +68,56 @@ Return Value:
     NTSTATUS status = STATUS_INVALID_PARAMETER;
     BOOLEAN *requestedDiagnosticMode;
     UCHAR *requestedPage;
+    TOUCH_TEST_RETRY_STATS *retryStats;
+    HIMAX_CONTROLLER_CONTEXT *controller;
+    BOOLEAN *requestedTraceEnable;
+    TOUCH_TEST_SPB_TRACE_HEADER *traceHeader;
+    LARGE_INTEGER frequency;
+    TOUCH_TEST_LATENCY_STATS *latencyStats;
+    BOOLEAN *requestedLatencyReset;
+    BOOLEAN reset;
+    BOOLEAN *requestedCaptureEnable;
+    PVOID captureBuffer;
+    ULONG captureLength;
+    HIMAX_CAPTURE_REPLAY_STATS replayStats;
+    TOUCH_TEST_REPLAY_RESULT *replayResult;
+    TOUCH_TEST_BUS_STATS *busStats;
+    ULONG *requestedFrames;
+    ULONG benchFrames;
+    ULONG benchSeed;
+    HIMAX_DECODE_BENCHMARK benchmark;
+    TOUCH_TEST_DECODE_BENCH_RESULT *benchResult;
+    TOUCH_TEST_FRAME_STATS *frameStats;
+    ULONG *requestedRate;
+    ULONG rate;
+    TOUCH_TEST_REPORT_RATE *reportRate;
+    TOUCH_TEST_SCAN_STATS *scanStats;
+    TOUCH_TEST_SCAN_SCRIPT *scanScript;
+    TOUCH_TEST_SCAN_SCRIPT_RESULT *scanResult;
+    HIMAX_SCAN_POLICY scanPolicy;
+    HIMAX_SCAN_STEP scanSteps[HIMAX_SCAN_SCRIPT_MAX_STEPS];
+    ULONG scanCount;
+    TOUCH_TEST_GESTURE_STATS *gestureStats;
+    TOUCH_TEST_FILTER_STATS *filterStats;
+    TOUCH_TEST_RESUME_STATS *resumeStats;
+    TOUCH_TEST_BRINGUP *bringUp;
+    TOUCH_TEST_READY_SIMULATION *readySimulation;
+    TOUCH_TEST_READY_SIMULATION_RESULT *readyResult;
+    BRINGUP_READY_POLICY readyPolicy;
+    ULONG readyAfterInUs[TOUCH_TEST_READY_SIMULATE_MAX_CHIPS];
+    ULONG readyCount;
+    ULONG readyBusyInUs;
+    TOUCH_TEST_COMMAND_LISTS *commandLists;
+    TOUCH_TEST_RETRY_SIMULATION *retrySimulation;
+    TOUCH_TEST_RETRY_SIMULATION_RESULT *retryResult;
+    ULONG retryFailedAttempts[HIMAX_RETRY_SIMULATE_MAX_PROBES];
+    ULONG retryCount;
+    BOOLEAN retryHotPath;
+    TOUCH_TEST_FLASH_SIMULATION *flashSimulation;
+    TOUCH_TEST_FLASH_SIMULATION_RESULT *flashResult;
+    ULONG flashLength;
+    ULONG flashSeed;
+    ULONG i;
 
 
     devContext = GetDeviceContext(WdfPdoGetParent(WdfIoQueueGetDevice(Queue)));
@@ -126,14 +176,25 @@ Return Value:
                 goto exit;
             }
 
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
             //
-            // Perform read
+            // Perform read. The raw access bypasses the cached interface
+            // state, keep the interrupt thread off the bus and have the
+            // driver forget what it knew of the chip afterwards
             //
+            WdfInterruptAcquireLock(devContext->InterruptObject);
+
             status = SpbReadDataSynchronously(
                 &devContext->I2CContext,
                 headerTemp.Address,
                 readBuffer,
                 headerTemp.RequestedTransferLength);
+
+            HimaxInvalidateBusState(controller);
+
+            WdfInterruptReleaseLock(devContext->InterruptObject);
+
             if (!NT_SUCCESS(status))
             {
                 goto exit;
@@ -169,15 +230,23 @@ Return Value:
                 goto exit;
             }
 
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
             //
-            // Perform write
+            // Perform write, under the same rules as reads
             //
+            WdfInterruptAcquireLock(devContext->InterruptObject);
+
             status = SpbWriteDataSynchronously(
                 &devContext->I2CContext,
                 headerIn->Address,
                 (PVOID) (headerIn+1),
                 headerIn->RequestedTransferLength);
 
+            HimaxInvalidateBusState(controller);
+
+            WdfInterruptReleaseLock(devContext->InterruptObject);
+
             if (!NT_SUCCESS(status))
             {
                 goto exit;
@@ -258,6 +327,874 @@ Return Value:
             break;
         }
 
+        case IOCTL_TOUCH_SELFTEST_RETRY_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_RETRY_STATS),
+                (PVOID) &retryStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            retryStats->HotPath.Operations = controller->HotPathRetry.Operations;
+            retryStats->HotPath.Retries = controller->HotPathRetry.Retries;
+            retryStats->HotPath.Exhausted = controller->HotPathRetry.Exhausted;
+            retryStats->HotPath.FastFails = controller->HotPathRetry.FastFails;
+
+            retryStats->BringUp.Operations = controller->BringUpRetry.Operations;
+            retryStats->BringUp.Retries = controller->BringUpRetry.Retries;
+            retryStats->BringUp.Exhausted = controller->BringUpRetry.Exhausted;
+            retryStats->BringUp.FastFails = controller->BringUpRetry.FastFails;
+
+            retryStats->BreakerOpen = controller->Breaker.Open;
+            retryStats->BreakerTrips = controller->Breaker.Trips;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_RETRY_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_TRACE_ENABLE:
+        {
+            //
+            // Validate parameters and memory
+            //
+            if (InputBufferLength != sizeof(BOOLEAN))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(BOOLEAN),
+                (PVOID) &requestedTraceEnable,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            SpbTraceEnable(&devContext->I2CContext, *requestedTraceEnable);
+
+            WdfRequestSetInformation(Request, sizeof(*requestedTraceEnable));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_TRACE_READ:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_SPB_TRACE_HEADER),
+                (PVOID) &traceHeader,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            KeQueryPerformanceCounter(&frequency);
+
+            traceHeader->RecordSize = sizeof(SPB_TRACE_RECORD);
+            traceHeader->TimestampFrequency = frequency.QuadPart;
+            traceHeader->RequestCount = devContext->I2CContext.RequestCount;
+            traceHeader->PoolAcquisitions = devContext->I2CContext.BufferPool.Acquisitions;
+            traceHeader->PoolAllocations = devContext->I2CContext.BufferPool.Allocations;
+            traceHeader->RecordCount = SpbTraceSnapshot(
+                &devContext->I2CContext,
+                (SPB_TRACE_RECORD*) (traceHeader + 1),
+                (ULONG) ((OutputBufferLength - sizeof(TOUCH_TEST_SPB_TRACE_HEADER)) /
+                    sizeof(SPB_TRACE_RECORD)));
+
+            WdfRequestSetInformation(
+                Request,
+                sizeof(TOUCH_TEST_SPB_TRACE_HEADER) +
+                    traceHeader->RecordCount * sizeof(SPB_TRACE_RECORD));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_LATENCY:
+        {
+            //
+            // Validate parameters and memory
+            //
+            if (InputBufferLength != 0 && InputBufferLength != sizeof(BOOLEAN))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            requestedLatencyReset = NULL;
+
+            if (InputBufferLength == sizeof(BOOLEAN))
+            {
+                status = WdfRequestRetrieveInputBuffer(
+                    Request,
+                    sizeof(BOOLEAN),
+                    (PVOID) &requestedLatencyReset,
+                    NULL);
+
+                if (!NT_SUCCESS(status))
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                    goto exit;
+                }
+            }
+
+            //
+            // Input and output share the buffer, consume the input first
+            //
+            reset = (requestedLatencyReset != NULL) && *requestedLatencyReset;
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_LATENCY_STATS),
+                (PVOID) &latencyStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            LatencyQuery(&devContext->Latency, latencyStats->Stages);
+
+            if (reset)
+            {
+                LatencyReset(&devContext->Latency);
+            }
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_LATENCY_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_CAPTURE_ENABLE:
+        {
+            //
+            // Validate parameters and memory
+            //
+            if (InputBufferLength != sizeof(BOOLEAN))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(BOOLEAN),
+                (PVOID) &requestedCaptureEnable,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            HimaxCaptureEnable(&controller->Capture, *requestedCaptureEnable);
+            SpbTraceEnable(&devContext->I2CContext, *requestedCaptureEnable);
+
+            WdfRequestSetInformation(Request, sizeof(*requestedCaptureEnable));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_CAPTURE_READ:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(HIMAX_CAPTURE_STREAM_HEADER),
+                &captureBuffer,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            status = HimaxCaptureWriteStream(
+                &controller->Capture,
+                &devContext->I2CContext,
+                captureBuffer,
+                (ULONG) OutputBufferLength,
+                &captureLength);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            WdfRequestSetInformation(Request, captureLength);
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_REPLAY:
+        {
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(HIMAX_CAPTURE_STREAM_HEADER),
+                &captureBuffer,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            //
+            // Input and output share the buffer, replay before writing
+            //
+            status = HimaxCaptureReplay(
+                &devContext->ReportContext,
+                controller->Filter.Profiles,
+                controller->Filter.Profile,
+                captureBuffer,
+                (ULONG) InputBufferLength,
+                &replayStats);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_REPLAY_RESULT),
+                (PVOID) &replayResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            replayResult->Stats = replayStats;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_REPLAY_RESULT));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_BUS_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_BUS_STATS),
+                (PVOID) &busStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            busStats->EventReads = controller->BusState.EventReads;
+            busStats->EventReadTransfers = controller->BusState.EventReadTransfers;
+            busStats->LegacyEventReadOperations = controller->BusState.EventReads * 3;
+            busStats->WritesSkipped = controller->BusState.WritesSkipped;
+            busStats->BurstRestores = controller->BusState.BurstRestores;
+            busStats->PredictedReads = controller->BusState.PredictedReads;
+            busStats->Mispredictions = controller->BusState.Mispredictions;
+            busStats->BytesSaved = controller->BusState.BytesSaved;
+            busStats->BytesWasted = controller->BusState.BytesWasted;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_BUS_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_DECODE_BENCH:
+        {
+            benchFrames = 0;
+            benchSeed = 0;
+
+            if (InputBufferLength >= sizeof(ULONG))
+            {
+                status = WdfRequestRetrieveInputBuffer(
+                    Request,
+                    sizeof(ULONG),
+                    (PVOID) &requestedFrames,
+                    NULL);
+
+                if (!NT_SUCCESS(status))
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                    goto exit;
+                }
+
+                benchFrames = requestedFrames[0];
+
+                if (InputBufferLength >= 2 * sizeof(ULONG))
+                {
+                    benchSeed = requestedFrames[1];
+                }
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            //
+            // Input and output share the buffer, run before writing
+            //
+            status = HimaxDecodeBenchmark(
+                controller->Layout,
+                &controller->Bounds,
+                benchFrames,
+                benchSeed,
+                &benchmark);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_DECODE_BENCH_RESULT),
+                (PVOID) &benchResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            benchResult->Benchmark = benchmark;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_DECODE_BENCH_RESULT));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_FRAME_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_FRAME_STATS),
+                (PVOID) &frameStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            frameStats->Frames = controller->FrameStats;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_FRAME_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_REPORT_RATE:
+        {
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            if (InputBufferLength >= sizeof(ULONG))
+            {
+                status = WdfRequestRetrieveInputBuffer(
+                    Request,
+                    sizeof(ULONG),
+                    (PVOID) &requestedRate,
+                    NULL);
+
+                if (!NT_SUCCESS(status))
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                    goto exit;
+                }
+
+                rate = *requestedRate;
+
+                //
+                // Keep the interrupt thread off the bus while switching
+                //
+                WdfInterruptAcquireLock(devContext->InterruptObject);
+
+                status = HimaxSetReportRate(
+                    controller,
+                    &devContext->I2CContext,
+                    rate);
+
+                WdfInterruptReleaseLock(devContext->InterruptObject);
+
+                if (!NT_SUCCESS(status))
+                {
+                    goto exit;
+                }
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_REPORT_RATE),
+                (PVOID) &reportRate,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            reportRate->Hz = controller->ReportRate.Hz;
+            reportRate->Supported = controller->ReportRate.Register != 0;
+            reportRate->Changes = controller->ReportRate.Changes;
+            reportRate->MeasuredMilliHz = HimaxGetMeasuredReportRate(controller);
+            reportRate->Intervals = controller->ReportRate.Intervals;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_REPORT_RATE));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_SCAN_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_SCAN_STATS),
+                (PVOID) &scanStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            scanStats->State = controller->Scan.Machine.State;
+            scanStats->Transitions = controller->Scan.Transitions;
+            scanStats->Wake = controller->Scan.Wake;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_SCAN_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_SCAN_SCRIPT:
+        {
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_SCAN_SCRIPT),
+                (PVOID) &scanScript,
+                NULL);
+
+            if ((!NT_SUCCESS(status)) ||
+                (scanScript->Count > HIMAX_SCAN_SCRIPT_MAX_STEPS))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            //
+            // Input and output share the buffer, copy the script out
+            //
+            scanPolicy = scanScript->Policy;
+            scanCount = scanScript->Count;
+            RtlCopyMemory(scanSteps, scanScript->Steps, scanCount * sizeof(HIMAX_SCAN_STEP));
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_SCAN_SCRIPT_RESULT),
+                (PVOID) &scanResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            RtlZeroMemory(scanResult, sizeof(TOUCH_TEST_SCAN_SCRIPT_RESULT));
+
+            status = HimaxScanRunScript(
+                &scanPolicy,
+                scanSteps,
+                scanCount,
+                scanResult->Results);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            scanResult->Count = scanCount;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_SCAN_SCRIPT_RESULT));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_GESTURE_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_GESTURE_STATS),
+                (PVOID) &gestureStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            gestureStats->Enabled = controller->Gesture.Enabled;
+            gestureStats->DedupWindowMs = controller->Gesture.DedupWindowMs;
+            gestureStats->Detected = controller->Gesture.Detected;
+            gestureStats->Reported = controller->Gesture.Reported;
+            gestureStats->Suppressed = controller->Gesture.Suppressed;
+            gestureStats->Ignored = controller->Gesture.Ignored;
+            gestureStats->LastWakeInUs = controller->Gesture.LastWakeInUs;
+            gestureStats->MaxWakeInUs = controller->Gesture.MaxWakeInUs;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_GESTURE_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_FILTER_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_FILTER_STATS),
+                (PVOID) &filterStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            filterStats->Profile = controller->Filter.Profile;
+            filterStats->ChargerConnected = controller->Filter.ChargerConnected;
+            filterStats->Switches = controller->Filter.Switches;
+
+            RtlCopyMemory(filterStats->Profiles, controller->Filter.Profiles, sizeof(filterStats->Profiles));
+            RtlCopyMemory(filterStats->Raw, controller->Filter.Raw, sizeof(filterStats->Raw));
+            RtlCopyMemory(filterStats->Filtered, controller->Filter.Filtered, sizeof(filterStats->Filtered));
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_FILTER_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_RESUME_STATS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_RESUME_STATS),
+                (PVOID) &resumeStats,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            resumeStats->LastPath = controller->Resume.LastPath;
+            resumeStats->SnapshotRegisters = controller->Resume.Count;
+            resumeStats->VerifyFailures = controller->Resume.VerifyFailures;
+
+            RtlCopyMemory(resumeStats->Paths, controller->Resume.Paths, sizeof(resumeStats->Paths));
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_RESUME_STATS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_BRINGUP:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_BRINGUP),
+                (PVOID) &bringUp,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            bringUp->Timeline = devContext->BringUp;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_BRINGUP));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_READY_SIMULATE:
+        {
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_READY_SIMULATION),
+                (PVOID) &readySimulation,
+                NULL);
+
+            if ((!NT_SUCCESS(status)) ||
+                (readySimulation->Count > TOUCH_TEST_READY_SIMULATE_MAX_CHIPS))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            //
+            // Input and output share the buffer, copy the chips out
+            //
+            readyPolicy = readySimulation->Policy;
+            readyCount = readySimulation->Count;
+            readyBusyInUs = readySimulation->ConfigurationInUs;
+            RtlCopyMemory(readyAfterInUs, readySimulation->ReadyAfterInUs, readyCount * sizeof(ULONG));
+
+            if (readyPolicy.FloorInUs == 0 &&
+                readyPolicy.InitialDelayInUs == 0 &&
+                readyPolicy.MaxDelayInUs == 0 &&
+                readyPolicy.TimeoutInUs == 0)
+            {
+                BringUpDefaultReadyPolicy(&readyPolicy);
+            }
+
+            //
+            // A zero delay would never advance the virtual clock
+            //
+            if (readyPolicy.InitialDelayInUs == 0 ||
+                readyPolicy.MaxDelayInUs < readyPolicy.InitialDelayInUs)
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_READY_SIMULATION_RESULT),
+                (PVOID) &readyResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            RtlZeroMemory(readyResult, sizeof(TOUCH_TEST_READY_SIMULATION_RESULT));
+
+            for (i = 0; i < readyCount; i++)
+            {
+                BringUpSimulateReady(
+                    &readyPolicy,
+                    readyAfterInUs[i],
+                    0,
+                    &readyResult->SequentialInUs[i],
+                    &readyResult->SequentialPolls[i]);
+
+                readyResult->SequentialInUs[i] += readyBusyInUs;
+
+                BringUpSimulateReady(
+                    &readyPolicy,
+                    readyAfterInUs[i],
+                    readyBusyInUs,
+                    &readyResult->ElapsedInUs[i],
+                    &readyResult->Polls[i]);
+            }
+
+            readyResult->Count = readyCount;
+            readyResult->FixedInUs = TOUCH_DELAY_TO_COMMUNICATE + readyBusyInUs;
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_READY_SIMULATION_RESULT));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_COMMAND_LISTS:
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_COMMAND_LISTS),
+                (PVOID) &commandLists,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            //
+            // The lists are built from a copy of the configuration, keep
+            // it from changing underneath
+            //
+            WdfWaitLockAcquire(controller->ControllerLock, NULL);
+
+            status = HimaxCommandListVerify(controller, commandLists->Checks);
+
+            WdfWaitLockRelease(controller->ControllerLock);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_COMMAND_LISTS));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_RETRY_SIMULATE:
+        {
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_RETRY_SIMULATION),
+                (PVOID) &retrySimulation,
+                NULL);
+
+            if ((!NT_SUCCESS(status)) ||
+                (retrySimulation->Count > HIMAX_RETRY_SIMULATE_MAX_PROBES))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            //
+            // Input and output share the buffer, copy the script out
+            //
+            retryHotPath = retrySimulation->HotPath;
+            retryCount = retrySimulation->Count;
+            RtlCopyMemory(retryFailedAttempts, retrySimulation->FailedAttempts, retryCount * sizeof(ULONG));
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_RETRY_SIMULATION_RESULT),
+                (PVOID) &retryResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            WdfWaitLockAcquire(controller->ControllerLock, NULL);
+
+            status = HimaxRetrySimulate(
+                controller,
+                retryHotPath,
+                retryFailedAttempts,
+                retryCount,
+                &retryResult->Simulation);
+
+            WdfWaitLockRelease(controller->ControllerLock);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_RETRY_SIMULATION_RESULT));
+
+            break;
+        }
+
+        case IOCTL_TOUCH_SELFTEST_FLASH_SIMULATE:
+        {
+            status = WdfRequestRetrieveInputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_FLASH_SIMULATION),
+                (PVOID) &flashSimulation,
+                NULL);
+
+            if ((!NT_SUCCESS(status)) ||
+                (flashSimulation->Length == 0) ||
+                (flashSimulation->Length > HIMAX_FLASH_SIMULATE_MAX_LENGTH))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            //
+            // Input and output share the buffer
+            //
+            flashLength = flashSimulation->Length;
+            flashSeed = flashSimulation->Seed;
+
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(TOUCH_TEST_FLASH_SIMULATION_RESULT),
+                (PVOID) &flashResult,
+                NULL);
+
+            if (!NT_SUCCESS(status))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                goto exit;
+            }
+
+            controller = (HIMAX_CONTROLLER_CONTEXT*) devContext->TouchContext;
+
+            WdfWaitLockAcquire(controller->ControllerLock, NULL);
+
+            status = HimaxFlashSimulate(
+                controller,
+                flashLength,
+                flashSeed,
+                &flashResult->Simulation);
+
+            WdfWaitLockRelease(controller->ControllerLock);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            WdfRequestSetInformation(Request, sizeof(TOUCH_TEST_FLASH_SIMULATION_RESULT));
+
+            break;
+        }
+
         default:
         {
             status = STATUS_NOT_IMPLEMENTED;
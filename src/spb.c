@@ -22,9 +22,489 @@
 #include <internal.h>
 #include <controller.h>
 #include "spb.h"
+
+//
+// The SDK header carrying the SPB sequence IOCTL definitions shares its
+// name with our own spb.h, so it is named by its directory under the
+// SDK include root, which the project adds to the include paths
+//
+#include <shared\spb.h>
 #include <spb.tmh>
 
-#define I2C_VERBOSE_LOGGING 0
+//
+// Layout of the preallocated sequence memory. Every write transfer is
+// described by a two element buffer list (address pointer + payload),
+// every read transfer by an address write entry and a read entry.
+//
+typedef struct _SPB_SEQUENCE
+{
+    SPB_TRANSFER_LIST_AND_ENTRIES(SPB_MAX_SEQUENCE_TRANSFERS * 2) Sequence;
+    SPB_TRANSFER_BUFFER_LIST_ENTRY Buffers[SPB_MAX_SEQUENCE_TRANSFERS][2];
+    UCHAR Addresses[SPB_MAX_SEQUENCE_TRANSFERS];
+} SPB_SEQUENCE;
+
+NTSTATUS
+SpbReuseRequest(
+    IN SPB_CONTEXT* SpbContext
+)
+/*++
+
+  Routine Description:
+
+    This helper routine recycles the preallocated Spb request so it
+    can be sent again. Must be called with the SpbLock held.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    WDF_REQUEST_REUSE_PARAMS reuseParams;
+    NTSTATUS status;
+
+    WDF_REQUEST_REUSE_PARAMS_INIT(
+        &reuseParams,
+        WDF_REQUEST_REUSE_NO_FLAGS,
+        STATUS_SUCCESS);
+
+    status = WdfRequestReuse(SpbContext->SequenceRequest, &reuseParams);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error reusing Spb request - 0x%08lX",
+            status);
+    }
+
+    return status;
+}
+
+NTSTATUS
+SpbBufferPoolInitialize(
+    IN SPB_CONTEXT* SpbContext
+)
+/*++
+
+  Routine Description:
+
+    This helper routine carves the tiered transfer buffer pool out
+    of a single NonPagedPool allocation made at initialization time.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    static const ULONG tierSizes[SPB_BUFFER_TIER_COUNT] =
+    {
+        SPB_SMALL_BUFFER_SIZE,
+        SPB_MEDIUM_BUFFER_SIZE,
+        SPB_LARGE_BUFFER_SIZE
+    };
+    static const ULONG tierCounts[SPB_BUFFER_TIER_COUNT] =
+    {
+        SPB_SMALL_BUFFER_COUNT,
+        SPB_MEDIUM_BUFFER_COUNT,
+        SPB_LARGE_BUFFER_COUNT
+    };
+    SPB_BUFFER_POOL* pool;
+    PUCHAR buffer;
+    size_t length;
+    NTSTATUS status;
+    ULONG i;
+
+    pool = &SpbContext->BufferPool;
+    length = 0;
+
+    for (i = 0; i < SPB_BUFFER_TIER_COUNT; i++)
+    {
+        length += (size_t)tierSizes[i] * tierCounts[i];
+    }
+
+    status = WdfMemoryCreate(
+        WDF_NO_OBJECT_ATTRIBUTES,
+        NonPagedPool,
+        TOUCH_POOL_TAG,
+        length,
+        &pool->Memory,
+        (PVOID*)&buffer);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error allocating Spb buffer pool - 0x%08lX",
+            status);
+        goto exit;
+    }
+
+    pool->Base = buffer;
+    pool->Length = length;
+
+    for (i = 0; i < SPB_BUFFER_TIER_COUNT; i++)
+    {
+        pool->Tiers[i].Buffers = buffer;
+        pool->Tiers[i].BufferSize = tierSizes[i];
+        pool->Tiers[i].BufferCount = tierCounts[i];
+        pool->Tiers[i].InUseMask = 0;
+
+        buffer += (size_t)tierSizes[i] * tierCounts[i];
+    }
+
+exit:
+    return status;
+}
+
+PUCHAR
+SpbAcquireBuffer(
+    IN SPB_CONTEXT* SpbContext,
+    IN ULONG Length
+)
+/*++
+
+  Routine Description:
+
+    This routine hands out a transfer buffer of at least Length bytes
+    from the smallest pool tier with a free slot. Slots are claimed
+    with an interlocked compare-exchange, no lock is taken. Only when
+    every fitting slot is busy, or the request exceeds the largest
+    tier, does it fall back to a pool allocation.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+    Length     - The minimum size of the buffer
+
+  Return Value:
+
+    Pointer to the buffer, NULL if no memory could be found
+
+--*/
+{
+    SPB_BUFFER_POOL* pool;
+    SPB_BUFFER_TIER* tier;
+    PUCHAR buffer;
+    LONG inUse;
+    LONG freeMask;
+    LONG slot;
+    ULONG i;
+
+    pool = &SpbContext->BufferPool;
+
+    for (i = 0; i < SPB_BUFFER_TIER_COUNT; i++)
+    {
+        tier = &pool->Tiers[i];
+
+        if (Length > tier->BufferSize)
+        {
+            continue;
+        }
+
+        for (;;)
+        {
+            inUse = tier->InUseMask;
+            freeMask = ~inUse & ((1L << tier->BufferCount) - 1);
+
+            if (freeMask == 0)
+            {
+                break;
+            }
+
+            slot = freeMask & -freeMask;
+
+            if (InterlockedCompareExchange(
+                &tier->InUseMask,
+                inUse | slot,
+                inUse) == inUse)
+            {
+                InterlockedIncrement(&pool->Acquisitions);
+
+                return tier->Buffers +
+                    (size_t)RtlFindLeastSignificantBit((ULONGLONG)slot) * tier->BufferSize;
+            }
+        }
+    }
+
+    buffer = ExAllocatePool2(
+        POOL_FLAG_NON_PAGED | POOL_FLAG_UNINITIALIZED,
+        Length,
+        TOUCH_POOL_TAG);
+
+    if (buffer != NULL)
+    {
+        InterlockedIncrement(&pool->Allocations);
+    }
+
+    return buffer;
+}
+
+VOID
+SpbReleaseBuffer(
+    IN SPB_CONTEXT* SpbContext,
+    IN PUCHAR Buffer
+)
+/*++
+
+  Routine Description:
+
+    This routine returns a buffer obtained with SpbAcquireBuffer.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+    Buffer     - The buffer to give back
+
+  Return Value:
+
+    None
+
+--*/
+{
+    SPB_BUFFER_POOL* pool;
+    SPB_BUFFER_TIER* tier;
+    size_t offset;
+    ULONG i;
+
+    pool = &SpbContext->BufferPool;
+
+    if (Buffer < pool->Base || Buffer >= pool->Base + pool->Length)
+    {
+        ExFreePoolWithTag(Buffer, TOUCH_POOL_TAG);
+        return;
+    }
+
+    for (i = 0; i < SPB_BUFFER_TIER_COUNT; i++)
+    {
+        tier = &pool->Tiers[i];
+        offset = Buffer - tier->Buffers;
+
+        if (Buffer >= tier->Buffers &&
+            offset < (size_t)tier->BufferSize * tier->BufferCount)
+        {
+            InterlockedAnd(
+                &tier->InUseMask,
+                ~(1L << (offset / tier->BufferSize)));
+            return;
+        }
+    }
+}
+
+VOID
+SpbTraceSequence(
+    IN SPB_CONTEXT* SpbContext,
+    IN LONGLONG Timestamp,
+    IN SPB_TRANSFER* Transfers,
+    IN ULONG TransferCount,
+    IN NTSTATUS Status
+)
+/*++
+
+  Routine Description:
+
+    This helper routine appends one trace record per transfer of a
+    completed submission. Must be called with the SpbLock held, which
+    serializes writers; readers only rely on the record sequence.
+
+  Arguments:
+
+    SpbContext    - Pointer to the current device context
+    Timestamp     - Performance counter value at submission time
+    Transfers     - The register transfers that were submitted
+    TransferCount - The amount of transfers in the above list
+    Status        - The completion status of the submission
+
+  Return Value:
+
+    None
+
+--*/
+{
+    SPB_TRACE_RING* ring;
+    SPB_TRACE_RECORD* record;
+    ULONG sequence;
+    ULONG slot;
+    ULONG totalLength;
+    UCHAR attempt;
+    ULONG i;
+
+    ring = &SpbContext->Trace;
+
+    if (!ring->Enabled || ring->Records == NULL)
+    {
+        return;
+    }
+
+    totalLength = 0;
+
+    for (i = 0; i < TransferCount; i++)
+    {
+        totalLength += Transfers[i].Length;
+    }
+
+    //
+    // Retries resend the same submission right after it failed
+    //
+    attempt = 0;
+
+    if (!NT_SUCCESS(ring->LastStatus) &&
+        ring->LastAddress == Transfers[0].Address &&
+        ring->LastRead == Transfers[0].Read &&
+        ring->LastLength == totalLength &&
+        ring->LastCount == TransferCount &&
+        ring->LastAttempt != MAXUCHAR)
+    {
+        attempt = ring->LastAttempt + 1;
+    }
+
+    ring->LastAddress = Transfers[0].Address;
+    ring->LastRead = Transfers[0].Read;
+    ring->LastLength = totalLength;
+    ring->LastCount = TransferCount;
+    ring->LastAttempt = attempt;
+    ring->LastStatus = Status;
+
+    for (i = 0; i < TransferCount; i++)
+    {
+        sequence = (ULONG)InterlockedIncrement(&ring->Head) - 1;
+        slot = sequence & (SPB_TRACE_RECORD_COUNT - 1);
+        record = &ring->Records[slot];
+
+        ring->Guards[slot] = SPB_TRACE_GUARD_BUSY(sequence);
+        KeMemoryBarrier();
+
+        record->Sequence = sequence;
+        record->Timestamp = Timestamp;
+        record->Length = Transfers[i].Length;
+        record->Status = Status;
+        record->Address = Transfers[i].Address;
+        record->Direction = Transfers[i].Read ?
+            SPB_TRACE_DIRECTION_READ : SPB_TRACE_DIRECTION_WRITE;
+        record->Attempt = attempt;
+        record->PayloadLength = (UCHAR)min(Transfers[i].Length, SPB_TRACE_PAYLOAD_SIZE);
+
+        //
+        // Read payloads are only meaningful if the transfer completed
+        //
+        if (Transfers[i].Read && !NT_SUCCESS(Status))
+        {
+            record->PayloadLength = 0;
+        }
+
+        if (record->PayloadLength != 0)
+        {
+            RtlCopyMemory(record->Payload, Transfers[i].Data, record->PayloadLength);
+        }
+
+        KeMemoryBarrier();
+        ring->Guards[slot] = SPB_TRACE_GUARD_STABLE(sequence);
+    }
+}
+
+VOID
+SpbTraceEnable(
+    IN SPB_CONTEXT* SpbContext,
+    IN BOOLEAN Enable
+)
+/*++
+
+  Routine Description:
+
+    This routine turns transaction tracing on or off at runtime.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+    Enable     - Whether transactions should be recorded
+
+  Return Value:
+
+    None
+
+--*/
+{
+    InterlockedExchange(&SpbContext->Trace.Enabled, Enable ? 1 : 0);
+}
+
+ULONG
+SpbTraceSnapshot(
+    IN SPB_CONTEXT* SpbContext,
+    OUT SPB_TRACE_RECORD* Records,
+    IN ULONG MaxRecords
+)
+/*++
+
+  Routine Description:
+
+    This routine copies the most recent trace records, oldest first.
+    Records overwritten or being written while copied are skipped.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+    Records    - A buffer to receive the records
+    MaxRecords - The amount of records the above buffer can hold
+
+  Return Value:
+
+    The amount of records copied
+
+--*/
+{
+    SPB_TRACE_RING* ring;
+    SPB_TRACE_RECORD* record;
+    ULONG head;
+    ULONG available;
+    ULONG sequence;
+    ULONG slot;
+    ULONG count;
+
+    ring = &SpbContext->Trace;
+
+    if (ring->Records == NULL)
+    {
+        return 0;
+    }
+
+    head = (ULONG)ring->Head;
+    available = min(head, SPB_TRACE_RECORD_COUNT);
+    available = min(available, MaxRecords);
+    count = 0;
+
+    for (sequence = head - available; sequence != head; sequence++)
+    {
+        slot = sequence & (SPB_TRACE_RECORD_COUNT - 1);
+        record = &ring->Records[slot];
+
+        if (ring->Guards[slot] != SPB_TRACE_GUARD_STABLE(sequence))
+        {
+            continue;
+        }
+
+        KeMemoryBarrier();
+        Records[count] = *record;
+        KeMemoryBarrier();
+
+        if (ring->Guards[slot] == SPB_TRACE_GUARD_STABLE(sequence))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
 
 NTSTATUS
 SpbDoWriteDataSynchronously(
@@ -53,53 +533,48 @@ SpbDoWriteDataSynchronously(
 
 --*/
 {
-    PUCHAR buffer;
+    PUCHAR buffer = NULL;
     ULONG length;
-    WDFMEMORY memory;
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+    SPB_TRANSFER transfer;
+    LARGE_INTEGER timestamp;
     NTSTATUS status;
 
+    transfer.Read = FALSE;
+    transfer.Address = Address;
+    transfer.Data = Data;
+    transfer.Length = Length;
+    transfer.DelayInUs = 0;
+
+    if (SpbContext->SimulatedTarget != NULL)
+    {
+        status = SpbContext->SimulatedTarget(SpbContext->SimulatedContext, &transfer, 1);
+        goto exit;
+    }
+
     //
     // The address pointer and data buffer must be combined
     // into one contiguous buffer representing the write transaction.
     //
     length = Length + 1;
-    memory = NULL;
+    buffer = SpbAcquireBuffer(SpbContext, length);
 
-    if (length > DEFAULT_SPB_BUFFER_SIZE)
+    if (buffer == NULL)
     {
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            length,
-            &memory,
-            &buffer);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_SPB,
-                "Error allocating memory for Spb write - 0x%08lX",
-                status);
-            goto exit;
-        }
+        status = STATUS_INSUFFICIENT_RESOURCES;
 
-        WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-            &memoryDescriptor,
-            memory,
-            NULL);
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error allocating memory for Spb write - 0x%08lX",
+            status);
+        goto exit;
     }
-    else
-    {
-        buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
 
-        WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-            &memoryDescriptor,
-            (PVOID)buffer,
-            length);
-    }
+    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+        &memoryDescriptor,
+        (PVOID)buffer,
+        length);
 
     //
     // Transaction starts by specifying the address bytes
@@ -111,24 +586,27 @@ SpbDoWriteDataSynchronously(
     //
     RtlCopyMemory((buffer + sizeof(Address)), Data, length - sizeof(Address));
 
-#if I2C_VERBOSE_LOGGING
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "I2CWRITE: LENGTH=%d", length);
-    for (ULONG j = 0; j < length; j++)
+    timestamp = KeQueryPerformanceCounter(NULL);
+
+    status = SpbReuseRequest(SpbContext);
+
+    if (!NT_SUCCESS(status))
     {
-        UCHAR byte = *(buffer + j);
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, " %02hhX", byte);
+        goto exit;
     }
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "\n");
-#endif
+
+    InterlockedIncrement(&SpbContext->RequestCount);
 
     status = WdfIoTargetSendWriteSynchronously(
         SpbContext->SpbIoTarget,
-        NULL,
+        SpbContext->SequenceRequest,
         &memoryDescriptor,
         NULL,
         NULL,
         NULL);
 
+    SpbTraceSequence(SpbContext, timestamp.QuadPart, &transfer, 1, status);
+
     if (!NT_SUCCESS(status))
     {
         Trace(
@@ -141,9 +619,9 @@ SpbDoWriteDataSynchronously(
 
 exit:
 
-    if (NULL != memory)
+    if (NULL != buffer)
     {
-        WdfObjectDelete(memory);
+        SpbReleaseBuffer(SpbContext, buffer);
     }
 
     return status;
@@ -193,25 +671,25 @@ SpbWriteDataSynchronously(
 }
 
 NTSTATUS
-SpbReadDataSynchronously(
+SpbDoExecuteSequence(
     IN SPB_CONTEXT* SpbContext,
-    IN UCHAR Address,
-    _In_reads_bytes_(Length) PVOID Data,
-    IN ULONG Length
+    IN SPB_TRANSFER* Transfers,
+    IN ULONG TransferCount
 )
 /*++
 
   Routine Description:
 
-    This helper routine abstracts creating and sending an I/O
-    request (I2C Read) to the Spb I/O target.
+    This helper routine chains a list of register reads and writes
+    into a single SPB sequence (repeated start between transfers)
+    and sends it to the Spb I/O target with the preallocated request.
+    Must be called with the SpbLock held.
 
   Arguments:
 
-    SpbContext - Pointer to the current device context
-    Address    - The I2C register address to read from
-    Data       - A buffer to receive the data at at the above address
-    Length     - The amount of data to be read from the above address
+    SpbContext    - Pointer to the current device context
+    Transfers     - The register transfers making up the sequence
+    TransferCount - The amount of transfers in the above list
 
   Return Value:
 
@@ -219,118 +697,226 @@ SpbReadDataSynchronously(
 
 --*/
 {
-    PUCHAR buffer;
-    WDFMEMORY memory;
+    SPB_SEQUENCE* sequence;
+    SPB_TRANSFER_LIST* list;
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
     NTSTATUS status;
-    ULONG_PTR bytesRead;
-
-    WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+    ULONG_PTR bytesTransferred;
+    ULONG_PTR bytesExpected;
+    LARGE_INTEGER timestamp;
+    ULONG entry;
+    ULONG i;
 
-    memory = NULL;
-    status = STATUS_INVALID_PARAMETER;
-    bytesRead = 0;
-
-    //
-    // Read transactions start by writing an address pointer
-    //
-    status = SpbDoWriteDataSynchronously(
-        SpbContext,
-        Address,
-        NULL,
-        0);
+    if (TransferCount == 0 || TransferCount > SPB_MAX_SEQUENCE_TRANSFERS)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        goto exit;
+    }
 
-    if (!NT_SUCCESS(status))
+    if (SpbContext->SimulatedTarget != NULL)
     {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_SPB,
-            "Error setting address pointer for Spb read - 0x%08lX",
-            status);
+        status = SpbContext->SimulatedTarget(SpbContext->SimulatedContext, Transfers, TransferCount);
         goto exit;
     }
 
-    if (Length > DEFAULT_SPB_BUFFER_SIZE)
+    sequence = (SPB_SEQUENCE*)WdfMemoryGetBuffer(SpbContext->SequenceMemory, NULL);
+    list = &sequence->Sequence.List;
+    bytesTransferred = 0;
+    bytesExpected = 0;
+    entry = 0;
+
+    for (i = 0; i < TransferCount; i++)
     {
-        status = WdfMemoryCreate(
-            WDF_NO_OBJECT_ATTRIBUTES,
-            NonPagedPool,
-            TOUCH_POOL_TAG,
-            Length,
-            &memory,
-            &buffer);
+        sequence->Addresses[i] = Transfers[i].Address;
 
-        if (!NT_SUCCESS(status))
+        if (Transfers[i].Read)
         {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_SPB,
-                "Error allocating memory for Spb read - 0x%08lX",
-                status);
-            goto exit;
+            //
+            // Read transactions start by writing an address pointer,
+            // followed by the data payload read back from the device
+            //
+            list->Transfers[entry++] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+                SpbTransferDirectionToDevice,
+                Transfers[i].DelayInUs,
+                &sequence->Addresses[i],
+                sizeof(UCHAR));
+
+            list->Transfers[entry++] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+                SpbTransferDirectionFromDevice,
+                0,
+                Transfers[i].Data,
+                Transfers[i].Length);
+        }
+        else
+        {
+            //
+            // Write transactions send the address pointer directly
+            // followed by the payload, without staging a copy
+            //
+            sequence->Buffers[i][0].Buffer = &sequence->Addresses[i];
+            sequence->Buffers[i][0].BufferCapacity = sizeof(UCHAR);
+            sequence->Buffers[i][1].Buffer = Transfers[i].Data;
+            sequence->Buffers[i][1].BufferCapacity = Transfers[i].Length;
+
+            list->Transfers[entry++] = SPB_TRANSFER_LIST_ENTRY_INIT_BUFFER_LIST(
+                SpbTransferDirectionToDevice,
+                Transfers[i].DelayInUs,
+                sequence->Buffers[i],
+                (Transfers[i].Length != 0) ? 2 : 1);
         }
 
-        WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-            &memoryDescriptor,
-            memory,
-            NULL);
+        bytesExpected += sizeof(UCHAR) + Transfers[i].Length;
     }
-    else
-    {
-        buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
 
-        WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-            &memoryDescriptor,
-            (PVOID)buffer,
-            Length);
+    SPB_TRANSFER_LIST_INIT(list, entry);
+
+    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+        &memoryDescriptor,
+        (PVOID)list,
+        sizeof(sequence->Sequence));
+
+    timestamp = KeQueryPerformanceCounter(NULL);
+
+    status = SpbReuseRequest(SpbContext);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
     }
 
+    InterlockedIncrement(&SpbContext->RequestCount);
 
-    status = WdfIoTargetSendReadSynchronously(
+    status = WdfIoTargetSendIoctlSynchronously(
         SpbContext->SpbIoTarget,
-        NULL,
+        SpbContext->SequenceRequest,
+        IOCTL_SPB_EXECUTE_SEQUENCE,
         &memoryDescriptor,
         NULL,
         NULL,
-        &bytesRead);
+        &bytesTransferred);
 
-    if (!NT_SUCCESS(status) ||
-        bytesRead != Length)
+    //
+    // The sequence reports the total amount of bytes moved in
+    // both directions, which includes the address pointers
+    //
+    if (NT_SUCCESS(status) &&
+        bytesTransferred != bytesExpected)
+    {
+        status = STATUS_DEVICE_PROTOCOL_ERROR;
+    }
+
+    SpbTraceSequence(SpbContext, timestamp.QuadPart, Transfers, TransferCount, status);
+
+    if (!NT_SUCCESS(status))
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_SPB,
-            "Error reading from Spb - 0x%08lX",
+            "Error executing Spb sequence - 0x%08lX",
             status);
         goto exit;
     }
 
-#if I2C_VERBOSE_LOGGING
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "I2CREAD: LENGTH=%d", Length);
-    for (ULONG j = 0; j < Length; j++)
-    {
-        UCHAR byte = *(buffer + j);
-        DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, " %02hhX", byte);
-    }
-    DbgPrintEx(DPFLTR_IHVDRIVER_ID, DPFLTR_ERROR_LEVEL, "\n");
-#endif
+exit:
+    return status;
+}
 
-    //
-    // Copy back to the caller's buffer
-    //
-    RtlCopyMemory(Data, buffer, Length);
+NTSTATUS
+SpbExecuteSequence(
+    IN SPB_CONTEXT* SpbContext,
+    IN SPB_TRANSFER* Transfers,
+    IN ULONG TransferCount
+)
+/*++
 
-exit:
-    if (NULL != memory)
-    {
-        WdfObjectDelete(memory);
-    }
+  Routine Description:
+
+    This routine chains a list of register reads and writes into a
+    single SPB sequence and utilizes a helper routine to do work
+    inside of locked code.
+
+  Arguments:
+
+    SpbContext    - Pointer to the current device context
+    Transfers     - The register transfers making up the sequence
+    TransferCount - The amount of transfers in the above list
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+
+    WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+
+    status = SpbDoExecuteSequence(
+        SpbContext,
+        Transfers,
+        TransferCount);
 
     WdfWaitLockRelease(SpbContext->SpbLock);
 
     return status;
 }
 
+NTSTATUS
+SpbReadDataSynchronously(
+    IN SPB_CONTEXT* SpbContext,
+    IN UCHAR Address,
+    _In_reads_bytes_(Length) PVOID Data,
+    IN ULONG Length
+)
+/*++
+
+  Routine Description:
+
+    This helper routine abstracts creating and sending an I/O
+    request (I2C Write-Read) to the Spb I/O target.
+
+    The address pointer write and the data read are submitted as a
+    single SPB sequence, so the controller sees a repeated start
+    instead of two independent bus transactions.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context
+    Address    - The I2C register address to read from
+    Data       - A buffer to receive the data at at the above address
+    Length     - The amount of data to be read from the above address
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    SPB_TRANSFER transfer;
+    NTSTATUS status;
+
+    transfer.Read = TRUE;
+    transfer.Address = Address;
+    transfer.Data = Data;
+    transfer.Length = Length;
+    transfer.DelayInUs = 0;
+
+    status = SpbExecuteSequence(SpbContext, &transfer, 1);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error reading from Spb - 0x%08lX",
+            status);
+        goto exit;
+    }
+
+exit:
+    return status;
+}
+
 VOID
 SpbTargetDeinitialize(
     IN WDFDEVICE FxDevice,
@@ -366,14 +952,24 @@ SpbTargetDeinitialize(
         WdfObjectDelete(SpbContext->SpbLock);
     }
 
-    if (SpbContext->ReadMemory != NULL)
+    if (SpbContext->BufferPool.Memory != NULL)
+    {
+        WdfObjectDelete(SpbContext->BufferPool.Memory);
+    }
+
+    if (SpbContext->SequenceMemory != NULL)
+    {
+        WdfObjectDelete(SpbContext->SequenceMemory);
+    }
+
+    if (SpbContext->SequenceRequest != NULL)
     {
-        WdfObjectDelete(SpbContext->ReadMemory);
+        WdfObjectDelete(SpbContext->SequenceRequest);
     }
 
-    if (SpbContext->WriteMemory != NULL)
+    if (SpbContext->Trace.Memory != NULL)
     {
-        WdfObjectDelete(SpbContext->WriteMemory);
+        WdfObjectDelete(SpbContext->Trace.Memory);
     }
 }
 
@@ -469,15 +1065,27 @@ SpbTargetInitialize(
     }
 
     //
-    // Allocate some fixed-size buffers from NonPagedPool for typical
-    // Spb transaction sizes to avoid pool fragmentation in most cases
+    // Allocate the transfer buffers from NonPagedPool up front, sized for
+    // typical register writes, flash pages and the largest Himax transfer,
+    // to avoid pool allocations and fragmentation in steady state
+    //
+    status = SpbBufferPoolInitialize(SpbContext);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    //
+    // Preallocate the transfer list and the request used for every
+    // transaction, so servicing an interrupt does not allocate
     //
     status = WdfMemoryCreate(
         WDF_NO_OBJECT_ATTRIBUTES,
         NonPagedPool,
         TOUCH_POOL_TAG,
-        DEFAULT_SPB_BUFFER_SIZE,
-        &SpbContext->WriteMemory,
+        sizeof(SPB_SEQUENCE),
+        &SpbContext->SequenceMemory,
         NULL);
 
     if (!NT_SUCCESS(status))
@@ -485,31 +1093,57 @@ SpbTargetInitialize(
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_SPB,
-            "Error allocating default memory for Spb write - 0x%08lX",
+            "Error allocating memory for Spb sequence - 0x%08lX",
+            status);
+        goto exit;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&objectAttributes);
+    objectAttributes.ParentObject = SpbContext->SpbIoTarget;
+
+    status = WdfRequestCreate(
+        &objectAttributes,
+        SpbContext->SpbIoTarget,
+        &SpbContext->SequenceRequest);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error creating Spb request - 0x%08lX",
             status);
         goto exit;
     }
 
+    //
+    // The trace ring is always allocated so tracing can be turned on
+    // at runtime without touching the transfer path
+    //
     status = WdfMemoryCreate(
         WDF_NO_OBJECT_ATTRIBUTES,
         NonPagedPool,
         TOUCH_POOL_TAG,
-        DEFAULT_SPB_BUFFER_SIZE,
-        &SpbContext->ReadMemory,
-        NULL);
+        sizeof(SPB_TRACE_RECORD) * SPB_TRACE_RECORD_COUNT,
+        &SpbContext->Trace.Memory,
+        (PVOID*)&SpbContext->Trace.Records);
 
     if (!NT_SUCCESS(status))
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_SPB,
-            "Error allocating default memory for Spb read - 0x%08lX",
+            "Error allocating memory for Spb trace - 0x%08lX",
             status);
         goto exit;
     }
 
+    RtlZeroMemory(
+        SpbContext->Trace.Records,
+        sizeof(SPB_TRACE_RECORD) * SPB_TRACE_RECORD_COUNT);
+
     //
-    // Allocate a waitlock to guard access to the default buffers
+    // Allocate a waitlock to guard access to the preallocated request
     //
     status = WdfWaitLockCreate(
         WDF_NO_OBJECT_ATTRIBUTES,
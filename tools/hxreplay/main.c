@@ -0,0 +1,222 @@
+/*++
+	Copyright (c) LumiaWoA authors. All Rights Reserved.
+
+	Module Name:
+
+		main.c
+
+	Abstract:
+
+		Replays an event stack capture stream, as written by the capture
+		self test, through the driver's decoding, contact filtering and
+		report packing on a development host, and prints the counters
+		and the jitter each filter profile leaves.
+
+	Environment:
+
+		User mode
+
+	Revision History:
+
+--*/
+
+#include <stdio.h>
+#include <Cross Platform Shim/compat.h>
+#include <resolutions.h>
+#include <hx83112/hxreplay.h>
+
+static
+void
+Usage(
+	const char* Program
+)
+{
+	fprintf(stderr,
+		"usage: %s [-w width] [-h height] [-d deadband] [-c charger-deadband]\n"
+		"          [-b charger-debounce-frames] [-p normal|charger] capture\n",
+		Program);
+}
+
+static
+int
+ParseUlong(
+	const char* Text,
+	ULONG* Value
+)
+{
+	char* end;
+	unsigned long value;
+
+	value = strtoul(Text, &end, 0);
+
+	if (*Text == '\0' || *end != '\0' || value > MAXULONG)
+	{
+		return 0;
+	}
+
+	*Value = (ULONG)value;
+	return 1;
+}
+
+static
+void
+PrintJitter(
+	const char* Name,
+	const HIMAX_JITTER_STATS* Stats
+)
+{
+	printf("%-8s frames %u, held %u, moves %u, displacement %llu, max step %u, phantoms %u\n",
+		Name,
+		Stats->Frames,
+		Stats->HeldContacts,
+		Stats->Moves,
+		(unsigned long long)Stats->Displacement,
+		Stats->MaxStep,
+		Stats->Phantoms);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	TOUCH_SCREEN_PROPERTIES props;
+	HIMAX_FILTER_PARAMS profiles[HimaxFilterProfiles];
+	HIMAX_FILTER_PROFILE profile = HimaxFilterNormal;
+	HIMAX_CAPTURE_REPLAY_STATS stats;
+	HIMAX_REPLAY* replay = NULL;
+	UINT8* stream = NULL;
+	FILE* file = NULL;
+	long length;
+	NTSTATUS status;
+	ULONG* value;
+	int result = 1;
+	int i;
+
+	memset(&props, 0, sizeof(props));
+	memset(profiles, 0, sizeof(profiles));
+
+	props.TouchPhysicalWidth = TOUCH_DEFAULT_RESOLUTION_X;
+	props.TouchPhysicalHeight = TOUCH_DEFAULT_RESOLUTION_Y;
+
+	for (i = 1; i < argc - 1 && argv[i][0] == '-'; i += 2)
+	{
+		if (strcmp(argv[i], "-p") == 0)
+		{
+			if (strcmp(argv[i + 1], "normal") == 0)
+			{
+				profile = HimaxFilterNormal;
+			}
+			else if (strcmp(argv[i + 1], "charger") == 0)
+			{
+				profile = HimaxFilterCharger;
+			}
+			else
+			{
+				Usage(argv[0]);
+				return 2;
+			}
+
+			continue;
+		}
+
+		switch (argv[i][1])
+		{
+		case 'w': value = &props.TouchPhysicalWidth; break;
+		case 'h': value = &props.TouchPhysicalHeight; break;
+		case 'd': value = &profiles[HimaxFilterNormal].Deadband; break;
+		case 'c': value = &profiles[HimaxFilterCharger].Deadband; break;
+		case 'b': value = &profiles[HimaxFilterCharger].DebounceFrames; break;
+		default: value = NULL; break;
+		}
+
+		if (value == NULL || argv[i][2] != '\0' || !ParseUlong(argv[i + 1], value))
+		{
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (i != argc - 1)
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+
+	file = fopen(argv[i], "rb");
+
+	if (file == NULL)
+	{
+		perror(argv[i]);
+		goto exit;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0 ||
+		(length = ftell(file)) < 0 ||
+		fseek(file, 0, SEEK_SET) != 0)
+	{
+		perror(argv[i]);
+		goto exit;
+	}
+
+	stream = malloc(length > 0 ? (size_t)length : 1);
+	replay = calloc(1, sizeof(HIMAX_REPLAY));
+
+	if (stream == NULL || replay == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		goto exit;
+	}
+
+	if (fread(stream, 1, (size_t)length, file) != (size_t)length)
+	{
+		perror(argv[i]);
+		goto exit;
+	}
+
+	status = HimaxReplayStream(
+		replay,
+		&props,
+		profiles,
+		profile,
+		stream,
+		(ULONG)min((unsigned long)length, MAXULONG),
+		&stats);
+
+	if (!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "%s: not a valid version %d capture stream (0x%08X)\n",
+			argv[i],
+			HIMAX_CAPTURE_VERSION,
+			(unsigned int)status);
+		goto exit;
+	}
+
+	printf("replayed %u frames in %u us: %u discarded, %u gestures, %u records skipped\n",
+		stats.FramesReplayed,
+		stats.ElapsedInUs,
+		stats.FramesDiscarded,
+		stats.Gestures,
+		stats.RecordsSkipped);
+	printf("reported %u frames in %u hid reports\n",
+		stats.FramesReported,
+		stats.HidReports);
+
+	PrintJitter("raw", &stats.RawJitter);
+	PrintJitter("normal", &stats.Jitter[HimaxFilterNormal]);
+	PrintJitter("charger", &stats.Jitter[HimaxFilterCharger]);
+
+	result = 0;
+
+exit:
+	if (file != NULL)
+	{
+		fclose(file);
+	}
+
+	free(stream);
+	free(replay);
+
+	return result;
+}